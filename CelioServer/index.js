@@ -7,6 +7,7 @@ var webServerHelper = require('./webserver.js');
 var net = require('net');
 var os = require('os');
 var LOG = require('./log.js');
+var Protocol = require('./protocol.js');
 
 const WEB_SERVER_PORT = 8081;
 const TCP_SERVER_PORT = 9000;
@@ -43,7 +44,7 @@ function handleConnection(conn) {
     function onConnData(d) {  
       let dataString = StringHelper.byteArrayToAscii(d);
       LOG.log('LANETTE CLIENT: %s', remoteAddress, dataString.substring(0,16));  
-      tcpRequestHandler.handleRequest(conn, d);
+      tcpRequestHandler.handleData(conn, d);
     }
   
     function onConnClose() {  
@@ -55,7 +56,7 @@ function handleConnection(conn) {
       LOG.log('Connection %s error: %s', remoteAddress, err.message);  
     }  
 
-    conn.write('For the link to work, the Machine needs a special gemstone.');
+    conn.write(Protocol.SERVER_GREETING);
 }
 
 function getIPv4() {
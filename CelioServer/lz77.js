@@ -0,0 +1,117 @@
+/**
+ * The LZ77 format the gba's BIOS decodes (LZ77UnCompWram, used by LZDecompressWram in pokeemerald's decompress.c)
+ *
+ *   10 SS SS SS            (S is the 24bit little endian size of the uncompressed data)
+ *   FF <8 blocks> ...      (F flags the next 8 blocks, top bit first, 0 is a literal byte and 1 a back reference)
+ *   LD DD                  (a back reference copies L + 3 bytes from D + 1 bytes back)
+ *
+ * The output is padded to a multiple of 4 bytes as the BIOS reads it a word at a time.
+ * Back references of 1 byte are fine for WRAM, so this isn't safe to decode straight into VRAM
+ */
+
+const LZ77_TYPE      = 0x10;
+const HEADER_SIZE    = 4;
+const MIN_MATCH      = 3;
+const MAX_MATCH      = 18;
+const MAX_DISTANCE   = 0x1000;
+
+/**
+ * Greedy, checking every earlier position. Payloads here are at most a few hundred bytes so that's plenty quick
+ * @param bytes a Uint8Array (or array) of up to 16MB
+ * @returns a Uint8Array holding the compressed data
+ */
+function compress(bytes) {
+    let out = [LZ77_TYPE, bytes.length & 0xff, (bytes.length >> 8) & 0xff, (bytes.length >> 16) & 0xff];
+    let pos = 0;
+
+    while (pos < bytes.length) {
+        let flagsIndex = out.length;
+        out.push(0);
+
+        for (let block = 0; block < 8 && pos < bytes.length; block++) {
+            let bestLength = 0;
+            let bestDistance = 0;
+            let maxLength = Math.min(MAX_MATCH, bytes.length - pos);
+
+            for (let start = Math.max(0, pos - MAX_DISTANCE); start < pos; start++) {
+                let length = 0;
+                while (length < maxLength && bytes[start + length] == bytes[pos + length]) {
+                    length++;
+                }
+
+                // Ties go to the nearest match
+                if (length >= bestLength && length >= MIN_MATCH) {
+                    bestLength = length;
+                    bestDistance = pos - start;
+                }
+            }
+
+            if (bestLength >= MIN_MATCH) {
+                out[flagsIndex] |= 0x80 >> block;
+                out.push(((bestLength - MIN_MATCH) << 4) | ((bestDistance - 1) >> 8), (bestDistance - 1) & 0xff);
+                pos += bestLength;
+            } else {
+                out.push(bytes[pos]);
+                pos++;
+            }
+        }
+    }
+
+    while (out.length % 4 != 0) {
+        out.push(0);
+    }
+
+    return new Uint8Array(out);
+}
+
+/**
+ * Only used to check compress, the gba has its own
+ * @returns a Uint8Array holding the uncompressed data, or null if the data isn't valid
+ */
+function decompress(bytes) {
+    if (bytes.length < HEADER_SIZE || bytes[0] != LZ77_TYPE) {
+        return null;
+    }
+
+    let size = bytes[1] | (bytes[2] << 8) | (bytes[3] << 16);
+    let out = new Uint8Array(size);
+    let outPos = 0;
+    let pos = HEADER_SIZE;
+
+    while (outPos < size) {
+        if (pos >= bytes.length) {
+            return null;
+        }
+
+        let flags = bytes[pos++];
+        for (let block = 0; block < 8 && outPos < size; block++) {
+            if (!(flags & (0x80 >> block))) {
+                if (pos >= bytes.length) {
+                    return null;
+                }
+                out[outPos++] = bytes[pos++];
+                continue;
+            }
+
+            if (pos + 1 >= bytes.length) {
+                return null;
+            }
+
+            let length = (bytes[pos] >> 4) + MIN_MATCH;
+            let distance = (((bytes[pos] & 0xf) << 8) | bytes[pos + 1]) + 1;
+            pos += 2;
+
+            if (distance > outPos) {
+                return null;
+            }
+
+            for (let i = 0; i < length && outPos < size; i++, outPos++) {
+                out[outPos] = out[outPos - distance];
+            }
+        }
+    }
+
+    return out;
+}
+
+module.exports = { LZ77_TYPE, HEADER_SIZE, compress, decompress };
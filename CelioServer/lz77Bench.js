@@ -0,0 +1,119 @@
+/**
+ * How much link time compressed payloads (see lz77.js) save for each feature that can use them.
+ * Run with `npm run bench`, optionally with the link's bytes/sec (the BYTES/SEC column of the link simulator) e.g `npm run bench -- 7600`
+ *
+ * Words are the SI commands it takes to move the answer to the gba, counted the way the game reads it:
+ *   framed: a 16 byte frame (bigger for big blocks) is its words and a trailer, then one ack for the block
+ *   legacy: a 16 byte chunk is a command, its words and the check bytes
+ */
+var trainerHelper = require('./trainer.js');
+var StringHelper = require('./pokeString.js');
+var marketHelper = require('./market.js');
+var LZ77 = require('./lz77.js');
+var Protocol = require('./protocol.js');
+
+const DEFAULT_BYTES_PER_SEC = 7600; // Framed blocks on a clean link in the simulator
+const FRAME_SIZE = 16;
+const MAX_FRAMES = 16;
+const LEGACY_CHUNK_SIZE = 16;
+const RUNS = 1000;
+
+function framedWords(size) {
+    let frameSize = FRAME_SIZE;
+    while (Math.ceil(size / frameSize) > MAX_FRAMES) {
+        frameSize += FRAME_SIZE;
+    }
+
+    let frames = Math.ceil(size / frameSize);
+    return Math.ceil(size / 4) + frames + 1;
+}
+
+function legacyWords(size) {
+    let words = 0;
+    for (let offset = 0; offset < size; offset += LEGACY_CHUNK_SIZE) {
+        words += 1 + Math.ceil(Math.min(LEGACY_CHUNK_SIZE, size - offset) / 4) + 1;
+    }
+    return words;
+}
+
+// A mon as the game sends it for a trade: 32 bytes of box header, 48 encrypted (so incompressible) bytes, then the party stats
+function sampleTradeMon() {
+    let mon = new Uint8Array(100);
+    let seed = 0x1234;
+    let next = () => (seed = (seed * 1103515245 + 12345) & 0x7fffffff) >> 16;
+
+    mon.set([0x2a, 0x8f, 0x11, 0x6c, 0x39, 0x30, 0x00, 0x00], 0); // Personality, OT id
+    mon.set(StringHelper.convertMessageToHex("ZIGZAG"), 8);
+    mon[18] = 2; // Language
+    mon.set(StringHelper.convertMessageToHex("MAY"), 20);
+    for (let i = 32; i < 80; i++) {
+        mon[i] = next() & 0xff;
+    }
+    mon.set([0x00, 0x00, 0x00, 0x00, 0x0c, 0xff, 0x00, 0x00, 0x21, 0x00, 0x21, 0x00, 0x14, 0x00, 0x12, 0x00, 0x17, 0x00, 0x10, 0x00], 80);
+    return mon;
+}
+
+function sampleMail() {
+    let mail = new Uint8Array(8 + 2 + (2 * 9));
+    mail.set(StringHelper.convertMessageToHex("MAY"), 0);
+    mail.set([0x00, 0x7B, 0x04, 0x1f, 0x04, 0x20, 0x04, 0x21, 0x0c, 0x02, 0x0c, 0x02, 0x0c, 0x02, 0x0c, 0x02, 0x0c, 0x02, 0x0c, 0x02], 8);
+    return mail;
+}
+
+// The payload the gba reads back with compression, or null if the server would send it raw (as compressPayload in tcpRequestManager.js)
+function compressedAnswer(feature) {
+    let compressed = LZ77.compress(feature.payload);
+    if (!feature.sized || compressed.length >= feature.payload.length) {
+        return null;
+    }
+    return compressed;
+}
+
+function main() {
+    let bytesPerSec = process.argv[2] ? parseFloat(process.argv[2]) : DEFAULT_BYTES_PER_SEC;
+    let msPerWord = 4 / bytesPerSec * 1000;
+
+    let features = [
+        // sized: whether the gba can tell how much of a compressed answer to read (a sized call, or the trade header)
+        // header: the bytes the packed header (NET_CONN_PACKED_HEADER_SIZE) adds, a trade's is in padding it always had
+        { name: "BATTLE", payload: trainerHelper.getTrainer().get3MonTeam(), sized: true, header: Protocol.NET_CONN_PACKED_HEADER_SIZE },
+        { name: "TRADE",  payload: sampleTradeMon(), sized: true, header: 0 },
+        { name: "MAIL",   payload: sampleMail(), sized: false, header: 0 },
+        { name: "MART",   payload: marketHelper.getMart().getDataArray(), sized: true, header: 0 } // Never packed, so it has no header either
+    ];
+
+    console.log("Link time at %d bytes/sec (%s ms per word)\n", bytesPerSec, msPerWord.toFixed(3));
+    console.log("%s %s %s %s %s %s %s %s %s",
+                "FEATURE".padEnd(8), "RAW".padStart(5), "LZ77".padStart(5), "SENT".padStart(5),
+                "WORDS".padStart(6), "SAVED".padStart(6), "LEGACY".padStart(7), "SAVED".padStart(6), "ENCODE_US".padStart(10));
+
+    for (let feature of features) {
+        let start = process.hrtime.bigint();
+        for (let i = 0; i < RUNS; i++) {
+            LZ77.compress(feature.payload);
+        }
+        let encodeUs = Number(process.hrtime.bigint() - start) / 1000 / RUNS;
+
+        let compressed = LZ77.compress(feature.payload);
+        let answer = compressedAnswer(feature);
+        let sent = feature.sized ? feature.header + (answer ? answer.length : feature.payload.length) : feature.payload.length;
+        let roundTrip = LZ77.decompress(compressed);
+
+        if (!roundTrip || Buffer.compare(Buffer.from(roundTrip), Buffer.from(feature.payload)) != 0) {
+            console.log("%s does not decompress to what was compressed", feature.name);
+            process.exitCode = 1;
+        }
+
+        let framedSaved = framedWords(feature.payload.length) - framedWords(sent);
+        let legacySaved = legacyWords(feature.payload.length) - legacyWords(sent);
+
+        console.log("%s %s %s %s %s %s %s %s %s",
+                    feature.name.padEnd(8), String(feature.payload.length).padStart(5), String(compressed.length).padStart(5), String(sent).padStart(5),
+                    String(framedWords(sent)).padStart(6), (framedSaved * msPerWord).toFixed(2).padStart(6),
+                    String(legacyWords(sent)).padStart(7), (legacySaved * msPerWord).toFixed(2).padStart(6), encodeUs.toFixed(1).padStart(10));
+    }
+
+    console.log("\nSAVED columns are ms of link time per run, SENT includes the packed header. Anything that comes out bigger goes raw, and so does mail as the gba has no way to be told a shorter size");
+}
+
+main();
@@ -0,0 +1,72 @@
+/**
+ * Length prefixed frames used once a client has asked for tagged requests (see PIPELINE_REQUEST in tcpRequestManager.js).
+ * The channel reads them with PokecomChannel/source/netframe.c, keep the two in step
+ *
+ *   23 TT SS SS <request>   (T is the tag, S is the 16bit big endian size of the request)
+ *   26 TT SS SS <response>  (T is the tag of the request being answered)
+ */
+
+var Protocol = require('./protocol.js');
+
+const REQUEST_MARK  = Protocol.NF_REQUEST_MARK;
+const RESPONSE_MARK = Protocol.NF_RESPONSE_MARK;
+const HEADER_SIZE   = Protocol.NF_HEADER_SIZE;
+const MAX_BODY_SIZE = Protocol.NF_MAX_BODY_SIZE;
+
+function encodeFrame(mark, tag, bytes) {
+    if (bytes.length > MAX_BODY_SIZE) {
+        throw new Error("Frame body too big: " + bytes.length);
+    }
+
+    let frame = Buffer.allocUnsafe(HEADER_SIZE + bytes.length);
+    frame[0] = mark;
+    frame[1] = tag;
+    frame[2] = bytes.length >> 8;
+    frame[3] = bytes.length & 0xff;
+    frame.set(bytes, HEADER_SIZE);
+    return frame;
+}
+
+/**
+ * Turns whatever TCP hands over into whole frames, however they were split up.
+ * Reads are only copied when a frame is spread over several of them
+ */
+class FrameReassembler {
+    constructor(mark) {
+        this.mark = mark;
+        this.pending = null;
+    }
+
+    /**
+     * @param data the bytes that were just read
+     * @param onFrame called with (tag, body) for every frame that is now complete, body is only valid during the call
+     * @returns false if the stream isn't framed, anything left over is dropped as there's no way to find the next frame
+     */
+    push(data, onFrame) {
+        let buffer = this.pending ? Buffer.concat([this.pending, data]) : data;
+        let offset = 0;
+        this.pending = null;
+
+        while (buffer.length - offset >= HEADER_SIZE) {
+            if (buffer[offset] != this.mark) {
+                return false;
+            }
+
+            let size = (buffer[offset + 2] << 8) | buffer[offset + 3];
+            if (buffer.length - offset < HEADER_SIZE + size) {
+                break;
+            }
+
+            onFrame(buffer[offset + 1], buffer.subarray(offset + HEADER_SIZE, offset + HEADER_SIZE + size));
+            offset += HEADER_SIZE + size;
+        }
+
+        if (offset < buffer.length) {
+            this.pending = Buffer.from(buffer.subarray(offset));
+        }
+
+        return true;
+    }
+}
+
+module.exports = { REQUEST_MARK, RESPONSE_MARK, HEADER_SIZE, MAX_BODY_SIZE, encodeFrame, FrameReassembler };
@@ -1,24 +1,45 @@
 var StringHelper = require('./pokeString.js');
 var LOG = require('./log.js');
+var NetFrame = require('./netFrame.js');
+var LZ77 = require('./lz77.js');
+var Protocol = require('./protocol.js');
 
 const WELCOME_MESSAGE = "Celio: Shinx of black quartz, judge\\my preview.";
 var SERVER_NAME = "Celio's Server"
 
+// The requests, answers and their layouts are in protocol.js, generated from Protocol/protocol.json
 // Connection Requests
-const SERVER_NAME_REQUEST        = StringHelper.asciiToByteArray("NR");
-const WELCOME_MESSAGE_REQUEST    = StringHelper.asciiToByteArray("WR");
-const PLAYER_DATA                = StringHelper.asciiToByteArray("PD");
+const SERVER_NAME_REQUEST        = requestKey(Protocol.SERVER_NAME_REQUEST);
+const WELCOME_MESSAGE_REQUEST    = requestKey(Protocol.WELCOME_REQUEST);
+const PLAYER_DATA                = requestKey(Protocol.SEND_PLAYER_DATA);
+// Tagged requests, so a client can have several requests waiting at once
+const PIPELINE_REQUEST           = requestKey(Protocol.PIPELINE_REQUEST);
+// Answers the channel can keep and hand out again without asking
+const CACHE_REQUEST              = requestKey(Protocol.CACHE_REQUEST);
 // Ereader battle
-const BATTLE_REQUEST             = StringHelper.asciiToByteArray("BA");
+const BATTLE_REQUEST             = requestKey(Protocol.BATTLE_REQUEST);
 // Mart
-const MART_REQUEST               = StringHelper.asciiToByteArray("MA");
+const MART_REQUEST               = requestKey(Protocol.MART_REQUEST);
 // Gift Egg
-const GIFT_EGG_REQUEST           = StringHelper.asciiToByteArray("GE");
+const GIFT_EGG_REQUEST           = requestKey(Protocol.GIFT_EGG_REQUEST);
 // Mail
-const POST_MAIL_REQUEST          = StringHelper.asciiToByteArray("PM"); 
-const READ_MAIL_REQUEST          = StringHelper.asciiToByteArray("RM"); 
+const POST_MAIL_REQUEST          = requestKey(Protocol.POST_MAIL_REQUEST);
+const READ_MAIL_REQUEST          = requestKey(Protocol.READ_MAIL_REQUEST);
 // Wonder Trade
-const TRADE_REQUEST              = StringHelper.asciiToByteArray("TR");
+const TRADE_REQUEST              = requestKey(Protocol.TRADE_REQUEST);
+
+const PIPELINE_VERSION        = Protocol.PIPELINE_VERSION;
+const GAME_CHANNEL            = Protocol.SERVER_ANSWER_CHANNEL;
+
+// Seconds the channel can keep an answer for without hearing from us, in case it wasn't connected when it changed
+const CACHE_TTL               = 300;
+// Only answers every player gets the same of (the gift egg is made for the player and the welcome counts who's online)
+const CACHEABLE_REQUESTS      = [Protocol.BATTLE_REQUEST, Protocol.MART_REQUEST];
+
+// Put in a request by clients that can take the answer compressed (see NET_CONN_LZ77_MARK in the game's constants/net_protocol.h),
+// and then in front of the answer to say whether it is
+const LZ77_MARK               = [Protocol.NET_CONN_LZ77_MARK >> 8, Protocol.NET_CONN_LZ77_MARK & 0xff];
+const RAW_MARK                = [Protocol.NET_CONN_RAW_MARK >> 8, Protocol.NET_CONN_RAW_MARK & 0xff];
 
 const TRADING_STATE_NONE     = 0;
 const TRADING_STATE_OFFERING = 2;
@@ -30,12 +51,12 @@ class TcpRequestHelper {
     {
         const requestHandler = new RequestHandler();
 
-        requestHandler.registerHandler(SERVER_NAME_REQUEST, (conn, data, clientList) => {
+        requestHandler.registerHandler(SERVER_NAME_REQUEST, (conn, data, clientList, tag) => {
             LOG.log('CELIO SERVER: Sending message %s', SERVER_NAME);  
-            conn.write("SN_" + SERVER_NAME);
+            writeResponse(conn, new Uint8Array(StringHelper.asciiToByteArray("SN_" + SERVER_NAME)), tag);
         });
           
-        requestHandler.registerHandler(WELCOME_MESSAGE_REQUEST, (conn, data, clientList) => {
+        requestHandler.registerHandler(WELCOME_MESSAGE_REQUEST, (conn, data, clientList, tag) => {
             let playersConnectedMsg = ""; 
             
             if (clientList.size < 1) {
@@ -46,12 +67,12 @@ class TcpRequestHelper {
                 playersConnectedMsg = clientList.size + " other players are online.";
             }
             
-            let welcomeMessage = new Message(0xF0, 0x30, StringHelper.convertMessageToHex("Welcome #!\\" + playersConnectedMsg));
+            let welcomeMessage = new Message(GAME_CHANNEL, Protocol.WELCOME_ANSWER_SIZE, StringHelper.convertMessageToHex("Welcome #!\\" + playersConnectedMsg));
             LOG.log('CELIO SERVER: Sending message %s', welcomeMessage.byteArray());
-            sendMessage(conn, welcomeMessage);
+            sendMessage(conn, welcomeMessage, tag);
         });
           
-        requestHandler.registerHandler(PLAYER_DATA, (conn, data, clientList) => {
+        requestHandler.registerHandler(PLAYER_DATA, (conn, data, clientList, tag) => {
             let dataArray = new Uint8Array(data.length);
             dataArray.set(data);
           
@@ -72,33 +93,64 @@ class TcpRequestHelper {
           
             LOG.log('GAME: %s | PLAYER: %s | GENDER: %s | TRAINER_ID %s', conn.game, conn.name, conn.gender, conn.trainerId);
         });
+
+        requestHandler.registerHandler(PIPELINE_REQUEST, (conn, data, clientList, tag) => {
+            LOG.log('CELIO SERVER: Client is using tagged requests');
+            // Always framed, so the client can tell it apart from the single 0 older servers answer with
+            writeResponse(conn, new Uint8Array([...StringHelper.asciiToByteArray(Protocol.PIPELINE_REQUEST), PIPELINE_VERSION]), tag === undefined ? 0 : tag);
+            conn.pipelined = true;
+            conn.requestFrames = new NetFrame.FrameReassembler(NetFrame.REQUEST_MARK);
+        });
+
+        requestHandler.registerHandler(CACHE_REQUEST, (conn, data, clientList, tag) => {
+            // Versions can only go out framed, where tag 0 is never waited on
+            if (!conn.pipelined) {
+                return;
+            }
+
+            LOG.log('CELIO SERVER: Client is keeping answers');
+            requestHandler.cachingClients.add(conn);
+
+            for (let request of CACHEABLE_REQUESTS) {
+                writeResponse(conn, requestHandler.cacheVersionMessage(request, 0), 0);
+            }
+        });
           
           
-        var battleMessage = new Message(0xF0, 0x10 * 3, trainerHelper.getTrainer().get3MonTeam());
-        requestHandler.registerHandler(BATTLE_REQUEST, (conn, data, clientList) => {
-            battleMessage = new Message(0xF0, 0x10 * 3, trainerHelper.getTrainer().get3MonTeam());
+        var battleMessage = new Message(GAME_CHANNEL, Protocol.BATTLE_ANSWER_SIZE, trainerHelper.getTrainer().get3MonTeam());
+        requestHandler.registerHandler(BATTLE_REQUEST, (conn, data, clientList, tag) => {
+            // BA_1LZ, the team can go compressed as a whole and the answer says whether it did (BATTLE_PACKED_ANSWER)
+            let team = trainerHelper.getTrainer().get3MonTeam();
+            if (acceptsLz77(data, Protocol.BATTLE_MSG_LZ77_MARK_OFFSET - Protocol.REQUEST_PREFIX_SIZE)) {
+                let packed = packPayload(team);
+                battleMessage = new Message(GAME_CHANNEL, packed.length, packed);
+            } else {
+                battleMessage = new Message(GAME_CHANNEL, Protocol.BATTLE_ANSWER_SIZE, team);
+            }
             LOG.log('CELIO SERVER: Sending Battle Data');  // TODO make this array longer
             LOG.log("RAW HEX: " + Array.apply([], battleMessage.content).map(x => "0x" +  x.toString(16)).join(","));
-            sendMessage(conn, battleMessage);
+            requestHandler.markCacheable(conn, Protocol.BATTLE_REQUEST, tag);
+            sendMessage(conn, battleMessage, tag);
         });
           
-        var martMessage = new Message(0xF0, 0x10, marketHelper.createDefault().getDataArray());
-        requestHandler.registerHandler(MART_REQUEST, (conn, data, clientList) => {
-            martMessage = new Message(0xF0, 0x10, marketHelper.getMart().getDataArray());
+        var martMessage = new Message(GAME_CHANNEL, Protocol.MART_ANSWER_SIZE, marketHelper.createDefault().getDataArray());
+        requestHandler.registerHandler(MART_REQUEST, (conn, data, clientList, tag) => {
+            martMessage = new Message(GAME_CHANNEL, Protocol.MART_ANSWER_SIZE, marketHelper.getMart().getDataArray());
             LOG.log('CELIO SERVER: Sending Mart Data');
             LOG.log("RAW HEX: " + Array.apply([], martMessage.content).map(x => "0x" +  x.toString(16)).join(","));
-            sendMessage(conn, martMessage);
+            requestHandler.markCacheable(conn, Protocol.MART_REQUEST, tag);
+            sendMessage(conn, martMessage, tag);
         });
           
-        var giftEggMessage = new Message(0xF0, 0x4, giftEggHelper.createDefault().getDataArray());
-        requestHandler.registerHandler(GIFT_EGG_REQUEST, (conn, data, clientList) => {
-            giftEggMessage = new Message(0xF0, 0x4, giftEggHelper.getGiftEgg().getDataArray(conn.id));
+        var giftEggMessage = new Message(GAME_CHANNEL, Protocol.GIFT_EGG_ANSWER_SIZE, giftEggHelper.createDefault().getDataArray());
+        requestHandler.registerHandler(GIFT_EGG_REQUEST, (conn, data, clientList, tag) => {
+            giftEggMessage = new Message(GAME_CHANNEL, Protocol.GIFT_EGG_ANSWER_SIZE, giftEggHelper.getGiftEgg().getDataArray(conn.id));
             LOG.log('CELIO SERVER: Sending Gift Egg Data');
             LOG.log("RAW HEX: " + Array.apply([], giftEggMessage.content).map(x => "0x" +  x.toString(16)).join(","));
-            sendMessage(conn, giftEggMessage);
+            sendMessage(conn, giftEggMessage, tag);
         });   
     
-        requestHandler.registerHandler(POST_MAIL_REQUEST, (conn, data, clientList) => {
+        requestHandler.registerHandler(POST_MAIL_REQUEST, (conn, data, clientList, tag) => {
 
             let friendKey = new Uint8Array(4);
             let isUsingFriendCode = data[0] == "1".charCodeAt(0);
@@ -123,10 +175,10 @@ class TcpRequestHelper {
                 "message": data.slice(5, 5 + 2 + (2 * 9)) // 2 Byte mail type + 9, 2 Byte easy chat words
             }
 
-            sendMessage(conn, new Message(0xF0, 0x2, new Uint8Array([200, isUsingFriendCode ? 1 : 0])));
+            sendMessage(conn, new Message(GAME_CHANNEL, Protocol.POST_MAIL_ANSWER_SIZE, new Uint8Array([Protocol.POST_MAIL_OK, isUsingFriendCode ? 1 : 0])), tag);
         });
 
-        requestHandler.registerHandler(READ_MAIL_REQUEST, (conn, data, clientList) => {
+        requestHandler.registerHandler(READ_MAIL_REQUEST, (conn, data, clientList, tag) => {
 
             let friendKey = new Uint8Array(4);
             if (data[0] == "1".charCodeAt(0)) {
@@ -145,12 +197,12 @@ class TcpRequestHelper {
 
             var modMail = clientList.get(conn.id).modMail;
             if (modMail) {
-                var mailHex = new Uint8Array(8 + 2 + (2 * 9));
+                var mailHex = new Uint8Array(Protocol.READ_MAIL_ANSWER_SIZE);
                 mailHex.set(new Uint8Array(StringHelper.convertMessageToHex("ADMIN")), 0);
                 mailHex[8] = 0x00;
                 mailHex[9] = 0x7B;
                 mailHex.set(modMail, 8 + 2);
-                sendMessage(conn, new Message(0xF0, 8 + 2 + (2 * 9), mailHex)); 
+                sendMessage(conn, new Message(GAME_CHANNEL, Protocol.READ_MAIL_ANSWER_SIZE, mailHex), tag); 
                 clientList.get(conn.id).modMail = null; 
                 return;
             }
@@ -160,23 +212,23 @@ class TcpRequestHelper {
                                                       .filter(m => m.id != conn.id)
                                                       .filter(m => m.friendKey = friendKey)
                                                       .filter(m => m.sentTime > lastMailCheckTime)
-                                                      .sort((a, b) => b.getTime() - a.getTime())[0];
+                                                      .sort((a, b) => b.sentTime - a.sentTime)[0];
 
             if (nextMessage) {
 
                 clientList.get(conn.id).lastMailCheckTime = nextMessage.sentTime;
-                var mailHex = new Uint8Array(8 + 2 + (2 * 9)); // Player name + mail type + 9 easy chat words
+                var mailHex = new Uint8Array(Protocol.READ_MAIL_ANSWER_SIZE); // Player name + mail type + 9 easy chat words
                 mailHex.set(new Uint8Array(StringHelper.convertMessageToHex(nextMessage.name)), 0);
                 mailHex.set(nextMessage.message, 8);
                 
-                sendMessage(conn, new Message(0xF0, 8 + 2 + (2 * 9), mailHex)); 
+                sendMessage(conn, new Message(GAME_CHANNEL, Protocol.READ_MAIL_ANSWER_SIZE, mailHex), tag); 
 
             } else  {
-                sendMessage(conn, new Message(0xF0, 0x2, new Uint8Array([0xFF, 0xFF]))); // No new messages
+                sendMessage(conn, new Message(GAME_CHANNEL, 0x2, new Uint8Array([0xFF, 0xFF])), tag); // No new messages
             }
         });
 
-        requestHandler.registerHandler(TRADE_REQUEST, (conn, data, clientList) => {
+        requestHandler.registerHandler(TRADE_REQUEST, (conn, data, clientList, tag) => {
             LOG.log("Trade request");
 
             let friendKey = new Uint8Array(4);
@@ -190,7 +242,8 @@ class TcpRequestHelper {
 
             // 100 bytes is the size of a mon
             // The server was sent 16 bytes + the mon. By now it has trimmed 3 bytes off the start
-            let dataArray = new Uint8Array(100 + 16);
+            // Clients that can take the partner's mon compressed put LZ at the start of the padding after the friend key
+            let dataArray = new Uint8Array(Protocol.TRADE_ANSWER_SIZE);
             dataArray.set(new Uint8Array(StringHelper.convertMessageToHex(conn.name)), 0);
             dataArray.set(data.slice(13, data.length), 16);
 
@@ -201,34 +254,43 @@ class TcpRequestHelper {
                     clientList.get(candidateTrade.id).tradeState = TRADING_STATE_ACCEPTED;
 
                 // Switch our data and return    
-                candidateTrade.tradeResponse = new Message(0xF0, 100 + 16, dataArray);
-                sendMessage(conn, candidateTrade.tradeOffer);
+                candidateTrade.tradeResponse = tradeMessage(dataArray, candidateTrade.tradeLz77);
+                sendMessage(conn, tradeMessage(candidateTrade.tradeOffer, acceptsLz77(data, Protocol.TRADE_MSG_LZ77_MARK_OFFSET - Protocol.REQUEST_PREFIX_SIZE)), tag);
 
                 if (clientList.get(candidateTrade.id))
                     clientList.get(candidateTrade.id).tradeState = TRADING_STATE_NONE;
 
             } else {
                 // We are the first, offer ourselves
-                clientList.get(conn.id).tradeOffer = new Message(0xF0, 100 + 16, dataArray);
-                clientList.get(conn.id).tradeResponse = new Message(0xF0, 100 + 16, new Uint8Array(100 + 16));
+                clientList.get(conn.id).tradeOffer = dataArray;
+                clientList.get(conn.id).tradeLz77 = acceptsLz77(data, Protocol.TRADE_MSG_LZ77_MARK_OFFSET - Protocol.REQUEST_PREFIX_SIZE);
+                clientList.get(conn.id).tradeResponse = new Message(GAME_CHANNEL, Protocol.TRADE_ANSWER_SIZE, new Uint8Array(Protocol.TRADE_ANSWER_SIZE));
                 clientList.get(conn.id).friendKey = friendKey;
                 clientList.get(conn.id).tradeState = TRADING_STATE_OFFERING;
                 new Promise(resolve => setTimeout(resolve, 3000)).then(() => {
 
+                    // The client went while it was waiting, there's no one to answer
+                    if (!clientList.get(conn.id)) {
+                        return;
+                    }
+
                     if (clientList.get(conn.id).tradeState == TRADING_STATE_OFFERING) {
 
                         // The offer was not accepted. Wait another 100 ms just incase
                         clientList.get(conn.id).tradeState = TRADING_STATE_NONE;
                         new Promise(resolve => setTimeout(resolve, 100)).then(() => {
 
-                            sendMessage(conn, clientList.get(conn.id).tradeResponse);
+                            if (!clientList.get(conn.id)) {
+                                return;
+                            }
+                            sendMessage(conn, clientList.get(conn.id).tradeResponse, tag);
 
                         });
 
                     } else {
 
                         // Offer was accepted we can return right away
-                        sendMessage(conn, clientList.get(conn.id).tradeResponse);
+                        sendMessage(conn, clientList.get(conn.id).tradeResponse, tag);
 
                     }
 
@@ -276,6 +338,10 @@ class RequestHandler {
     constructor() {
       this.handlers = new Map();
       this.clientList = new Map();
+      this.cachingClients = new Set();
+      // Starting from the time means a restarted server never hands out a version a channel kept from before
+      let startVersion = Math.floor(Date.now() / 1000) >>> 0;
+      this.cacheVersions = new Map(CACHEABLE_REQUESTS.map(request => [request, startVersion]));
     }
   
     /**
@@ -291,7 +357,24 @@ class RequestHandler {
       this.handlers.set(identifier.join(""), handlerFunction);
     }
   
-    handleRequest(conn, data) {
+    /**
+     * Clients that haven't asked for tagged requests send one request per write.
+     * Once they have (see PIPELINE_REQUEST) each request is prefixed with its tag and size, so several can arrive in one read
+     * or one can be split over several, and every response is sent back with the tag of the request it answers
+     */
+    handleData(conn, data) {
+      if (!conn.pipelined) {
+        this.handleRequest(conn, data);
+        return;
+      }
+
+      let framed = conn.requestFrames.push(data, (tag, request) => this.handleRequest(conn, request, tag));
+      if (!framed) {
+        LOG.log("UNTAGGED DATA FROM A PIPELINED CLIENT, DROPPING IT");
+      }
+    }
+
+    handleRequest(conn, data, tag) {
       let dataString = StringHelper.byteArrayToAscii(data);
       let delimiterIndex = dataString.indexOf('_');
       let messageKey = StringHelper.asciiToByteArray(dataString.substring(0,delimiterIndex)).join("");
@@ -299,13 +382,13 @@ class RequestHandler {
   
       if (handler) {
         try {
-            handler(conn, data.slice(delimiterIndex + 1, data.length), this.clientList);
+            handler(conn, data.slice(delimiterIndex + 1, data.length), this.clientList, tag);
         } catch (e) {
             LOG.error(e);
-            conn.write(new Uint8Array(1));
+            writeResponse(conn, new Uint8Array(1), tag);
         }
       } else {
-        conn.write(new Uint8Array(1));
+        writeResponse(conn, new Uint8Array(1), tag);
         LOG.log("UNKNOWN MSG KEY (length %s):\nASCII:%s", data.length, StringHelper.asciiToByteArray(dataString.substring(0,delimiterIndex)).join(","));
         LOG.log("RAW HEX: " + Array.apply([], data).map(x => "0x" +  x.toString(16)).join(","));
       }
@@ -313,12 +396,115 @@ class RequestHandler {
 
     closeConnection(conn) {
         this.clientList.delete(conn.id);
+        this.cachingClients.delete(conn);
+    }
+
+    /**
+     * CACHE_VERSION for a request, e.g. "MA_"
+     * @param tag the request whose answer is about to be sent, 0 if it's only to bring the client's version up to date
+     */
+    cacheVersionMessage(request, tag) {
+      let message = new Uint8Array(Protocol.CACHE_VERSION_MSG_SIZE);
+      let version = this.cacheVersions.get(request);
+
+      message.set(StringHelper.asciiToByteArray(Protocol.CACHE_VERSION), Protocol.CACHE_VERSION_MSG_PREFIX_OFFSET);
+      message.set(StringHelper.asciiToByteArray(request.substring(0, Protocol.CACHE_VERSION_MSG_REQUEST_SIZE)), Protocol.CACHE_VERSION_MSG_REQUEST_OFFSET);
+      message.set([version >>> 24, (version >> 16) & 0xff, (version >> 8) & 0xff, version & 0xff], Protocol.CACHE_VERSION_MSG_VERSION_OFFSET);
+      message.set([CACHE_TTL >> 8, CACHE_TTL & 0xff], Protocol.CACHE_VERSION_MSG_TTL_OFFSET);
+      message[Protocol.CACHE_VERSION_MSG_TAG_OFFSET] = tag;
+      return message;
+    }
+
+    /**
+     * Lets a client that asked to keep answers know the one about to be sent to it can be kept
+     */
+    markCacheable(conn, request, tag) {
+      if (tag !== undefined && this.cachingClients.has(conn)) {
+        writeResponse(conn, this.cacheVersionMessage(request, tag), 0);
+      }
+    }
+
+    /**
+     * Call whenever what a cacheable request is answered with changes, every client keeping answers is told straight away
+     */
+    cacheableChanged(request) {
+      this.cacheVersions.set(request, (this.cacheVersions.get(request) + 1) >>> 0);
+      LOG.log('CELIO SERVER: %s answers changed, telling %d clients', request, this.cachingClients.size);
+
+      for (let conn of this.cachingClients) {
+        writeResponse(conn, this.cacheVersionMessage(request, 0), 0);
+      }
     }
 
 }
 
-function sendMessage(conn, message) {
-    conn.write(message.byteArray());
+/**
+ * @param tag the tag of the request being answered, undefined if the client isn't using tagged requests 
+ */
+function writeResponse(conn, bytes, tag) {
+    if (tag === undefined) {
+        conn.write(bytes);
+        return;
+    }
+
+    conn.write(NetFrame.encodeFrame(NetFrame.RESPONSE_MARK, tag, bytes));
+}
+
+function sendMessage(conn, message, tag) {
+    writeResponse(conn, message.byteArray(), tag);
+}
+
+/**
+ * The key a request's handler is stored under, from its prefix as it is in protocol.js (e.g "BA_")
+ */
+function requestKey(prefix) {
+    return StringHelper.asciiToByteArray(prefix.substring(0, prefix.indexOf('_')));
+}
+
+/**
+ * @param offset where the mark would be in the request's data (after the request id and '_' have been trimmed off)
+ */
+function acceptsLz77(data, offset) {
+    return data.length >= offset + LZ77_MARK.length && data[offset] == LZ77_MARK[0] && data[offset + 1] == LZ77_MARK[1];
+}
+
+/**
+ * @returns the content compressed, or null if that doesn't make it any smaller
+ */
+function compressPayload(content) {
+    let compressed = LZ77.compress(content);
+    return compressed.length < content.length ? compressed : null;
+}
+
+/**
+ * The content behind a NET_CONN_PACKED_HEADER_SIZE header saying how it's sent: compressed with LZ if that's smaller, otherwise raw with RW
+ */
+function packPayload(content) {
+    let compressed = compressPayload(content);
+    let payload = compressed || content;
+    let packed = new Uint8Array(Protocol.NET_CONN_PACKED_HEADER_SIZE + payload.length);
+
+    packed.set(compressed ? LZ77_MARK : RAW_MARK, 0);
+    packed[2] = payload.length >> 8;
+    packed[3] = payload.length & 0xff;
+    packed.set(payload, Protocol.NET_CONN_PACKED_HEADER_SIZE);
+    return packed;
+}
+
+/**
+ * The 16 byte header (the partner's name) stays raw so the gba can check there is a partner before reading the rest.
+ * For a client that can take the mon compressed the end of the header's padding is the packed header (PACKING and MON_SIZE)
+ */
+function tradeMessage(tradeData, lz77) {
+    if (!lz77) {
+        return new Message(GAME_CHANNEL, Protocol.TRADE_ANSWER_SIZE, tradeData);
+    }
+
+    let packedMon = packPayload(tradeData.subarray(Protocol.TRADE_ANSWER_MON_OFFSET));
+    let packed = new Uint8Array(Protocol.TRADE_ANSWER_PACKING_OFFSET + packedMon.length);
+    packed.set(tradeData.subarray(0, Protocol.TRADE_ANSWER_PACKING_OFFSET), 0);
+    packed.set(packedMon, Protocol.TRADE_ANSWER_PACKING_OFFSET);
+    return new Message(GAME_CHANNEL, packed.length, packed);
 }
 
 module.exports = TcpRequestHelper;
\ No newline at end of file
@@ -2,6 +2,7 @@
  * Test designed to run against a freshly restarted server. Running against a server where players have already connected will fail
  */
 var net = require('net');
+var LZ77 = require('./lz77.js');
 
 var serverAddr = '127.0.0.1';
 var serverPort = 9000;
@@ -43,6 +44,7 @@ class Validator {
 
 var player1Validatior = new Validator(verifyInitialResponse);
 var player2Validatior = new Validator(verifyInitialResponse);
+var player3Validatior = new Validator(verifyIgnoreResponse);
 
 player1.on('data', (data) => player1Validatior.validate(data));
 player1.on('error', () => console.log("Failed to connect to server"));
@@ -194,6 +196,17 @@ async function runTests() {
     player1.write(new Uint8Array([as("B"), as("A"), as("_"), as("1")]));
     await sleep(500); 
 
+    // Test Download Battle compressed
+    console.log("Test Download Battle compressed");
+    testsRun++;
+    player1Validatior.updateValidationFunction(verifyDownloadBattleCompressedResponse);
+    player1.write(new Uint8Array([as("B"), as("A"), as("_"), as("1"), as("L"), as("Z"), 0x00, 0x00]));
+    await sleep(500); 
+
+    // Test tagged requests (several requests in one write, answered with the tag they were sent with)
+    console.log("Test tagged requests");
+    testsRun += await runPipelineTests();
+
     // Test trade without friend key
     // console.log("UNIMPLEMENTED: Test trade without friend key");
     // testsRun++;
@@ -210,10 +223,11 @@ async function runTests() {
     console.log("=====================================");
     console.log("=== RESULTS                       ===");
     console.log("=====================================");
-    console.log("Pass Count:" + (player1Validatior.passCount + player2Validatior.passCount));
-    console.log("Fail Count:" + (player1Validatior.failCount + player2Validatior.failCount));
+    console.log("Pass Count:" + (player1Validatior.passCount + player2Validatior.passCount + player3Validatior.passCount));
+    console.log("Fail Count:" + (player1Validatior.failCount + player2Validatior.failCount + player3Validatior.failCount));
 
-    if (testsRun - (player1Validatior.passCount + player2Validatior.passCount + player1Validatior.failCount + player2Validatior.failCount) > 0) {
+    if (testsRun - (player1Validatior.passCount + player2Validatior.passCount + player3Validatior.passCount 
+                    + player1Validatior.failCount + player2Validatior.failCount + player3Validatior.failCount) > 0) {
         console.log("\nWARNING - Some tests did not finish");   
     } else {
         console.log("\nAll tests have finished");
@@ -225,6 +239,106 @@ async function runTests() {
     player2.destroy();
 }
 
+/**
+ * Player 3 never joins, it only checks tagged requests. Returns the number of tests run
+ */
+async function runPipelineTests() {
+    let testsRun = 0;
+    let player3 = new net.Socket();
+    let received = [];
+
+    player3.on('data', (data) => received.push(...data));
+    await new Promise((resolve) => player3.connect(serverPort, serverAddr, resolve));
+    await sleep(BETWEEN_TEST_DELAY);
+
+    testsRun++;
+    player3Validatior.updateValidationFunction(verifyPipelineResponse);
+    received = [];
+    player3.write(new Uint8Array([as("P"), as("L"), as("_")]));
+    await sleep(BETWEEN_TEST_DELAY);
+    // Sent before anything else, so it's answered as a frame with tag 0
+    let pipelineResponse = untagResponses(received);
+    player3Validatior.validate(pipelineResponse.has(0) ? pipelineResponse.get(0) : []);
+
+    // Three requests in one write, the last is one the server doesn't know
+    received = [];
+    player3.write(new Uint8Array([
+        ...tagRequest(1, [as("M"), as("A"), as("_"), as("1")]),
+        ...tagRequest(2, [as("G"), as("E"), as("_"), as("1")]),
+        ...tagRequest(3, [as("X"), as("X"), as("_")])
+    ]));
+    await sleep(BETWEEN_TEST_DELAY);
+
+    // One request split over two writes
+    let split = tagRequest(4, [as("M"), as("A"), as("_"), as("1")]);
+    player3.write(new Uint8Array(split.slice(0, 3)));
+    await sleep(BETWEEN_TEST_DELAY);
+    player3.write(new Uint8Array(split.slice(3)));
+    await sleep(BETWEEN_TEST_DELAY);
+
+    let responses = untagResponses(received);
+    let checks = [[1, verifyMartResponse], [2, verifyEggResponse], [3, verifyUnknownResponse], [4, verifyMartResponse]];
+
+    for (let [tag, validationFunction] of checks) {
+        testsRun++;
+        player3Validatior.updateValidationFunction(validationFunction);
+        player3Validatior.validate(responses.has(tag) ? responses.get(tag) : []);
+    }
+
+    // Asking to keep answers gets the version of each one that can be kept, then a mart answer is sent with its version in front
+    received = [];
+    player3.write(new Uint8Array([
+        ...tagRequest(0, [as("C"), as("C"), as("_")]),
+        ...tagRequest(5, [as("M"), as("A"), as("_"), as("1")])
+    ]));
+    await sleep(BETWEEN_TEST_DELAY);
+
+    let frames = splitResponses(received);
+    // The version sent in front of the mart names its tag, the ones that only bring the version up to date have 0
+    let versions = frames.filter(frame => frame.tag == 0 && frame.body[11] == 0);
+
+    testsRun++;
+    player3Validatior.updateValidationFunction(verifyCacheVersionsResponse);
+    player3Validatior.validate(versions);
+
+    testsRun++;
+    player3Validatior.updateValidationFunction(verifyCacheableMartResponse);
+    player3Validatior.validate(frames);
+
+    player3.destroy();
+    return testsRun;
+}
+
+function tagRequest(tag, bytes) {
+    return [0x23, tag, bytes.length >> 8, bytes.length & 0xff, ...bytes];
+}
+
+function untagResponses(bytes) {
+    let responses = new Map();
+
+    for (let frame of splitResponses(bytes)) {
+        responses.set(frame.tag, frame.body);
+    }
+
+    return responses;
+}
+
+/**
+ * Every response frame in the order they came, for when several have the same tag
+ */
+function splitResponses(bytes) {
+    let frames = [];
+    let offset = 0;
+
+    while (offset + 4 <= bytes.length && bytes[offset] == 0x26) {
+        let size = (bytes[offset + 2] << 8) | bytes[offset + 3];
+        frames.push({ tag: bytes[offset + 1], body: bytes.slice(offset + 4, offset + 4 + size) });
+        offset += 4 + size;
+    }
+
+    return frames;
+}
+
 function verifyIgnoreResponse(data) {
     // Do nothing
 }
@@ -270,6 +384,41 @@ function verifySecondWelcomeMessageResponse(data) {
                'First Welcome Message Response Failed \n Expected: ' + toHexString(expected) + "\n Actual: " + toHexString(data)); 
 }
 
+function verifyPipelineResponse(data) {
+    let expected = [as("P"), as("L"), as("_"), 0x01];
+    return assertTrue(() => compHex(data, expected),
+    'Pipeline Request Correct Response',
+    'Pipeline Request Response Failed \n Expected: ' + toHexString(expected) + "\n Actual: " + toHexString(data)); 
+}
+
+/**
+ * CV_, the request's two letters, a 4 byte version, a 2 byte ttl and the tag of the answer that follows
+ */
+function isCacheVersion(body, request, tag) {
+    return body.length == 12 && compHex(body.slice(0, 5), [as("C"), as("V"), as("_"), as(request[0]), as(request[1])]) && body[11] == tag;
+}
+
+function verifyCacheVersionsResponse(frames) {
+    return assertTrue(() => frames.length == 2 && isCacheVersion(frames[0].body, "BA", 0) && isCacheVersion(frames[1].body, "MA", 0),
+    'Cache Request Correct Response',
+    'Cache Request Response Failed \n Expected: CV_ for BA and MA \n Actual: ' + frames.map(frame => toHexString(frame.body)).join(" | ")); 
+}
+
+function verifyCacheableMartResponse(frames) {
+    let marked = frames.findIndex(frame => frame.tag == 0 && isCacheVersion(frame.body, "MA", 5));
+    let answered = frames.findIndex(frame => frame.tag == 5);
+    return assertTrue(() => marked >= 0 && answered == marked + 1 && verifyMartResponse(frames[answered].body),
+    'Cacheable Mart Correct Response',
+    'Cacheable Mart Response Failed \n Expected: CV_ for MA with tag 5 then the mart \n Actual: ' + frames.map(frame => toHexString(frame.body)).join(" | ")); 
+}
+
+function verifyUnknownResponse(data) {
+    let expected = [0x00];
+    return assertTrue(() => compHex(data, expected),
+    'Unknown Request Correct Response',
+    'Unknown Request Response Failed \n Expected: ' + toHexString(expected) + "\n Actual: " + toHexString(data)); 
+}
+
 function verifyMartResponse(data) {
     let expected = [
         //  MESSAGE_TYPE, MESSAGE_OFFSET, MESSAGE_LENGTH_BYTE_1, MESSAGE_LENGTH_BYTE_2, ASCII_UNDERSCORE 
@@ -353,15 +502,32 @@ function verifyDownloadBattleResponse(data) {
     let expected = [
         //  MESSAGE_TYPE, MESSAGE_OFFSET, MESSAGE_LENGTH_BYTE_1, MESSAGE_LENGTH_BYTE_2, ASCII_UNDERSCORE 
             0x25, 0xf0, 0x00, 0x10 * 3, 0x5f,
+            ...expectedBattleTeam()];
+    return assertTrue(() => compHex(data, expected),
+    'Download Battle Message Correct Response',
+    'Download Battle Message Response Failed \n Expected: ' + toHexString(expected) + "\n Actual: " + toHexString(data)); 
+}
+
+function verifyDownloadBattleCompressedResponse(data) {
+    let expectedHeader = [
+        //  MESSAGE_TYPE, MESSAGE_OFFSET, MESSAGE_LENGTH_BYTE_1, MESSAGE_LENGTH_BYTE_2, ASCII_UNDERSCORE 
+            0x25, 0xf0, 0x00, 0x28, 0x5f,
+        // [ "LZ"    ] [ 36 BYTES] [ LZ77, 48 BYTES ONCE UNCOMPRESSED ]
+            0x4c, 0x5a, 0x00, 0x24, 0x10, 0x30, 0x00, 0x00];
+    let team = LZ77.decompress(data.subarray(9));
+    return assertTrue(() => compHex(data.subarray(0, expectedHeader.length), expectedHeader) && team != null && compHex(team, expectedBattleTeam()),
+    'Download Battle Compressed Message Correct Response',
+    'Download Battle Compressed Message Response Failed \n Expected: ' + toHexString(expectedHeader) + " then " + toHexString(expectedBattleTeam()) + "\n Actual: " + toHexString(data)); 
+}
+
+function expectedBattleTeam() {
+    return [
         // [ SPECIES ] [LVL] [ ITEM    ] [ MOVE 1  ] [ MOVE 2  ] [ MOVE 3  ] [ MOVE 4  ] [ NICKNAME      ]   
            0x81, 0x00, 0x0A, 0xC8, 0x00, 0x96, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xBC, 0xE3, 0xD6,
         // [ SPECIES ] [LVL] [ ITEM    ] [ MOVE 1  ] [ MOVE 2  ] [ MOVE 3  ] [ MOVE 4  ] [ NICKNAME      ]     
            0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc4, 0xdd, 0xe1, 
         // [ SPECIES ] [LVL] [ ITEM    ] [ MOVE 1  ] [ MOVE 2  ] [ MOVE 3  ] [ MOVE 4  ] [ NICKNAME      ]        
            0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xbb, 0xe1, 0xed];
-    return assertTrue(() => compHex(data, expected),
-    'Download Battle Message Correct Response',
-    'Download Battle Message Response Failed \n Expected: ' + toHexString(expected) + "\n Actual: " + toHexString(data)); 
 }
 
 function verifyTradeNoFriendKeyPlayer1Response(data) {
@@ -4,6 +4,7 @@ const bodyParser = require('body-parser');
 const app = express();
 const baseDirectory = "web-src";
 var LOG = require('./log.js');
+var Protocol = require('./protocol.js');
 
 /**
  * Rather than adding a bad security, I've not added any. 
@@ -47,6 +48,7 @@ class WebServerHelper {
             LOG.log(request.body);
             response.writeHead(200, {'Content-Type': 'text/html'})
             trainerHelper.updateTrainer1Pokemon(request.body);
+            tcpRequestHandler.cacheableChanged(Protocol.BATTLE_REQUEST);
             LOG.log("New Trainer Data " + JSON.stringify(trainerHelper.getBattle1Pokemon()))
             response.end(JSON.stringify({'result': 'Data Updated'}));
         });
@@ -76,6 +78,7 @@ class WebServerHelper {
             LOG.log(request.body);
             response.writeHead(200, {'Content-Type': 'text/html'})
             marketHelper.updateMart(request.body);
+            tcpRequestHandler.cacheableChanged(Protocol.MART_REQUEST);
             LOG.log("New Mart Data " + JSON.stringify(marketHelper.getMart()))
             response.end(JSON.stringify({'result': 'Data Updated'}));
         });
@@ -0,0 +1,6 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * debug.h
+ * Stand in for the libogc gdb stub header (unused on PC)
+ ***************************************************************************/
@@ -0,0 +1,79 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * gccore.h
+ * Stand in for the libogc header so linkcableclient.c can be built on a PC.
+ * Only the parts the channel actually uses are provided, the implementations
+ * live in libogc_host.cpp
+ ***************************************************************************/
+
+#ifndef _LINKSIM_GCCORE_H_
+#define _LINKSIM_GCCORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef volatile u8  vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+// ======================= LWP (threads) ======================================================
+
+typedef u32 lwp_t;
+#define LWP_THREAD_NULL 0xffffffff
+
+s32 LWP_CreateThread(lwp_t *thethread, void* (*entry)(void *), void *arg, void *stackbase, u32 stack_size, u8 prio);
+s32 LWP_SuspendThread(lwp_t thethread);
+s32 LWP_ResumeThread(lwp_t thethread);
+s32 LWP_JoinThread(lwp_t thethread, void **value_ptr);
+
+typedef u32 mutex_t;
+typedef u32 cond_t;
+
+s32 LWP_MutexInit(mutex_t *mutex, bool use_recursive);
+s32 LWP_MutexLock(mutex_t mutex);
+s32 LWP_MutexUnlock(mutex_t mutex);
+
+struct timespec;
+
+s32 LWP_CondInit(cond_t *cond);
+s32 LWP_CondSignal(cond_t cond);
+// Like libogc the timeout is relative, not an absolute time like pthread_cond_timedwait
+s32 LWP_CondTimedWait(cond_t cond, mutex_t mutex, const struct timespec *reltime);
+
+// ======================= SI (serial interface) ======================================================
+
+#define SI_TYPE_GC     0x08000000u
+#define SI_GC_STANDARD 0x01000000u
+
+typedef void (*SICallback)(s32 res, u32 val);
+
+u32 SI_Transfer(s32 chan, void *out, u32 out_len, void *in, u32 in_len, SICallback cb, u32 us_delay);
+u32 SI_GetTypeAsync(s32 chan, SICallback cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
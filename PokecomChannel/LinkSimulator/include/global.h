@@ -0,0 +1,86 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * global.h
+ * Stand in for pokeemerald's global.h when building src/net_conn_link.c
+ * on a PC. The file is compiled as C++ so the JOY registers can be small
+ * objects that behave like the real hardware (JOYCNT flags are cleared by
+ * writing 1 to them, and every read of JOYCNT costs GBA time).
+ ***************************************************************************/
+
+#ifndef GUARD_GLOBAL_H
+#define GUARD_GLOBAL_H
+
+#ifndef __cplusplus
+#error "net_conn_link.c must be built as C++ for the link simulator"
+#endif
+
+#include <stdint.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+typedef volatile u8  vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+
+typedef u8  bool8;
+typedef u32 bool32;
+
+#define TRUE  1
+#define FALSE 0
+
+// Each simulated GBA is its own thread, so each gets its own copy of the link code's state
+#define EWRAM_DATA thread_local
+
+// Interrupts are only taken while the GBA waits for the next frame (see SimGba::WaitForNextFrame), so there's nothing to mask
+static u16 sRegIme __attribute__((unused)) = 1;
+#define REG_IME sRegIme
+
+// Implemented by the simulated wire the calling GBA thread is plugged into (see joybus_wire.cpp)
+u16 GbaJoybus_ReadCnt(void);
+void GbaJoybus_WriteCnt(u16 value);
+u32 GbaJoybus_ReadData(int reg);
+void GbaJoybus_WriteData(int reg, u32 value, u32 mask);
+
+enum {
+    GBA_JOY_REG_RECV,
+    GBA_JOY_REG_TRANS
+};
+
+class JoyCntRegister {
+public:
+    operator u16() const { return GbaJoybus_ReadCnt(); }
+    JoyCntRegister &operator=(u16 value) { GbaJoybus_WriteCnt(value); return *this; }
+    JoyCntRegister &operator|=(u16 value) { GbaJoybus_WriteCnt(GbaJoybus_ReadCnt() | value); return *this; }
+};
+
+template <int reg, typename T, int shift>
+class JoyDataRegister {
+public:
+    operator T() const { return (T) (GbaJoybus_ReadData(reg) >> shift); }
+    JoyDataRegister &operator=(T value) { GbaJoybus_WriteData(reg, (u32) value << shift, (u32) (T) ~0 << shift); return *this; }
+};
+
+// Objects rather than temporaries so expressions like JOY_CNT&JOY_READ don't parse as casts
+static JoyCntRegister sJoyCnt __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_RECV, u32, 0> sJoyRecv __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_RECV, u16, 0> sJoyRecvL __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_RECV, u16, 16> sJoyRecvH __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_TRANS, u32, 0> sJoyTrans __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_TRANS, u16, 0> sJoyTransL __attribute__((unused));
+static JoyDataRegister<GBA_JOY_REG_TRANS, u16, 16> sJoyTransH __attribute__((unused));
+
+#define JOY_CNT     sJoyCnt
+#define JOY_RECV    sJoyRecv
+#define JOY_RECV_L  sJoyRecvL
+#define JOY_RECV_H  sJoyRecvH
+#define JOY_TRANS   sJoyTrans
+#define JOY_TRANS_L sJoyTransL
+#define JOY_TRANS_H sJoyTransH
+
+#endif // GUARD_GLOBAL_H
@@ -0,0 +1,85 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * network.h
+ * Stand in for the libogc network header. Structures keep the libogc (BSD)
+ * layout, libogc_host.cpp translates them to the host socket api.
+ ***************************************************************************/
+
+#ifndef _LINKSIM_NETWORK_H_
+#define _LINKSIM_NETWORK_H_
+
+#include "gccore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AF_INET     2
+#define PF_INET     AF_INET
+#define SOCK_STREAM 1
+#define IPPROTO_IP  0
+
+typedef u32 socklen_t;
+
+struct in_addr {
+	u32 s_addr;
+};
+
+struct sockaddr_in {
+	u8 sin_len;
+	u8 sin_family;
+	u16 sin_port;
+	struct in_addr sin_addr;
+	s8 sin_zero[8];
+};
+
+struct sockaddr {
+	u8 sa_len;
+	u8 sa_family;
+	s8 sa_data[14];
+};
+
+struct hostent {
+	char *h_name;
+	char **h_aliases;
+	u16 h_addrtype;
+	u16 h_length;
+	char **h_addr_list;
+};
+
+#define POLLIN 0x0001
+
+#define F_GETFL 3
+#define F_SETFL 4
+#define IOS_O_NONBLOCK 0x04
+
+struct pollsd {
+	s32 socket;
+	u32 events;
+	u32 revents;
+};
+
+s32 net_socket(u32 domain, u32 type, u32 protocol);
+s32 net_connect(s32 s, struct sockaddr *addr, socklen_t addrlen);
+s32 net_recv(s32 s, void *mem, s32 len, u32 flags);
+s32 net_send(s32 s, const void *data, s32 size, u32 flags);
+s32 net_close(s32 s);
+s32 net_poll(struct pollsd *sds, s32 nsds, s32 timeout);
+s32 net_fcntl(s32 s, u32 cmd, u32 flags);
+struct hostent *net_gethostbyname(const char *addrString);
+
+s32 if_config(char *local_ip, char *netmask, char *gateway, bool use_dhcp, int max_retries);
+
+// These are resolved straight from the host libc
+u32 inet_addr(const char *cp);
+int inet_aton(const char *cp, struct in_addr *addr);
+char *inet_ntoa(struct in_addr addr);
+u16 htons(u16 hostshort);
+u16 ntohs(u16 netshort);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
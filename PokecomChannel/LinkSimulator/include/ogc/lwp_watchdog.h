@@ -0,0 +1,31 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * ogc/lwp_watchdog.h
+ * Stand in for the libogc timebase functions. The host timebase counts in
+ * microseconds, so ticks and microseconds are the same thing
+ ***************************************************************************/
+
+#ifndef _LINKSIM_LWP_WATCHDOG_H_
+#define _LINKSIM_LWP_WATCHDOG_H_
+
+#include "gccore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TB_TIMER_CLOCK 1000
+
+#define ticks_to_microsecs(ticks) ((u64) (ticks))
+#define ticks_to_millisecs(ticks) (((u64) (ticks)) / 1000)
+#define microsecs_to_ticks(usec) ((u64) (usec))
+#define millisecs_to_ticks(msec) (((u64) (msec)) * 1000)
+
+u64 gettime(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,8 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * ogcsys.h
+ * Stand in for the libogc header, everything needed is in gccore.h
+ ***************************************************************************/
+
+#include "gccore.h"
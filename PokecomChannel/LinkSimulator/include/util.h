@@ -0,0 +1,16 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * util.h
+ * Stand in for pokeemerald's util.h, which drags in the sprite code.
+ * Only what src/net_conn_link.c uses is declared here.
+ ***************************************************************************/
+
+#ifndef GUARD_UTIL_H
+#define GUARD_UTIL_H
+
+#include "global.h"
+
+u16 CalcCRC16WithTable(const u8 *data, u32 length);
+
+#endif // GUARD_UTIL_H
@@ -0,0 +1,6 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * wpad.h
+ * Stand in for the wiimote header (unused by the link code)
+ ***************************************************************************/
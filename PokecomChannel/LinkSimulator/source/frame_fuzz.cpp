@@ -0,0 +1,364 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * frame_fuzz.cpp
+ * Feeds random server streams through the channel's frame reader
+ * (netframe.c), split up every way TCP might, and checks it against a
+ * simple model. Also reports how fast it goes.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+	#include "netframe.h"
+}
+
+#define VIRTUAL_CHANNELS_SIZE MAX_MSG_SIZE
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+
+enum {
+	SPLIT_WHOLE, // The socket always has everything the reader asks for
+	SPLIT_RANDOM, // Each read gets whatever's left of a randomly sized segment
+	SPLIT_BYTES, // One byte per read
+	SPLIT_COUNT
+};
+
+static const char *splitNames[SPLIT_COUNT] = { "whole", "random", "1 byte" };
+
+struct ExpectedFrame {
+	int result;
+	u8 tag;
+	u8 msgChannel;
+	u16 msgSize;
+	std::vector<u8> other;
+};
+
+struct FuzzOptions {
+	u32 frames;
+	u32 maxSegment;
+	u32 garbageBytes;
+	u32 seed;
+};
+
+// The virtual channels, with a guard either side to catch the reader writing out of bounds
+static u8 channelMemory[GUARD_SIZE + VIRTUAL_CHANNELS_SIZE + GUARD_SIZE];
+static u8 *const virtualChannels = &channelMemory[GUARD_SIZE];
+
+static bool guardsIntact()
+{
+	for (u32 i = 0; i < GUARD_SIZE; i++)
+	{
+		if (channelMemory[i] != GUARD_BYTE || channelMemory[GUARD_SIZE + VIRTUAL_CHANNELS_SIZE + i] != GUARD_BYTE)
+			return false;
+	}
+
+	return true;
+}
+
+static void resetChannels()
+{
+	memset(channelMemory, GUARD_BYTE, sizeof(channelMemory));
+	memset(virtualChannels, 0, VIRTUAL_CHANNELS_SIZE);
+}
+
+/* Appends a random frame to the stream, and what the reader should make of it, applying any message to model */
+static void addFrame(std::mt19937 &rng, std::vector<u8> &stream, std::deque<ExpectedFrame> &expected, std::vector<u8> &model)
+{
+	std::vector<u8> body;
+	u8 tag = (u8) rng();
+
+	switch (rng() % 8)
+	{
+		case 0: // Nothing at all, what the server sends for requests it ignores
+			break;
+		case 1: case 2: // SN_, PL_ and unknown requests
+		{
+			u32 size = rng() % 100;
+			for (u32 i = 0; i < size; i++)
+				body.push_back((u8) rng());
+		} break;
+		case 3: // Starts like a message but is too short to be one
+		{
+			body.push_back(NF_MSG_ID);
+			for (u32 i = rng() % (NF_MSG_HEADER_SIZE - 1); i > 0; i--)
+				body.push_back((u8) rng());
+		} break;
+		default: // Messages, with sizes that are sometimes a lie and channels that sometimes run off the end
+		{
+			u8 channel = rng() % 4 == 0 ? (u8) rng() : (u8) (0xF0 + rng() % 0x10);
+			u16 declared = rng() % 8 == 0 ? (u16) (rng() % 0x2000) : (u16) (rng() % 0x80);
+			u32 sent = rng() % 4 == 0 ? rng() % (declared + 32) : declared;
+
+			body.push_back(NF_MSG_ID);
+			body.push_back(channel);
+			body.push_back(declared >> 8);
+			body.push_back(declared & 0xFF);
+			body.push_back('_');
+			for (u32 i = 0; i < sent; i++)
+				body.push_back((u8) rng());
+		} break;
+	}
+
+	ExpectedFrame frame;
+	frame.tag = tag;
+
+	if (body.size() >= NF_MSG_HEADER_SIZE && body[0] == NF_MSG_ID)
+	{
+		u32 offset = std::min<u32>(body[1] * NF_VIRTUAL_CHANNEL_SIZE, VIRTUAL_CHANNELS_SIZE);
+		u32 size = std::min<u32>((u32) (body[3] | body[2] << 8), VIRTUAL_CHANNELS_SIZE - offset);
+		u32 sent = std::min<u32>(size, body.size() - NF_MSG_HEADER_SIZE);
+
+		memcpy(&model[offset], &body[NF_MSG_HEADER_SIZE], sent);
+		memset(&model[offset + sent], 0, size - sent);
+
+		frame.result = NF_MESSAGE;
+		frame.msgChannel = body[1];
+		frame.msgSize = size;
+	}
+	else
+	{
+		frame.result = NF_OTHER;
+		frame.other.assign(body.begin(), body.begin() + std::min<size_t>(body.size(), NF_MAX_OTHER_SIZE));
+	}
+
+	u8 header[NF_HEADER_SIZE];
+	NF_writeHeader(header, NF_RESPONSE_MARK, tag, (u16) body.size());
+	stream.insert(stream.end(), header, header + NF_HEADER_SIZE);
+	stream.insert(stream.end(), body.begin(), body.end());
+	expected.push_back(frame);
+}
+
+/* Stands in for the socket, handing out the stream in segments the way TCP might */
+class SplitStream {
+public:
+	SplitStream(const std::vector<u8> &stream, int split, u32 maxSegment, u32 seed) : stream(stream), split(split), maxSegment(maxSegment), rng(seed), offset(0), segmentLeft(0), reads(0)
+	{
+	}
+
+	u32 Recv(u8 *buffer, u32 size)
+	{
+		if (segmentLeft == 0)
+		{
+			switch (split)
+			{
+				case SPLIT_WHOLE:  segmentLeft = stream.size() - offset; break;
+				case SPLIT_RANDOM: segmentLeft = 1 + rng() % maxSegment; break;
+				default:           segmentLeft = 1; break;
+			}
+		}
+
+		u32 count = std::min<u32>(std::min<u32>(size, segmentLeft), stream.size() - offset);
+		memcpy(buffer, &stream[offset], count);
+		offset += count;
+		segmentLeft -= count;
+		reads++;
+		return count;
+	}
+
+	bool Done() const { return offset == stream.size(); }
+	u32 Reads() const { return reads; }
+
+private:
+	const std::vector<u8> &stream;
+	int split;
+	u32 maxSegment;
+	std::mt19937 rng;
+	u32 offset;
+	u32 segmentLeft;
+	u32 reads;
+};
+
+static bool checkFrame(const NFReader &reader, int result, const ExpectedFrame &frame, std::string *error)
+{
+	char message[128];
+
+	if (result != frame.result || reader.tag != frame.tag)
+	{
+		snprintf(message, sizeof(message), "got result %d tag %02x, expected result %d tag %02x", result, reader.tag, frame.result, frame.tag);
+		*error = message;
+		return false;
+	}
+
+	if (result == NF_MESSAGE && (reader.msgChannel != frame.msgChannel || reader.msgSize != frame.msgSize))
+	{
+		snprintf(message, sizeof(message), "message went to %02x size %x, expected %02x size %x", reader.msgChannel, reader.msgSize, frame.msgChannel, frame.msgSize);
+		*error = message;
+		return false;
+	}
+
+	if (result == NF_OTHER && (reader.otherSize != frame.other.size() || memcmp(reader.other, frame.other.data(), frame.other.size()) != 0))
+	{
+		snprintf(message, sizeof(message), "other response of size %x, expected size %x", reader.otherSize, (u32) frame.other.size());
+		*error = message;
+		return false;
+	}
+
+	return true;
+}
+
+static bool runSplit(const FuzzOptions &options, const std::vector<u8> &stream, std::deque<ExpectedFrame> expected, const std::vector<u8> &model, int split)
+{
+	NFReader reader;
+	SplitStream socket(stream, split, options.maxSegment, options.seed + split);
+	u32 frames = expected.size();
+	std::string error;
+
+	resetChannels();
+	NF_initReader(&reader, virtualChannels, VIRTUAL_CHANNELS_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	while (!socket.Done() && error.empty())
+	{
+		u8 *buffer;
+		u32 size = NF_getRecvBuffer(&reader, &buffer);
+		int result = NF_commit(&reader, socket.Recv(buffer, size));
+
+		if (result == NF_NEED_MORE)
+			continue;
+
+		if (expected.empty())
+			error = "more frames than were sent";
+		else if (checkFrame(reader, result, expected.front(), &error))
+			expected.pop_front();
+	}
+
+	u64 elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	if (error.empty() && !expected.empty())
+		error = "frames went missing";
+	if (error.empty() && memcmp(virtualChannels, model.data(), VIRTUAL_CHANNELS_SIZE) != 0)
+		error = "virtual channels don't match";
+	if (error.empty() && !guardsIntact())
+		error = "wrote outside the virtual channels";
+
+	printf("%-8s %8u frames %9u reads %6.2f reads/frame %9.1f MB/s  %s\n", splitNames[split], frames, socket.Reads(), (double) socket.Reads() / frames,
+	       elapsedUs > 0 ? (double) stream.size() / elapsedUs : 0.0, error.empty() ? "OK" : error.c_str());
+
+	return error.empty();
+}
+
+/* Random bytes that mostly look like frame headers, the reader has to report errors without ever writing out of bounds */
+static bool runGarbage(const FuzzOptions &options, std::mt19937 &rng)
+{
+	NFReader reader;
+	std::vector<u8> stream(options.garbageBytes);
+	u32 errors = 0;
+
+	for (u32 i = 0; i < stream.size(); i++)
+		stream[i] = rng() % 3 == 0 ? NF_RESPONSE_MARK : (u8) rng();
+
+	SplitStream socket(stream, SPLIT_RANDOM, options.maxSegment, options.seed);
+
+	resetChannels();
+	NF_initReader(&reader, virtualChannels, VIRTUAL_CHANNELS_SIZE);
+
+	while (!socket.Done())
+	{
+		u8 *buffer;
+		u32 size = NF_getRecvBuffer(&reader, &buffer);
+
+		if (size == 0 || size > VIRTUAL_CHANNELS_SIZE)
+		{
+			printf("garbage  reader asked for %u bytes\n", size);
+			return false;
+		}
+
+		if (NF_commit(&reader, socket.Recv(buffer, size)) == NF_ERROR)
+			errors++;
+	}
+
+	bool passed = guardsIntact();
+	printf("garbage  %8u bytes %9u errors  %s\n", (u32) stream.size(), errors, passed ? "OK" : "wrote outside the virtual channels");
+	return passed;
+}
+
+static void printUsage(const char *name)
+{
+	printf("Usage: %s [options]\n", name);
+	printf("  --frames N        frames in the stream (default 200000)\n");
+	printf("  --max-segment N   largest segment handed out in random split mode (default 1500)\n");
+	printf("  --garbage N       bytes of random data to throw at the reader (default 1000000)\n");
+	printf("  --seed N          seed for the stream (default 1)\n");
+}
+
+static bool parseOptions(int argc, char **argv, FuzzOptions *options)
+{
+	options->frames = 200000;
+	options->maxSegment = 1500;
+	options->garbageBytes = 1000000;
+	options->seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return false;
+		}
+
+		i++;
+
+		if (arg == "--frames")              options->frames = strtoul(value, NULL, 0);
+		else if (arg == "--max-segment")    options->maxSegment = strtoul(value, NULL, 0);
+		else if (arg == "--garbage")        options->garbageBytes = strtoul(value, NULL, 0);
+		else if (arg == "--seed")           options->seed = strtoul(value, NULL, 0);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options->frames == 0 || options->maxSegment == 0)
+	{
+		fprintf(stderr, "--frames and --max-segment must be at least 1\n");
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	FuzzOptions options;
+
+	if (!parseOptions(argc, argv, &options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	std::mt19937 rng(options.seed);
+	std::vector<u8> stream;
+	std::deque<ExpectedFrame> expected;
+	std::vector<u8> model(VIRTUAL_CHANNELS_SIZE, 0);
+	bool passed = true;
+
+	for (u32 i = 0; i < options.frames; i++)
+		addFrame(rng, stream, expected, model);
+
+	printf("%u frames, %u bytes\n", options.frames, (u32) stream.size());
+
+	for (int split = 0; split < SPLIT_COUNT; split++)
+		passed &= runSplit(options, stream, expected, model, split);
+
+	passed &= runGarbage(options, rng);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * joybus_wire.cpp
+ * A simulated DOL-011 cable
+ ***************************************************************************/
+
+#include "joybus_wire.h"
+
+#include <chrono>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+
+#define SI_CMD_STATUS 0x00
+#define SI_CMD_READ   0x14
+#define SI_CMD_WRITE  0x15
+#define SI_CMD_RESET  0xFF
+
+#define JOYSTAT_GENERAL_PURPOSE 0x10 // What the channel looks for to decide a GBA is plugged in
+
+#define IRQ_WAIT_MS 20 // A GBA that isn't taking interrupts (stuck in a long frame, say) doesn't hold the wii up for longer than this
+
+static JoybusWire *wires[4];
+static thread_local JoybusWire *gbaWire;
+
+u64 LinkSim_NowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void LinkSim_BusyWaitNs(u32 ns)
+{
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// A real GBA has its own CPU, so give the channel's threads a go when there are fewer cores than busy GBAs
+	do
+	{
+		sched_yield();
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+	while ((u64) (now.tv_sec - start.tv_sec) * 1000000000 + (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+JoybusWire::JoybusWire(const JoybusWireConfig &config, u32 seed) : config(config), joyCnt(0), joyRecv(0), joyTrans(0), rng(seed), irqPending(false)
+{
+}
+
+bool JoybusWire::ShouldDrop()
+{
+	if (config.dropRate <= 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(rngLock);
+	return std::uniform_real_distribution<double>(0, 1)(rng) < config.dropRate;
+}
+
+u32 JoybusWire::MaybeFlip(u32 word)
+{
+	if (config.flipRate <= 0)
+		return word;
+
+	std::lock_guard<std::mutex> lock(rngLock);
+	if (std::uniform_real_distribution<double>(0, 1)(rng) >= config.flipRate)
+		return word;
+
+	stats.flipped++;
+	return word ^ (1u << std::uniform_int_distribution<u32>(0, 31)(rng));
+}
+
+void JoybusWire::WaitOnWire()
+{
+	u32 delay = config.latencyUs;
+
+	if (config.jitterUs > 0)
+	{
+		std::lock_guard<std::mutex> lock(rngLock);
+		delay += std::uniform_int_distribution<u32>(0, config.jitterUs)(rng);
+	}
+
+	if (delay > 0)
+		usleep(delay);
+}
+
+u32 JoybusWire::Transfer(const u8 *out, u32 outLen, u8 *in, u32 inLen)
+{
+	stats.siCommands++;
+	WaitOnWire();
+
+	if (outLen == 0)
+		return WIRE_SI_ERROR_NO_RESPONSE;
+
+	if (ShouldDrop())
+	{
+		stats.dropped++;
+		return WIRE_SI_ERROR_NO_RESPONSE;
+	}
+
+	u8 joyStat = JOYSTAT_GENERAL_PURPOSE;
+
+	switch (out[0])
+	{
+		case SI_CMD_RESET:
+			joyCnt |= WIRE_JOYCNT_RESET;
+			// fall through
+		case SI_CMD_STATUS:
+		{
+			u8 res[3] = { 0x00, 0x04, joyStat };
+			memcpy(in, res, inLen < 3 ? inLen : 3);
+		} break;
+		case SI_CMD_READ:
+		{
+			u32 word = MaybeFlip(joyTrans.load());
+			u8 res[5] = { (u8) word, (u8) (word >> 8), (u8) (word >> 16), (u8) (word >> 24), joyStat };
+			memcpy(in, res, inLen < 5 ? inLen : 5);
+			joyCnt |= WIRE_JOYCNT_SEND;
+			stats.wordsFromGba++;
+			RaiseIrq();
+		} break;
+		case SI_CMD_WRITE:
+		{
+			if (outLen < 5)
+				return WIRE_SI_ERROR_NO_RESPONSE;
+
+			joyRecv = MaybeFlip((u32) (out[1] | out[2] << 8 | out[3] << 16 | out[4] << 24));
+			joyCnt |= WIRE_JOYCNT_RECV;
+			if (inLen > 0)
+				in[0] = joyStat;
+			stats.wordsToGba++;
+			RaiseIrq();
+		} break;
+		default:
+			return WIRE_SI_ERROR_NO_RESPONSE;
+	}
+
+	return 0;
+}
+
+void JoybusWire::RaiseIrq()
+{
+	if (!(joyCnt.load() & WIRE_JOYCNT_IRQ))
+		return;
+
+	std::unique_lock<std::mutex> lock(irqLock);
+	irqPending = true;
+	irqCond.notify_all();
+	irqCond.wait_for(lock, std::chrono::milliseconds(IRQ_WAIT_MS), [this] { return !irqPending; });
+}
+
+u64 JoybusWire::ServiceIrqs(u64 untilUs, void (*handler)(void))
+{
+	std::unique_lock<std::mutex> lock(irqLock);
+	u64 handlerUs = 0;
+
+	while (true)
+	{
+		u64 now = LinkSim_NowUs();
+
+		if (!irqPending && now < untilUs)
+			irqCond.wait_for(lock, std::chrono::microseconds(untilUs - now), [this] { return irqPending; });
+
+		if (irqPending)
+		{
+			// Still pending if the wii gave up waiting, a real GBA takes it as soon as it can too
+			lock.unlock();
+			u64 startUs = LinkSim_NowUs();
+			handler();
+			handlerUs += LinkSim_NowUs() - startUs;
+			lock.lock();
+			irqPending = false;
+			irqCond.notify_all();
+			continue;
+		}
+
+		if (LinkSim_NowUs() >= untilUs)
+			break;
+	}
+
+	return handlerUs;
+}
+
+u16 JoybusWire::ReadCnt()
+{
+	// The rest of the GBA's loop happens after the read, reading after the wait would leave a window for the wii that the hardware doesn't have
+	u16 value = joyCnt.load();
+	LinkSim_BusyWaitNs(config.gbaPollNs);
+	return value;
+}
+
+void JoybusWire::WriteCnt(u16 value)
+{
+	// Flags are cleared by writing 1, the irq enable bit is a normal bit
+	u16 current = joyCnt.load();
+	while (!joyCnt.compare_exchange_weak(current, (u16) ((current & WIRE_JOYCNT_FLAGS & ~value) | (value & WIRE_JOYCNT_IRQ))))
+		;
+}
+
+u32 JoybusWire::ReadData(int reg)
+{
+	return reg == GBA_JOY_REG_RECV ? joyRecv.load() : joyTrans.load();
+}
+
+void JoybusWire::WriteData(int reg, u32 value, u32 mask)
+{
+	std::atomic<u32> &data = reg == GBA_JOY_REG_RECV ? joyRecv : joyTrans;
+	u32 current = data.load();
+	while (!data.compare_exchange_weak(current, (current & ~mask) | (value & mask)))
+		;
+}
+
+void JoybusWire_Attach(int port, JoybusWire *wire)
+{
+	wires[port] = wire;
+}
+
+JoybusWire *JoybusWire_Get(int port)
+{
+	if (port < 0 || port > 3)
+		return NULL;
+
+	return wires[port];
+}
+
+void JoybusWire_BindGbaThread(JoybusWire *wire)
+{
+	gbaWire = wire;
+}
+
+// ======================= GBA register access (see include/global.h) ======================================================
+
+u16 GbaJoybus_ReadCnt(void)
+{
+	return gbaWire->ReadCnt();
+}
+
+void GbaJoybus_WriteCnt(u16 value)
+{
+	gbaWire->WriteCnt(value);
+}
+
+u32 GbaJoybus_ReadData(int reg)
+{
+	return gbaWire->ReadData(reg);
+}
+
+void GbaJoybus_WriteData(int reg, u32 value, u32 mask)
+{
+	gbaWire->WriteData(reg, value, mask);
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * joybus_wire.h
+ * A simulated DOL-011 cable. The wii side talks to it through SI_Transfer,
+ * the GBA side through the JOY registers. Each SI command can be given a
+ * latency, some random jitter, a chance of being lost and a chance of
+ * arriving with a bit flipped.
+ ***************************************************************************/
+
+#ifndef _JOYBUS_WIRE_H_
+#define _JOYBUS_WIRE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+
+#include "gccore.h"
+
+// JOYCNT bits as seen by the GBA
+#define WIRE_JOYCNT_RESET 0x01 // Master sent a reset
+#define WIRE_JOYCNT_RECV  0x02 // Master wrote to JOY_RECV (JOY_WRITE in constants/network.h)
+#define WIRE_JOYCNT_SEND  0x04 // Master read JOY_TRANS (JOY_READ in constants/network.h)
+#define WIRE_JOYCNT_FLAGS 0x07
+#define WIRE_JOYCNT_IRQ   0x40
+
+// Error bits reported back to the SI callback (same values as the channel's SI_ERROR_*)
+#define WIRE_SI_ERROR_NO_RESPONSE 0x0008
+
+struct JoybusWireConfig {
+	u32 latencyUs;  //!< Fixed time every SI command spends on the wire
+	u32 jitterUs;   //!< Up to this much extra time is randomly added to each SI command
+	double dropRate; //!< Chance (0-1) that an SI command never reaches the GBA
+	double flipRate; //!< Chance (0-1) that a word read from or written to the GBA has one bit flipped on the way
+	u32 gbaPollNs;  //!< Time the GBA spends on each read of JOYCNT (one iteration of its busy wait loops)
+};
+
+struct JoybusWireStats {
+	std::atomic<u32> siCommands{0};
+	std::atomic<u32> wordsToGba{0};
+	std::atomic<u32> wordsFromGba{0};
+	std::atomic<u32> dropped{0};
+	std::atomic<u32> flipped{0};
+};
+
+class JoybusWire {
+public:
+	JoybusWire(const JoybusWireConfig &config, u32 seed);
+
+	//!< Master side, performs one SI command. Returns the SI error bits (0 on success)
+	u32 Transfer(const u8 *out, u32 outLen, u8 *in, u32 inLen);
+
+	//!< Slave side register access
+	u16 ReadCnt();
+	void WriteCnt(u16 value);
+	u32 ReadData(int reg);
+	void WriteData(int reg, u32 value, u32 mask);
+
+	//!< Runs handler (the serial interrupt) on the calling GBA thread for every word the wii moves while WIRE_JOYCNT_IRQ is set,
+	//!< until untilUs. The wii waits for each one to be handled, the way it never gets ahead of a real GBA's interrupt.
+	//!< Returns the time spent in handler
+	u64 ServiceIrqs(u64 untilUs, void (*handler)(void));
+
+	const JoybusWireConfig &GetConfig() const { return config; }
+	JoybusWireStats &GetStats() { return stats; }
+
+private:
+	bool ShouldDrop();
+	u32 MaybeFlip(u32 word);
+	void WaitOnWire();
+	void RaiseIrq();
+
+	JoybusWireConfig config;
+	JoybusWireStats stats;
+
+	std::atomic<u16> joyCnt;
+	std::atomic<u32> joyRecv;
+	std::atomic<u32> joyTrans;
+
+	std::mutex rngLock;
+	std::mt19937 rng;
+
+	std::mutex irqLock;
+	std::condition_variable irqCond;
+	bool irqPending;
+};
+
+//!< Plug a wire into a gamecube port (or unplug it with NULL). SI_Transfer on that port then goes over the wire
+void JoybusWire_Attach(int port, JoybusWire *wire);
+JoybusWire *JoybusWire_Get(int port);
+
+//!< The GBA thread calling this will access the JOY registers of the given wire
+void JoybusWire_BindGbaThread(JoybusWire *wire);
+
+//!< Monotonic clock helpers shared by the simulator
+u64 LinkSim_NowUs();
+void LinkSim_BusyWaitNs(u32 ns);
+
+#endif
@@ -0,0 +1,350 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * libogc_host.cpp
+ * PC implementations of the libogc calls made by linkcableclient.c.
+ * Threads become pthreads, sockets become host sockets and SI transfers
+ * go over whichever simulated wire is plugged into the port.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <mutex>
+#include <vector>
+
+#include "gccore.h"
+#include "joybus_wire.h"
+
+// Layouts of the libogc network structures (see include/network.h)
+struct OgcInAddr {
+	u32 s_addr;
+};
+
+struct OgcSockaddrIn {
+	u8 sin_len;
+	u8 sin_family;
+	u16 sin_port;
+	OgcInAddr sin_addr;
+	s8 sin_zero[8];
+};
+
+struct OgcHostent {
+	char *h_name;
+	char **h_aliases;
+	u16 h_addrtype;
+	u16 h_length;
+	char **h_addr_list;
+};
+
+struct OgcPollsd {
+	s32 socket;
+	u32 events;
+	u32 revents;
+};
+
+#define OGC_AF_INET 2
+#define OGC_POLLIN 0x0001
+#define OGC_F_GETFL 3
+#define OGC_F_SETFL 4
+#define OGC_O_NONBLOCK 0x04
+
+static std::mutex threadsLock;
+static std::vector<pthread_t> threads;
+static std::vector<pthread_mutex_t *> mutexes;
+static std::vector<pthread_cond_t *> conds;
+
+// ======================= LWP ======================================================
+
+extern "C" s32 LWP_CreateThread(lwp_t *thethread, void* (*entry)(void *), void *arg, void *stackbase, u32 stack_size, u8 prio)
+{
+	(void)(stackbase);
+	(void)(stack_size);
+	(void)(prio);
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, entry, arg) != 0)
+		return -1;
+
+	std::lock_guard<std::mutex> lock(threadsLock);
+	threads.push_back(thread);
+	*thethread = (lwp_t) (threads.size() - 1);
+	return 0;
+}
+
+// pthreads can't be suspended from the outside. The channel only does this to a thread that is blocked on a socket, so doing nothing is equivalent
+extern "C" s32 LWP_SuspendThread(lwp_t thethread)
+{
+	(void)(thethread);
+	return 0;
+}
+
+extern "C" s32 LWP_ResumeThread(lwp_t thethread)
+{
+	(void)(thethread);
+	return 0;
+}
+
+extern "C" s32 LWP_JoinThread(lwp_t thethread, void **value_ptr)
+{
+	pthread_t thread;
+	{
+		std::lock_guard<std::mutex> lock(threadsLock);
+		if (thethread >= threads.size())
+			return -1;
+		thread = threads[thethread];
+	}
+	return pthread_join(thread, value_ptr);
+}
+
+// Handles are indexes into mutexes/conds, which are only ever added to
+extern "C" s32 LWP_MutexInit(mutex_t *mutex, bool use_recursive)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutex_t *hostMutex = new pthread_mutex_t;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, use_recursive ? PTHREAD_MUTEX_RECURSIVE : PTHREAD_MUTEX_NORMAL);
+	pthread_mutex_init(hostMutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	std::lock_guard<std::mutex> lock(threadsLock);
+	mutexes.push_back(hostMutex);
+	*mutex = (mutex_t) (mutexes.size() - 1);
+	return 0;
+}
+
+static pthread_mutex_t *getMutex(mutex_t mutex)
+{
+	std::lock_guard<std::mutex> lock(threadsLock);
+	return mutex < mutexes.size() ? mutexes[mutex] : NULL;
+}
+
+static pthread_cond_t *getCond(cond_t cond)
+{
+	std::lock_guard<std::mutex> lock(threadsLock);
+	return cond < conds.size() ? conds[cond] : NULL;
+}
+
+extern "C" s32 LWP_MutexLock(mutex_t mutex)
+{
+	pthread_mutex_t *hostMutex = getMutex(mutex);
+	return hostMutex != NULL ? pthread_mutex_lock(hostMutex) : -1;
+}
+
+extern "C" s32 LWP_MutexUnlock(mutex_t mutex)
+{
+	pthread_mutex_t *hostMutex = getMutex(mutex);
+	return hostMutex != NULL ? pthread_mutex_unlock(hostMutex) : -1;
+}
+
+extern "C" s32 LWP_CondInit(cond_t *cond)
+{
+	pthread_cond_t *hostCond = new pthread_cond_t;
+	pthread_cond_init(hostCond, NULL);
+
+	std::lock_guard<std::mutex> lock(threadsLock);
+	conds.push_back(hostCond);
+	*cond = (cond_t) (conds.size() - 1);
+	return 0;
+}
+
+extern "C" s32 LWP_CondSignal(cond_t cond)
+{
+	pthread_cond_t *hostCond = getCond(cond);
+	return hostCond != NULL ? pthread_cond_signal(hostCond) : -1;
+}
+
+extern "C" s32 LWP_CondTimedWait(cond_t cond, mutex_t mutex, const struct timespec *reltime)
+{
+	pthread_cond_t *hostCond = getCond(cond);
+	pthread_mutex_t *hostMutex = getMutex(mutex);
+
+	if (hostCond == NULL || hostMutex == NULL)
+		return -1;
+
+	if (reltime == NULL)
+		return pthread_cond_wait(hostCond, hostMutex);
+
+	struct timespec abstime;
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += reltime->tv_sec + (abstime.tv_nsec + reltime->tv_nsec) / 1000000000;
+	abstime.tv_nsec = (abstime.tv_nsec + reltime->tv_nsec) % 1000000000;
+
+	return pthread_cond_timedwait(hostCond, hostMutex, &abstime);
+}
+
+// ======================= Time ======================================================
+
+extern "C" u64 gettime(void)
+{
+	return LinkSim_NowUs();
+}
+
+// ======================= SI ======================================================
+
+extern "C" u32 SI_Transfer(s32 chan, void *out, u32 out_len, void *in, u32 in_len, SICallback cb, u32 us_delay)
+{
+	(void)(us_delay);
+
+	JoybusWire *wire = JoybusWire_Get(chan);
+	u32 res = WIRE_SI_ERROR_NO_RESPONSE;
+
+	if (wire != NULL)
+	{
+		res = wire->Transfer((const u8 *) out, out_len, (u8 *) in, in_len);
+	}
+	else
+	{
+		usleep(us_delay);
+		memset(in, 0, in_len);
+	}
+
+	if (cb != NULL)
+		cb((s32) res, 0);
+
+	return 1;
+}
+
+extern "C" u32 SI_GetTypeAsync(s32 chan, SICallback cb)
+{
+	// GBA as reported by libogc (see SI_GBA in linkcableclient.c)
+	u32 type = JoybusWire_Get(chan) != NULL ? 0x00040000 : 0;
+
+	if (cb != NULL)
+		cb(0, type);
+
+	return type;
+}
+
+// ======================= Network ======================================================
+
+extern "C" s32 if_config(char *local_ip, char *netmask, char *gateway, bool use_dhcp, int max_retries)
+{
+	(void)(use_dhcp);
+	(void)(max_retries);
+
+	strcpy(local_ip, "127.0.0.1");
+	strcpy(netmask, "255.0.0.0");
+	strcpy(gateway, "127.0.0.1");
+	return 0;
+}
+
+extern "C" s32 net_socket(u32 domain, u32 type, u32 protocol)
+{
+	(void)(domain);
+	(void)(type);
+	(void)(protocol);
+
+	int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	return sock < 0 ? -errno : sock;
+}
+
+extern "C" s32 net_connect(s32 s, void *addr, u32 addrlen)
+{
+	(void)(addrlen);
+
+	const OgcSockaddrIn *ogcAddr = (const OgcSockaddrIn *) addr;
+	struct sockaddr_in hostAddr;
+
+	memset(&hostAddr, 0, sizeof(hostAddr));
+	hostAddr.sin_family = AF_INET;
+	hostAddr.sin_port = ogcAddr->sin_port;
+	hostAddr.sin_addr.s_addr = ogcAddr->sin_addr.s_addr;
+
+	return connect(s, (struct sockaddr *) &hostAddr, sizeof(hostAddr)) < 0 ? -errno : 0;
+}
+
+extern "C" s32 net_recv(s32 s, void *mem, s32 len, u32 flags)
+{
+	ssize_t res = recv(s, mem, len, flags);
+	return res < 0 ? -errno : (s32) res;
+}
+
+extern "C" s32 net_send(s32 s, const void *data, s32 size, u32 flags)
+{
+	ssize_t res = send(s, data, size, flags | MSG_NOSIGNAL);
+	return res < 0 ? -errno : (s32) res;
+}
+
+extern "C" s32 net_close(s32 s)
+{
+	return close(s) < 0 ? -errno : 0;
+}
+
+extern "C" s32 net_poll(OgcPollsd *sds, s32 nsds, s32 timeout)
+{
+	std::vector<struct pollfd> fds(nsds);
+
+	for (s32 i = 0; i < nsds; i++)
+	{
+		fds[i].fd = sds[i].socket;
+		fds[i].events = sds[i].events & OGC_POLLIN ? POLLIN : 0;
+		fds[i].revents = 0;
+	}
+
+	int res = poll(fds.data(), nsds, timeout);
+	if (res < 0)
+		return -errno;
+
+	// Hang ups are reported as readable so the caller finds out from recv, the same as on the wii
+	for (s32 i = 0; i < nsds; i++)
+		sds[i].revents = fds[i].revents & (POLLIN | POLLHUP | POLLERR) ? OGC_POLLIN : 0;
+
+	return res;
+}
+
+// Only the non blocking flag means anything to the channel, so it's the only one translated
+extern "C" s32 net_fcntl(s32 s, u32 cmd, u32 flags)
+{
+	int hostFlags = fcntl(s, F_GETFL, 0);
+	if (hostFlags < 0)
+		return -errno;
+
+	if (cmd == OGC_F_GETFL)
+		return hostFlags & O_NONBLOCK ? OGC_O_NONBLOCK : 0;
+
+	if (cmd != OGC_F_SETFL)
+		return -EINVAL;
+
+	hostFlags = flags & OGC_O_NONBLOCK ? hostFlags | O_NONBLOCK : hostFlags & ~O_NONBLOCK;
+	return fcntl(s, F_SETFL, hostFlags) < 0 ? -errno : 0;
+}
+
+extern "C" OgcHostent *net_gethostbyname(const char *addrString)
+{
+	static OgcInAddr resolved;
+	static char *addrList[2];
+	static OgcHostent entry;
+
+	memset(&entry, 0, sizeof(entry));
+	addrList[0] = (char *) &resolved;
+	addrList[1] = NULL;
+	entry.h_addr_list = addrList;
+
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	// libogc never returns NULL for a lookup on a working network, it hands back an entry the caller rejects
+	if (getaddrinfo(addrString, NULL, &hints, &result) != 0 || result == NULL)
+		return &entry;
+
+	resolved.s_addr = ((struct sockaddr_in *) result->ai_addr)->sin_addr.s_addr;
+	entry.h_addrtype = OGC_AF_INET;
+	entry.h_length = sizeof(resolved);
+	freeaddrinfo(result);
+
+	return &entry;
+}
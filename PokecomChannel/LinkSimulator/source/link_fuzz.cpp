@@ -0,0 +1,920 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * link_fuzz.cpp
+ * Throws malformed commands at the channel's link code (linkcableclient.c)
+ * from pokeemerald's JOYBUS code, and malformed answers at it from a fake
+ * server, then checks a loopback still makes it through. Each input is a
+ * list of operations (see runInput). Built against libFuzzer when that's
+ * available, otherwise with its own driver that also reports how fast it goes.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "global.h"
+#include "net_conn_link.h"
+#include "constants/network.h"
+#include "joybus_wire.h"
+#include "net_protocol.h"
+
+extern "C" {
+	#include "linkcableclient.h"
+	#include "netframe.h"
+}
+
+#define FUZZ_PORT 0
+#define DEFAULT_FRAME_US 16743 // A real frame, the GBA side times blocks out in frames so shorter ones fail blocks the channel would have finished
+#define DEFAULT_POLL_NS 2000 // Same as the simulator, any quicker and the GBA gives up on words the channel is about to send
+#define MAX_OPS 32 // Operations taken from one input, anything after is ignored
+#define FRAMES_BETWEEN_BLOCKS 2 // Same gap the simulator's GBA leaves
+#define CANCEL_AFTER_FRAMES 180 // A player would have pressed B on a block still going after this many frames (a refused 0xFFFF byte send keeps going for half a minute)
+#define GBA_BUFFER_SIZE 0x10000 // Room for the biggest size a command can ask for
+#define LIVENESS_CHANNEL 0x10 // Same channel the simulator's loopback uses
+#define LIVENESS_BYTES 64
+#define LIVENESS_ATTEMPTS 40 // The channel may still be waiting on the server for a call when the input ends
+#define FAKE_SERVER_NAME "SN_Link Fuzz"
+#define MAX_RAW_ANSWER 8192 // Most a legacy (unframed) answer sends, whatever size it claims
+
+// The first byte of each operation, mod OP_COUNT
+enum {
+	OP_SEND, // NET_CONN_SEND_REQ to any channel with any size
+	OP_RECV, // NET_CONN_RECV_REQ
+	OP_TRAN, // NET_CONN_TRAN_REQ, the channel transmits to the fake server
+	OP_CALL, // NET_CONN_CALL_REQ, if the channel agreed to calls
+	OP_STRM, // NET_CONN_STRM_REQ, if the channel agreed to streams
+	OP_PINF, // NET_CONN_PINF_REQ with whatever is in the virtual channels
+	OP_CINF, // NET_CONN_CINF_REQ, after a block of any size (the size the channel uses for the address)
+	OP_LIFN, // NET_CONN_LIFN_REQ
+	OP_RAW, // Any command word at all
+	OP_HANDSHAKE, // NET_CONN_HANDSHAKE_REQ, or drop back to the legacy link mode
+	OP_SERVER, // Change how the fake server answers the next requests
+	OP_XCHG, // NET_CONN_XCHG_REQ, if the channel agreed to exchanges (the two blocks may well overlap)
+	OP_COUNT
+};
+
+// How the fake server answers anything that isn't part of connecting
+enum {
+	SERVER_ANSWER, // A 0x25 message to the channel and size the input asked for, even if it runs past the virtual channels
+	SERVER_OTHER, // A frame that isn't a 0x25 message
+	SERVER_TRUNCATED, // A header promising more than ever comes
+	SERVER_GARBAGE, // Bytes that don't start with a frame
+	SERVER_SILENT, // Never answers
+	SERVER_CLOSE, // Drops the connection
+	SERVER_MODE_COUNT
+};
+
+struct ServerBehaviour {
+	u8 mode;
+	u8 channel;
+	u16 size;
+	u8 fill;
+};
+
+struct OpStats {
+	u32 count;
+	u32 ok;
+	u32 checkFailed;
+	u32 errors;
+};
+
+struct FuzzOptions {
+	u32 runs;
+	u32 maxLength;
+	u32 seed;
+	u32 frameUs;
+	u32 pollNs;
+	bool legacyServer;
+	bool verbose;
+	std::vector<std::string> inputs;
+};
+
+static FuzzOptions options;
+static JoybusWire *wire;
+static u64 nextFrameUs;
+static u16 linkCaps;
+static u8 gbaBuffer[GBA_BUFFER_SIZE];
+static u8 gbaResponse[GBA_BUFFER_SIZE];
+static OpStats opStats[OP_COUNT];
+static u32 inputsRun;
+static u32 cancelledBlocks;
+static FILE *report = stdout;
+
+// ======================= Input ======================================================
+
+class FuzzInput {
+public:
+	FuzzInput(const u8 *data, size_t size) : data(data), size(size), pos(0) {}
+
+	bool Empty() const { return pos >= size; }
+
+	u8 Byte()
+	{
+		return pos < size ? data[pos++] : 0;
+	}
+
+	u16 Word()
+	{
+		u16 high = Byte();
+		return (u16) (high << 8 | Byte());
+	}
+
+	/* Mostly the sizes either side of a limit, the rest of the time anything up to just past the virtual channels */
+	u16 Size(u8 channel)
+	{
+		u16 channelLeft = (u16) (MAX_MSG_SIZE - channel * VIRTUAL_CHANNEL_SIZE);
+
+		switch (Byte() % 16)
+		{
+			case 0:  return 0;
+			case 1:  return 1;
+			case 2:  return 4;
+			case 3:  return NET_CONN_FRAME_SIZE + 1;
+			case 4:  return NET_CONN_STREAM_SEGMENT_SIZE;
+			case 5:  return MAX_MSG_SIZE - 1;
+			case 6:  return MAX_MSG_SIZE;
+			case 7:  return MAX_MSG_SIZE + 1;
+			case 8:  return 0xFFFF;
+			case 9:  return channelLeft - 1;
+			case 10: return channelLeft;
+			case 11: return channelLeft + 1;
+			case 12: return Byte();
+			default: return Word() % (MAX_MSG_SIZE + VIRTUAL_CHANNEL_SIZE); // Nothing the GBA needs long to send
+		}
+	}
+
+private:
+	const u8 *data;
+	size_t size;
+	size_t pos;
+};
+
+// ======================= Fake server ======================================================
+
+/*
+* Speaks just enough of the server's side of the connection (see CelioServer/tcpRequestManager.js) for the channel to
+* connect, then answers every other request the way the last OP_SERVER said to
+*/
+class FakeServer {
+public:
+	bool Start()
+	{
+		struct sockaddr_in addr;
+		socklen_t addrLen = sizeof(addr);
+
+		listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		if (listenFd < 0)
+			return false;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+
+		if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0
+		 || getsockname(listenFd, (struct sockaddr *) &addr, &addrLen) < 0)
+			return false;
+
+		port = ntohs(addr.sin_port);
+		behaviour.mode = SERVER_SILENT;
+		std::thread(&FakeServer::Run, this).detach();
+		return true;
+	}
+
+	u16 GetPort() const { return port; }
+
+	void SetBehaviour(const ServerBehaviour &next)
+	{
+		std::lock_guard<std::mutex> lock(behaviourLock);
+		behaviour = next;
+	}
+
+	void SetLegacy(bool value) { legacy = value; }
+
+private:
+	struct Client {
+		int fd;
+		bool negotiated; //!< Has asked for tagged requests (every channel does first)
+		bool pipelined;
+		std::vector<u8> in;
+	};
+
+	void Run()
+	{
+		std::vector<Client> clients;
+
+		while (true)
+		{
+			std::vector<struct pollfd> fds(1 + clients.size());
+
+			fds[0].fd = listenFd;
+			fds[0].events = POLLIN;
+			for (size_t i = 0; i < clients.size(); i++)
+			{
+				fds[i + 1].fd = clients[i].fd;
+				fds[i + 1].events = POLLIN;
+			}
+
+			if (poll(fds.data(), fds.size(), 10) <= 0)
+				continue;
+
+			for (size_t i = clients.size(); i > 0; i--)
+			{
+				if (fds[i].revents && !Receive(clients[i - 1]))
+				{
+					close(clients[i - 1].fd);
+					clients.erase(clients.begin() + (i - 1));
+				}
+			}
+
+			if (fds[0].revents & POLLIN)
+			{
+				Client client;
+				client.fd = accept(listenFd, NULL, NULL);
+				client.negotiated = false;
+				client.pipelined = false;
+
+				if (client.fd >= 0)
+				{
+					Write(client.fd, (const u8 *) SERVER_GREETING, strlen(SERVER_GREETING));
+					clients.push_back(client);
+				}
+			}
+		}
+	}
+
+	/* Returns false once the client should be dropped */
+	bool Receive(Client &client)
+	{
+		u8 buffer[4096];
+		ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+
+		if (received <= 0)
+			return false;
+
+		client.in.insert(client.in.end(), buffer, buffer + received);
+
+		if (!client.negotiated)
+		{
+			if (client.in.size() < strlen(PIPELINE_REQUEST))
+				return true;
+
+			// Older servers answer with a single 0, newer ones with a frame holding PL_ and their version
+			client.negotiated = true;
+			client.pipelined = !legacy && memcmp(client.in.data(), PIPELINE_REQUEST, strlen(PIPELINE_REQUEST)) == 0;
+			client.in.erase(client.in.begin(), client.in.begin() + strlen(PIPELINE_REQUEST));
+
+			if (client.pipelined)
+			{
+				u8 answer[sizeof(PIPELINE_REQUEST)];
+				memcpy(answer, PIPELINE_REQUEST, strlen(PIPELINE_REQUEST));
+				answer[strlen(PIPELINE_REQUEST)] = PIPELINE_VERSION;
+				Reply(client, 0, answer, sizeof(answer));
+			}
+			else
+			{
+				u8 zero = 0;
+				Write(client.fd, &zero, 1);
+			}
+		}
+
+		if (!client.pipelined)
+		{
+			// Unframed requests come one per read, like the real server assumes
+			bool keep = client.in.empty() || Answer(client, 0, client.in.data(), client.in.size());
+			client.in.clear();
+			return keep;
+		}
+
+		while (client.in.size() >= NF_HEADER_SIZE)
+		{
+			u16 size = (u16) (client.in[2] << 8 | client.in[3]);
+
+			if (client.in[0] != NF_REQUEST_MARK)
+				return false;
+
+			if (client.in.size() < NF_HEADER_SIZE + (size_t) size)
+				break;
+
+			std::vector<u8> body(client.in.begin() + NF_HEADER_SIZE, client.in.begin() + NF_HEADER_SIZE + size);
+			u8 tag = client.in[1];
+			client.in.erase(client.in.begin(), client.in.begin() + NF_HEADER_SIZE + size);
+
+			if (!Answer(client, tag, body.data(), body.size()))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool Answer(Client &client, u8 tag, const u8 *request, size_t size)
+	{
+		std::vector<u8> answer;
+		ServerBehaviour next;
+
+		if (size >= REQUEST_PREFIX_SIZE && memcmp(request, SERVER_NAME_REQUEST, REQUEST_PREFIX_SIZE) == 0)
+		{
+			Reply(client, tag, (const u8 *) FAKE_SERVER_NAME, strlen(FAKE_SERVER_NAME));
+			return true;
+		}
+
+		if (size >= REQUEST_PREFIX_SIZE && memcmp(request, WELCOME_REQUEST, REQUEST_PREFIX_SIZE) == 0)
+		{
+			answer.assign(NF_MSG_HEADER_SIZE + WELCOME_ANSWER_SIZE, 0xFF);
+			WriteMessageHeader(answer.data(), SERVER_ANSWER_CHANNEL, WELCOME_ANSWER_SIZE);
+			Reply(client, tag, answer.data(), answer.size());
+			return true;
+		}
+
+		if (size >= REQUEST_PREFIX_SIZE && memcmp(request, SEND_PLAYER_DATA, REQUEST_PREFIX_SIZE) == 0)
+			return true;
+
+		{
+			std::lock_guard<std::mutex> lock(behaviourLock);
+			next = behaviour;
+		}
+
+		switch (next.mode)
+		{
+			case SERVER_ANSWER:
+			{
+				// The size in the message is what the input asked for, the payload is only what fits in a frame
+				u32 payload = std::min<u32>(next.size, client.pipelined ? NF_MAX_BODY_SIZE - NF_MSG_HEADER_SIZE : MAX_RAW_ANSWER);
+				answer.assign(NF_MSG_HEADER_SIZE + payload, next.fill);
+				WriteMessageHeader(answer.data(), next.channel, next.size);
+				Reply(client, tag, answer.data(), answer.size());
+				return true;
+			}
+			case SERVER_OTHER:
+				answer.assign(next.size % NF_MAX_OTHER_SIZE * 2 + 1, next.fill);
+				Reply(client, tag, answer.data(), answer.size());
+				return true;
+			case SERVER_TRUNCATED:
+			{
+				u8 header[NF_HEADER_SIZE + NF_MSG_HEADER_SIZE];
+				u32 length = NF_MSG_HEADER_SIZE;
+
+				if (client.pipelined)
+					length += NF_writeHeader(header, NF_RESPONSE_MARK, tag, (u16) (next.size + NF_MSG_HEADER_SIZE));
+
+				WriteMessageHeader(&header[length - NF_MSG_HEADER_SIZE], next.channel, next.size);
+				Write(client.fd, header, length);
+				return true;
+			}
+			case SERVER_GARBAGE:
+				answer.assign(next.size % 64 + 1, next.fill);
+				Write(client.fd, answer.data(), answer.size());
+				return true;
+			case SERVER_CLOSE:
+				return false;
+			default:
+				return true;
+		}
+	}
+
+	static void WriteMessageHeader(u8 *out, u8 channel, u16 size)
+	{
+		out[0] = NF_MSG_ID;
+		out[1] = channel;
+		out[2] = size >> 8;
+		out[3] = size & 0xFF;
+		out[4] = '_';
+	}
+
+	void Reply(Client &client, u8 tag, const u8 *body, size_t size)
+	{
+		if (client.pipelined)
+		{
+			u8 header[NF_HEADER_SIZE];
+			NF_writeHeader(header, NF_RESPONSE_MARK, tag, (u16) size);
+			Write(client.fd, header, sizeof(header));
+		}
+
+		Write(client.fd, body, size);
+	}
+
+	static void Write(int fd, const u8 *data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+			if (sent <= 0)
+				return;
+
+			data += sent;
+			size -= sent;
+		}
+	}
+
+	int listenFd = -1;
+	u16 port = 0;
+	std::atomic<bool> legacy{false};
+	std::mutex behaviourLock;
+	ServerBehaviour behaviour;
+};
+
+static FakeServer server;
+
+// ======================= GBA ======================================================
+
+bool32 NetConnLink_CheckCanceled(u8 taskId)
+{
+	(void)(taskId);
+	return FALSE;
+}
+
+/* Same as SimGba::WaitForNextFrame, the serial interrupt only gets its turn while the GBA waits for vblank */
+static void waitForNextFrame()
+{
+	u64 now = LinkSim_NowUs();
+
+	if (nextFrameUs == 0)
+		nextFrameUs = now;
+
+	while (nextFrameUs <= now)
+		nextFrameUs += options.frameUs;
+
+	wire->ServiceIrqs(nextFrameUs, NetConnLink_SerialIntr);
+}
+
+static void handshake(bool legacy)
+{
+	waitForNextFrame();
+	JOY_TRANS = 0;
+
+	// Pretending to be an older ROM is just not asking, the channel drops back to legacy on the next plain command.
+	// The game forgets its caps the same way when a new connection starts, otherwise a lost answer keeps the old ones
+	if (legacy)
+		NetConnLink_ForgetCaps();
+	linkCaps = legacy ? 0 : NetConnLink_Handshake(0);
+	NetConnLink_SetBackground(TRUE);
+}
+
+enum { BLOCK_SEND, BLOCK_RECEIVE, BLOCK_CALL, BLOCK_STREAM, BLOCK_EXCHANGE };
+
+/* One attempt at a block, the way Task_NetworkTaskLoop makes it (the game would retry, the next operation is our retry) */
+static u8 runBlock(int kind, u16 cmd, u8 *data, u16 length, bool disableChecks, u16 recvCmd = 0, u16 responseLength = 0)
+{
+	u16 streamOffset = 0;
+	u32 busyFrames = 0;
+	u8 result;
+
+	waitForNextFrame();
+
+	if (kind == BLOCK_STREAM)
+		result = NetConnLink_StreamBlock(cmd, data, length, &streamOffset, 0);
+	else if (kind == BLOCK_CALL)
+		result = NetConnLink_CallBlock(cmd, data, length, recvCmd, gbaResponse, responseLength, 0);
+	else if (kind == BLOCK_EXCHANGE)
+		result = NetConnLink_ExchangeBlock(cmd, data, length, recvCmd, gbaResponse, responseLength, 0);
+	else if (kind == BLOCK_RECEIVE)
+		result = NetConnLink_ReceiveBlock(cmd, data, length, disableChecks, 0);
+	else
+		result = NetConnLink_TransferBlock(cmd, data, length, disableChecks, 0);
+
+	while (result == NET_CONN_LINK_BUSY)
+	{
+		if (++busyFrames > CANCEL_AFTER_FRAMES)
+		{
+			NetConnLink_StopBlock();
+			cancelledBlocks++;
+			result = NET_CONN_LINK_ERROR;
+			break;
+		}
+
+		waitForNextFrame();
+		result = NetConnLink_PollBlock();
+	}
+
+	// NET_CONN_STATE_ERROR clears JOY_TRANS before starting again
+	if (result == NET_CONN_LINK_ERROR)
+		JOY_TRANS = 0;
+
+	for (u32 frame = 0; frame < FRAMES_BETWEEN_BLOCKS; frame++)
+		waitForNextFrame();
+
+	return result;
+}
+
+static void recordResult(int op, u8 result)
+{
+	opStats[op].count++;
+
+	if (result == NET_CONN_LINK_OK)
+		opStats[op].ok++;
+	else if (result == NET_CONN_LINK_CHECK_FAILED)
+		opStats[op].checkFailed++;
+	else
+		opStats[op].errors++;
+}
+
+/* Puts data the same size the block asks for in the GBA's buffer, some of it from the input */
+static void fillGbaBuffer(FuzzInput &input, u16 length)
+{
+	u8 seed = input.Byte();
+
+	for (u32 i = 0; i < length; i++)
+		gbaBuffer[i] = (u8) (seed + i * 31);
+}
+
+static void runInput(const u8 *data, size_t size)
+{
+	FuzzInput input(data, size);
+
+	// The first byte picks how the fake server speaks, so both ways of reading answers are covered
+	server.SetLegacy(options.legacyServer || (input.Byte() & 1));
+
+	for (u32 ops = 0; ops < MAX_OPS && !input.Empty(); ops++)
+	{
+		int op = input.Byte() % OP_COUNT;
+		u8 channel = input.Byte();
+		u16 length = input.Size(channel);
+		bool disableChecks = input.Byte() & 1;
+		u8 result = NET_CONN_LINK_OK;
+
+		switch (op)
+		{
+			case OP_SEND:
+				fillGbaBuffer(input, length);
+				result = runBlock(BLOCK_SEND, NET_CONN_SEND_REQ | channel, gbaBuffer, length, disableChecks);
+				break;
+			case OP_RECV:
+				result = runBlock(BLOCK_RECEIVE, NET_CONN_RECV_REQ | channel, gbaBuffer, length, disableChecks);
+				break;
+			case OP_TRAN:
+				// The size is how much of the virtual channels to transmit, the way the game's trade asks
+				fillGbaBuffer(input, length);
+				result = runBlock(BLOCK_SEND, NET_CONN_TRAN_REQ | channel, gbaBuffer, length, disableChecks);
+				break;
+			case OP_CALL:
+			{
+				if (!(linkCaps & NET_CONN_LINK_CAP_CALL))
+					continue;
+
+				u8 recvChannel = input.Byte();
+				u16 responseLength = input.Size(recvChannel);
+				fillGbaBuffer(input, length);
+				result = runBlock(BLOCK_CALL, NET_CONN_CALL_REQ | channel, gbaBuffer, length, false, NET_CONN_RECV_REQ | recvChannel, responseLength);
+				break;
+			}
+			case OP_STRM:
+				if (!(linkCaps & NET_CONN_LINK_CAP_STREAM))
+					continue;
+
+				result = runBlock(BLOCK_STREAM, NET_CONN_STRM_REQ | channel, gbaBuffer, length, false);
+				break;
+			case OP_PINF:
+				result = runBlock(BLOCK_SEND, NET_CONN_PINF_REQ, gbaBuffer, 0, disableChecks);
+				break;
+			case OP_CINF:
+				// The channel takes the address's length from the last block, even one it refused
+				fillGbaBuffer(input, length);
+				runBlock(BLOCK_SEND, NET_CONN_SEND_REQ, gbaBuffer, length, disableChecks);
+				result = runBlock(BLOCK_SEND, NET_CONN_CINF_REQ, gbaBuffer, 0, disableChecks);
+				break;
+			case OP_LIFN:
+				result = runBlock(BLOCK_RECEIVE, NET_CONN_LIFN_REQ, gbaBuffer, 4, true);
+				break;
+			case OP_RAW:
+			{
+				u16 cmd = (u16) (channel << 8 | input.Byte());
+				fillGbaBuffer(input, length);
+				result = runBlock(disableChecks ? BLOCK_RECEIVE : BLOCK_SEND, cmd, gbaBuffer, length, disableChecks);
+				break;
+			}
+			case OP_HANDSHAKE:
+				handshake(disableChecks);
+				break;
+			case OP_XCHG:
+			{
+				if (!(linkCaps & NET_CONN_LINK_CAP_DUPLEX))
+					continue;
+
+				u8 recvChannel = input.Byte();
+				u16 responseLength = input.Size(recvChannel);
+				fillGbaBuffer(input, length);
+				result = runBlock(BLOCK_EXCHANGE, NET_CONN_XCHG_REQ | channel, gbaBuffer, length, false, NET_CONN_RECV_REQ | recvChannel, responseLength);
+				break;
+			}
+			case OP_SERVER:
+			{
+				ServerBehaviour next;
+				next.mode = input.Byte() % SERVER_MODE_COUNT;
+				next.channel = channel;
+				next.size = length;
+				next.fill = input.Byte();
+				server.SetBehaviour(next);
+				break;
+			}
+		}
+
+		recordResult(op, result);
+	}
+}
+
+/* A loopback through a channel the input may have left in any state. The fake server stops answering first, so it can't write over it */
+static bool linkAlive()
+{
+	static const ServerBehaviour silent = { SERVER_SILENT, 0, 0, 0 };
+	u8 sent[LIVENESS_BYTES];
+
+	server.SetBehaviour(silent);
+
+	for (u32 i = 0; i < LIVENESS_BYTES; i++)
+		sent[i] = (u8) (i * 29 + inputsRun);
+
+	for (u32 attempt = 0; attempt < LIVENESS_ATTEMPTS; attempt++)
+	{
+		handshake(false);
+		memcpy(gbaBuffer, sent, sizeof(sent));
+		memset(gbaResponse, 0, sizeof(sent));
+
+		if (runBlock(BLOCK_SEND, NET_CONN_SEND_REQ | LIVENESS_CHANNEL, gbaBuffer, sizeof(sent), false) == NET_CONN_LINK_OK
+		 && runBlock(BLOCK_RECEIVE, NET_CONN_RECV_REQ | LIVENESS_CHANNEL, gbaResponse, sizeof(sent), false) == NET_CONN_LINK_OK
+		 && memcmp(sent, gbaResponse, sizeof(sent)) == 0)
+			return true;
+
+		// Whatever the channel was doing (waiting on the server for a call, say) it should have given up within a few frames
+		for (u32 frame = 0; frame < 30; frame++)
+			waitForNextFrame();
+	}
+
+	return false;
+}
+
+// ======================= Harness ======================================================
+
+static bool startHarness()
+{
+	static JoybusWireConfig config;
+	char address[32];
+
+	config.gbaPollNs = options.pollNs;
+	wire = new JoybusWire(config, options.seed);
+	JoybusWire_Attach(FUZZ_PORT, wire);
+	JoybusWire_BindGbaThread(wire);
+
+	if (!server.Start())
+	{
+		fprintf(stderr, "Could not start the fake server: %s\n", strerror(errno));
+		return false;
+	}
+
+	snprintf(address, sizeof(address), "127.0.0.1:%u", server.GetPort());
+	setOverrideAddress(address);
+	setupGBAConnectors();
+
+	while (!isConnected(FUZZ_PORT))
+		usleep(1000);
+
+	// Connect to the fake server once to start with (the address is overridden, so any will do), later CINFs connect again
+	for (u32 attempt = 0; attempt < LIVENESS_ATTEMPTS; attempt++)
+	{
+		handshake(false);
+		memset(gbaBuffer, 0, 16);
+
+		if (runBlock(BLOCK_SEND, NET_CONN_SEND_REQ, gbaBuffer, 16, false) == NET_CONN_LINK_OK
+		 && runBlock(BLOCK_SEND, NET_CONN_CINF_REQ, gbaBuffer, 0, false) == NET_CONN_LINK_OK)
+			return true;
+	}
+
+	fprintf(stderr, "The channel never took the server's address\n");
+	return false;
+}
+
+/* Runs one input and checks the link survived it */
+static bool fuzzOne(const u8 *data, size_t size)
+{
+	runInput(data, size);
+	inputsRun++;
+	return linkAlive();
+}
+
+#ifdef LINKFUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	(void)(argc);
+	(void)(argv);
+	options.seed = 1;
+	options.frameUs = DEFAULT_FRAME_US;
+	options.pollNs = DEFAULT_POLL_NS;
+
+	if (!startHarness())
+		abort();
+
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	if (!fuzzOne(data, size))
+	{
+		fprintf(stderr, "The link did not come back after this input\n");
+		abort();
+	}
+
+	return 0;
+}
+
+#else
+
+static void printUsage(const char *name)
+{
+	printf("Usage: %s [options] [input files]\n", name);
+	printf("  --runs N          random inputs to run when no input files are given (default 500)\n");
+	printf("  --max-length N    longest random input in bytes (default 96)\n");
+	printf("  --seed N          seed for the inputs (default 1)\n");
+	printf("  --frame-us US     length of a GBA frame (default %d)\n", DEFAULT_FRAME_US);
+	printf("  --poll-ns NS      time the GBA spends per JOYCNT poll (default %d)\n", DEFAULT_POLL_NS);
+	printf("  --legacy-server   the fake server never agrees to tagged requests\n");
+	printf("  --verbose         leave the channel's own logging on\n");
+	printf("Input files are run once each, as libFuzzer would (e.g. to reproduce a failure this wrote out)\n");
+}
+
+static bool parseOptions(int argc, char **argv)
+{
+	options.runs = 500;
+	options.maxLength = 96;
+	options.seed = 1;
+	options.frameUs = DEFAULT_FRAME_US;
+	options.pollNs = DEFAULT_POLL_NS;
+	options.legacyServer = false;
+	options.verbose = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (arg.compare(0, 2, "--") != 0)
+		{
+			options.inputs.push_back(arg);
+			continue;
+		}
+
+		if (arg == "--legacy-server")
+		{
+			options.legacyServer = true;
+			continue;
+		}
+
+		if (arg == "--verbose")
+		{
+			options.verbose = true;
+			continue;
+		}
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return false;
+		}
+
+		i++;
+
+		if (arg == "--runs")              options.runs = strtoul(value, NULL, 0);
+		else if (arg == "--max-length")   options.maxLength = strtoul(value, NULL, 0);
+		else if (arg == "--seed")         options.seed = strtoul(value, NULL, 0);
+		else if (arg == "--frame-us")     options.frameUs = strtoul(value, NULL, 0);
+		else if (arg == "--poll-ns")      options.pollNs = strtoul(value, NULL, 0);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options.maxLength == 0 || options.frameUs == 0)
+	{
+		fprintf(stderr, "--max-length and --frame-us must be at least 1\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool readInput(const std::string &path, std::vector<u8> &data)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	u8 buffer[4096];
+	size_t read;
+
+	if (file == NULL)
+		return false;
+
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+
+	fclose(file);
+	return true;
+}
+
+/* Keeps an input the link didn't survive, so it can be run again on its own */
+static void saveFailure(const std::vector<u8> &data, u32 failures)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "linkfuzz-failure-%u.bin", failures);
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+		return;
+
+	fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+	fprintf(report, "input %u: the link did not come back, saved to %s\n", inputsRun, path);
+}
+
+static const char *opNames[OP_COUNT] = { "SEND", "RECV", "TRAN", "CALL", "STRM", "PINF", "CINF", "LIFN", "RAW", "HAND", "SERVER", "XCHG" };
+
+static void printReport(u64 elapsedUs, u32 failures)
+{
+	double seconds = elapsedUs / 1000000.0;
+
+	fprintf(report, "\nOP          COUNT       OK  CHK_FAIL   ERRORS\n");
+	for (int op = 0; op < OP_COUNT; op++)
+		fprintf(report, "%-8s %8u %8u  %8u %8u\n", opNames[op], opStats[op].count, opStats[op].ok, opStats[op].checkFailed, opStats[op].errors);
+
+	fprintf(report, "\n%u inputs in %.1f s (%.2f inputs/s), %u blocks cancelled, %u inputs the link did not come back from\n",
+		inputsRun, seconds, seconds > 0 ? inputsRun / seconds : 0, cancelledBlocks, failures);
+}
+
+int main(int argc, char **argv)
+{
+	if (!parseOptions(argc, argv))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	// The channel logs every command to stdout, keep the report on its own unless asked
+	if (!options.verbose)
+	{
+		report = fdopen(dup(STDOUT_FILENO), "w");
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+
+	if (!startHarness())
+		return 1;
+
+	std::mt19937 rng(options.seed);
+	u32 failures = 0;
+	u64 startUs = LinkSim_NowUs();
+	u32 runs = options.inputs.empty() ? options.runs : (u32) options.inputs.size();
+
+	for (u32 run = 0; run < runs; run++)
+	{
+		std::vector<u8> data;
+
+		if (!options.inputs.empty())
+		{
+			if (!readInput(options.inputs[run], data))
+			{
+				fprintf(stderr, "Could not read %s\n", options.inputs[run].c_str());
+				return 1;
+			}
+		}
+		else
+		{
+			data.resize(1 + rng() % options.maxLength);
+			for (u8 &byte : data)
+				byte = (u8) rng();
+		}
+
+		if (!fuzzOne(data.data(), data.size()))
+			saveFailure(data, ++failures);
+
+		if ((run + 1) % 100 == 0)
+			fprintf(report, "%u inputs, %u failures\n", run + 1, failures);
+		fflush(report);
+	}
+
+	printReport(LinkSim_NowUs() - startUs, failures);
+	fprintf(report, "\n%s\n", failures == 0 ? "LINK SURVIVED EVERY INPUT" : "SOME INPUTS BROKE THE LINK");
+	fflush(report);
+
+	// The channel's threads never exit, so don't wait for them
+	_exit(failures == 0 ? 0 : 1);
+}
+
+#endif
@@ -0,0 +1,774 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * link_replay.cpp
+ * Plays a session recorded by the channel (see trace.h) back through the
+ * channel's link code (linkcableclient.c) from pokeemerald's JOYBUS code,
+ * against a running CelioServer, at the speed it was recorded or faster.
+ * The replay is recorded too, and both are summarised the same way so a
+ * change to the channel can be checked against real sessions.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "global.h"
+#include "constants/network.h"
+#include "joybus_wire.h"
+#include "sim_gba.h"
+
+extern "C" {
+	#include "linkcableclient.h"
+	#include "telemetry.h"
+	#include "trace.h"
+}
+
+#define DEFAULT_FRAME_US 16743 // 59.73 fps
+#define RETRY_WINDOW_MS 250 // The same as SL_PACER_RETRY_WINDOW in seriallink.h
+#define REREAD_WINDOW_US 8000 // The gba puts a command up at most once a frame, the same one sooner than this is the channel reading it again
+
+struct ReplayOptions {
+	JoybusWireConfig wire;
+	u32 frameUs;
+	double speed; //!< 0 plays every command straight after the last one
+	double maxSlowdown; //!< 0 for no limit
+	bool dump;
+	std::string input;
+	std::string output;
+	std::string server;
+};
+
+struct TraceRecord {
+	u64 timeUs;
+	u8 type;
+	u8 port;
+	u8 source;
+	std::vector<u8> data;
+};
+
+struct Trace {
+	std::vector<TraceRecord> records;
+	u32 lost;
+};
+
+//!< One command from the gba as the channel saw it, with any attempts the gba made again straight away folded in
+struct TraceCommand {
+	u8 command; //!< TL_CMD_*
+	u8 word[4]; //!< The command word as it came off the link
+	u8 recvWord[4]; //!< The receive command that follows a call's (or an exchange's) word
+	bool hasRecvWord;
+	std::vector<u8> data; //!< What the gba sent, for the commands that send anything
+	u64 startUs;
+	u64 endUs;
+	u32 attempts;
+	bool ended;
+	bool ok;
+};
+
+struct CommandSummary {
+	u32 commands;
+	u32 failed;
+	u32 attempts;
+	std::vector<u32> latencies; //!< From the first attempt to the end of the last, in us
+};
+
+struct NetSummary {
+	u32 connects;
+	u32 closes;
+	u64 bytesSent;
+	u64 bytesReceived;
+	std::vector<u32> roundTrips; //!< From a send to the next thing received, in us
+	std::string address;
+};
+
+struct PortResult {
+	u32 replayed;
+	u32 failed;
+	u32 skipped;
+};
+
+static void printUsage(const char *name)
+{
+	printf("Usage: %s [options] TRACE\n", name);
+	printf("  --server ADDR     address:port of a running CelioServer, used in place of the address in the trace\n");
+	printf("  --speed N         play the session back N times as fast as it was recorded, 0 for every command straight after the last (default 1)\n");
+	printf("  --out FILE        where the replay is recorded (default TRACE.replay)\n");
+	printf("  --max-slowdown F  fail if the replay's p90 command latency is more than F times the recording's\n");
+	printf("  --dump            print every record in the trace and stop\n");
+	printf("  --latency US      time every SI command spends on the wire (default 0)\n");
+	printf("  --jitter US       up to this much extra time is added to each SI command (default 0)\n");
+	printf("  --poll-ns NS      time the GBA spends per JOYCNT poll (default 2000)\n");
+	printf("  --frame-us US     length of a GBA frame (default %d)\n", DEFAULT_FRAME_US);
+}
+
+static bool parseOptions(int argc, char **argv, ReplayOptions *options)
+{
+	options->wire.latencyUs = 0;
+	options->wire.jitterUs = 0;
+	options->wire.dropRate = 0;
+	options->wire.flipRate = 0;
+	options->wire.gbaPollNs = 2000;
+	options->frameUs = DEFAULT_FRAME_US;
+	options->speed = 1;
+	options->maxSlowdown = 0;
+	options->dump = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (arg == "--dump")
+		{
+			options->dump = true;
+			continue;
+		}
+
+		if (arg.compare(0, 2, "--") != 0)
+		{
+			options->input = arg;
+			continue;
+		}
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return false;
+		}
+
+		i++;
+
+		if (arg == "--server")            options->server = value;
+		else if (arg == "--speed")        options->speed = strtod(value, NULL);
+		else if (arg == "--out")          options->output = value;
+		else if (arg == "--max-slowdown") options->maxSlowdown = strtod(value, NULL);
+		else if (arg == "--latency")      options->wire.latencyUs = strtoul(value, NULL, 10);
+		else if (arg == "--jitter")       options->wire.jitterUs = strtoul(value, NULL, 10);
+		else if (arg == "--poll-ns")      options->wire.gbaPollNs = strtoul(value, NULL, 10);
+		else if (arg == "--frame-us")     options->frameUs = strtoul(value, NULL, 10);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options->input.empty() || options->speed < 0)
+		return false;
+
+	if (options->output.empty())
+		options->output = options->input + ".replay";
+
+	return true;
+}
+
+// ======================= Reading a trace ======================================================
+
+static u16 getU16(const u8 *in)
+{
+	return (u16) (in[0] | in[1] << 8);
+}
+
+static u32 getU32(const u8 *in)
+{
+	return (u32) getU16(in) | (u32) getU16(&in[2]) << 16;
+}
+
+static const char *getRecordName(u8 type)
+{
+	static const char *names[TR_RECORD_COUNT] = { "SI_READ", "SI_READ_FAILED", "SI_WRITE", "SI_WRITE_FAILED", "COMMAND_START", "COMMAND_END",
+	                                              "BLOCK_DATA", "TCP_CONNECT", "TCP_SEND", "TCP_RECV", "TCP_CLOSE", "LOST" };
+
+	return type < TR_RECORD_COUNT ? names[type] : "?";
+}
+
+/* Reads the whole of a trace in time order. Returns false if it isn't one */
+static bool readTrace(const char *path, Trace *trace)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open %s\n", path);
+		return false;
+	}
+
+	std::vector<u8> bytes;
+	u8 buffer[4096];
+	size_t read;
+
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + read);
+
+	fclose(file);
+
+	if (bytes.size() < TR_FILE_HEADER_SIZE || memcmp(bytes.data(), TR_MAGIC, 4) != 0 || getU16(&bytes[4]) != TR_VERSION)
+	{
+		fprintf(stderr, "%s is not a version %d trace\n", path, TR_VERSION);
+		return false;
+	}
+
+	// The times are 32 bit, so each ring's are unwrapped on their own (each ring is written in order)
+	u64 base[TR_PORTS][TR_SOURCE_COUNT] = {};
+	u32 last[TR_PORTS][TR_SOURCE_COUNT] = {};
+	size_t pos = TR_FILE_HEADER_SIZE;
+
+	trace->records.clear();
+	trace->lost = 0;
+
+	while (pos + TR_RECORD_HEADER_SIZE <= bytes.size())
+	{
+		const u8 *header = &bytes[pos];
+		u16 length = getU16(&header[6]);
+		TraceRecord record;
+
+		if (pos + TR_RECORD_HEADER_SIZE + length > bytes.size())
+			break;
+
+		record.type = header[4];
+		record.port = header[5] & 0xF;
+		record.source = header[5] >> 4;
+		record.data.assign(header + TR_RECORD_HEADER_SIZE, header + TR_RECORD_HEADER_SIZE + length);
+		pos += TR_RECORD_HEADER_SIZE + length;
+
+		if (record.port >= TR_PORTS || record.source >= TR_SOURCE_COUNT)
+			continue;
+
+		u32 time = getU32(header);
+		if (time < last[record.port][record.source])
+			base[record.port][record.source] += (u64) 1 << 32;
+		last[record.port][record.source] = time;
+		record.timeUs = base[record.port][record.source] + time;
+
+		if (record.type == TR_LOST && length >= 4)
+			trace->lost += getU32(record.data.data());
+
+		trace->records.push_back(record);
+	}
+
+	if (pos != bytes.size())
+		fprintf(stderr, "%s ends part way through a record, it was probably not stopped\n", path);
+
+	std::stable_sort(trace->records.begin(), trace->records.end(), [](const TraceRecord &a, const TraceRecord &b) { return a.timeUs < b.timeUs; });
+	return true;
+}
+
+static void dumpTrace(const Trace &trace)
+{
+	for (const TraceRecord &record : trace.records)
+	{
+		printf("%12.3f ms port %d %-6s %-16s %5u ", record.timeUs / 1000.0, record.port, record.source == TR_SOURCE_SERIAL ? "serial" : "net",
+		       getRecordName(record.type), (unsigned int) record.data.size());
+
+		if (record.type == TR_COMMAND_START && record.data.size() >= 3)
+			printf(" %s %u", TL_getCommandName(record.data[0]), (unsigned int) getU16(&record.data[1]));
+		else if (record.type == TR_TCP_CONNECT)
+			printf(" %.*s", (int) record.data.size(), (const char *) record.data.data());
+		else
+		{
+			for (size_t i = 0; i < record.data.size() && i < 16; i++)
+				printf(" %02X", record.data[i]);
+			if (record.data.size() > 16)
+				printf(" ...");
+		}
+
+		printf("\n");
+	}
+}
+
+// ======================= Commands ======================================================
+
+static bool isBlock(u8 command)
+{
+	return command == TL_CMD_SEND || command == TL_CMD_RECV || command == TL_CMD_CALL || command == TL_CMD_STRM || command == TL_CMD_XCHG;
+}
+
+/* The gba making the same command again, rather than a new one that happens to look the same */
+static bool isAttemptOf(const TraceCommand &command, const TraceCommand &last)
+{
+	if (last.command != command.command || memcmp(last.word, command.word, 4) != 0)
+		return false;
+
+	// A send with different data is a different request
+	if ((command.command == TL_CMD_SEND || command.command == TL_CMD_CALL) && last.ok && command.data != last.data)
+		return false;
+
+	return !last.ok || (isBlock(last.command) && command.startUs - last.endUs < RETRY_WINDOW_MS * 1000);
+}
+
+/*
+* Groups a port's serial records into the commands the gba made. The gba makes a command again when it failed, or when a
+* block's check bytes didn't match (which the channel can't tell, see checkForRepeatedBlock), and in framed link mode it
+* shakes hands again before it does. Those attempts are one command here, the same as SimGba counts them. A word command
+* the gba hasn't taken down yet is read again by the channel, those are left out altogether
+*/
+static std::vector<TraceCommand> getCommands(const Trace &trace, int port)
+{
+	std::vector<TraceCommand> attempts;
+	u8 lastRead[4] = {0};
+	TraceCommand *current = NULL;
+	bool reread = false;
+
+	for (const TraceRecord &record : trace.records)
+	{
+		if (record.port != port || record.source != TR_SOURCE_SERIAL)
+			continue;
+
+		switch (record.type)
+		{
+			case TR_SI_READ:
+			{
+				if (record.data.size() < 4)
+					break;
+
+				// The call's (or exchange's) receive command, once the gba has put it up
+				if (current != NULL && (current->command == TL_CMD_CALL || current->command == TL_CMD_XCHG) && !current->hasRecvWord && record.data[1] == NET_CONN_RECV_REQ >> 8)
+				{
+					memcpy(current->recvWord, record.data.data(), 4);
+					current->hasRecvWord = true;
+				}
+
+				memcpy(lastRead, record.data.data(), 4);
+			} break;
+			case TR_COMMAND_START:
+			{
+				if (record.data.empty())
+					break;
+
+				if (!isBlock(record.data[0]) && !attempts.empty() && attempts.back().command == record.data[0]
+				 && memcmp(attempts.back().word, lastRead, 4) == 0 && record.timeUs - attempts.back().endUs < REREAD_WINDOW_US)
+				{
+					current = NULL;
+					reread = true;
+					break;
+				}
+
+				TraceCommand command = {};
+				command.command = record.data[0];
+				memcpy(command.word, lastRead, 4);
+				command.startUs = record.timeUs;
+				command.endUs = record.timeUs;
+				command.attempts = 1;
+				attempts.push_back(command);
+				current = &attempts.back();
+			} break;
+			case TR_BLOCK_DATA:
+			{
+				if (current != NULL && record.data.size() >= 2)
+					current->data.assign(record.data.begin() + 2, record.data.end());
+			} break;
+			case TR_COMMAND_END:
+			{
+				if (reread || current == NULL)
+				{
+					reread = false;
+					break;
+				}
+
+				current->ok = !record.data.empty() && record.data[0] != 0;
+				current->ended = true;
+				current->endUs = record.timeUs;
+				current = NULL;
+			} break;
+			default:
+				break;
+		}
+	}
+
+	std::vector<TraceCommand> commands;
+
+	for (const TraceCommand &attempt : attempts)
+	{
+		// The last command that wasn't a handshake
+		size_t previous = commands.size();
+		while (previous > 0 && commands[previous - 1].command == TL_CMD_HAND)
+			previous--;
+
+		if (attempt.ended && previous > 0 && isAttemptOf(attempt, commands[previous - 1]))
+		{
+			commands.resize(previous);
+			TraceCommand &last = commands.back();
+			last.attempts++;
+			last.ok = attempt.ok;
+			last.endUs = attempt.endUs;
+			last.data = attempt.data;
+			last.hasRecvWord = attempt.hasRecvWord;
+			memcpy(last.recvWord, attempt.recvWord, 4);
+			continue;
+		}
+
+		commands.push_back(attempt);
+	}
+
+	return commands;
+}
+
+static void summarise(const std::vector<TraceCommand> &commands, CommandSummary summary[TL_CMD_COUNT])
+{
+	for (int i = 0; i < TL_CMD_COUNT; i++)
+		summary[i] = CommandSummary();
+
+	for (const TraceCommand &command : commands)
+	{
+		if (command.command >= TL_CMD_COUNT || !command.ended)
+			continue;
+
+		CommandSummary &entry = summary[command.command];
+		entry.commands++;
+		entry.attempts += command.attempts;
+
+		if (command.ok)
+			entry.latencies.push_back((u32) (command.endUs - command.startUs));
+		else
+			entry.failed++;
+	}
+
+	for (int i = 0; i < TL_CMD_COUNT; i++)
+		std::sort(summary[i].latencies.begin(), summary[i].latencies.end());
+}
+
+static NetSummary summariseNet(const Trace &trace, int port)
+{
+	NetSummary summary = NetSummary();
+	u64 sentAt = 0;
+
+	for (const TraceRecord &record : trace.records)
+	{
+		if (record.port != port || record.source != TR_SOURCE_NET)
+			continue;
+
+		if (record.type == TR_TCP_CONNECT)
+		{
+			summary.connects++;
+			summary.address.assign(record.data.begin(), record.data.end());
+		}
+		else if (record.type == TR_TCP_CLOSE)
+		{
+			summary.closes++;
+			sentAt = 0;
+		}
+		else if (record.type == TR_TCP_SEND)
+		{
+			summary.bytesSent += record.data.size();
+			if (sentAt == 0)
+				sentAt = record.timeUs;
+		}
+		else if (record.type == TR_TCP_RECV)
+		{
+			summary.bytesReceived += record.data.size();
+			if (sentAt != 0)
+				summary.roundTrips.push_back((u32) (record.timeUs - sentAt));
+			sentAt = 0;
+		}
+	}
+
+	std::sort(summary.roundTrips.begin(), summary.roundTrips.end());
+	return summary;
+}
+
+/* Nearest rank percentile in ms */
+static double getPercentile(const std::vector<u32> &sorted, u32 percentile)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t rank = (sorted.size() * percentile + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static std::vector<u32> getAllLatencies(const CommandSummary summary[TL_CMD_COUNT])
+{
+	std::vector<u32> all;
+
+	for (int i = 0; i < TL_CMD_COUNT; i++)
+		all.insert(all.end(), summary[i].latencies.begin(), summary[i].latencies.end());
+
+	std::sort(all.begin(), all.end());
+	return all;
+}
+
+static bool hasPort(const Trace &trace, int port)
+{
+	for (const TraceRecord &record : trace.records)
+		if (record.port == port && record.source == TR_SOURCE_SERIAL && record.type == TR_COMMAND_START)
+			return true;
+
+	return false;
+}
+
+// ======================= Replay ======================================================
+
+/* The game only shakes hands on a ROM with the framed link mode, and always before anything else */
+static bool isLegacy(const std::vector<TraceCommand> &commands)
+{
+	return commands.empty() || commands[0].command != TL_CMD_HAND;
+}
+
+static bool replayCommand(SimGba &gba, const TraceCommand &command)
+{
+	u16 cmd = (u16) (command.word[0] | command.word[1] << 8);
+	u16 length = getU16(&command.word[2]);
+	std::vector<u8> data(length > 0 ? length : 1, 0);
+	u8 status[4];
+
+	// A block the channel refused never had its data recorded, it goes out as zeroes
+	memcpy(data.data(), command.data.data(), std::min((size_t) length, command.data.size()));
+
+	switch (command.command)
+	{
+		case TL_CMD_SEND:
+			return gba.Send(cmd, data.data(), length);
+		case TL_CMD_RECV:
+			return gba.Receive(cmd, data.data(), length);
+		case TL_CMD_CALL:
+		{
+			if (!command.hasRecvWord)
+				return false;
+
+			u16 recvLength = getU16(&command.recvWord[2]);
+			std::vector<u8> response(recvLength > 0 ? recvLength : 1, 0);
+			return gba.Call(cmd, data.data(), length, (u16) (command.recvWord[0] | command.recvWord[1] << 8), response.data(), recvLength);
+		}
+		case TL_CMD_XCHG:
+		{
+			if (!command.hasRecvWord)
+				return false;
+
+			u16 recvLength = getU16(&command.recvWord[2]);
+			std::vector<u8> response(recvLength > 0 ? recvLength : 1, 0);
+			return gba.Exchange(cmd, data.data(), length, (u16) (command.recvWord[0] | command.recvWord[1] << 8), response.data(), recvLength);
+		}
+		case TL_CMD_STRM:
+			return gba.Stream(cmd, data.data(), length);
+		case TL_CMD_TRAN:
+			return gba.Send(cmd, NULL, length, true);
+		case TL_CMD_LIFN:
+			return gba.Receive(NET_CONN_LIFN_REQ, status, 4, true);
+		case TL_CMD_PINF:
+		case TL_CMD_CINF:
+			return gba.Send(cmd, NULL, 0);
+		case TL_CMD_HAND:
+			gba.Handshake();
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void replayPort(SimGba *gba, const std::vector<TraceCommand> *commands, const ReplayOptions *options, PortResult *result)
+{
+	u64 startedAt = LinkSim_NowUs();
+	u64 firstUs = commands->empty() ? 0 : (*commands)[0].startUs;
+
+	*result = PortResult();
+	gba->Handshake();
+
+	for (size_t i = 0; i < commands->size(); i++)
+	{
+		const TraceCommand &command = (*commands)[i];
+
+		// The handshake the game starts with was just made, a BCLR has no answer the game waits for
+		if ((i == 0 && command.command == TL_CMD_HAND) || command.command == TL_CMD_BCLR)
+		{
+			result->skipped++;
+			continue;
+		}
+
+		// Wait out the time the game spent between commands, a frame at a time like the game would
+		if (options->speed > 0)
+		{
+			u64 dueUs = startedAt + (u64) ((command.startUs - firstUs) / options->speed);
+			while (LinkSim_NowUs() + options->frameUs < dueUs)
+				gba->WaitFrames(1);
+		}
+
+		result->replayed++;
+		if (!replayCommand(*gba, command))
+			result->failed++;
+	}
+}
+
+// ======================= Report ======================================================
+
+static void printComparison(int port, const CommandSummary original[TL_CMD_COUNT], const CommandSummary replay[TL_CMD_COUNT])
+{
+	printf("\n=== PORT %d ===\n", port);
+	printf("%-6s | %8s %8s %8s %8s %8s | %8s %8s %8s %8s %8s\n", "", "RECORDED", "", "", "", "", "REPLAYED", "", "", "", "");
+	printf("%-6s | %8s %8s %8s %8s %8s | %8s %8s %8s %8s %8s\n", "CMD", "COUNT", "FAILED", "ATTEMPTS", "P50_MS", "P90_MS",
+	       "COUNT", "FAILED", "ATTEMPTS", "P50_MS", "P90_MS");
+
+	for (int i = 0; i < TL_CMD_COUNT; i++)
+	{
+		if (original[i].commands == 0 && replay[i].commands == 0)
+			continue;
+
+		printf("%-6s | %8u %8u %8u %8.1f %8.1f | %8u %8u %8u %8.1f %8.1f\n", TL_getCommandName((u8) i),
+		       original[i].commands, original[i].failed, original[i].attempts, getPercentile(original[i].latencies, 50), getPercentile(original[i].latencies, 90),
+		       replay[i].commands, replay[i].failed, replay[i].attempts, getPercentile(replay[i].latencies, 50), getPercentile(replay[i].latencies, 90));
+	}
+}
+
+static void printNet(const char *name, const NetSummary &summary)
+{
+	if (summary.connects == 0 && summary.bytesSent == 0)
+		return;
+
+	printf("%s server%s%s: %u connects, %u closes, %llu bytes sent, %llu received, round trip ms p50 %.1f, p90 %.1f over %u\n", name,
+	       summary.address.empty() ? "" : " ", summary.address.c_str(), summary.connects, summary.closes, (unsigned long long) summary.bytesSent,
+	       (unsigned long long) summary.bytesReceived, getPercentile(summary.roundTrips, 50), getPercentile(summary.roundTrips, 90),
+	       (unsigned int) summary.roundTrips.size());
+}
+
+int main(int argc, char **argv)
+{
+	ReplayOptions options;
+	Trace original;
+
+	if (!parseOptions(argc, argv, &options))
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	if (!readTrace(options.input.c_str(), &original))
+		return 2;
+
+	if (options.dump)
+	{
+		dumpTrace(original);
+		return 0;
+	}
+
+	if (original.lost > 0)
+		printf("The trace is missing %u records, the channel couldn't write it out fast enough\n", (unsigned int) original.lost);
+
+	std::vector<int> ports;
+	std::vector<std::vector<TraceCommand>> commands(TR_PORTS);
+	bool connects = false;
+
+	for (int port = 0; port < TR_PORTS; port++)
+	{
+		if (!hasPort(original, port))
+			continue;
+
+		ports.push_back(port);
+		commands[port] = getCommands(original, port);
+		connects = connects || summariseNet(original, port).connects > 0;
+	}
+
+	if (ports.empty())
+	{
+		fprintf(stderr, "%s has no commands from a gba in it\n", options.input.c_str());
+		return 2;
+	}
+
+	if (connects && options.server.empty())
+	{
+		fprintf(stderr, "The session connected to a server, replaying it needs --server\n");
+		return 2;
+	}
+
+	std::vector<JoybusWire *> wires(TR_PORTS, NULL);
+	std::vector<SimGba *> gbas(TR_PORTS, NULL);
+	std::vector<PortResult> results(TR_PORTS);
+
+	for (int port : ports)
+	{
+		wires[port] = new JoybusWire(options.wire, 1 + port);
+		gbas[port] = new SimGba(port, wires[port], options.frameUs, isLegacy(commands[port]), true);
+		JoybusWire_Attach(port, wires[port]);
+	}
+
+	if (!options.server.empty())
+		setOverrideAddress((char *) options.server.c_str());
+
+	if (TR_start(options.output.c_str()) < 0)
+	{
+		fprintf(stderr, "Could not record the replay to %s\n", options.output.c_str());
+		return 2;
+	}
+
+	setupGBAConnectors();
+
+	while (true)
+	{
+		bool allConnected = true;
+		for (int port : ports)
+			allConnected = allConnected && isConnected(port);
+
+		if (allConnected)
+			break;
+
+		usleep(1000);
+	}
+
+	std::vector<std::thread> threads;
+	for (int port : ports)
+		threads.emplace_back(replayPort, gbas[port], &commands[port], &options, &results[port]);
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	if (TR_stop() < 0)
+	{
+		fprintf(stderr, "Could not write all of the replay to %s\n", options.output.c_str());
+		fflush(stdout);
+		_exit(2);
+	}
+
+	Trace replay;
+	if (!readTrace(options.output.c_str(), &replay))
+		_exit(2);
+
+	bool passed = true;
+	CommandSummary originalSummary[TL_CMD_COUNT];
+	CommandSummary replaySummary[TL_CMD_COUNT];
+
+	for (int port : ports)
+	{
+		summarise(commands[port], originalSummary);
+		summarise(getCommands(replay, port), replaySummary);
+		printComparison(port, originalSummary, replaySummary);
+		printNet("recorded", summariseNet(original, port));
+		printNet("replayed", summariseNet(replay, port));
+
+		std::vector<u32> originalAll = getAllLatencies(originalSummary);
+		std::vector<u32> replayAll = getAllLatencies(replaySummary);
+		double originalP90 = getPercentile(originalAll, 90);
+		double replayP90 = getPercentile(replayAll, 90);
+		u32 originalFailed = 0, replayFailed = 0;
+
+		for (int i = 0; i < TL_CMD_COUNT; i++)
+		{
+			originalFailed += originalSummary[i].failed;
+			replayFailed += replaySummary[i].failed;
+		}
+
+		printf("replayed %u commands (%u skipped), %u failed on the gba; p90 %.1f ms recorded, %.1f ms replayed\n", results[port].replayed,
+		       results[port].skipped, results[port].failed, originalP90, replayP90);
+
+		// The channel only knows a command failed from its side, the gba knows for sure
+		if (replayFailed > originalFailed || results[port].failed > originalFailed)
+			passed = false;
+
+		if (options.maxSlowdown > 0 && originalP90 > 0 && replayP90 > originalP90 * options.maxSlowdown)
+		{
+			printf("p90 is %.2f times the recording's, more than --max-slowdown\n", replayP90 / originalP90);
+			passed = false;
+		}
+	}
+
+	printf("\n%s\n", passed ? "REPLAY PASSED" : "REPLAY FAILED");
+
+	// The channel's threads never exit, so don't wait for them
+	fflush(stdout);
+	_exit(passed ? 0 : 1);
+}
@@ -0,0 +1,842 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * load_gen.cpp
+ * Opens lots of sessions against a CelioServer at once, each one connecting
+ * the way the channel does and then asking for what the game asks for, and
+ * reports how fast the server answered each kind of request.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+	#include "netframe.h"
+}
+
+#define MAX_EVENTS 256
+#define REPORT_INTERVAL_US 5000000
+
+// What is timed. CONNECT is from connect() to the answer to WELCOME_REQUEST, the rest from sending a request to its answer
+enum {
+	REQ_CONNECT,
+	REQ_BATTLE,
+	REQ_MART,
+	REQ_GIFT_EGG,
+	REQ_POST_MAIL,
+	REQ_READ_MAIL,
+	REQ_TRADE,
+	REQ_COUNT
+};
+
+static const char *requestNames[REQ_COUNT] = { "CONNECT", "BA", "MA", "GE", "PM", "RM", "TR" };
+
+enum {
+	SESSION_IDLE, // Waiting to connect, or to connect again after an error
+	SESSION_CONNECTING,
+	SESSION_GREETING, // Reading SERVER_GREETING
+	SESSION_PIPELINE, // Waiting for the answer to PIPELINE_REQUEST
+	SESSION_NAME, // Waiting for SN_
+	SESSION_WELCOME, // Waiting for the welcome message
+	SESSION_THINKING, // Connected, waiting to send the next request
+	SESSION_WAITING // Waiting for the answer to a request
+};
+
+struct LoadOptions {
+	std::string server;
+	u32 sessions;
+	u32 durationSec;
+	u32 thinkMs;
+	u32 rampMs;
+	u32 timeoutMs;
+	u32 seed;
+	std::vector<int> requests; //!< REQ_* each session goes round, in order
+};
+
+struct Session {
+	u32 index;
+	int fd;
+	u8 state;
+	u32 generation; //!< Bumped on every change of state, so timers set for an earlier one are ignored
+	u8 tag; //!< Tag of the request being waited on
+	int request; //!< REQ_* being waited on
+	u32 next; //!< Index into LoadOptions::requests of the next request
+	u64 startedAt; //!< When the request being waited on (or the connect) started
+	u32 greetingReceived;
+	std::vector<u8> out;
+	size_t outSent;
+	bool waitingForWrite; //!< If EPOLLOUT is being watched for
+	NFReader reader;
+	u8 virtualChannels[MAX_MSG_SIZE];
+};
+
+struct Timer {
+	u64 at;
+	u32 session;
+	u32 generation;
+
+	bool operator>(const Timer &other) const { return at > other.at; }
+};
+
+struct RequestStats {
+	u64 errors;
+	std::vector<u32> latencies; //!< us
+};
+
+static LoadOptions options;
+static sockaddr_in serverAddress;
+static int epollFd;
+static std::vector<Session *> sessions;
+static std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > timers;
+static RequestStats stats[REQ_COUNT];
+static std::mt19937 rng;
+static u64 startTime;
+static u64 endTime;
+static u32 connectedSessions;
+static u32 disconnects;
+
+static u64 nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void setTimer(Session *session, u64 at)
+{
+	Timer timer = { at, session->index, session->generation };
+	timers.push(timer);
+}
+
+static void setState(Session *session, u8 state)
+{
+	if (state == SESSION_THINKING && session->state != SESSION_WAITING)
+		connectedSessions++;
+	else if (state == SESSION_IDLE && (session->state == SESSION_THINKING || session->state == SESSION_WAITING))
+		connectedSessions--;
+
+	session->state = state;
+	session->generation++;
+}
+
+/* Anywhere from half to one and a half times --think-ms, so the sessions don't all end up asking at once */
+static u64 thinkTime()
+{
+	return options.thinkMs == 0 ? 0 : (options.thinkMs / 2 + rng() % (options.thinkMs + 1)) * 1000ull;
+}
+
+/* Only what happens before the end of the run counts */
+static void addResult(int request, bool ok, u64 startedAt)
+{
+	u64 now = nowUs();
+
+	if (now > endTime)
+		return;
+
+	if (ok)
+		stats[request].latencies.push_back((u32) std::min<u64>(now - startedAt, UINT32_MAX));
+	else
+		stats[request].errors++;
+}
+
+// --------------------------------------------------------------------------------
+static void closeSession(Session *session)
+{
+	if (session->fd >= 0)
+	{
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, session->fd, NULL);
+		close(session->fd);
+		session->fd = -1;
+	}
+}
+
+/* Counts the error against whatever was being waited on and starts again with a new connection after a think */
+static void failSession(Session *session, const char *why)
+{
+	if (session->state >= SESSION_CONNECTING && session->state <= SESSION_WELCOME)
+		addResult(REQ_CONNECT, false, 0);
+	else if (session->state == SESSION_WAITING)
+		addResult(session->request, false, 0);
+
+	if (session->state == SESSION_THINKING || session->state == SESSION_WAITING)
+		disconnects++;
+
+	if (nowUs() < endTime && session->index < 4)
+		fprintf(stderr, "session %u: %s\n", session->index, why);
+
+	closeSession(session);
+	setState(session, SESSION_IDLE);
+	setTimer(session, nowUs() + thinkTime());
+}
+
+/* Sends what it can now, the rest goes when the socket is writable again */
+static bool flushSession(Session *session)
+{
+	while (session->outSent < session->out.size())
+	{
+		ssize_t sent = send(session->fd, &session->out[session->outSent], session->out.size() - session->outSent, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EAGAIN)
+			break;
+		if (sent <= 0)
+			return false;
+
+		session->outSent += sent;
+	}
+
+	// Requests are small, so the socket only has to be watched for writing when it was full
+	bool waitForWrite = session->outSent < session->out.size();
+	if (waitForWrite != session->waitingForWrite)
+	{
+		epoll_event event;
+		event.events = EPOLLIN | (waitForWrite ? (u32) EPOLLOUT : 0);
+		event.data.u32 = session->index;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, session->fd, &event);
+		session->waitingForWrite = waitForWrite;
+	}
+
+	return true;
+}
+
+/* Queues a request, framed unless it's PIPELINE_REQUEST, the same way sendToServer in linkcableclient.c does */
+static bool sendRequest(Session *session, const u8 *data, u16 size, u8 tag, bool framed)
+{
+	if (session->outSent == session->out.size())
+	{
+		session->out.clear();
+		session->outSent = 0;
+	}
+
+	if (framed)
+	{
+		u8 header[NF_HEADER_SIZE];
+		NF_writeHeader(header, NF_REQUEST_MARK, tag, size);
+		session->out.insert(session->out.end(), header, header + NF_HEADER_SIZE);
+	}
+
+	session->out.insert(session->out.end(), data, data + size);
+	return flushSession(session);
+}
+
+static bool sendString(Session *session, const char *request, u8 tag, bool framed)
+{
+	return sendRequest(session, (const u8 *) request, strlen(request), tag, framed);
+}
+
+/* Tags go round 1-255, 0 is kept for requests nothing waits on */
+static u8 nextTag(Session *session)
+{
+	session->tag = session->tag == 0xFF ? 1 : session->tag + 1;
+	return session->tag;
+}
+
+// --------------------------------------------------------------------------------
+static void startConnect(Session *session)
+{
+	session->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	session->startedAt = nowUs();
+	session->greetingReceived = 0;
+	session->out.clear();
+	session->outSent = 0;
+	session->waitingForWrite = true; // Until it's connected
+	session->tag = 0;
+	NF_initReader(&session->reader, session->virtualChannels, MAX_MSG_SIZE);
+
+	if (session->fd < 0)
+	{
+		setState(session, SESSION_CONNECTING);
+		failSession(session, strerror(errno));
+		return;
+	}
+
+	int one = 1;
+	setsockopt(session->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLOUT;
+	event.data.u32 = session->index;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, session->fd, &event);
+
+	setState(session, SESSION_CONNECTING);
+	setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+
+	if (connect(session->fd, (sockaddr *) &serverAddress, sizeof(serverAddress)) < 0 && errno != EINPROGRESS)
+		failSession(session, strerror(errno));
+}
+
+/* Each session is its own player, the server tells them apart by name and trainer id */
+static void sendPlayerData(Session *session)
+{
+	u8 message[sizeof(SEND_PLAYER_DATA) - 1 + sizeof(PlayerData)];
+	PlayerData playerData;
+	char name[16];
+
+	memset(&playerData, 0, sizeof(playerData));
+	snprintf(name, sizeof(name), "LG%06u", session->index);
+	memcpy(playerData.playerName, name, sizeof(playerData.playerName));
+	playerData.trainerId = htons((u16) session->index);
+	playerData.gender = session->index & 1;
+	strncpy(playerData.gameName, "Load Generator", sizeof(playerData.gameName));
+
+	memcpy(message, SEND_PLAYER_DATA, strlen(SEND_PLAYER_DATA));
+	memcpy(&message[strlen(SEND_PLAYER_DATA)], &playerData, sizeof(playerData));
+
+	// The server doesn't answer player data, so it gets the tag that's never waited on
+	sendRequest(session, message, sizeof(message), 0, true);
+}
+
+static void sendNextRequest(Session *session)
+{
+	// The requests as the game sends them, see the layouts in net_protocol.h
+	u8 message[TRADE_MSG_SIZE];
+	u16 size;
+
+	memset(message, 0, sizeof(message));
+	session->request = options.requests[session->next];
+	session->next = (session->next + 1) % options.requests.size();
+
+	switch (session->request)
+	{
+		case REQ_BATTLE:
+			size = BATTLE_MSG_SIZE;
+			memcpy(&message[BATTLE_MSG_PREFIX_OFFSET], BATTLE_REQUEST, BATTLE_MSG_PREFIX_SIZE);
+			message[BATTLE_MSG_TRAINER_OFFSET] = '1';
+			break;
+		case REQ_MART:
+			size = MART_MSG_SIZE;
+			memcpy(&message[MART_MSG_PREFIX_OFFSET], MART_REQUEST, MART_MSG_PREFIX_SIZE);
+			message[MART_MSG_MART_OFFSET] = '1';
+			break;
+		case REQ_GIFT_EGG:
+			size = GIFT_EGG_MSG_SIZE;
+			memcpy(&message[GIFT_EGG_MSG_PREFIX_OFFSET], GIFT_EGG_REQUEST, GIFT_EGG_MSG_PREFIX_SIZE);
+			message[GIFT_EGG_MSG_EGG_OFFSET] = '1';
+			break;
+		case REQ_POST_MAIL:
+		{
+			// A mail type and easy chat words as the game would send them
+			static const u8 mail[POST_MAIL_MSG_MAIL_TYPE_SIZE + POST_MAIL_MSG_MAIL_WORDS_SIZE] = { 0x00, 0x7B, 0x04, 0x1F, 0x04, 0x20, 0x04, 0x21, 0x0C, 0x02, 0x0C, 0x02, 0x0C, 0x02, 0x0C, 0x02, 0x0C, 0x02, 0x0C, 0x02 };
+			size = POST_MAIL_MSG_SIZE;
+			memcpy(&message[POST_MAIL_MSG_PREFIX_OFFSET], POST_MAIL_REQUEST, POST_MAIL_MSG_PREFIX_SIZE);
+			message[POST_MAIL_MSG_MODE_OFFSET] = '0';
+			memcpy(&message[POST_MAIL_MSG_MAIL_TYPE_OFFSET], mail, sizeof(mail));
+			break;
+		}
+		case REQ_READ_MAIL:
+			size = READ_MAIL_MSG_SIZE;
+			memcpy(&message[READ_MAIL_MSG_PREFIX_OFFSET], READ_MAIL_REQUEST, READ_MAIL_MSG_PREFIX_SIZE);
+			message[READ_MAIL_MSG_MODE_OFFSET] = '0';
+			break;
+		default:
+			// Sessions offering at the same time trade with each other, one left on its own gets its mon back after the server's 3.1s wait
+			size = TRADE_MSG_SIZE;
+			memcpy(&message[TRADE_MSG_PREFIX_OFFSET], TRADE_REQUEST, TRADE_MSG_PREFIX_SIZE);
+			message[TRADE_MSG_MODE_OFFSET] = '0';
+			for (u32 i = 0; i < TRADE_MSG_MON_SIZE; i++)
+				message[TRADE_MSG_MON_OFFSET + i] = (u8) (session->index + i);
+			break;
+	}
+
+	setState(session, SESSION_WAITING);
+	session->startedAt = nowUs();
+	setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+
+	if (!sendRequest(session, message, size, nextTag(session), true))
+		failSession(session, "send failed");
+}
+
+/* If the answer is the size the server sends for the request (the game checks no more than that) */
+static bool answerOk(Session *session, int result)
+{
+	const NFReader &reader = session->reader;
+
+	if (result != NF_MESSAGE || reader.msgChannel != SERVER_ANSWER_CHANNEL)
+		return false;
+
+	switch (session->request)
+	{
+		case REQ_BATTLE:
+			return reader.msgSize == BATTLE_ANSWER_SIZE;
+		case REQ_MART:
+			return reader.msgSize == MART_ANSWER_SIZE;
+		case REQ_GIFT_EGG:
+			return reader.msgSize == GIFT_EGG_ANSWER_SIZE;
+		case REQ_POST_MAIL:
+			return reader.msgSize == POST_MAIL_ANSWER_SIZE && session->virtualChannels[SERVER_ANSWER_CHANNEL * NF_VIRTUAL_CHANNEL_SIZE + POST_MAIL_ANSWER_STATUS_OFFSET] == POST_MAIL_OK;
+		case REQ_READ_MAIL:
+			return reader.msgSize == 2 || reader.msgSize == READ_MAIL_ANSWER_SIZE; // No new mail (FF FF), or a name and a mail
+		default:
+			return reader.msgSize == TRADE_ANSWER_SIZE;
+	}
+}
+
+/* A whole response frame has come in */
+static void onResponse(Session *session, int result)
+{
+	const NFReader &reader = session->reader;
+
+	switch (session->state)
+	{
+		case SESSION_PIPELINE:
+			if (result != NF_OTHER || reader.otherSize <= strlen(PIPELINE_REQUEST) || memcmp(reader.other, PIPELINE_REQUEST, strlen(PIPELINE_REQUEST)) != 0 ||
+			    reader.other[strlen(PIPELINE_REQUEST)] < PIPELINE_VERSION)
+			{
+				failSession(session, "server doesn't do tagged requests");
+				return;
+			}
+
+			setState(session, SESSION_NAME);
+			setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+			if (!sendString(session, SERVER_NAME_REQUEST, nextTag(session), true))
+				failSession(session, "send failed");
+			return;
+
+		case SESSION_NAME:
+			if (result != NF_OTHER || reader.tag != session->tag || reader.otherSize < 3 || memcmp(reader.other, "SN_", 3) != 0)
+			{
+				failSession(session, "bad answer to " SERVER_NAME_REQUEST);
+				return;
+			}
+
+			setState(session, SESSION_WELCOME);
+			setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+			if (!sendString(session, WELCOME_REQUEST, nextTag(session), true))
+				failSession(session, "send failed");
+			return;
+
+		case SESSION_WELCOME:
+			if (result != NF_MESSAGE || reader.tag != session->tag)
+			{
+				failSession(session, "bad answer to " WELCOME_REQUEST);
+				return;
+			}
+
+			addResult(REQ_CONNECT, true, session->startedAt);
+			sendPlayerData(session);
+			setState(session, SESSION_THINKING);
+			setTimer(session, nowUs() + thinkTime());
+			return;
+
+		case SESSION_WAITING:
+			if (reader.tag != session->tag)
+			{
+				failSession(session, "answer with the wrong tag");
+				return;
+			}
+
+			// A bad answer is counted but the session carries on, the server is still talking to it
+			addResult(session->request, answerOk(session, result), session->startedAt);
+			setState(session, SESSION_THINKING);
+			setTimer(session, nowUs() + thinkTime());
+			return;
+
+		default:
+			failSession(session, "answer nothing was waiting for");
+			return;
+	}
+}
+
+static void onReadable(Session *session)
+{
+	if (session->state == SESSION_GREETING)
+	{
+		// Only ever read as far as the end of the greeting, so it can't be mistaken for the start of a frame
+		char greeting[sizeof(SERVER_GREETING)];
+		ssize_t res = recv(session->fd, greeting, strlen(SERVER_GREETING) - session->greetingReceived, 0);
+
+		if (res < 0 && errno == EAGAIN)
+			return;
+		if (res <= 0)
+		{
+			failSession(session, "connection closed");
+			return;
+		}
+
+		session->greetingReceived += res;
+		if (session->greetingReceived < strlen(SERVER_GREETING))
+			return;
+
+		setState(session, SESSION_PIPELINE);
+		setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+		if (!sendString(session, PIPELINE_REQUEST, 0, false))
+			failSession(session, "send failed");
+		return;
+	}
+
+	while (session->fd >= 0)
+	{
+		u8 *buffer;
+		u32 size = NF_getRecvBuffer(&session->reader, &buffer);
+		ssize_t res = recv(session->fd, buffer, size, 0);
+
+		if (res < 0 && errno == EAGAIN)
+			return;
+		if (res <= 0)
+		{
+			failSession(session, "connection closed");
+			return;
+		}
+
+		int result = NF_commit(&session->reader, res);
+
+		if (result == NF_ERROR)
+			failSession(session, "not a frame");
+		else if (result != NF_NEED_MORE)
+			onResponse(session, result);
+	}
+}
+
+static void onEvent(Session *session, u32 events)
+{
+	if (session->state == SESSION_CONNECTING)
+	{
+		int error = 0;
+		socklen_t length = sizeof(error);
+
+		if (getsockopt(session->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+		{
+			failSession(session, strerror(error));
+			return;
+		}
+
+		// Nothing goes out until the greeting is in
+		setState(session, SESSION_GREETING);
+		setTimer(session, session->startedAt + options.timeoutMs * 1000ull);
+		flushSession(session);
+		return;
+	}
+
+	if ((events & EPOLLOUT) && !flushSession(session))
+	{
+		failSession(session, "send failed");
+		return;
+	}
+
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		onReadable(session);
+}
+
+static void onTimer(Session *session)
+{
+	switch (session->state)
+	{
+		case SESSION_IDLE:
+			startConnect(session);
+			break;
+		case SESSION_THINKING:
+			sendNextRequest(session);
+			break;
+		default:
+			failSession(session, "timed out");
+			break;
+	}
+}
+
+// --------------------------------------------------------------------------------
+/* Nearest rank percentile in ms */
+static double getPercentile(const std::vector<u32> &sorted, u32 percentile)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t rank = (sorted.size() * percentile + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static void printProgress(u64 now)
+{
+	u64 done = 0, errors = 0;
+
+	for (int request = 0; request < REQ_COUNT; request++)
+	{
+		done += stats[request].latencies.size();
+		errors += stats[request].errors;
+	}
+
+	printf("%6.1f s  %u connected  %llu answered  %llu errors\n", (now - startTime) / 1000000.0, connectedSessions,
+	       (unsigned long long) done, (unsigned long long) errors);
+	fflush(stdout);
+}
+
+static u64 printReport()
+{
+	double seconds = options.durationSec;
+	u64 done = 0, errors = 0;
+	std::vector<u32> all;
+
+	printf("\n%u sessions for %u s against %s, thinking %u ms between requests\n", options.sessions, options.durationSec, options.server.c_str(), options.thinkMs);
+	printf("%-8s %9s %8s %9s %9s %9s %9s %9s\n", "REQUEST", "COUNT", "ERRORS", "REQ/S", "P50_MS", "P90_MS", "P99_MS", "MAX_MS");
+
+	for (int request = 0; request < REQ_COUNT; request++)
+	{
+		std::vector<u32> &latencies = stats[request].latencies;
+
+		if (latencies.empty() && stats[request].errors == 0)
+			continue;
+
+		std::sort(latencies.begin(), latencies.end());
+		printf("%-8s %9u %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", requestNames[request], (u32) latencies.size(), (unsigned long long) stats[request].errors,
+		       latencies.size() / seconds, getPercentile(latencies, 50), getPercentile(latencies, 90), getPercentile(latencies, 99), getPercentile(latencies, 100));
+
+		// CONNECT isn't a request
+		if (request == REQ_CONNECT)
+			continue;
+
+		done += latencies.size();
+		errors += stats[request].errors;
+		all.insert(all.end(), latencies.begin(), latencies.end());
+	}
+
+	std::sort(all.begin(), all.end());
+	printf("%-8s %9u %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", "ALL", (u32) done, (unsigned long long) errors, done / seconds,
+	       getPercentile(all, 50), getPercentile(all, 90), getPercentile(all, 99), getPercentile(all, 100));
+	printf("%u sessions connected at the end, %u lost their connection along the way\n", connectedSessions, disconnects);
+
+	return done;
+}
+
+// --------------------------------------------------------------------------------
+static void printUsage(const char *name)
+{
+	printf("Usage: %s --server ADDR [options]\n", name);
+	printf("  --server ADDR     address:port of a running CelioServer\n");
+	printf("  --sessions N      sessions open at once, each one a wii with a gba plugged in (default 100)\n");
+	printf("  --duration S      seconds to run for once the first session starts (default 30)\n");
+	printf("  --think-ms MS     average time a session waits between requests, each wait is 0.5 to 1.5 times this (default 1000)\n");
+	printf("  --ramp-ms MS      sessions start connecting at random times over this long (default 1000)\n");
+	printf("  --timeout-ms MS   a session that waits this long for an answer gives up and connects again (default 5000)\n");
+	printf("  --requests LIST   requests each session goes round, from BA, MA, GE, PM, RM and TR (default BA,MA,GE,PM,RM,TR)\n");
+	printf("  --seed N          seed for think times and start times (default 1)\n");
+}
+
+static bool parseRequests(const char *list)
+{
+	std::string names = list;
+	size_t start = 0;
+
+	options.requests.clear();
+
+	while (start <= names.size())
+	{
+		size_t end = names.find(',', start);
+		std::string name = names.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		int request;
+
+		for (request = REQ_BATTLE; request < REQ_COUNT; request++)
+		{
+			if (name == requestNames[request])
+				break;
+		}
+
+		if (request == REQ_COUNT)
+		{
+			fprintf(stderr, "Unknown request %s\n", name.c_str());
+			return false;
+		}
+
+		options.requests.push_back(request);
+
+		if (end == std::string::npos)
+			break;
+		start = end + 1;
+	}
+
+	return true;
+}
+
+static bool parseOptions(int argc, char **argv)
+{
+	options.sessions = 100;
+	options.durationSec = 30;
+	options.thinkMs = 1000;
+	options.rampMs = 1000;
+	options.timeoutMs = 5000;
+	options.seed = 1;
+	parseRequests("BA,MA,GE,PM,RM,TR");
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return false;
+		}
+
+		i++;
+
+		if (arg == "--server")              options.server = value;
+		else if (arg == "--sessions")       options.sessions = strtoul(value, NULL, 10);
+		else if (arg == "--duration")       options.durationSec = strtoul(value, NULL, 10);
+		else if (arg == "--think-ms")       options.thinkMs = strtoul(value, NULL, 10);
+		else if (arg == "--ramp-ms")        options.rampMs = strtoul(value, NULL, 10);
+		else if (arg == "--timeout-ms")     options.timeoutMs = strtoul(value, NULL, 10);
+		else if (arg == "--seed")           options.seed = strtoul(value, NULL, 10);
+		else if (arg == "--requests")
+		{
+			if (!parseRequests(value))
+				return false;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options.server.empty() || options.sessions == 0 || options.durationSec == 0 || options.timeoutMs == 0)
+	{
+		fprintf(stderr, "--server is needed, and --sessions, --duration and --timeout-ms must be at least 1\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool resolveServer()
+{
+	size_t colon = options.server.rfind(':');
+	addrinfo hints, *result;
+
+	if (colon == std::string::npos)
+	{
+		fprintf(stderr, "--server must be address:port\n");
+		return false;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(options.server.substr(0, colon).c_str(), options.server.substr(colon + 1).c_str(), &hints, &result) != 0)
+	{
+		fprintf(stderr, "Could not resolve %s\n", options.server.c_str());
+		return false;
+	}
+
+	memcpy(&serverAddress, result->ai_addr, sizeof(serverAddress));
+	freeaddrinfo(result);
+	return true;
+}
+
+/* Every session is a socket, so the default limit of 1024 files doesn't go far */
+static void raiseFileLimit()
+{
+	rlimit limit;
+	rlim_t needed = options.sessions + 64;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= needed)
+		return;
+
+	limit.rlim_cur = std::min(needed, limit.rlim_max);
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	if (limit.rlim_cur < needed)
+		fprintf(stderr, "Only %llu files can be open at once, raise the hard limit (ulimit -Hn) for %u sessions\n", (unsigned long long) limit.rlim_cur, options.sessions);
+}
+
+int main(int argc, char **argv)
+{
+	if (!parseOptions(argc, argv))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (!resolveServer())
+		return 1;
+
+	signal(SIGPIPE, SIG_IGN);
+	raiseFileLimit();
+	rng.seed(options.seed);
+
+	epollFd = epoll_create1(0);
+	startTime = nowUs();
+	endTime = startTime + options.durationSec * 1000000ull;
+
+	for (u32 i = 0; i < options.sessions; i++)
+	{
+		Session *session = new Session();
+		session->index = i;
+		session->fd = -1;
+		session->state = SESSION_IDLE;
+		session->next = i % options.requests.size(); // So the requests are spread out from the start
+		sessions.push_back(session);
+		setTimer(session, startTime + (options.rampMs == 0 ? 0 : rng() % (options.rampMs * 1000ull)));
+	}
+
+	epoll_event events[MAX_EVENTS];
+	u64 nextReport = startTime + REPORT_INTERVAL_US;
+
+	while (true)
+	{
+		u64 now = nowUs();
+
+		if (now >= endTime)
+			break;
+
+		while (!timers.empty() && timers.top().at <= now)
+		{
+			Timer timer = timers.top();
+			timers.pop();
+
+			if (sessions[timer.session]->generation == timer.generation)
+				onTimer(sessions[timer.session]);
+		}
+
+		if (now >= nextReport)
+		{
+			printProgress(now);
+			nextReport += REPORT_INTERVAL_US;
+		}
+
+		u64 wakeAt = std::min(endTime, nextReport);
+		if (!timers.empty())
+			wakeAt = std::min(wakeAt, timers.top().at);
+
+		int waitMs = wakeAt > now ? (int) ((wakeAt - now + 999) / 1000) : 0;
+		int count = epoll_wait(epollFd, events, MAX_EVENTS, waitMs);
+
+		for (int i = 0; i < count; i++)
+		{
+			Session *session = sessions[events[i].data.u32];
+
+			if (session->fd >= 0)
+				onEvent(session, events[i].events);
+		}
+	}
+
+	u64 answered = printReport();
+
+	for (Session *session : sessions)
+	{
+		closeSession(session);
+		delete session;
+	}
+
+	close(epollFd);
+
+	return answered > 0 ? 0 : 1;
+}
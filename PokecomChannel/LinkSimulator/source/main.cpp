@@ -0,0 +1,847 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * main.cpp
+ * Runs the pokecom channel's link code (linkcableclient.c) against
+ * pokeemerald's JOYBUS code (net_conn_link.c) over a simulated cable, and
+ * reports what each kind of message costs.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "global.h"
+#include "constants/network.h"
+#include "joybus_wire.h"
+#include "sim_gba.h"
+
+extern "C" {
+	#include "linkcableclient.h"
+	#include "telemetry.h"
+	#include "trace.h"
+}
+
+#define DEFAULT_FRAME_US 16743 // 59.73 fps
+#define LOOPBACK_CHANNEL 0x10  // Virtual channel the loopback data is written to (well clear of the ones the game uses)
+#define LOOPBACK_MAX_BYTES 3840 // The channel buffer is 4096 bytes, minus the channels below LOOPBACK_CHANNEL
+
+enum {
+	SCENARIO_LOOPBACK,
+	SCENARIO_LINKUP,
+	SCENARIO_BATTLE,
+	SCENARIO_MART,
+	SCENARIO_EGG,
+	SCENARIO_ALL,
+	SCENARIO_STRESS,
+	SCENARIO_DUPLEX
+};
+
+struct SimOptions {
+	JoybusWireConfig wire;
+	u32 frameUs;
+	u32 bytes;
+	u32 iterations;
+	int ports;
+	int scenario;
+	u32 seed;
+	bool legacy;
+	bool pollServer;
+	bool noCall;
+	bool noStream;
+	bool noLz77;
+	bool noPush;
+	bool warmPool;
+	bool polled;
+	std::string server;
+	std::string telemetry;
+	std::string trace;
+};
+
+//!< Where the counters were when a feature started, so what it cost can be recorded once it's done
+struct FeatureStart {
+	u32 attempts;
+	u32 siCommands;
+	u32 words;
+	u64 us;
+};
+
+struct PortResult {
+	bool passed;
+	u64 elapsedUs;
+	u32 frames;
+};
+
+static void printUsage(const char *name)
+{
+	printf("Usage: %s [options]\n", name);
+	printf("  --scenario NAME   loopback (default), linkup, battle, mart, egg, all, stress or duplex. Everything but loopback, stress and duplex needs --server\n");
+	printf("  --server ADDR     address:port of a running CelioServer, sent to the channel just like the game does\n");
+	printf("  --latency US      time every SI command spends on the wire (default 0)\n");
+	printf("  --jitter US       up to this much extra time is added to each SI command (default 0)\n");
+	printf("  --drop RATE       chance from 0 to 1 an SI command is lost (default 0)\n");
+	printf("  --flip RATE       chance from 0 to 1 a word has a bit flipped on the wire (default 0)\n");
+	printf("  --poll-ns NS      time the GBA spends per JOYCNT poll (default 2000)\n");
+	printf("  --frame-us US     length of a GBA frame (default %d)\n", DEFAULT_FRAME_US);
+	printf("  --bytes N         loopback payload size, each way for duplex (default 256)\n");
+	printf("  --iterations N    times to repeat the scenario (default 1)\n");
+	printf("  --ports N         number of GBAs to plug in, 1 to 4 (default 1)\n");
+	printf("  --seed N          seed for jitter/drops (default 1)\n");
+	printf("  --legacy          skip the handshake like a ROM from before the framed link mode\n");
+	printf("  --poll-server     after a transmit poll LIFN every frame until the server has answered instead of waiting the game's fixed delay\n");
+	printf("  --no-call         download with a separate send, transmit and receive like a ROM from before NET_CONN_CALL_REQ\n");
+	printf("  --no-stream       read payloads back in chunks like a ROM from before NET_CONN_STRM_REQ\n");
+	printf("  --no-lz77         ask for raw payloads like a ROM from before compressed payloads (NET_CONN_LZ77_MARK)\n");
+	printf("  --warm-pool       test the server from the channel's menu before plugging in, which fills the channel's session pool\n");
+	printf("  --no-push         keep asking LIFN while waiting on the server like a ROM from before NET_CONN_LINK_CAP_LIFN_PUSH\n");
+	printf("  --polled          busy wait on every block like a ROM from before the JOY interrupt engine, instead of moving framed blocks in the background\n");
+	printf("  --telemetry FILE  write the channel's telemetry dump (see telemetry.h) to FILE at the end, - for stdout\n");
+	printf("  --trace FILE      record the whole run (see trace.h) to FILE, for linkreplay\n");
+}
+
+/* The duplex scenario sends to LOOPBACK_CHANNEL and exchanges into the channels straight after it */
+static u8 getDuplexChannel(u32 bytes)
+{
+	return (u8) (LOOPBACK_CHANNEL + (bytes + MINIMUM_CHUNK_SIZE - 1) / MINIMUM_CHUNK_SIZE);
+}
+
+static bool parseOptions(int argc, char **argv, SimOptions *options)
+{
+	options->wire.latencyUs = 0;
+	options->wire.jitterUs = 0;
+	options->wire.dropRate = 0;
+	options->wire.flipRate = 0;
+	options->wire.gbaPollNs = 2000;
+	options->frameUs = DEFAULT_FRAME_US;
+	options->bytes = 256;
+	options->iterations = 1;
+	options->ports = 1;
+	options->scenario = SCENARIO_LOOPBACK;
+	options->seed = 1;
+	options->legacy = false;
+	options->pollServer = false;
+	options->noCall = false;
+	options->noStream = false;
+	options->noLz77 = false;
+	options->noPush = false;
+	options->warmPool = false;
+	options->polled = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (arg == "--legacy")
+		{
+			options->legacy = true;
+			continue;
+		}
+
+		if (arg == "--poll-server")
+		{
+			options->pollServer = true;
+			continue;
+		}
+
+		if (arg == "--no-call")
+		{
+			options->noCall = true;
+			continue;
+		}
+
+		if (arg == "--no-stream")
+		{
+			options->noStream = true;
+			continue;
+		}
+
+		if (arg == "--no-lz77")
+		{
+			options->noLz77 = true;
+			continue;
+		}
+
+		if (arg == "--warm-pool")
+		{
+			options->warmPool = true;
+			continue;
+		}
+
+		if (arg == "--no-push")
+		{
+			options->noPush = true;
+			continue;
+		}
+
+		if (arg == "--polled")
+		{
+			options->polled = true;
+			continue;
+		}
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg.c_str());
+			return false;
+		}
+
+		i++;
+
+		if (arg == "--scenario")
+		{
+			std::string name = value;
+			if (name == "loopback")     options->scenario = SCENARIO_LOOPBACK;
+			else if (name == "linkup")  options->scenario = SCENARIO_LINKUP;
+			else if (name == "battle")  options->scenario = SCENARIO_BATTLE;
+			else if (name == "mart")    options->scenario = SCENARIO_MART;
+			else if (name == "egg")     options->scenario = SCENARIO_EGG;
+			else if (name == "all")     options->scenario = SCENARIO_ALL;
+			else if (name == "stress")  options->scenario = SCENARIO_STRESS;
+			else if (name == "duplex")  options->scenario = SCENARIO_DUPLEX;
+			else
+			{
+				fprintf(stderr, "Unknown scenario %s\n", value);
+				return false;
+			}
+		}
+		else if (arg == "--server")     options->server = value;
+		else if (arg == "--telemetry")  options->telemetry = value;
+		else if (arg == "--trace")      options->trace = value;
+		else if (arg == "--latency")    options->wire.latencyUs = strtoul(value, NULL, 10);
+		else if (arg == "--jitter")     options->wire.jitterUs = strtoul(value, NULL, 10);
+		else if (arg == "--drop")       options->wire.dropRate = strtod(value, NULL);
+		else if (arg == "--flip")       options->wire.flipRate = strtod(value, NULL);
+		else if (arg == "--poll-ns")    options->wire.gbaPollNs = strtoul(value, NULL, 10);
+		else if (arg == "--frame-us")   options->frameUs = strtoul(value, NULL, 10);
+		else if (arg == "--bytes")      options->bytes = strtoul(value, NULL, 10);
+		else if (arg == "--iterations") options->iterations = strtoul(value, NULL, 10);
+		else if (arg == "--ports")      options->ports = atoi(value);
+		else if (arg == "--seed")       options->seed = strtoul(value, NULL, 10);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options->ports < 1 || options->ports > 4 || options->bytes == 0 || options->bytes > LOOPBACK_MAX_BYTES)
+	{
+		fprintf(stderr, "--ports must be 1-4 and --bytes 1-%d\n", LOOPBACK_MAX_BYTES);
+		return false;
+	}
+
+	// Both payloads have to fit in the loopback channels side by side
+	if (options->scenario == SCENARIO_DUPLEX && options->bytes > LOOPBACK_MAX_BYTES / 2)
+	{
+		fprintf(stderr, "--bytes must be 1-%d for duplex\n", LOOPBACK_MAX_BYTES / 2);
+		return false;
+	}
+
+	// Every port is plugged in and doing loopback at once, to see if any of them are starved
+	if (options->scenario == SCENARIO_STRESS)
+		options->ports = 4;
+
+	if (options->scenario != SCENARIO_LOOPBACK && options->scenario != SCENARIO_STRESS && options->scenario != SCENARIO_DUPLEX && options->server.empty())
+	{
+		fprintf(stderr, "This scenario needs --server\n");
+		return false;
+	}
+
+	return true;
+}
+
+// ======================= Game data ======================================================
+
+static FeatureStart startFeature(SimGba &gba)
+{
+	JoybusWireStats &wireStats = gba.GetWire()->GetStats();
+	FeatureStart start;
+
+	start.attempts = gba.GetTotalAttempts();
+	start.siCommands = wireStats.siCommands.load();
+	start.words = wireStats.wordsToGba.load() + wireStats.wordsFromGba.load();
+	start.us = LinkSim_NowUs();
+	return start;
+}
+
+static void recordFeature(SimGba &gba, const char *name, const FeatureStart &start, u32 payloadBytes)
+{
+	JoybusWireStats &wireStats = gba.GetWire()->GetStats();
+
+	gba.RecordFeature(name, gba.GetTotalAttempts() - start.attempts, wireStats.siCommands.load() - start.siCommands,
+	                  wireStats.wordsToGba.load() + wireStats.wordsFromGba.load() - start.words, payloadBytes, LinkSim_NowUs() - start.us);
+}
+
+/* Converts ascii to the game's character set (only what's needed for names and addresses) */
+static void charsToBytes(const char *string, u8 *bytes, u32 length)
+{
+	for (u32 i = 0; i < length; i++)
+	{
+		char c = *string != '\0' ? *string++ : '\0';
+
+		if (c >= '0' && c <= '9')      bytes[i] = 0xA1 + (c - '0');
+		else if (c >= 'A' && c <= 'Z') bytes[i] = 0xBB + (c - 'A');
+		else if (c >= 'a' && c <= 'z') bytes[i] = 0xD5 + (c - 'a');
+		else if (c == '.')             bytes[i] = 0xAD;
+		else if (c == ':')             bytes[i] = 0xF0;
+		else if (c == ' ')             bytes[i] = 0x00;
+		else                           bytes[i] = 0xFF; // EOS
+	}
+}
+
+/* The same choice Task_LinkupProcess and Task_TradeProcess make with CanUseStream */
+static bool receivePayload(SimGba &gba, const SimOptions &options, u16 cmd, u8 *data, u16 length)
+{
+	if ((gba.GetLinkCaps() & NET_CONN_LINK_CAP_STREAM) && !options.noStream)
+	{
+		if (gba.Stream(NET_CONN_STRM_REQ | (cmd & 0xFF), data, length))
+			return true;
+		if (!gba.StreamFellBack())
+			return false;
+	}
+
+	return gba.ReceiveChunked(cmd, data, length, gba.GetChunkSize());
+}
+
+/* Same as CanUseStatusPush in net_conn.c */
+static bool canUseStatusPush(SimGba &gba, const SimOptions &options)
+{
+	return (gba.GetLinkCaps() & NET_CONN_LINK_CAP_LIFN_PUSH) && !options.noPush;
+}
+
+static bool runLinkup(SimGba &gba, const SimOptions &options)
+{
+	// Player name + 1 + Gender + Special Warp Flag + Trainer ID (see PLAYER_INFO_LENGTH in net_conn.c)
+	u8 playerInfo[16] = {0};
+	u8 gameName[20];
+	u8 serverAddr[LOOPBACK_MAX_BYTES];
+	u8 status[4];
+	u8 welcome[48];
+	char playerName[8];
+	u16 serverAddrLength = (u16) options.server.size();
+
+	snprintf(playerName, sizeof(playerName), "SIM%d", gba.GetPort());
+	charsToBytes(playerName, playerInfo, 8);
+	playerInfo[10] = (u8) gba.GetPort();
+	charsToBytes("Link Simulator      ", gameName, sizeof(gameName));
+	charsToBytes(options.server.c_str(), serverAddr, serverAddrLength);
+
+	if (!gba.Send(NET_CONN_SEND_REQ, playerInfo, 14)
+	 || !gba.Send(NET_CONN_SCH2_REQ, gameName, sizeof(gameName))
+	 || !gba.Send(NET_CONN_PINF_REQ, NULL, 0)
+	 || !gba.Send(NET_CONN_SEND_REQ, serverAddr, serverAddrLength)
+	 || !gba.Send(NET_CONN_CINF_REQ, NULL, 0))
+		return false;
+
+	bool push = canUseStatusPush(gba, options);
+
+	for (int polls = 0; polls < 30; polls++)
+	{
+		bool pushed = false;
+
+		// The same order Task_LinkupProcess goes in, with a push it asks straight after CINF and then only if a whole wait goes by without one
+		if (!push)
+			gba.WaitTextAnimation(60);
+		else if (polls > 0)
+			pushed = gba.WaitForStatusPush(60, status);
+
+		if (!pushed && !gba.Receive(NET_CONN_LIFN_REQ, status, 4, true))
+			continue;
+
+		if (!(status[0] == NET_CONN_LIFN_REQ >> 8 && status[1] == (NET_CONN_LIFN_REQ & 0xFF)))
+			continue;
+
+		if (status[3] >= NETWORK_MIN_ERROR)
+		{
+			printf("Port %d: channel could not reach the server (state %d)\n", gba.GetPort(), status[3]);
+			return false;
+		}
+
+		if (status[3] == NETWORK_CONNECTION_SUCCESS && status[2] == NETWORK_STATE_WAITING)
+		{
+			gba.RecordConnectTime(getConnectTime(gba.GetPort()));
+			return receivePayload(gba, options, NET_CONN_RCHF0_REQ, welcome, sizeof(welcome));
+		}
+	}
+
+	printf("Port %d: timed out waiting for the server\n", gba.GetPort());
+	return false;
+}
+
+static bool isServerReady(const u8 *status)
+{
+	return status[0] == NET_CONN_LIFN_REQ >> 8 && status[1] == (NET_CONN_LIFN_REQ & 0xFF) && status[2] == NETWORK_STATE_WAITING;
+}
+
+/* Polls LIFN every frame until the channel says the server has answered, returns false if it never does */
+static bool waitForServer(SimGba &gba, const SimOptions &options, u16 waitDuration)
+{
+	u64 startUs = LinkSim_NowUs();
+	u8 status[4];
+
+	// Give up after twice the game's own delay, the game would have read whatever was there by then
+	// Every poll is a block of its own, so it already waits for the next frame
+	for (u32 frames = 0; frames < ((u32) waitDuration + 1) * 4; frames++)
+	{
+		if (!gba.Receive(NET_CONN_LIFN_REQ, status, 4, true))
+			continue;
+
+		// If the channel pushes the status there's no need to keep asking, it's written as soon as the server answers
+		if (isServerReady(status) || (canUseStatusPush(gba, options) && gba.WaitForStatusPush(waitDuration * 2, status) && isServerReady(status)))
+		{
+			gba.RecordServerRoundTrip((u32) (LinkSim_NowUs() - startUs));
+			return true;
+		}
+	}
+
+	printf("Port %d: the server did not answer in time\n", gba.GetPort());
+	return false;
+}
+
+static bool runDownloadSteps(SimGba &gba, const SimOptions &options, const u8 *requestBytes, u16 requestSize, u8 *response, u16 *responseSize, u16 waitDuration)
+{
+	// The same choice Task_DownloadBattleProcess makes with CanUseCall
+	if ((gba.GetLinkCaps() & NET_CONN_LINK_CAP_CALL) && !options.noCall)
+	{
+		if (!gba.Call(NET_CONN_CCH2_REQ, requestBytes, requestSize, NET_CONN_RCHF0_REQ, response, *responseSize))
+			return false;
+
+		*responseSize = gba.GetCallResponseLength();
+		return true;
+	}
+
+	if (!gba.Send(NET_CONN_SCH2_REQ, requestBytes, requestSize)
+	 || !gba.Send(NET_CONN_TCH2_REQ, NULL, requestSize, true))
+		return false;
+
+	if (options.pollServer)
+	{
+		if (!waitForServer(gba, options, waitDuration))
+			return false;
+	}
+	else
+	{
+		gba.WaitTextAnimation(waitDuration);
+	}
+
+	return gba.ReceiveChunked(NET_CONN_RCHF0_REQ, response, *responseSize, gba.GetChunkSize());
+}
+
+/* compressible is for the payloads the game asks for compressed, the same request bytes Task_DownloadBattleProcess sends */
+static bool runDownload(SimGba &gba, const SimOptions &options, const char *request, u16 responseSize, u16 waitDuration, bool compressible = false)
+{
+	u8 requestBytes[8] = {0};
+	u16 requestSize = 4;
+	u8 response[64];
+	FeatureStart start = startFeature(gba);
+
+	memcpy(requestBytes, request, 4);
+
+	if (compressible && !options.noLz77)
+	{
+		requestBytes[4] = NET_CONN_LZ77_MARK >> 8;
+		requestBytes[5] = NET_CONN_LZ77_MARK & 0xFF;
+		requestSize = 8;
+
+		// The answer then says whether it's compressed, in a header in front of it
+		responseSize += NET_CONN_PACKED_HEADER_SIZE;
+	}
+
+	bool passed = runDownloadSteps(gba, options, requestBytes, requestSize, response, &responseSize, waitDuration);
+
+	if (passed)
+		recordFeature(gba, request, start, responseSize);
+
+	return passed;
+}
+
+static bool runLoopback(SimGba &gba, const SimOptions &options, u32 iteration)
+{
+	std::vector<u8> sent(options.bytes);
+	std::vector<u8> received(options.bytes, 0);
+
+	for (u32 i = 0; i < options.bytes; i++)
+		sent[i] = (u8) (i * 7 + iteration * 13 + gba.GetPort());
+
+	FeatureStart start = startFeature(gba);
+
+	if (!gba.SendChunked(NET_CONN_SEND_REQ | LOOPBACK_CHANNEL, sent.data(), options.bytes, gba.GetChunkSize()))
+		return false;
+
+	if (!receivePayload(gba, options, NET_CONN_RECV_REQ | LOOPBACK_CHANNEL, received.data(), options.bytes))
+		return false;
+
+	recordFeature(gba, "LOOPBACK", start, options.bytes);
+
+	if (sent != received)
+	{
+		printf("Port %d: loopback data did not match what was sent\n", gba.GetPort());
+		return false;
+	}
+
+	return true;
+}
+
+/**
+* The same payload each way, first as a send and a receive then as one exchange (NET_CONN_XCHG_REQ), to compare what each costs.
+* The exchange reads back what the send wrote, and what the exchange wrote is read back afterwards without being counted
+*/
+static bool runDuplex(SimGba &gba, const SimOptions &options, u32 iteration)
+{
+	u16 bytes = (u16) options.bytes;
+	u8 channel = getDuplexChannel(bytes);
+	std::vector<u8> sent(bytes);
+	std::vector<u8> exchanged(bytes);
+	std::vector<u8> received(bytes, 0);
+
+	if (!(gba.GetLinkCaps() & NET_CONN_LINK_CAP_DUPLEX))
+	{
+		printf("Port %d: the channel did not agree to NET_CONN_LINK_CAP_DUPLEX\n", gba.GetPort());
+		return false;
+	}
+
+	for (u32 i = 0; i < bytes; i++)
+	{
+		sent[i] = (u8) (i * 7 + iteration * 13 + gba.GetPort());
+		exchanged[i] = (u8) (i * 11 + iteration * 5 + gba.GetPort() + 1);
+	}
+
+	FeatureStart start = startFeature(gba);
+
+	if (!gba.Send(NET_CONN_SEND_REQ | LOOPBACK_CHANNEL, sent.data(), bytes)
+	 || !gba.Receive(NET_CONN_RECV_REQ | LOOPBACK_CHANNEL, received.data(), bytes))
+		return false;
+
+	recordFeature(gba, "SEPARATE", start, bytes * 2);
+
+	if (sent != received)
+	{
+		printf("Port %d: the receive did not match what was sent\n", gba.GetPort());
+		return false;
+	}
+
+	std::fill(received.begin(), received.end(), 0);
+	start = startFeature(gba);
+
+	if (!gba.Exchange(NET_CONN_XCHG_REQ | channel, exchanged.data(), bytes, NET_CONN_RECV_REQ | LOOPBACK_CHANNEL, received.data(), bytes))
+		return false;
+
+	recordFeature(gba, "EXCHANGE", start, bytes * 2);
+
+	if (sent != received)
+	{
+		printf("Port %d: the exchange did not read back what was sent before it\n", gba.GetPort());
+		return false;
+	}
+
+	if (!gba.Receive(NET_CONN_RECV_REQ | channel, received.data(), bytes))
+		return false;
+
+	if (exchanged != received)
+	{
+		printf("Port %d: the exchange's own block did not arrive\n", gba.GetPort());
+		return false;
+	}
+
+	return true;
+}
+
+static void runPort(SimGba *gba, const SimOptions *options, PortResult *result)
+{
+	u64 startUs = LinkSim_NowUs();
+	bool passed = true;
+
+	gba->Handshake();
+
+	if (options->scenario != SCENARIO_LOOPBACK && options->scenario != SCENARIO_STRESS && options->scenario != SCENARIO_DUPLEX)
+		passed = runLinkup(*gba, *options);
+
+	for (u32 i = 0; i < options->iterations && passed; i++)
+	{
+		switch (options->scenario)
+		{
+			case SCENARIO_LOOPBACK:
+			case SCENARIO_STRESS:
+				passed = runLoopback(*gba, *options, i);
+				break;
+			case SCENARIO_DUPLEX:
+				passed = runDuplex(*gba, *options, i);
+				break;
+			case SCENARIO_BATTLE:
+				passed = runDownload(*gba, *options, "BA_1", 48, 60, true);
+				break;
+			case SCENARIO_MART:
+				passed = runDownload(*gba, *options, "MA_1", 16, 40);
+				break;
+			case SCENARIO_EGG:
+				passed = runDownload(*gba, *options, "GE_1", 4, 40);
+				break;
+			case SCENARIO_ALL:
+				passed = runDownload(*gba, *options, "BA_1", 48, 60, true)
+				      && runDownload(*gba, *options, "MA_1", 16, 40)
+				      && runDownload(*gba, *options, "GE_1", 4, 40);
+				break;
+			case SCENARIO_LINKUP:
+				// Linking up again resets the channel's existing connection, which is when the standby socket gets used
+				passed = i == 0 || runLinkup(*gba, *options);
+				break;
+			default:
+				break;
+		}
+	}
+
+	result->passed = passed;
+	result->elapsedUs = LinkSim_NowUs() - startUs;
+	result->frames = gba->GetFrameCount();
+}
+
+// ======================= Report ======================================================
+
+/* Nearest rank percentile of the block latencies in ms */
+static double getLatencyPercentile(const std::vector<u32> &sorted, u32 percentile)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t rank = (sorted.size() * percentile + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static void printReport(const std::vector<SimGba *> &gbas, const std::vector<JoybusWire *> &wires, const std::vector<PortResult> &results)
+{
+	for (size_t p = 0; p < gbas.size(); p++)
+	{
+		JoybusWireStats &wireStats = wires[p]->GetStats();
+
+		printf("\n=== PORT %d : %s ===\n", gbas[p]->GetPort(), results[p].passed ? "PASS" : "FAIL");
+		printf("elapsed %.1f ms over %u frames, %u SI commands (%u dropped, %u flipped), %u words to GBA, %u words from GBA\n",
+		       results[p].elapsedUs / 1000.0, results[p].frames, wireStats.siCommands.load(), wireStats.dropped.load(),
+		       wireStats.flipped.load(), wireStats.wordsToGba.load(), wireStats.wordsFromGba.load());
+		printf("link mode %s%s%s%s\n", gbas[p]->GetLinkCaps() & NET_CONN_LINK_CAP_FRAMED ? "framed" : "legacy", gbas[p]->GetLinkCaps() & NET_CONN_LINK_CAP_CALL ? " + call" : "",
+			gbas[p]->GetLinkCaps() & NET_CONN_LINK_CAP_STREAM ? " + stream" : "", gbas[p]->GetLinkCaps() & NET_CONN_LINK_CAP_LIFN_PUSH ? " + push" : "");
+		printf("%-6s %8s %8s %8s %8s %10s %8s %10s %10s %12s\n", "TYPE", "BLOCKS", "ATTEMPTS", "RETRIES", "CHK_FAIL", "ERRORS", "RESENT", "BYTES", "LINK_MS", "BYTES/SEC");
+
+		for (int type = 0; type < LINK_MSG_COUNT; type++)
+		{
+			const LinkMessageStats &stats = gbas[p]->GetStats(type);
+
+			if (stats.attempts == 0)
+				continue;
+
+			printf("%-6s %8u %8u %8u %8u %10u %8u %10llu %10.1f %12.0f\n",
+			       SimGba::GetMessageTypeName(type), stats.blocks, stats.attempts, stats.attempts - stats.blocks,
+			       stats.checkFailures, stats.errors, stats.framesResent, (unsigned long long) stats.bytes, stats.totalTimeUs / 1000.0,
+			       stats.totalTimeUs > 0 ? stats.bytes * 1000000.0 / stats.totalTimeUs : 0.0);
+		}
+
+		printf("game loop: longest stall %.1f ms, %u frames stalled, %.1f ms in the serial interrupt\n", gbas[p]->GetLongestStallUs() / 1000.0,
+		       gbas[p]->GetFramesStalled(), gbas[p]->GetIrqTimeUs() / 1000.0);
+
+		std::vector<u32> latencies = gbas[p]->GetBlockLatencies();
+		std::sort(latencies.begin(), latencies.end());
+		printf("block latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f over %u blocks\n",
+		       getLatencyPercentile(latencies, 50), getLatencyPercentile(latencies, 90), getLatencyPercentile(latencies, 99),
+		       getLatencyPercentile(latencies, 100), (unsigned int) latencies.size());
+
+		std::vector<u32> roundTrips = gbas[p]->GetServerRoundTrips();
+		std::sort(roundTrips.begin(), roundTrips.end());
+		if (!roundTrips.empty())
+			printf("server round trip ms: p50 %.1f, p90 %.1f, max %.1f over %u requests\n",
+			       getLatencyPercentile(roundTrips, 50), getLatencyPercentile(roundTrips, 90), getLatencyPercentile(roundTrips, 100),
+			       (unsigned int) roundTrips.size());
+
+		const std::map<std::string, FeatureStats> &features = gbas[p]->GetFeatures();
+		if (!features.empty())
+			printf("%-8s %6s %14s %14s %12s %11s %10s\n", "FEATURE", "RUNS", "EXCHANGES/RUN", "SI_CMDS/RUN", "PAYLOAD/RUN", "WORDS/BYTE", "MS/RUN");
+
+		for (const auto &feature : features)
+			printf("%-8s %6u %14.1f %14.1f %12.1f %11.3f %10.1f\n", feature.first.c_str(), feature.second.runs,
+			       (double) feature.second.exchanges / feature.second.runs, (double) feature.second.siCommands / feature.second.runs,
+			       (double) feature.second.payloadBytes / feature.second.runs,
+			       feature.second.payloadBytes > 0 ? (double) feature.second.words / feature.second.payloadBytes : 0.0,
+			       feature.second.timeUs / 1000.0 / feature.second.runs);
+
+		std::vector<u32> connectTimes = gbas[p]->GetConnectTimes();
+		if (!connectTimes.empty())
+		{
+			u32 first = connectTimes[0];
+			std::vector<u32> reconnects(connectTimes.begin() + 1, connectTimes.end());
+			std::sort(reconnects.begin(), reconnects.end());
+
+			printf("connect ms (channel timer): first %u", first);
+			if (!reconnects.empty())
+				printf(", reconnect p50 %u, max %u over %u", reconnects[(reconnects.size() - 1) / 2], reconnects.back(), (unsigned int) reconnects.size());
+			printf("\n");
+		}
+	}
+
+	u32 cacheHits, cacheMisses;
+	getRequestCacheStats(&cacheHits, &cacheMisses);
+
+	if (cacheHits + cacheMisses > 0)
+		printf("\nrequest cache: %u answered by the channel, %u went to the server\n", (unsigned int) cacheHits, (unsigned int) cacheMisses);
+}
+
+/* How far apart the best and worst served ports are, a fair link should be close to 1 */
+static void printFairness(const std::vector<SimGba *> &gbas)
+{
+	double bestP99 = 0, worstP99 = 0, bestP50 = 0, worstP50 = 0;
+
+	for (size_t p = 0; p < gbas.size(); p++)
+	{
+		std::vector<u32> latencies = gbas[p]->GetBlockLatencies();
+		std::sort(latencies.begin(), latencies.end());
+		double p50 = getLatencyPercentile(latencies, 50);
+		double p99 = getLatencyPercentile(latencies, 99);
+
+		if (p == 0 || p50 < bestP50) bestP50 = p50;
+		if (p == 0 || p50 > worstP50) worstP50 = p50;
+		if (p == 0 || p99 < bestP99) bestP99 = p99;
+		if (p == 0 || p99 > worstP99) worstP99 = p99;
+	}
+
+	printf("\nfairness: p50 worst/best %.2f (%.1f / %.1f ms), p99 worst/best %.2f (%.1f / %.1f ms)\n",
+	       bestP50 > 0 ? worstP50 / bestP50 : 0.0, worstP50, bestP50, bestP99 > 0 ? worstP99 / bestP99 : 0.0, worstP99, bestP99);
+}
+
+/* What an exchange cost next to the send and receive it stands in for, over every port */
+static void printDuplex(const std::vector<SimGba *> &gbas)
+{
+	FeatureStats separate = {};
+	FeatureStats exchange = {};
+
+	for (SimGba *gba : gbas)
+	{
+		const std::map<std::string, FeatureStats> &features = gba->GetFeatures();
+
+		for (const auto &feature : features)
+		{
+			FeatureStats &total = feature.first == "EXCHANGE" ? exchange : separate;
+			total.runs += feature.second.runs;
+			total.siCommands += feature.second.siCommands;
+			total.words += feature.second.words;
+			total.payloadBytes += feature.second.payloadBytes;
+			total.timeUs += feature.second.timeUs;
+		}
+	}
+
+	if (separate.payloadBytes == 0 || exchange.payloadBytes == 0)
+		return;
+
+	printf("\nduplex: %.3f words/byte and %.1f ms/run exchanged, %.3f words/byte and %.1f ms/run sent and received (%.0f%% of the SI commands, %.0f%% of the time)\n",
+	       (double) exchange.words / exchange.payloadBytes, exchange.timeUs / 1000.0 / exchange.runs,
+	       (double) separate.words / separate.payloadBytes, separate.timeUs / 1000.0 / separate.runs,
+	       100.0 * exchange.siCommands / separate.siCommands * separate.runs / exchange.runs, 100.0 * exchange.timeUs / separate.timeUs * separate.runs / exchange.runs);
+}
+
+int main(int argc, char **argv)
+{
+	SimOptions options;
+
+	if (!parseOptions(argc, argv, &options))
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	std::vector<JoybusWire *> wires;
+	std::vector<SimGba *> gbas;
+	std::vector<PortResult> results(options.ports);
+
+	for (int port = 0; port < options.ports; port++)
+	{
+		wires.push_back(new JoybusWire(options.wire, options.seed + port));
+		gbas.push_back(new SimGba(port, wires[port], options.frameUs, options.legacy, !options.polled));
+		JoybusWire_Attach(port, wires[port]);
+	}
+
+	if (!options.server.empty())
+		setOverrideAddress((char *) options.server.c_str());
+
+	if (!options.trace.empty() && TR_start(options.trace.c_str()) < 0)
+	{
+		fprintf(stderr, "Could not record a trace to %s\n", options.trace.c_str());
+		return 2;
+	}
+
+	setupGBAConnectors();
+
+	// What the menu does when the server is typed in, the pool is filled from another thread so wait for it to have something
+	if (options.warmPool && !options.server.empty())
+	{
+		u32 result = testTCPConnection((char *) options.server.c_str());
+		printf("Server test %s\n", result == CONNECTION_SUCCESS ? "passed" : "failed");
+
+		for (int waited = 0; waited < 2000 && getPooledSessions() == 0; waited++)
+			usleep(1000);
+
+		printf("%u pooled sessions\n", (unsigned int) getPooledSessions());
+	}
+
+	// Give the channel a moment to find the GBAs the same way the real one would
+	while (true)
+	{
+		bool allConnected = true;
+		for (int port = 0; port < options.ports; port++)
+			allConnected = allConnected && isConnected(port);
+
+		if (allConnected)
+			break;
+
+		usleep(1000);
+	}
+
+	std::vector<std::thread> threads;
+	for (int port = 0; port < options.ports; port++)
+		threads.emplace_back(runPort, gbas[port], &options, &results[port]);
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	printReport(gbas, wires, results);
+
+	if (options.scenario == SCENARIO_STRESS)
+		printFairness(gbas);
+
+	if (options.scenario == SCENARIO_DUPLEX)
+		printDuplex(gbas);
+
+	if (options.telemetry == "-")
+	{
+		printf("\n");
+		TL_dump(stdout);
+	}
+	else if (!options.telemetry.empty() && TL_dumpToFile(options.telemetry.c_str()) < 0)
+	{
+		fprintf(stderr, "Could not write telemetry to %s\n", options.telemetry.c_str());
+	}
+
+	if (!options.trace.empty())
+	{
+		u32 lost = TR_getLost();
+
+		if (TR_stop() < 0)
+			fprintf(stderr, "Could not write all of the trace to %s\n", options.trace.c_str());
+		else if (lost > 0)
+			fprintf(stderr, "The trace is missing %u records, the rings were full\n", (unsigned int) lost);
+	}
+
+	bool passed = true;
+	for (const PortResult &result : results)
+		passed = passed && result.passed;
+
+	printf("\n%s\n", passed ? "ALL PORTS PASSED" : "SOME PORTS FAILED");
+
+	// The channel's threads never exit, so don't wait for them
+	fflush(stdout);
+	_exit(passed ? 0 : 1);
+}
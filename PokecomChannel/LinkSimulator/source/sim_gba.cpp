@@ -0,0 +1,285 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * sim_gba.cpp
+ * Drives pokeemerald's JOYBUS code the same way net_conn.c does
+ ***************************************************************************/
+
+#include "sim_gba.h"
+
+#include <string.h>
+
+#include "global.h"
+#include "net_conn_link.h"
+#include "constants/network.h"
+
+// The game will happily retry a block with bad check bytes forever, the simulator gives up eventually so a broken link can't hang CI
+#define MAX_CHECK_FAILURES_PER_BLOCK 200
+
+// Frames between a block finishing and the next one starting (NET_CONN_STATE_PROCESS -> onProcess -> Task_NetworkTaskLoop)
+#define FRAMES_BETWEEN_BLOCKS 2
+
+bool32 NetConnLink_CheckCanceled(u8 taskId)
+{
+	(void)(taskId);
+	return FALSE;
+}
+
+SimGba::SimGba(int port, JoybusWire *wire, u32 frameUs, bool legacy, bool background) : port(port), wire(wire), frameUs(frameUs), nextFrameUs(0), frameCount(0),
+	legacy(legacy), background(background), linkCaps(0), streamOffset(0), streamFallback(false), longestStallUs(0), framesStalled(0), irqTimeUs(0)
+{
+	memset(stats, 0, sizeof(stats));
+}
+
+int SimGba::GetMessageType(u16 cmd)
+{
+	switch (cmd >> 8)
+	{
+		case NET_CONN_SEND_REQ >> 8: return LINK_MSG_SEND;
+		case NET_CONN_RECV_REQ >> 8: return LINK_MSG_RECV;
+		case NET_CONN_TRAN_REQ >> 8: return LINK_MSG_TRAN;
+		case NET_CONN_PINF_REQ >> 8: return LINK_MSG_INFO;
+		case NET_CONN_LIFN_REQ >> 8: return LINK_MSG_LIFN;
+		case NET_CONN_CALL_REQ >> 8: return LINK_MSG_CALL;
+		case NET_CONN_STRM_REQ >> 8: return LINK_MSG_STRM;
+		case NET_CONN_XCHG_REQ >> 8: return LINK_MSG_XCHG;
+		default:                     return LINK_MSG_OTHER;
+	}
+}
+
+const char *SimGba::GetMessageTypeName(int type)
+{
+	static const char *names[LINK_MSG_COUNT] = { "SEND", "RECV", "TRAN", "INFO", "LIFN", "CALL", "STRM", "XCHG", "OTHER" };
+	return names[type];
+}
+
+u32 SimGba::GetTotalAttempts() const
+{
+	u32 attempts = 0;
+
+	for (int type = 0; type < LINK_MSG_COUNT; type++)
+		attempts += stats[type].attempts;
+
+	return attempts;
+}
+
+void SimGba::RecordFeature(const std::string &name, u32 exchanges, u32 siCommands, u32 words, u32 payloadBytes, u64 timeUs)
+{
+	FeatureStats &feature = features[name];
+
+	feature.runs++;
+	feature.exchanges += exchanges;
+	feature.siCommands += siCommands;
+	feature.words += words;
+	feature.payloadBytes += payloadBytes;
+	feature.timeUs += timeUs;
+}
+
+void SimGba::WaitForNextFrame()
+{
+	u64 now = LinkSim_NowUs();
+
+	if (nextFrameUs == 0)
+		nextFrameUs = now;
+
+	// If a transfer ran over several frames the game just picks up on the next vblank
+	while (nextFrameUs <= now)
+	{
+		nextFrameUs += frameUs;
+		frameCount++;
+	}
+
+	// The GBA is idle in VBlankIntrWait, which is when the serial interrupt gets its turn
+	irqTimeUs += wire->ServiceIrqs(nextFrameUs, NetConnLink_SerialIntr);
+}
+
+void SimGba::RecordStall(u64 us)
+{
+	if (us > longestStallUs)
+		longestStallUs = us;
+
+	framesStalled += (u32) (us / frameUs);
+}
+
+
+void SimGba::WaitFrames(u32 frames)
+{
+	for (u32 i = 0; i < frames; i++)
+		WaitForNextFrame();
+}
+
+void SimGba::WaitTextAnimation(u16 duration)
+{
+	WaitFrames(((u32) duration + 1) * 2);
+}
+
+bool SimGba::WaitForStatusPush(u16 duration, u8 *status)
+{
+	for (u32 i = 0; i < ((u32) duration + 1) * 2; i++)
+	{
+		WaitForNextFrame();
+
+		if (NetConnLink_TakeStatusPush(status))
+			return true;
+	}
+
+	return false;
+}
+
+void SimGba::Handshake()
+{
+	JoybusWire_BindGbaThread(wire);
+	NetConnLink_SetBackground(background);
+
+	if (legacy)
+		return;
+
+	WaitForNextFrame();
+	linkCaps = NetConnLink_Handshake(0);
+}
+
+bool SimGba::DoBlock(u16 cmd, u8 *data, u16 length, bool disableChecks, int kind, u16 recvCmd, u8 *response, u16 responseLength)
+{
+	LinkMessageStats &msgStats = stats[GetMessageType(cmd)];
+	s32 retriesLeft = MAX_CONNECTION_RETRIES;
+	u32 checkFailures = 0;
+	u16 streamErrorOffset = 0;
+	u32 streamStalls = 0;
+	u64 startUs = 0;
+
+	JoybusWire_BindGbaThread(wire);
+
+	while (true)
+	{
+		WaitForNextFrame();
+
+		if (startUs == 0)
+			startUs = LinkSim_NowUs();
+
+		u64 attemptStartUs = LinkSim_NowUs();
+		u8 result;
+		if (kind == BLOCK_STREAM)
+			result = NetConnLink_StreamBlock(cmd, data, length, &streamOffset, 0);
+		else if (kind == BLOCK_EXCHANGE)
+			result = NetConnLink_ExchangeBlock(cmd, data, length, recvCmd, response, responseLength, 0);
+		else if (kind == BLOCK_CALL)
+			result = NetConnLink_CallBlock(cmd, data, length, recvCmd, response, responseLength, 0);
+		else if (kind == BLOCK_RECEIVE)
+			result = NetConnLink_ReceiveBlock(cmd, data, length, disableChecks, 0);
+		else
+			result = NetConnLink_TransferBlock(cmd, data, length, disableChecks, 0);
+		RecordStall(LinkSim_NowUs() - attemptStartUs);
+
+		// Task_NetworkTaskLoop checks on a background block once a frame until it's over
+		while (result == NET_CONN_LINK_BUSY)
+		{
+			WaitForNextFrame();
+			u64 pollStartUs = LinkSim_NowUs();
+			result = NetConnLink_PollBlock();
+			RecordStall(LinkSim_NowUs() - pollStartUs);
+		}
+
+		msgStats.linkTimeUs += LinkSim_NowUs() - attemptStartUs;
+		msgStats.attempts++;
+		msgStats.framesResent += NetConnLink_GetFramesResent();
+
+		if (result == NET_CONN_LINK_OK)
+		{
+			msgStats.blocks++;
+			msgStats.bytes += length + (kind == BLOCK_CALL || kind == BLOCK_EXCHANGE ? responseLength : 0);
+			msgStats.totalTimeUs += LinkSim_NowUs() - startUs;
+			blockLatencies.push_back((u32) (LinkSim_NowUs() - startUs));
+			WaitFrames(FRAMES_BETWEEN_BLOCKS);
+			return true;
+		}
+		else if (result == NET_CONN_LINK_CHECK_FAILED)
+		{
+			msgStats.checkFailures++;
+			if (++checkFailures >= MAX_CHECK_FAILURES_PER_BLOCK)
+				break;
+		}
+		else
+		{
+			// NET_CONN_STATE_ERROR: JOY_TRANS is cleared and the serial is reset before starting again from NET_CONN_STATE_INIT
+			// (a stream handshakes again the same way, but keeps streamOffset)
+			msgStats.errors++;
+			JOY_TRANS = 0;
+			if (kind == BLOCK_STREAM && streamOffset == streamErrorOffset && ++streamStalls >= MAX_STREAM_STALLS)
+			{
+				// DoStreamDataBlock goes back through NET_CONN_STATE_INIT to the retry point, which reads in chunks from then on
+				streamFallback = true;
+				WaitFrames(FRAMES_BETWEEN_BLOCKS);
+				Handshake();
+				break;
+			}
+			if (--retriesLeft < 0)
+				break;
+			streamErrorOffset = streamOffset;
+			WaitFrames(FRAMES_BETWEEN_BLOCKS);
+			Handshake();
+		}
+	}
+
+	msgStats.totalTimeUs += LinkSim_NowUs() - startUs;
+	return false;
+}
+
+bool SimGba::Send(u16 cmd, const u8 *data, u16 length, bool disableChecks)
+{
+	static u8 empty[4];
+	return DoBlock(cmd, data != NULL ? (u8 *) data : empty, length, disableChecks, BLOCK_SEND);
+}
+
+bool SimGba::Receive(u16 cmd, u8 *data, u16 length, bool disableChecks)
+{
+	return DoBlock(cmd, data, length, disableChecks, BLOCK_RECEIVE);
+}
+
+bool SimGba::Call(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength)
+{
+	return DoBlock(cmd, (u8 *) data, length, false, BLOCK_CALL, recvCmd, response, responseLength);
+}
+
+u16 SimGba::GetCallResponseLength() const
+{
+	return NetConnLink_GetCallResponseLength();
+}
+
+bool SimGba::Stream(u16 cmd, u8 *data, u16 length)
+{
+	streamOffset = 0;
+	streamFallback = false;
+	return DoBlock(cmd, data, length, false, BLOCK_STREAM);
+}
+
+bool SimGba::Exchange(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength)
+{
+	return DoBlock(cmd, (u8 *) data, length, false, BLOCK_EXCHANGE, recvCmd, response, responseLength);
+}
+
+u16 SimGba::GetChunkSize() const
+{
+	return (linkCaps & NET_CONN_LINK_CAP_FRAMED) ? FRAMED_CHUNK_SIZE : MINIMUM_CHUNK_SIZE;
+}
+
+bool SimGba::SendChunked(u16 cmd, const u8 *data, u16 length, u16 chunkSize)
+{
+	for (u16 offset = 0; offset < length; offset += chunkSize)
+	{
+		u16 size = length - offset < chunkSize ? length - offset : chunkSize;
+		if (!Send(cmd + offset / MINIMUM_CHUNK_SIZE, data + offset, size))
+			return false;
+	}
+	return true;
+}
+
+bool SimGba::ReceiveChunked(u16 cmd, u8 *data, u16 length, u16 chunkSize)
+{
+	for (u16 offset = 0; offset < length; offset += chunkSize)
+	{
+		u16 size = length - offset < chunkSize ? length - offset : chunkSize;
+		if (!Receive(cmd + offset / MINIMUM_CHUNK_SIZE, data + offset, size))
+			return false;
+	}
+	return true;
+}
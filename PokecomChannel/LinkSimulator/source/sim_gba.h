@@ -0,0 +1,139 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * sim_gba.h
+ * Drives pokeemerald's JOYBUS code (src/net_conn_link.c) the same way
+ * Task_NetworkTaskLoop in net_conn.c does, and keeps count of what it cost
+ ***************************************************************************/
+
+#ifndef _SIM_GBA_H_
+#define _SIM_GBA_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gccore.h"
+#include "joybus_wire.h"
+
+// Message types are grouped on the first byte of the NET_CONN command
+enum {
+	LINK_MSG_SEND = 0, // 0x15 NET_CONN_SEND_REQ
+	LINK_MSG_RECV,     // 0x25 NET_CONN_RECV_REQ
+	LINK_MSG_TRAN,     // 0x13 NET_CONN_TRAN_REQ
+	LINK_MSG_INFO,     // 0x12 NET_CONN_PINF_REQ / NET_CONN_CINF_REQ
+	LINK_MSG_LIFN,     // 0x20 NET_CONN_LIFN_REQ
+	LINK_MSG_CALL,     // 0x16 NET_CONN_CALL_REQ
+	LINK_MSG_STRM,     // 0x27 NET_CONN_STRM_REQ
+	LINK_MSG_XCHG,     // 0x17 NET_CONN_XCHG_REQ
+	LINK_MSG_OTHER,
+	LINK_MSG_COUNT
+};
+
+struct LinkMessageStats {
+	u32 blocks;        //!< Blocks that completed
+	u32 attempts;      //!< Times a block was put on the wire (including retries)
+	u32 checkFailures; //!< Attempts where the check bytes didn't match
+	u32 errors;        //!< Attempts where the wii stopped responding
+	u32 framesResent;  //!< Frames sent again within an attempt (framed link mode only), or stream segments that will be sent again
+	u64 bytes;         //!< Payload bytes of completed blocks
+	u64 linkTimeUs;    //!< Time spent inside the JOYBUS code
+	u64 totalTimeUs;   //!< Time from the first attempt to completion, including the frames spent waiting to retry
+};
+
+//!< What one game feature (a download, say) cost on the link, summed over every time it ran
+struct FeatureStats {
+	u32 runs;
+	u32 exchanges;  //!< Blocks the GBA started, including retries and LIFN polls
+	u32 siCommands; //!< Round trips over the cable
+	u32 words;      //!< Words that went over the cable, either way
+	u32 payloadBytes; //!< Bytes of the answer that came over the cable
+	u64 timeUs;
+};
+
+class SimGba {
+public:
+	SimGba(int port, JoybusWire *wire, u32 frameUs, bool legacy, bool background);
+
+	//!< NET_CONN_STATE_INIT, agrees on the link mode with the channel. Does nothing when pretending to be an older ROM
+	//!< (background is set up either way, like NetConnEnableSerial)
+	void Handshake();
+
+	//!< One configureSendRecvMgr + NET_CONN_STATE_SEND/RECEIVE. Returns false if the block could not be completed
+	bool Send(u16 cmd, const u8 *data, u16 length, bool disableChecks = false);
+	bool Receive(u16 cmd, u8 *data, u16 length, bool disableChecks = false);
+	//!< configureSendRecvMgrCall + NET_CONN_STATE_CALL, only works once the channel has agreed to NET_CONN_LINK_CAP_CALL
+	bool Call(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength);
+	//!< How much of the answer the last call moved, less than it asked for when the channel sized the answer (NET_CONN_LINK_CAP_SIZED_CALL)
+	u16 GetCallResponseLength() const;
+	//!< configureSendRecvMgrStream + NET_CONN_STATE_STREAM, only works once the channel has agreed to NET_CONN_LINK_CAP_STREAM
+	bool Stream(u16 cmd, u8 *data, u16 length);
+	//!< The last stream kept dropping without getting any further and gave up so the payload could be read in chunks (see MAX_STREAM_STALLS)
+	bool StreamFellBack() const { return streamFallback; }
+	//!< NET_CONN_XCHG_REQ, sends data and reads back response in one exchange. Only works once the channel has agreed to NET_CONN_LINK_CAP_DUPLEX
+	bool Exchange(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength);
+
+	//!< Same as configureSendRecvMgrChunked, each chunk is its own block in the next virtual channel
+	bool SendChunked(u16 cmd, const u8 *data, u16 length, u16 chunkSize);
+	bool ReceiveChunked(u16 cmd, u8 *data, u16 length, u16 chunkSize);
+	//!< Same as GetChunkSize in net_conn.c
+	u16 GetChunkSize() const;
+
+	//!< Mirrors DoWaitTextAnimation, which waits 2 frames per step
+	void WaitTextAnimation(u16 duration);
+	//!< The same wait, but checking for a pushed status every frame like LINKUP_WAIT_FOR_SERVER_TO_CONNECT. Returns false if none came
+	bool WaitForStatusPush(u16 duration, u8 *status);
+	void WaitFrames(u32 frames);
+
+	int GetPort() const { return port; }
+	u32 GetFrameCount() const { return frameCount; }
+	u16 GetLinkCaps() const { return linkCaps; }
+	const LinkMessageStats &GetStats(int type) const { return stats[type]; }
+	u32 GetTotalAttempts() const;
+	JoybusWire *GetWire() const { return wire; }
+	const std::vector<u32> &GetBlockLatencies() const { return blockLatencies; }
+	const std::vector<u32> &GetServerRoundTrips() const { return serverRoundTrips; }
+	const std::vector<u32> &GetConnectTimes() const { return connectTimes; }
+	const std::map<std::string, FeatureStats> &GetFeatures() const { return features; }
+	//!< Longest the game loop was held up in one go by the link code, and the frames it missed because of it
+	u64 GetLongestStallUs() const { return longestStallUs; }
+	u32 GetFramesStalled() const { return framesStalled; }
+	//!< GBA time spent in the serial interrupt, which the game loop doesn't get either
+	u64 GetIrqTimeUs() const { return irqTimeUs; }
+
+	//!< Time from a transmit finishing to LIFN saying the server has answered (see --poll-server)
+	void RecordServerRoundTrip(u32 us) { serverRoundTrips.push_back(us); }
+	void RecordConnectTime(u32 ms) { connectTimes.push_back(ms); }
+	void RecordFeature(const std::string &name, u32 exchanges, u32 siCommands, u32 words, u32 payloadBytes, u64 timeUs);
+
+	static int GetMessageType(u16 cmd);
+	static const char *GetMessageTypeName(int type);
+
+private:
+	enum { BLOCK_SEND, BLOCK_RECEIVE, BLOCK_CALL, BLOCK_STREAM, BLOCK_EXCHANGE };
+
+	bool DoBlock(u16 cmd, u8 *data, u16 length, bool disableChecks, int kind, u16 recvCmd = 0, u8 *response = NULL, u16 responseLength = 0);
+	void WaitForNextFrame();
+	void RecordStall(u64 us);
+
+	int port;
+	JoybusWire *wire;
+	u32 frameUs;
+	u64 nextFrameUs;
+	u32 frameCount;
+	bool legacy;
+	bool background; //!< Framed blocks are moved by the serial interrupt (NetConnLink_SetBackground)
+	u16 linkCaps;
+	u16 streamOffset; //!< Carried over every attempt at a stream, like sSendRecvMgr.streamOffset
+	bool streamFallback;
+	LinkMessageStats stats[LINK_MSG_COUNT];
+	std::vector<u32> blockLatencies; //!< totalTimeUs of every completed block, in order
+	std::vector<u32> serverRoundTrips; //!< In us, in order
+	std::vector<u32> connectTimes; //!< In ms as timed by the channel, one per linkup
+	std::map<std::string, FeatureStats> features;
+	u64 longestStallUs;
+	u32 framesStalled;
+	u64 irqTimeUs;
+};
+
+#endif
@@ -0,0 +1,23 @@
+/****************************************************************************
+ * Pokecom Link Simulator
+ *
+ * util_host.cpp
+ * PC implementations of the pokeemerald util.c functions the link code uses
+ ***************************************************************************/
+
+#include "util.h"
+
+// Same result as the table in util.c (CRC-16/CCITT reflected, seeded with 0x1121)
+u16 CalcCRC16WithTable(const u8 *data, u32 length)
+{
+	u16 crc = 0x1121;
+
+	for (u32 i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+
+	return ~crc;
+}
@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <wiiuse/wpad.h>
 #include "seriallink.h"
+#include "net_protocol.h"
 #include "pokestring.h"
 
 #define ENABLE_DEBUG_LOG   // enable ERROR_LOG
@@ -31,17 +32,6 @@
 #define LOG_AS(x, ...) { usleep(10000); }
 #endif
 
-#define SERVER_NAME_REQUEST "NR_"
-#define WELCOME_REQUEST "WR_"
-#define SEND_PLAYER_DATA "PD_"
-
-#define NET_CONN_HANDSHAKE_REQ 0xCAD0 // Sent by the gba to handshake
-#define NET_CONN_HANDSHAKE_RES_NO_INTERNET 0xCAD1 // Response to the gba if we have no internet
-#define NET_CONN_HANDSHAKE_RES_ONLINE 0xCAD2 // Response to the gba if we have internet
-
-#define MAX_MSG_SIZE 4096
-#define VIRTUAL_CHANNEL_SIZE 16
-
 // Selection of serial input identifier codes
 #define SI_ERROR_UNDER_RUN      0x0001
 #define SI_ERROR_OVER_RUN       0x0002
@@ -57,20 +47,6 @@
 #define SI_GBA_BIOS             (SI_TYPE_N64 | 0x00040800)
 #define SI_GC_CONTROLLER        (SI_TYPE_GC | SI_GC_STANDARD)
 
-// Special Commands Recognised by the wii
-#define NET_CONN_SEND_REQ 0x1500 // Tell wii you want to send it data              | msg bytes 15 YY XX XX (X is the 16bit size of msg to send, YY is the virtual channel)
-#define NET_CONN_SEND_ANY 0x15
-#define NET_CONN_RECV_REQ 0x2500 // Tell wii to send us data from the buffer for this devices port | msg bytes 25 YY XX XX (X is the 16bit size of msg to receive, YY is the virtual channel)
-#define NET_CONN_RECV_ANY 0x25 
-#define NET_CONN_TRAN_ANY 0x13
-#define NET_CONN_BCLR_REQ 0x1200 // Tell wii to clear the whole message buffer     | msg bytes 12 00 XX XX (last 16 bits are unused)
-#define NET_CONN_PINF_REQ 0x1201 // Tell wii to use current data as player info    | msg bytes 12 01 XX XX (last 16 bits are unused)
-#define NET_CONN_CINF_REQ 0x1202 // Tell wii to use current data as server info    | msg bytes 12 02 XX XX (last 16 bits are unused)
-// Special Commands Comming from the wii
-#define NET_CONN_CHCK_RES 0x1101 // Returning check bytes for the last data sent   | msg bytes 12 01 XX XX (X are the 16bit check bytes, made by XORing each seq 16bits of the msg)
-#define NET_CONN_LIFN_REQ 0x2005 // Return information about this devices network connection 
-
-
 // Serial Data Commands
 #define SI_STATUS 0x00
 #define SI_READ 0x14
@@ -0,0 +1,233 @@
+// Generated by Protocol/generate.js from Protocol/protocol.json, change those instead of this file
+
+#ifndef _NET_PROTOCOL_H_
+#define _NET_PROTOCOL_H_
+
+// The wii side of the cable
+#define MAX_MSG_SIZE 4096                                                             // The wii's buffer for each gba, which the virtual channels divide up
+#define VIRTUAL_CHANNEL_SIZE 16                                                       // Command channel numbers are multiplied by this to get the offset in the buffer
+
+// Both ends of the cable
+#define NET_CONN_HANDSHAKE_REQ 0xCAD0                                                 // Sent by the gba to handshake | msg bytes CA D0 XX XX (X are the capabilities the gba supports)
+#define NET_CONN_HANDSHAKE_RES_NO_INTERNET 0xCAD1                                     // Response to the gba if we have no internet | msg bytes CA D1 XX XX (X are the capabilities to use)
+#define NET_CONN_HANDSHAKE_RES_ONLINE 0xCAD2                                          // Response to the gba if we have internet | msg bytes CA D2 XX XX (X are the capabilities to use)
+#define NET_CONN_LINK_CAP_FRAMED 0x0001
+#define NET_CONN_LINK_CAP_CALL 0x0002                                                 // Only ever agreed along with NET_CONN_LINK_CAP_FRAMED
+#define NET_CONN_LINK_CAP_STREAM 0x0004
+#define NET_CONN_LINK_CAP_SIZED_CALL 0x0008                                           // Only ever agreed along with NET_CONN_LINK_CAP_CALL
+#define NET_CONN_LINK_CAP_LIFN_PUSH 0x0010                                            // The wii writes a waiting gba the NET_CONN_LIFN_REQ answer again whenever it changes
+#define NET_CONN_LINK_CAP_DUPLEX 0x0020                                               // NET_CONN_XCHG_REQ, only ever agreed along with NET_CONN_LINK_CAP_FRAMED
+#define NET_CONN_FACK_RES 0x1180                                                      // Frame ack, the low bits are the round | msg bytes 11 8R XX XX (X is a bitmap of the frames that need to be sent again)
+#define NET_CONN_FRAME_MARK 0xF7                                                      // First byte of every frame trailer | msg bytes F7 SS XX XX (S is the frame sequence number, X is the CRC16 of the frame)
+#define NET_CONN_FRAME_SIZE 16
+#define NET_CONN_MAX_FRAMES 16
+#define NET_CONN_MAX_FRAME_ROUNDS 4
+#define NET_CONN_CALL_RES 0x11C0                                                      // The server has answered a call | msg bytes 11 C0 XX XX (X is NET_CONN_CALL_ANSWERED, or 0 if the server never answered. With NET_CONN_LINK_CAP_SIZED_CALL X is the size of the answer instead)
+#define NET_CONN_CALL_ANSWERED 0x0001
+#define NET_CONN_STRM_FROM 0x11D0                                                     // Sent straight after NET_CONN_STRM_REQ | msg bytes 11 D0 XX XX (X is the offset to start from, always a multiple of NET_CONN_STREAM_SEGMENT_SIZE)
+#define NET_CONN_SACK_RES 0x11E0                                                      // Stream ack, sent by the gba at the end | msg bytes 11 E0 XX XX (X is how much of the payload the gba has, the next stream starts there)
+#define NET_CONN_STREAM_SEGMENT_SIZE 256
+#define NET_CONN_STREAM_MAX_SIZE 4096                                                 // The wii's buffer for each gba
+#define NET_CONN_CHCK_RES 0x1101                                                      // Returning check bytes for the last data sent | msg bytes 11 01 XX XX (X are the 16bit check bytes, made by XORing each seq 16bits of the msg)
+#define NET_CONN_LZ77_MARK 0x4C5A                                                     // "LZ", put after a request's own data to say the gba can take the answer compressed
+#define NET_CONN_LZ77_TYPE 0x10                                                       // First byte of the LZ77 header, the other 3 are the size once uncompressed
+#define NET_CONN_RAW_MARK 0x5257                                                      // "RW", where NET_CONN_LZ77_MARK would be to say an answer that could have come compressed didn't
+#define NET_CONN_PACKED_HEADER_SIZE 4                                                 // In front of the payload of an answer to a request with NET_CONN_LZ77_MARK | msg bytes MM MM SS SS (M is NET_CONN_LZ77_MARK or NET_CONN_RAW_MARK, S is the big endian size of the payload as sent)
+
+// Bytes in each frame of a length byte block, NET_CONN_FRAME_SIZE unless that needs more than NET_CONN_MAX_FRAMES frames, then as few (whole words) as fit it in that many
+#define NET_CONN_GET_FRAME_SIZE(length) ((length) > NET_CONN_FRAME_SIZE * NET_CONN_MAX_FRAMES ? ((((length) + NET_CONN_MAX_FRAMES - 1) / NET_CONN_MAX_FRAMES) + 3) & ~3 : NET_CONN_FRAME_SIZE)
+
+// Commands the wii recognises, the low byte of those with an *_ANY is the virtual channel
+#define NET_CONN_LIFN_REQ 0x2005                                                      // Return information about this devices network connection | msg bytes 20 05 XX XX (last 16 bits are unused, the answer is the one word 20 05 RR SS, R is 1 once ready and S the connection state)
+#define NET_CONN_RECV_REQ 0x2500                                                      // Tell wii to send us data from the buffer for this devices port | msg bytes 25 YY XX XX (X is the 16bit size of msg to receive, YY is the virtual channel)
+#define NET_CONN_RECV_ANY 0x25                                                        // First byte of any NET_CONN_RECV_REQ
+#define NET_CONN_SEND_REQ 0x1500                                                      // Tell wii you want to send it data | msg bytes 15 YY XX XX (X is the 16bit size of msg to send, YY is the virtual channel)
+#define NET_CONN_SEND_ANY 0x15                                                        // First byte of any NET_CONN_SEND_REQ
+#define NET_CONN_TRAN_REQ 0x1300                                                      // Tell wii to send it current data to the server | msg bytes 13 YY XX XX (last 16 bits are size of message to transsmit, YY is the virtual channel)
+#define NET_CONN_TRAN_ANY 0x13                                                        // First byte of any NET_CONN_TRAN_REQ
+#define NET_CONN_CALL_REQ 0x1600                                                      // Send a request, transmit it and receive the answer | msg bytes 16 YY XX XX then 25 ZZ RR RR (X is the size of the request for channel Y, R the size of the answer read from channel Z)
+#define NET_CONN_CALL_ANY 0x16                                                        // First byte of any NET_CONN_CALL_REQ
+#define NET_CONN_STRM_REQ 0x2700                                                      // Stream a whole payload from the wii | msg bytes 27 YY XX XX then 11 D0 OO OO (X is the 16bit size of the whole payload, YY is the virtual channel, O where to start)
+#define NET_CONN_STRM_ANY 0x27                                                        // First byte of any NET_CONN_STRM_REQ
+#define NET_CONN_XCHG_REQ 0x1700                                                      // Send a block and read one back in the same exchange, a word each way per slot | msg bytes 17 YY XX XX then 25 ZZ RR RR (X is the size of the block for channel Y, R the size of the block read from channel Z)
+#define NET_CONN_XCHG_ANY 0x17                                                        // First byte of any NET_CONN_XCHG_REQ
+#define NET_CONN_BCLR_REQ 0x1200                                                      // Tell wii to clear the whole message buffer | msg bytes 12 00 XX XX (last 16 bits are unused)
+#define NET_CONN_PINF_REQ 0x1201                                                      // Tell wii to use current data as player info | msg bytes 12 01 XX XX (last 16 bits are unused)
+#define NET_CONN_CINF_REQ 0x1202                                                      // Tell wii to use current data as server info | msg bytes 12 02 XX XX (last 16 bits are unused)
+
+// Between the wii and the server
+#define NF_REQUEST_MARK 0x23                                                          // First byte of a request frame | msg bytes 23 TT SS SS (T is the tag, S is the 16bit big endian size of what follows)
+#define NF_RESPONSE_MARK 0x26                                                         // First byte of a response frame | msg bytes 26 TT SS SS (T is the tag of the request being answered)
+#define NF_HEADER_SIZE 4
+#define NF_MAX_BODY_SIZE 0xFFFF
+#define NF_MSG_ID 0x25                                                                // Responses meant for the gba | msg bytes 25 VV SS SS 5F (V is the virtual channel, S is the 16bit big endian size)
+#define NF_MSG_HEADER_SIZE 5
+#define NF_VIRTUAL_CHANNEL_SIZE 16
+#define SERVER_ANSWER_CHANNEL 0xF0                                                    // Virtual channel the server writes its answers to the game's requests to
+#define REQUEST_PREFIX_SIZE 3                                                         // Two letters and a '_', the server hands the handler everything after it
+#define SERVER_NAME_REQUEST "NR_"                                                     // Answered with SN_ and the server's name
+#define WELCOME_REQUEST "WR_"                                                         // Answered with a message for the game to show (WELCOME_ANSWER)
+#define SEND_PLAYER_DATA "PD_"                                                        // Followed by PLAYER_DATA_MSG, never answered
+#define PIPELINE_REQUEST "PL_"                                                        // Asks the server for tagged requests, it answers with a frame holding PL_ and the version it speaks (older servers send a single 0)
+#define PIPELINE_VERSION 1
+#define CACHE_REQUEST "CC_"                                                           // Asks the server which answers can be kept (pipelined sessions only, never answered itself). It sends a CACHE_VERSION for each kind it lets the channel keep
+#define CACHE_VERSION "CV_"                                                           // CACHE_VERSION_MSG, always with tag 0. Sent for CACHE_REQUEST, in front of an answer that can be kept and whenever what it answers with changes
+#define SERVER_GREETING "For the link to work, the Machine needs a special gemstone." // Sent by the server as soon as the wii connects
+#define BATTLE_REQUEST "BA_"                                                          // BATTLE_MSG, answered with BATTLE_ANSWER
+#define MART_REQUEST "MA_"                                                            // MART_MSG, answered with MART_ANSWER
+#define GIFT_EGG_REQUEST "GE_"                                                        // GIFT_EGG_MSG, answered with GIFT_EGG_ANSWER
+#define POST_MAIL_REQUEST "PM_"                                                       // POST_MAIL_MSG, answered with POST_MAIL_ANSWER
+#define READ_MAIL_REQUEST "RM_"                                                       // READ_MAIL_MSG, answered with READ_MAIL_ANSWER (or FF FF if there's no new mail)
+#define TRADE_REQUEST "TR_"                                                           // TRADE_MSG, answered with TRADE_ANSWER once someone else offers a mon (or the server gives up after 3.1s)
+#define FRIEND_KEY_USED "1"                                                           // MODE of a request that only wants players with the same FRIEND_KEY, '0' for anyone
+#define POST_MAIL_OK 200                                                              // STATUS of POST_MAIL_ANSWER
+
+// PLAYER_DATA_MSG: What the channel sends after SEND_PLAYER_DATA, the gba's NET_CONN_PINF_REQ data
+#define PLAYER_DATA_MSG_PREFIX_OFFSET 0
+#define PLAYER_DATA_MSG_PREFIX_SIZE 3
+#define PLAYER_DATA_MSG_PLAYER_NAME_OFFSET 3
+#define PLAYER_DATA_MSG_PLAYER_NAME_SIZE 8
+#define PLAYER_DATA_MSG_TRAINER_ID_OFFSET 11                                          // Big endian
+#define PLAYER_DATA_MSG_TRAINER_ID_SIZE 2
+#define PLAYER_DATA_MSG_GENDER_OFFSET 13
+#define PLAYER_DATA_MSG_GENDER_SIZE 1
+#define PLAYER_DATA_MSG_GAME_NAME_OFFSET 14
+#define PLAYER_DATA_MSG_GAME_NAME_SIZE 20
+#define PLAYER_DATA_MSG_PADDING_OFFSET 34
+#define PLAYER_DATA_MSG_PADDING_SIZE 1
+#define PLAYER_DATA_MSG_SIZE 35
+
+// BATTLE_MSG
+#define BATTLE_MSG_PREFIX_OFFSET 0
+#define BATTLE_MSG_PREFIX_SIZE 3
+#define BATTLE_MSG_TRAINER_OFFSET 3                                                   // Always '1', for when there's more than one downloadable trainer
+#define BATTLE_MSG_TRAINER_SIZE 1
+#define BATTLE_MSG_LZ77_MARK_OFFSET 4                                                 // NET_CONN_LZ77_MARK if the team can come back compressed
+#define BATTLE_MSG_LZ77_MARK_SIZE 2
+#define BATTLE_MSG_PADDING_OFFSET 6
+#define BATTLE_MSG_PADDING_SIZE 2
+#define BATTLE_MSG_SIZE 8
+
+// MART_MSG
+#define MART_MSG_PREFIX_OFFSET 0
+#define MART_MSG_PREFIX_SIZE 3
+#define MART_MSG_MART_OFFSET 3                                                        // Always '1'
+#define MART_MSG_MART_SIZE 1
+#define MART_MSG_SIZE 4
+
+// GIFT_EGG_MSG
+#define GIFT_EGG_MSG_PREFIX_OFFSET 0
+#define GIFT_EGG_MSG_PREFIX_SIZE 3
+#define GIFT_EGG_MSG_EGG_OFFSET 3                                                     // Always '1'
+#define GIFT_EGG_MSG_EGG_SIZE 1
+#define GIFT_EGG_MSG_SIZE 4
+
+// POST_MAIL_MSG
+#define POST_MAIL_MSG_PREFIX_OFFSET 0
+#define POST_MAIL_MSG_PREFIX_SIZE 3
+#define POST_MAIL_MSG_MODE_OFFSET 3                                                   // FRIEND_KEY_USED or '0'
+#define POST_MAIL_MSG_MODE_SIZE 1
+#define POST_MAIL_MSG_FRIEND_KEY_OFFSET 4
+#define POST_MAIL_MSG_FRIEND_KEY_SIZE 4
+#define POST_MAIL_MSG_MAIL_TYPE_OFFSET 8                                              // Big endian item id
+#define POST_MAIL_MSG_MAIL_TYPE_SIZE 2
+#define POST_MAIL_MSG_MAIL_WORDS_OFFSET 10                                            // 9 big endian easy chat words
+#define POST_MAIL_MSG_MAIL_WORDS_SIZE 18
+#define POST_MAIL_MSG_SIZE 28
+
+// READ_MAIL_MSG
+#define READ_MAIL_MSG_PREFIX_OFFSET 0
+#define READ_MAIL_MSG_PREFIX_SIZE 3
+#define READ_MAIL_MSG_MODE_OFFSET 3
+#define READ_MAIL_MSG_MODE_SIZE 1
+#define READ_MAIL_MSG_FRIEND_KEY_OFFSET 4
+#define READ_MAIL_MSG_FRIEND_KEY_SIZE 4
+#define READ_MAIL_MSG_SIZE 8
+
+// TRADE_MSG
+#define TRADE_MSG_PREFIX_OFFSET 0
+#define TRADE_MSG_PREFIX_SIZE 3
+#define TRADE_MSG_MODE_OFFSET 3
+#define TRADE_MSG_MODE_SIZE 1
+#define TRADE_MSG_FRIEND_KEY_OFFSET 4
+#define TRADE_MSG_FRIEND_KEY_SIZE 4
+#define TRADE_MSG_LZ77_MARK_OFFSET 8                                                  // NET_CONN_LZ77_MARK if the partner's mon can come back compressed
+#define TRADE_MSG_LZ77_MARK_SIZE 2
+#define TRADE_MSG_PADDING_OFFSET 10
+#define TRADE_MSG_PADDING_SIZE 6
+#define TRADE_MSG_MON_OFFSET 16
+#define TRADE_MSG_MON_SIZE 100
+#define TRADE_MSG_SIZE 116
+
+// CACHE_VERSION_MSG
+#define CACHE_VERSION_MSG_PREFIX_OFFSET 0
+#define CACHE_VERSION_MSG_PREFIX_SIZE 3
+#define CACHE_VERSION_MSG_REQUEST_OFFSET 3                                            // The two letters of the request it's about, e.g. MA
+#define CACHE_VERSION_MSG_REQUEST_SIZE 2
+#define CACHE_VERSION_MSG_VERSION_OFFSET 5                                            // Big endian, answers kept from any other version are out of date
+#define CACHE_VERSION_MSG_VERSION_SIZE 4
+#define CACHE_VERSION_MSG_TTL_OFFSET 9                                                // Big endian seconds an answer can be kept for without hearing from the server
+#define CACHE_VERSION_MSG_TTL_SIZE 2
+#define CACHE_VERSION_MSG_TAG_OFFSET 11                                               // The request whose answer comes next and can be kept, 0 if it only brings the version up to date
+#define CACHE_VERSION_MSG_TAG_SIZE 1
+#define CACHE_VERSION_MSG_SIZE 12
+
+// WELCOME_ANSWER
+#define WELCOME_ANSWER_TEXT_OFFSET 0                                                  // Game text, 0xFF terminated
+#define WELCOME_ANSWER_TEXT_SIZE 48
+#define WELCOME_ANSWER_SIZE 48
+
+// BATTLE_ANSWER: For a BATTLE_MSG without the mark
+#define BATTLE_ANSWER_MONS_OFFSET 0                                                   // 3 mons of 16 bytes
+#define BATTLE_ANSWER_MONS_SIZE 48
+#define BATTLE_ANSWER_SIZE 48
+
+// BATTLE_PACKED_ANSWER: For a BATTLE_MSG with the mark, only as long as its TEAM
+#define BATTLE_PACKED_ANSWER_PACKING_OFFSET 0                                         // NET_CONN_LZ77_MARK if TEAM is compressed (only ever when that's smaller), NET_CONN_RAW_MARK if not
+#define BATTLE_PACKED_ANSWER_PACKING_SIZE 2
+#define BATTLE_PACKED_ANSWER_TEAM_SIZE_OFFSET 2                                       // Big endian
+#define BATTLE_PACKED_ANSWER_TEAM_SIZE_SIZE 2
+#define BATTLE_PACKED_ANSWER_TEAM_OFFSET 4                                            // BATTLE_ANSWER's MONS, or fewer bytes of them LZ77 compressed
+#define BATTLE_PACKED_ANSWER_TEAM_SIZE 48
+#define BATTLE_PACKED_ANSWER_SIZE 52
+
+// MART_ANSWER
+#define MART_ANSWER_ITEMS_OFFSET 0                                                    // Up to 6 little endian item ids, the rest is zeros
+#define MART_ANSWER_ITEMS_SIZE 16
+#define MART_ANSWER_SIZE 16
+
+// GIFT_EGG_ANSWER
+#define GIFT_EGG_ANSWER_EGG_OFFSET 0                                                  // Only the first 2 bytes are used
+#define GIFT_EGG_ANSWER_EGG_SIZE 4
+#define GIFT_EGG_ANSWER_SIZE 4
+
+// POST_MAIL_ANSWER
+#define POST_MAIL_ANSWER_STATUS_OFFSET 0                                              // POST_MAIL_OK
+#define POST_MAIL_ANSWER_STATUS_SIZE 1
+#define POST_MAIL_ANSWER_FRIEND_KEY_USED_OFFSET 1                                     // 1 if the mail was posted with a friend key
+#define POST_MAIL_ANSWER_FRIEND_KEY_USED_SIZE 1
+#define POST_MAIL_ANSWER_SIZE 2
+
+// READ_MAIL_ANSWER
+#define READ_MAIL_ANSWER_NAME_OFFSET 0
+#define READ_MAIL_ANSWER_NAME_SIZE 8
+#define READ_MAIL_ANSWER_MAIL_TYPE_OFFSET 8
+#define READ_MAIL_ANSWER_MAIL_TYPE_SIZE 2
+#define READ_MAIL_ANSWER_MAIL_WORDS_OFFSET 10
+#define READ_MAIL_ANSWER_MAIL_WORDS_SIZE 18
+#define READ_MAIL_ANSWER_SIZE 28
+
+// TRADE_ANSWER
+#define TRADE_ANSWER_NAME_OFFSET 0                                                    // The partner's name, game text
+#define TRADE_ANSWER_NAME_SIZE 8
+#define TRADE_ANSWER_PADDING_OFFSET 8
+#define TRADE_ANSWER_PADDING_SIZE 4
+#define TRADE_ANSWER_PACKING_OFFSET 12                                                // When TRADE_MSG had the mark, NET_CONN_LZ77_MARK if MON is compressed or NET_CONN_RAW_MARK if not. Otherwise zeros
+#define TRADE_ANSWER_PACKING_SIZE 2
+#define TRADE_ANSWER_MON_SIZE_OFFSET 14                                               // Big endian, zeros along with PACKING
+#define TRADE_ANSWER_MON_SIZE_SIZE 2
+#define TRADE_ANSWER_MON_OFFSET 16                                                    // All zeros if no one took the offer, fewer bytes LZ77 compressed if PACKING says so
+#define TRADE_ANSWER_MON_SIZE 100
+#define TRADE_ANSWER_SIZE 116
+
+#endif // _NET_PROTOCOL_H_
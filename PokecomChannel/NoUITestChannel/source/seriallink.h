@@ -8,6 +8,7 @@
 #include <ogcsys.h>
 #include <gccore.h>
 #include <string.h>
+#include "net_protocol.h"
 
 /**
 * Be aware we are using SIO_MULTI_MODE (SIOMULTI) with (i.e 16-bit multiplayer comms)
@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <gccore.h>
 #include <string.h>
+#include <time.h>
 #include <malloc.h>
 #include <ogcsys.h>
 #include <network.h>
@@ -20,6 +21,10 @@
 #include <errno.h>
 #include <wiiuse/wpad.h>
 #include "seriallink.h"
+#include "netframe.h"
+#include "net_protocol.h"
+#include "telemetry.h"
+#include "trace.h"
 #include "pokestring.h"
 #include "uilogger.h"
 
@@ -41,16 +46,28 @@
 #define LOG_AS(x, ...) { usleep(10000); }
 #endif
 
-#define SERVER_NAME_REQUEST "NR_"
-#define WELCOME_REQUEST "WR_"
-#define SEND_PLAYER_DATA "PD_"
-
-#define NET_CONN_HANDSHAKE_REQ 0xCAD0 // Sent by the gba to handshake
-#define NET_CONN_HANDSHAKE_RES_NO_INTERNET 0xCAD1 // Response to the gba if we have no internet
-#define NET_CONN_HANDSHAKE_RES_ONLINE 0xCAD2 // Response to the gba if we have internet
-
-#define MAX_MSG_SIZE 4096
-#define VIRTUAL_CHANNEL_SIZE 16
+#define SERVER_GREETING_TIMEOUT 1000 // ms we wait for the whole greeting before carrying on without it
+#define CONNECT_TIMEOUT 2000 // ms we give net_connect before giving up on the server
+#define CONNECT_POLL_DELAY 1000 // us between checks on a connect that's in progress
+#define HANDSHAKE_TIMEOUT 2000 // ms we wait for each answer while connecting, so a server that's stopped answering can't hold the thread
+
+// A server address can be a list, e.g. "192.168.1.10:9000,backup.example.com:9000", tried in order until one lets us in
+#define SERVER_ADDRESS_SEPARATOR ','
+#define SERVER_ENDPOINTS_MAX 4 // Servers we keep an eye on at once (across every port), and the most one address can list
+#define SERVER_POOL_SIZE 2 // Sessions already greeted and named (PL_ and NR_ done) kept open to each server that's up, ready for a gba to claim
+#define SERVER_CHECK_INTERVAL 10000 // ms between health checks on a server that's up, each check opens a fresh session and retires the oldest one
+#define SERVER_CHECK_BACKOFF_MAX 60000 // ms between health checks on a server that keeps failing them, at most
+#define SERVER_UNWANTED_AFTER 300000 // ms after nothing has asked for a server that its sessions are closed and it's no longer checked
+#define SERVER_POOL_POLL_DELAY 100000 // us between the pool thread looking for servers that are due a check
+
+#define TCP_MAX_IN_FLIGHT 4 // Transmissions from one gba that can be waiting on the server at once
+#define TCP_BUSY_POLL_MS 10 // How long we wait on the socket before checking for new requests while others are in flight
+#define TCP_IDLE_WAIT_MS 100 // How long we sleep with nothing in flight (queueing a request wakes us straight away)
+
+#define REQUEST_CACHE_ENTRIES 8 // Answers kept across every port, the one used longest ago makes way for a new one
+#define REQUEST_CACHE_VERSIONS 8 // Kinds of request (on each server) we keep the latest version of
+#define REQUEST_CACHE_KEY_SIZE 16 // Requests bigger than this are never kept
+#define REQUEST_CACHE_ANSWER_SIZE 256 // Nor are answers bigger than this
 
 // Selection of serial input identifier codes
 #define SI_ERROR_UNDER_RUN      0x0001
@@ -67,18 +84,13 @@
 #define SI_GBA_BIOS             (SI_TYPE_N64 | 0x00040800)
 #define SI_GC_CONTROLLER        (SI_TYPE_GC | SI_GC_STANDARD)
 
-// Special Commands Recognised by the wii
-#define NET_CONN_SEND_REQ 0x1500 // Tell wii you want to send it data              | msg bytes 15 YY XX XX (X is the 16bit size of msg to send, YY is the virtual channel)
-#define NET_CONN_SEND_ANY 0x15
-#define NET_CONN_RECV_REQ 0x2500 // Tell wii to send us data from the buffer for this devices port | msg bytes 25 YY XX XX (X is the 16bit size of msg to receive, YY is the virtual channel)
-#define NET_CONN_RECV_ANY 0x25 
-#define NET_CONN_TRAN_ANY 0x13
-#define NET_CONN_BCLR_REQ 0x1200 // Tell wii to clear the whole message buffer     | msg bytes 12 00 XX XX (last 16 bits are unused)
-#define NET_CONN_PINF_REQ 0x1201 // Tell wii to use current data as player info    | msg bytes 12 01 XX XX (last 16 bits are unused)
-#define NET_CONN_CINF_REQ 0x1202 // Tell wii to use current data as server info    | msg bytes 12 02 XX XX (last 16 bits are unused)
-// Special Commands Comming from the wii
-#define NET_CONN_CHCK_RES 0x1101 // Returning check bytes for the last data sent   | msg bytes 12 01 XX XX (X are the 16bit check bytes, made by XORing each seq 16bits of the msg)
-#define NET_CONN_LIFN_REQ 0x2005 // Return information about this devices network connection 
+// The commands and link constants are in net_protocol.h, generated from Protocol/protocol.json
+#define CALL_TIMEOUT 1000 // ms we wait on the server for a call before telling the gba it isn't coming (the gba waits longer than this)
+
+// Link modes agreed at NET_CONN_HANDSHAKE_REQ (see include/constants/network.h in the game for how frames work)
+#define NET_CONN_LINK_CAPS (NET_CONN_LINK_CAP_FRAMED | NET_CONN_LINK_CAP_CALL | NET_CONN_LINK_CAP_STREAM | NET_CONN_LINK_CAP_SIZED_CALL | NET_CONN_LINK_CAP_LIFN_PUSH | NET_CONN_LINK_CAP_DUPLEX) // Everything the channel supports
+#define FRAME_ACK_POLLS 100 // Times we check for the gba's frame ack before giving up on the block
+#define FRAME_ACK_POLL_DELAY 100 // us between checks for the gba's frame ack
 
 
 // Serial Data Commands
@@ -94,7 +106,7 @@
 
 #define SI_STATUS_CONNECTED 0x10
 
-#define MAX_TRANS_SIZE 1024
+#define MAX_TRANS_SIZE MAX_MSG_SIZE // Anything the gba can put in its virtual channels can be transmitted
 #define TCP_FLAGS 0
 
 #define SERVER_NAME_SIZE 32
@@ -112,7 +124,11 @@
                             : "=r" (rval)); rval; })
 bool IsDolphin(void)
 {        
+#ifdef GEKKO
     return (mfspr(SPR_ECID_U) == 0x0d96e200);
+#else
+    return false; // Host builds (see LinkSimulator) aren't running on a PPC at all
+#endif
 }
 
 // ======================= GBA LINK STUFF ======================================================
@@ -123,6 +139,13 @@ enum {
 	SERIAL_STATE_WAITING,
 	SERIAL_STATE_SENDING,
 	SERIAL_STATE_RECEIVING,
+	SERIAL_STATE_CALL_START, // Reading the receive command that follows NET_CONN_CALL_ANY
+	SERIAL_STATE_CALL_WAITING, // A call's request has been queued, waiting on the server before answering
+	SERIAL_STATE_CALL_ANSWERED, // Waiting for the gba to pick up NET_CONN_CALL_RES before sending the answer
+	SERIAL_STATE_STREAM_START, // Reading the offset that follows NET_CONN_STRM_ANY
+	SERIAL_STATE_STREAMING,
+	SERIAL_STATE_EXCHANGE_START, // Reading the receive command that follows NET_CONN_XCHG_ANY
+	SERIAL_STATE_EXCHANGING,
 	SERIAL_STATE_DONE,
 	SERIAL_STATE_ERROR
 };
@@ -133,13 +156,6 @@ enum {
     SERIAL_CONNECTED // When a connection has been established with the gba
 };
 
-typedef struct {
-	char playerName[8];
-	u16 trainerId;
-	u8 gender;
-	char gameName[20];
-} PlayerData;
-
 typedef struct {
 	PlayerData playerData; //!< game data for player connected to the port
 
@@ -151,7 +167,9 @@ typedef struct {
     u8 requestStop; //!< If we are waiting to stop
 
     u8 gcport; //!< the gamecube port we are listening on (starting from 0)
+    u16 linkCaps; //!< NET_CONN_LINK_CAP_* flags agreed with the gba at the last handshake (0 is the original unframed link)
     char receivedMsgBuffer[MAX_MSG_SIZE]; //!< Where we store data that has been recived from the gba/server
+	u32 dirtyChannels[MAX_MSG_SIZE / VIRTUAL_CHANNEL_SIZE / 32]; //!< One bit per virtual channel written since the last NET_CONN_BCLR_REQ
 } SerialConnector;
 
 // ======================= HTTP STUFF ======================================================
@@ -159,44 +177,146 @@ typedef struct {
 // Client Connector state (lifecycle state in the connection loop)
 enum {
 	TCP_STATE_INIT = 0,
-	TCP_STATE_WAITING,
-	TCP_STATE_SENDING,
-	TCP_STATE_FETCHING,
+	TCP_STATE_WAITING, // Connected, requests are sent and answered as they come in
 	TCP_STATE_DONE
 };
 
+// One of the servers an address lists
 typedef struct {
-	u8 connectionResult; //!< State the (externally visible) client is in i.e if it's connected or has had an error 
-    u8 internalState; //!<  State the (internal) current connection is in i.e sending data, waiting e.t.c
+	char address[64]; //!< host:port
+	struct sockaddr_in server;
+} ServerAddress;
 
-    bool requestSend; //!< If there is data waiting to be sent
-    bool requestFetch; //!< If we are waiting to fetch data
-    bool requestStop; //!< If we are waiting to stop
-	bool requestReset; //!< If we need to reconnect to the socket
+typedef struct {
+	u8 tag; //!< Echoed back by the server with the response (pipelined sessions only)
+	bool answered; //!< If the response has been copied to the serial connector's buffer
+	u16 answerSize; //!< The size of the 0x25 message that answered it, 0 if the answer wasn't one
+	u8 virtualChannel; //!< The virtual channel the data was transmitted from
+	u16 size; //!< The size of the data we are transmitting
+	u64 queuedAt; //!< When the gba asked for the transmission
+	bool cacheable; //!< If the server sent a CACHE_VERSION for the answer, so it can be kept
+	u32 cacheVersion; //!< The version it sent
+	u16 cacheTtl; //!< Seconds the answer can be kept for
+	char header[NF_HEADER_SIZE]; //!< Written in front of data when the session is pipelined, so the request goes out in one send without another copy
+	char data[MAX_TRANS_SIZE]; //!< Copy of the virtual channels taken when the gba asked, so it can carry on using them
+} TCPRequest;
 
-	bool threadActive; //!< If the thread using the connector is active
+/*
+* A TCPConnector's status word. The connection's result and state, and the requests to stop or reset it, are all kept in the
+* one word so the serial thread always sees them together (a LIFN answer is made from a single read of it). The network
+* thread and the serial thread both change it, always with an atomic read-modify-write so neither loses the other's change
+*/
+#define TCP_STATUS_RESULT 0x000000FF // The connection result (externally visible) i.e if it's connected or has had an error
+#define TCP_STATUS_STATE 0x0000FF00 // The TCP_STATE_* the (internal) current connection is in
+#define TCP_STATUS_STOP 0x00010000 // If we are waiting to stop
+#define TCP_STATUS_RESET 0x00020000 // If we need to reconnect to the socket
+#define TCP_STATUS_STATE_SHIFT 8
+
+typedef struct {
+	vu32 status; //!< TCP_STATUS_*, only ever changed through updateStatus
 
-	u8  trVitrualChannel; //!< The virtual channel we start transmitting from
-	u16 trSize; //!< The size of the data we are transmitting
+	bool threadActive; //!< If the thread using the connector is active
 
-    char *remoteAddressAndPort; //!< the address we are connecting to
-    char fetchedMsgBuffer[1024]; //!< Where we store data that has been recived
-    char sendMsgBuffer[1024]; //!< Where we store data that we want to send when ready
+	/*
+	* Transmissions from the gba, used as a ring. The serial thread only ever moves requestsQueued 
+	* and the network thread only moves requestsSent and requestsDone, so neither needs to lock
+	*/
+	TCPRequest requests[TCP_MAX_IN_FLIGHT];
+	vu32 requestsQueued; //!< Requests the gba has made
+	vu32 requestsSent; //!< Requests written to the socket
+	vu32 requestsDone; //!< Requests that have been answered (or dropped)
+	u8 nextTag; //!< Tag for the next request sent, 0 is kept for messages that don't get an answer
+	bool pipelined; //!< If the server agreed to tagged requests, otherwise it gets one request at a time like before
+
+	mutex_t wakeLock;
+	cond_t wake; //!< Signalled when a request is queued or the thread is asked to reset/stop
+
+    char remoteAddressAndPort[64]; //!< the address we are connecting to
+    char fetchedMsgBuffer[1024]; //!< Where we store data that has been recived (from servers that don't frame their responses)
+	NFReader reader; //!< Reassembles framed responses, 0x25 messages go straight to the serial connector's buffer
+    char sendMsgBuffer[NF_HEADER_SIZE + MAX_TRANS_SIZE]; //!< Where we build the requests made while connecting
 	SerialConnector *serialConnector; //!< A Reference serial connector so we can write data directly to its buffer
 	int sock; //!< The socket we are currently connected to
-	bool waitingForServer; //!< If we need to reconnect to the socket
+
+	char resolvedAddress[64]; //!< The address servers was worked out from, it's only looked up again if this changes
+	ServerAddress servers[SERVER_ENDPOINTS_MAX]; //!< Every server the address lists that could be looked up, in order
+	u8 serverCount;
+	u8 currentServer; //!< The one we're connected (or connecting) to
+	int standbySock; //!< A spare connection to the current server (already greeted) that a reset can pick up instead of connecting again
+	bool standbyTried; //!< If we've tried to open standbySock since the last connect
+
+	u64 connectStartedAt; //!< When the gba gave us the server address
+	u32 connectTime; //!< ms from connectStartedAt to CONNECTION_SUCCESS the last time we connected
 } TCPConnector;
 
+// ======================= SERVER POOL ======================================================
+
+enum {
+	SERVER_HEALTH_UNKNOWN = 0, // Not checked yet
+	SERVER_HEALTH_UP,
+	SERVER_HEALTH_DOWN // Failed its last check, or a port couldn't get in or lost its session
+};
+
+typedef struct {
+	int sock;
+	bool pipelined; //!< What the server agreed to at PIPELINE_REQUEST
+	u64 openedAt;
+} PooledSession;
+
+typedef struct {
+	ServerAddress address; //!< address.address[0] is 0 if the slot is free
+	u8 health; //!< SERVER_HEALTH_*
+	u8 failures; //!< Checks (or ports) that have failed to get in, in a row
+	u64 nextCheckAt;
+	u64 wantedAt; //!< The last time a port or the menu asked for it
+	PooledSession sessions[SERVER_POOL_SIZE]; //!< Oldest first
+	u8 pooled;
+} ServerEndpoint;
+
+// ======================= REQUEST CACHE ======================================================
+
+typedef struct {
+	char server[64]; //!< The address it's for, server[0] is 0 if the slot is free
+	u8 request[CACHE_VERSION_MSG_REQUEST_SIZE]; //!< The request's first two letters
+	u32 version;
+} CacheVersion;
+
+typedef struct {
+	char server[64]; //!< The address that answered, server[0] is 0 if the slot is free
+	u8 request[REQUEST_CACHE_KEY_SIZE]; //!< All of it, so a BA_ with the LZ77 mark is kept apart from one without
+	u16 requestSize;
+	u32 version;
+	u64 expiresAt;
+	u64 usedAt;
+	u8 channel; //!< The virtual channel the answer goes to
+	u16 answerSize;
+	u8 answer[REQUEST_CACHE_ANSWER_SIZE];
+} CachedAnswer;
+
 // ======================= Vars ======================================================
-static char overrideAddress[32]; // = "192.168.1.10:9000"; // = "127.0.0.1:9000"; // Some examples of what you might want to use testing locally or on dolphin
+static char overrideAddress[64]; // = "192.168.1.10:9000"; // = "127.0.0.1:9000"; // Some examples of what you might want to use testing locally or on dolphin
 static char serverName[SERVER_NAME_SIZE];
 static char playerNames[4][10];
 static u32 isPlayerConnected[4];
 
+static ServerEndpoint endpoints[SERVER_ENDPOINTS_MAX];
+static mutex_t endpointsLock; // Held only to look at or change endpoints, sessions are opened and greeted without it
+
+static CacheVersion cacheVersions[REQUEST_CACHE_VERSIONS];
+static u8 nextCacheVersion; //!< The slot given up next once they're all used
+static CachedAnswer cachedAnswers[REQUEST_CACHE_ENTRIES];
+static u32 cacheHits;
+static u32 cacheMisses;
+static mutex_t requestCacheLock; // Held to look at or change any of the cache, every port shares it
+
 // ======================= Functions ======================================================
 
 static void *httpd (TCPConnector *connector);
-static void *seriald (void * port);
+static void *seriald (void *arg);
+static void *poold (void *arg);
+static void watchServer(const ServerAddress *address);
+static void reportServer(const char *address, bool up);
+static TCPRequest *findRequest(TCPConnector *connector, u8 tag);
 
 u32 hasServerName()
 {
@@ -225,27 +345,121 @@ char* getPlayerName(u32 port)
 
 void setOverrideAddress(char* ipv4)
 {
-	strcpy(overrideAddress, ipv4);
+	strncpy(overrideAddress, ipv4, sizeof(overrideAddress) - 1);
 }
 
-u32 testTCPConnection(char* ipv4)
+/* Waits up to timeout ms for something to read, then reads whatever is there. Returns < 0 if nothing came */
+static s32 recvWithin(int sock, void *buffer, u32 size, u32 timeout)
 {
-	s32 ret;
+	struct pollsd sd;
 
-	char localip[16] = {0};
-	char gateway[16] = {0};
-	char netmask[16] = {0};
+	sd.socket = sock;
+	sd.events = POLLIN;
+	sd.revents = 0;
 
-	ret = if_config ( localip, netmask, gateway, TRUE, 20);
+	if (net_poll(&sd, 1, timeout) <= 0)
+		return -ETIMEDOUT;
 
+	return net_recv(sock, buffer, size, TCP_FLAGS);
+}
 
-	if (ret < 0) 
-    {
-		return CONNECTION_ERROR_NO_NETWORK_DEVICE;
+/* Waits for the whole SERVER_GREETING so none of it can be mistaken for the answer to the first request */
+static void recvGreeting(int sock, char *buffer)
+{
+	u32 received = 0;
+
+	while (received < strlen(SERVER_GREETING))
+	{
+		s32 res = recvWithin(sock, &buffer[received], strlen(SERVER_GREETING) - received, SERVER_GREETING_TIMEOUT);
+		if (res <= 0)
+			break;
+
+		received += res;
+	}
+
+	buffer[received] = '\0';
+}
+
+/* 
+* net_connect on its own can block for as long as the wii's tcp stack likes, so the socket is made non blocking 
+* until it's connected and we give up after CONNECT_TIMEOUT. Returns the connected (blocking) socket, or < 0
+*/
+static s32 connectToServer(struct sockaddr_in *server)
+{
+	s32 sock = net_socket (AF_INET, SOCK_STREAM, IPPROTO_IP);
+	if (sock < 0)
+		return sock;
+
+	s32 flags = net_fcntl(sock, F_GETFL, 0);
+	net_fcntl(sock, F_SETFL, flags | IOS_O_NONBLOCK);
+
+	u64 startedAt = gettime();
+	s32 res;
+
+	while (true)
+	{
+		res = net_connect(sock, (struct sockaddr *) server, sizeof(struct sockaddr_in));
+
+		if (res == 0 || res == -EISCONN)
+			break;
+
+		if ((res != -EINPROGRESS && res != -EALREADY) || ticks_to_millisecs(gettime() - startedAt) >= CONNECT_TIMEOUT)
+		{
+			net_close(sock);
+			return res < 0 && res != -EINPROGRESS && res != -EALREADY ? res : -ETIMEDOUT;
+		}
+
+		usleep(CONNECT_POLL_DELAY);
+	}
+
+	net_fcntl(sock, F_SETFL, flags);
+	return sock;
+}
+
+/* Splits an address into the servers it lists, returns how many there are (no more than SERVER_ENDPOINTS_MAX) */
+static u8 splitServerAddress(const char *address, char servers[SERVER_ENDPOINTS_MAX][64])
+{
+	u8 count = 0;
+	const char *start = address;
+
+	while (count < SERVER_ENDPOINTS_MAX)
+	{
+		const char *end = strchr(start, SERVER_ADDRESS_SEPARATOR);
+		u32 length = end != NULL ? (u32) (end - start) : strlen(start);
+
+		// Spaces either side of a separator are allowed
+		while (length > 0 && start[0] == ' ')
+		{
+			start++;
+			length--;
+		}
+
+		while (length > 0 && start[length - 1] == ' ')
+			length--;
+
+		if (length > 0 && length < 64)
+		{
+			memcpy(servers[count], start, length);
+			servers[count][length] = '\0';
+			count++;
+		}
+
+		if (end == NULL)
+			break;
+
+		start = end + 1;
 	}
 
+	return count;
+}
+
+/* Connects to one server and checks it answers with its name. resolved is filled in with where it is, or its address is left empty if it can't be */
+static u32 testServer(const char *address, ServerAddress *resolved)
+{
 	char addrCopy[64];
-	strcpy(addrCopy, ipv4);
+
+	resolved->address[0] = '\0';
+	strcpy(addrCopy, address);
 	char * ipOrDomainName; 
 	char * portString; 
 	char * token = strtok(addrCopy, ":");
@@ -265,39 +479,39 @@ u32 testTCPConnection(char* ipv4)
 		return CONNECTION_ERROR_INVALID_IP;
 	}
 
-	struct sockaddr_in server;
+	struct sockaddr_in *server = &resolved->server;
 	struct in_addr ipTest;
 
-	memset (&server, 0, sizeof (server));
+	memset (server, 0, sizeof (struct sockaddr_in));
 	memset (&ipTest, 0, sizeof (ipTest));
 
 	if (inet_aton(ipOrDomainName, &ipTest))
 	{
-		server.sin_family= AF_INET;
-		server.sin_len = sizeof (struct sockaddr_in); 
-		server.sin_port= htons (port);
-		server.sin_addr.s_addr = inet_addr(ipOrDomainName);
+		server->sin_family= AF_INET;
+		server->sin_len = sizeof (struct sockaddr_in); 
+		server->sin_port= htons (port);
+		server->sin_addr.s_addr = inet_addr(ipOrDomainName);
 	}
 	else
 	{
 		return CONNECTION_ERROR_CONNECTION_FAILED;
 	}
 
-	int sock = -1;
-	sock = net_socket (AF_INET, SOCK_STREAM, IPPROTO_IP);
-	s32 conn = net_connect(sock, (struct sockaddr *) &server, sizeof server);
-	if (conn < 0) 
+	strcpy(resolved->address, address);
+
+	s32 sock = connectToServer(server);
+	if (sock < 0) 
 	{
 		return CONNECTION_ERROR_CONNECTION_FAILED;
 	}
 
 	char msgBuffer[100];
 	memset (&msgBuffer, 0, 100);
-	conn = net_recv (sock, msgBuffer, 100, TCP_FLAGS);
-	conn = net_send(sock, SERVER_NAME_REQUEST, strlen(SERVER_NAME_REQUEST), TCP_FLAGS);
+	recvGreeting(sock, msgBuffer);
+	net_send(sock, SERVER_NAME_REQUEST, strlen(SERVER_NAME_REQUEST), TCP_FLAGS);
 
 	memset (msgBuffer, 0, 100);
-	conn = net_recv(sock, msgBuffer, 100, TCP_FLAGS);
+	recvWithin(sock, msgBuffer, 99, HANDSHAKE_TIMEOUT);
 
 	net_close(sock);
 
@@ -316,32 +530,172 @@ u32 testTCPConnection(char* ipv4)
 	return CONNECTION_ERROR_INVALID_RESPONSE;
 }
 
+/* Tests every server the address lists, it only has to be one of them that's up. The ones that are get a pool of sessions straight away */
+u32 testTCPConnection(char* ipv4)
+{
+	s32 ret;
+
+	char localip[16] = {0};
+	char gateway[16] = {0};
+	char netmask[16] = {0};
+
+	ret = if_config ( localip, netmask, gateway, TRUE, 20);
+
+
+	if (ret < 0) 
+    {
+		return CONNECTION_ERROR_NO_NETWORK_DEVICE;
+	}
+
+	char addresses[SERVER_ENDPOINTS_MAX][64];
+	u8 count = splitServerAddress(ipv4, addresses);
+	u32 result = CONNECTION_ERROR_INVALID_IP;
+
+	for (u8 i = 0; i < count; i++)
+	{
+		ServerAddress resolved;
+		u32 serverResult = testServer(addresses[i], &resolved);
+
+		// Only one we could find the address of can be watched, the rest can't be connected to anyway
+		if (resolved.address[0] != '\0')
+		{
+			watchServer(&resolved);
+			reportServer(resolved.address, serverResult == CONNECTION_SUCCESS);
+		}
+
+		if (serverResult == CONNECTION_SUCCESS)
+			result = CONNECTION_SUCCESS;
+		else if (result != CONNECTION_SUCCESS)
+			result = serverResult;
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------------------
+static void wakeNetworkThread(TCPConnector *connector)
+{
+	LWP_MutexLock(connector->wakeLock);
+	LWP_CondSignal(connector->wake);
+	LWP_MutexUnlock(connector->wakeLock);
+}
+
+static u32 getStatus(TCPConnector *connector)
+{
+	return __atomic_load_n(&connector->status, __ATOMIC_ACQUIRE);
+}
+
+/* Replaces the bits in mask with value, only if the state is still one of allowedStates (a bit per TCP_STATE_*). Returns if it did */
+static bool updateStatusIf(TCPConnector *connector, u32 mask, u32 value, u32 allowedStates)
+{
+	u32 status = getStatus(connector);
+
+	do
+	{
+		if (!(allowedStates & (1 << ((status & TCP_STATUS_STATE) >> TCP_STATUS_STATE_SHIFT))))
+			return false;
+	}
+	while (!__atomic_compare_exchange_n(&connector->status, &status, (status & ~mask) | (value & mask), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return true;
+}
+
+static void updateStatus(TCPConnector *connector, u32 mask, u32 value)
+{
+	updateStatusIf(connector, mask, value, 0xFFFFFFFF);
+}
+
+static u8 getConnectionResult(TCPConnector *connector)
+{
+	return getStatus(connector) & TCP_STATUS_RESULT;
+}
+
+static void setConnectionResult(TCPConnector *connector, u8 result)
+{
+	updateStatus(connector, TCP_STATUS_RESULT, result);
+}
+
+static u8 getTcpState(TCPConnector *connector)
+{
+	return (getStatus(connector) & TCP_STATUS_STATE) >> TCP_STATUS_STATE_SHIFT;
+}
+
+static void setTcpState(TCPConnector *connector, u8 state)
+{
+	updateStatus(connector, TCP_STATUS_STATE, (u32) state << TCP_STATUS_STATE_SHIFT);
+}
+
+/* The 16 bits of a NET_CONN_LIFN_REQ answer, the connection result and whether it's ready for the gba to carry on */
+static u16 getLinkStatus(TCPConnector *connector)
+{
+	u32 status = getStatus(connector);
+	u8 networkBusyState = 0; // Not_Ready
+
+	if ((status & TCP_STATUS_STATE) == TCP_STATE_WAITING << TCP_STATUS_STATE_SHIFT && 
+		!(status & (TCP_STATUS_STOP | TCP_STATUS_RESET)) && 
+		connector->requestsQueued == connector->requestsDone)
+	{
+		networkBusyState = 1; // Ready
+	}
+
+	return (u16) ((status & TCP_STATUS_RESULT) | networkBusyState << 8);
+}
+
+/* If the gba won't wait on a status past this one, either it's ready or the connection failed */
+static u8 isFinalStatus(u16 linkStatus)
+{
+	return (linkStatus >> 8) != 0 || (linkStatus & 0xFF) >= CONNECTION_ERROR_INVALID_IP;
+}
+
+/* 
+* Called from the serial thread when the gba transmits. The data is copied straight away so the gba can 
+* fill the virtual channels again while the server is still answering
+*/
+static bool queueRequest(TCPConnector *connector, u8 virtualChannel, u16 size)
+{
+	if (connector->requestsQueued - connector->requestsDone >= TCP_MAX_IN_FLIGHT)
+	{
+		LOG_NS("WARNING - Too many transmissions waiting on the server, dropping this one\n");
+		return false;
+	}
+
+	if (virtualChannel * VIRTUAL_CHANNEL_SIZE + size > MAX_TRANS_SIZE)
+	{
+		LOG_NS("WARNING - A request was made to transmit more than the max about of data\n");
+		return false;
+	}
+
+	TCPRequest *request = &connector->requests[connector->requestsQueued % TCP_MAX_IN_FLIGHT];
+	request->answered = 0;
+	request->answerSize = 0;
+	request->virtualChannel = virtualChannel;
+	request->size = size;
+	request->queuedAt = gettime();
+	memcpy(request->data, &(connector->serialConnector->receivedMsgBuffer)[virtualChannel * VIRTUAL_CHANNEL_SIZE], size);
+
+	connector->requestsQueued++;
+	wakeNetworkThread(connector);
+	return true;
+}
+
 static	lwp_t httd_handles[4] = { (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL };
-static	lwp_t serd_handles[4] = { (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL, (lwp_t)LWP_THREAD_NULL };
+static	lwp_t serd_handle = (lwp_t)LWP_THREAD_NULL;
+static	lwp_t pool_handle = (lwp_t)LWP_THREAD_NULL;
 
 static void startNetworkThread(TCPConnector *httpArgs)
 {
+	static bool networkConfigured = 0;
+
+	httpArgs->connectStartedAt = gettime();
+
 	LOG_AS("Http Handle is %x\n", httd_handles[httpArgs->serialConnector->gcport]);
 	if (httd_handles[httpArgs->serialConnector->gcport] != LWP_THREAD_NULL && httpArgs->threadActive == 1)
 	{
-		if (httpArgs->waitingForServer)
-		{
-			LOG_NS("Thread already exists but is stuck. We need to recreate it.\n");
-			LWP_SuspendThread(httd_handles[httpArgs->serialConnector->gcport]);
-			usleep(10000);
-			net_close (httpArgs->sock);
-			usleep(10000);
-			httpArgs->requestStop = 1;
-			LWP_ResumeThread(httd_handles[httpArgs->serialConnector->gcport]);
-			LWP_JoinThread(httd_handles[httpArgs->serialConnector->gcport], NULL);
-			httpArgs->waitingForServer = 0;
-		}
-		else 
-		{
-			LOG_NS("Thread already exists. Reseting to init\n");
-			httpArgs->requestReset = 1;
-			return;
-		}
+		// Everything the thread waits on has a timeout, so even if the server has stopped answering it will see this soon
+		LOG_NS("Thread already exists. Reseting to init\n");
+		updateStatus(httpArgs, TCP_STATUS_RESULT | TCP_STATUS_RESET, CONNECTION_STARTING | TCP_STATUS_RESET);
+		wakeNetworkThread(httpArgs);
+		return;
 	}
 
 	httpArgs->threadActive = 1;
@@ -352,19 +706,22 @@ static void startNetworkThread(TCPConnector *httpArgs)
 	char gateway[16] = {0};
 	char netmask[16] = {0};
 
-    httpArgs->requestSend = 0;
-    httpArgs->requestFetch = 0;
-    httpArgs->requestStop = 0;
-	httpArgs->requestReset = 0;
-	httpArgs->connectionResult = CONNECTION_INIT;
+    httpArgs->requestsQueued = 0;
+    httpArgs->requestsSent = 0;
+    httpArgs->requestsDone = 0;
+	updateStatus(httpArgs, TCP_STATUS_RESULT | TCP_STATUS_STOP | TCP_STATUS_RESET, CONNECTION_INIT);
 
-	ret = if_config ( localip, netmask, gateway, TRUE, 20);
+	// The network only needs setting up once, reconnecting shouldn't have to wait for dhcp again
+	ret = networkConfigured ? 0 : if_config ( localip, netmask, gateway, TRUE, 20);
 
 	if (ret>=0) 
     {
-		LOG_AS("Network configured, ip: %s, gw: %s, mask %s\n", localip, gateway, netmask);
+		if (!networkConfigured)
+			LOG_AS("Network configured, ip: %s, gw: %s, mask %s\n", localip, gateway, netmask);
 
-		httpArgs->internalState = TCP_STATE_INIT;
+		networkConfigured = 1;
+
+		setTcpState(httpArgs, TCP_STATE_INIT);
 
 		LWP_CreateThread(&httd_handles[httpArgs->serialConnector->gcport], /* thread handle */
 			            (void* (*)(void*))  httpd,                         /* code */
@@ -377,7 +734,8 @@ static void startNetworkThread(TCPConnector *httpArgs)
     else 
     {
 		LOG_NS("Network configuration failed!\n");
-		httpArgs->internalState = CONNECTION_ERROR_NO_NETWORK_DEVICE;
+		setConnectionResult(httpArgs, CONNECTION_ERROR_NO_NETWORK_DEVICE);
+		httpArgs->threadActive = 0;
 	}
 }
 
@@ -385,757 +743,2672 @@ void setupGBAConnectors()
 {
 	LOG_N("\nStarting Pokecom Channel\n");
 
-	u8 *port0 = malloc(sizeof(*port0));
-	*port0 = 0;
-	LWP_CreateThread(&serd_handles[0],	            /* thread handle */
-			         seriald,                       /* code */
-			         (void *) port0,		        /* arg pointer for thread */
+	LWP_MutexInit(&endpointsLock, false);
+	LWP_MutexInit(&requestCacheLock, false);
+	LWP_CreateThread(&pool_handle,	                /* thread handle */
+			         poold,                         /* code */
+			         NULL,		                    /* arg pointer for thread */
 			         NULL,			                /* stack base */
 			         16*1024,		                /* stack size */
-			         250          			        /* thread priority */ );
+			         150          			        /* thread priority */ );
 
-				
-	u8 *port1 = malloc(sizeof(*port1));
-	*port1 = 1;
-	LWP_CreateThread(&serd_handles[1],	            /* thread handle */
+	LWP_CreateThread(&serd_handle,	                /* thread handle */
 			         seriald,                       /* code */
-			         (void *) port1,		        /* arg pointer for thread */
+			         NULL,		                    /* arg pointer for thread */
 			         NULL,			                /* stack base */
 			         16*1024,		                /* stack size */
-			         240          			        /* thread priority */ );
+			         250          			        /* thread priority */ );
 
-	u8 *port2 = malloc(sizeof(*port2));
-	*port2 = 2;
-	LWP_CreateThread(&serd_handles[2],	            /* thread handle */
-			         seriald,                       /* code */
-			         (void *) port2,		        /* arg pointer for thread */
-			         NULL,			                /* stack base */
-			         16*1024,		                /* stack size */
-			         230          			        /* thread priority */ );
+}
 
-	u8 *port3 = malloc(sizeof(*port3));
-	*port3 = 3;
-	LWP_CreateThread(&serd_handles[3],	            /* thread handle */
-			         seriald,                       /* code */
-			         (void *) port3,		        /* arg pointer for thread */
-			         NULL,			                /* stack base */
-			         16*1024,		                /* stack size */
-			         220          			        /* thread priority */ );
+// ======================= Serial scheduler ======================================================
 
-}
+/*
+* One thread looks after all 4 gamecube ports. Each port is a state machine that makes at most one SI transfer per step
+* and then says when it next wants to run (see serialSleep). Every pass the scheduler steps each port that is due,
+* starting from a different port each time so no port can starve the others, then sleeps until the next port is due.
+* The wait before each word of a block (see SL_pacerWordDelay) is spent running the other ports.
+* Ports without a GBA are parked and only checked with SI_GetTypeAsync every SERIAL_PROBE_INTERVAL.
+*/
+#define SERIAL_PROBE_INTERVAL 250 // ms between looking for a GBA on a port that doesn't have one
+#define SERIAL_RESET_DELAY 10000  // us to give SI_GetTypeAsync/SL_reset before looking at the result
+#define SERIAL_POLL_DELAY 1000    // us between reading for a new command, and the delay we give the GBA after replying to one
+#define SERIAL_MAX_SLEEP 100000   // us the scheduler sleeps for at most
 
-// --------------------------------------------------------------------------------
-static void *seriald (void * port)
-{
-	SerialConnector connector;
-	connector.gcport = *(u8 *) port;
-	connector.requestSend = 0;
-	connector.requestReceive = 0;
-	connector.requestStop = 0;
-	connector.internalState = SERIAL_STATE_INIT;
-	connector.connectionResult = SERIAL_NO_GBA;
+enum {
+	BLOCK_IN_PROGRESS,
+	BLOCK_DONE,
+	BLOCK_BAD_FRAMES, // Framed mode, some frames were still bad after the last round
+	BLOCK_SI_ERROR    // The GBA stopped responding
+};
 
-	print_ui_log("STARTING GBA CONN");
+enum {
+	BLOCK_PHASE_WORDS,   // Moving the words of the current frame (the whole block is one frame in the original mode)
+	BLOCK_PHASE_TRAILER, // Moving the frame trailer, or the check bytes in the original mode
+	BLOCK_PHASE_ACK,     // Framed mode, moving the ack for the round
+	BLOCK_PHASE_ACK_WAIT // Exchanges, our ack has gone and we're reading the gba's
+};
 
-	LOG_AS("Waiting for a GBA (via DOL-011) in port %x...\n", connector.gcport);
+typedef struct {
+	u8 phase; //!< BLOCK_PHASE_*
+	u8 round; //!< Framed mode retransmit round
+	u8 frame; //!< Frame being moved
+	u16 frameSize; //!< Bytes per frame
+	u16 pos; //!< Next byte of the block to move
+	u16 pendingFrames; //!< Bitmap of the frames still to move this round
+	u16 badFrames; //!< Bitmap of the frames that failed their CRC this round
+	u16 polls; //!< Times we've checked for the frame ack this round
+	u32 framesResent; //!< Frames that had to be moved again
+} SerialBlock;
 
+typedef struct {
+	SerialConnector connector;
 	TCPConnector tcpConnector;
-	tcpConnector.remoteAddressAndPort = "127.0.0.1:9000";
-	tcpConnector.serialConnector = &connector;
 
-    int active = 1;    
-	u16 msgBytesCount = 0;
-	u8 pkt[4];
-	int commResult = 0;
-	u16 msgCheckBytes = 0xFFFF;
-	u16 msgBytesOffset = 0;
+	u16 msgBytesCount; //!< Size of the block being moved
+	u16 msgBytesOffset; //!< Where the block starts in receivedMsgBuffer
+	u16 msgCheckBytes;
+	u32 lastBlockCmd; //!< The command of the last block sent/received, if the GBA sends it again straight away the block failed
+	u64 lastBlockEndedAt;
+	SerialBlock block; //!< Progress through the block being sent/received (for an exchange, the gba's block and where both are up to)
+	SerialBlock exchangeBlock; //!< The block we send back in an exchange, only its frames are used
+	u16 exchangeOffset; //!< Where the block we send back in an exchange starts in receivedMsgBuffer
+	u16 exchangeCount;
 
-    while(active) {
+	u8 calling; //!< If the block being received is the request of a NET_CONN_CALL_ANY
+	u16 callResponseOffset; //!< Where the answer to the call is read from
+	u16 callResponseCount; //!< How much of it the gba wants
+	u16 callAnswer; //!< What we sent in NET_CONN_CALL_RES, the gba puts it back up when it's ready
+	u32 callRequest; //!< The call's place in tcpConnector.requests
+	u64 callQueuedAt;
 
-        switch (connector.internalState) 
-        {
-            case SERIAL_STATE_INIT: 
-            {
-                SL_reset(connector.gcport);
-				SL_resetDeviceType(connector.gcport);
-				usleep(10000);
-                commResult = SL_getstatus(connector.gcport, pkt);
-				SI_GetTypeAsync(connector.gcport, SL_getDeviceTypeCallback(connector.gcport));
-				usleep(10000);
-				
-				if (commResult < 0)
-				{
-					connector.internalState = SERIAL_STATE_ERROR;
-				}
-                else if (pkt[2]&SI_STATUS_CONNECTED && SL_getDeviceType(connector.gcport) & SI_GBA)
-                {
-					LOG_AS("Connection Established port %x\n", connector.gcport);
-                    connector.internalState = SERIAL_STATE_WAITING;
-					connector.connectionResult = SERIAL_CONNECTED;
-					isPlayerConnected[connector.gcport] = 1;
-                }
-                else
-                {
-                    usleep(10000);
-                }
+	u8 statusWatched; //!< If the gba is waiting on the server after a NET_CONN_LIFN_REQ and we push it the status when it changes
+	u16 pushedStatus; //!< The last status the gba was given, as a NET_CONN_LIFN_REQ answer or pushed
 
-            } break;
-            case SERIAL_STATE_WAITING:
-            {
-                commResult = SL_recv(connector.gcport, pkt);
+	u8 probing; //!< If we've asked SI_GetTypeAsync what is plugged in and are waiting to look at the answer
+	u64 wakeAt; //!< The scheduler won't step this port again until this time
+} SerialPort;
 
-				//LOG_AS("Reading %x with first %x and second %x\n", (u16) (pkt[0] | pkt[1] << 8), pkt[0], pkt[1]);
+static SerialPort serialPorts[4];
 
-				if (commResult < 0)
-				{
-					connector.internalState = SERIAL_STATE_WAITING;
-				}
-				else if (NET_CONN_SEND_ANY == pkt[1]) // We are reciving data from the GBA
-                {
-					msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+// --------------------------------------------------------------------------------
+static void serialSleep(SerialPort *port, u32 us)
+{
+	port->wakeAt = gettime() + microsecs_to_ticks(us);
+}
 
-					msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
-					
-					LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
-					LOG_NS("Receiving message \n");
+// --------------------------------------------------------------------------------
+static u8 getNextPendingFrame(SerialBlock *block, u8 frame)
+{
+	while (frame < NET_CONN_MAX_FRAMES && !(block->pendingFrames & (1 << frame)))
+		frame++;
 
-					msgCheckBytes = 0xFFFF;
-					msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-					msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+	return frame;
+}
 
-					LOG_AS("Check after CMD %x\n", msgCheckBytes);
-                    connector.internalState = SERIAL_STATE_RECEIVING;
-                }
-                else if (NET_CONN_RECV_ANY == pkt[1])  // We are sending data to the GBA
-                {
-					msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+// --------------------------------------------------------------------------------
+static u8 getMsgByte(SerialConnector *connector, u32 index)
+{
+	return index < MAX_MSG_SIZE ? connector->receivedMsgBuffer[index] : 0;
+}
 
-					msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
-					
-					LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
-					LOG_AS("Check after CMD %x\n", msgCheckBytes);
-					LOG_NS("Sending message \n");
-                    connector.internalState = SERIAL_STATE_SENDING;
-                }
-				else if ((u16) (pkt[0] | pkt[1] << 8) == NET_CONN_BCLR_REQ)
-				{
-					LOG_NS("Resetting MSG Buffer\n");
-					memset(connector.receivedMsgBuffer,0,MAX_MSG_SIZE);
-					memset(tcpConnector.fetchedMsgBuffer,0,1024);
-					usleep(1000);
-				}
-				else if (NET_CONN_PINF_REQ == (u16) (pkt[0] | pkt[1] << 8))
-				{
-					msgCheckBytes = 0xFFFF;
-					msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-					msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+// --------------------------------------------------------------------------------
+static void setMsgByte(SerialConnector *connector, u32 index, u8 value)
+{
+	if (index < MAX_MSG_SIZE)
+		connector->receivedMsgBuffer[index] = value;
+}
 
+/* Both the serial and network threads write to the virtual channels, so the dirty bits are only ever set or taken atomically */
+static void markChannelsDirty(SerialConnector *connector, u32 offset, u32 size)
+{
+	if (size == 0 || offset >= MAX_MSG_SIZE)
+		return;
 
-					if (validatePokeStringMsg(connector.receivedMsgBuffer, 0, 8))
-					{
-						bytesToChars(connector.receivedMsgBuffer, 0, 8);
-						LOG_AS("\n----- PLAYER INFO -----\nNAME: %s\n", &connector.receivedMsgBuffer[0]);
+	u32 end = offset + size < MAX_MSG_SIZE ? offset + size : MAX_MSG_SIZE;
 
-						for (int i = 0; i < 8; i++) 
-						{
-							connector.playerData.playerName[i] = connector.receivedMsgBuffer[i];
-							playerNames[connector.gcport][i] = connector.receivedMsgBuffer[i];
-						}
+	for (u32 channel = offset / VIRTUAL_CHANNEL_SIZE; channel * VIRTUAL_CHANNEL_SIZE < end; channel++)
+		__atomic_fetch_or(&connector->dirtyChannels[channel / 32], 1u << (channel % 32), __ATOMIC_RELAXED);
+}
 
+/* Zeroes every virtual channel written since the last clear (runs of them with one memset), returns how many there were */
+static u32 clearDirtyChannels(SerialConnector *connector)
+{
+	u32 cleared = 0;
 
-						if (connector.receivedMsgBuffer[8] % 2 == 0)
-						{
-							LOG_NS("GENDER: BOY\n");
-							connector.playerData.gender = 0;
-						}
-						else 
-						{
-							LOG_NS("GENDER: GIRL\n");
-							connector.playerData.gender = 1;
-						}
+	for (u32 word = 0; word < sizeof(connector->dirtyChannels) / sizeof(u32); word++)
+	{
+		u32 bits = __atomic_exchange_n(&connector->dirtyChannels[word], 0, __ATOMIC_RELAXED);
+		u32 channel = word * 32;
 
-						LOG_AS("TRAINER ID: %d\n", (u16) (connector.receivedMsgBuffer[10] + (connector.receivedMsgBuffer[11] << 8)));
-						connector.playerData.trainerId = (u16) (connector.receivedMsgBuffer[10] + (connector.receivedMsgBuffer[11] << 8));
+		while (bits != 0)
+		{
+			if (!(bits & 1))
+			{
+				bits >>= 1;
+				channel++;
+				continue;
+			}
 
-					}
+			u32 first = channel;
+			while (bits & 1)
+			{
+				bits >>= 1;
+				channel++;
+			}
 
-					if (validatePokeStringMsg(connector.receivedMsgBuffer, 32, 20))
-					{
-						bytesToChars(connector.receivedMsgBuffer, 32, 20);
-						LOG_AS("GAME: %s\n\n", &connector.receivedMsgBuffer[32]);
+			memset(&connector->receivedMsgBuffer[first * VIRTUAL_CHANNEL_SIZE], 0, (channel - first) * VIRTUAL_CHANNEL_SIZE);
+			cleared += channel - first;
+		}
+	}
 
-						for (int i = 0; i < 20; i++) 
-							connector.playerData.gameName[i] = connector.receivedMsgBuffer[32+i];
+	return cleared;
+}
 
-					}
+// --------------------------------------------------------------------------------
+static void lastBlockFailed(u8 port, u64 *lastBlockEndedAt)
+{
+	// Only back off once per block, one bad block can leave us reading the same stale word a few times
+	if (*lastBlockEndedAt == 0)
+		return;
+
+	*lastBlockEndedAt = 0;
+	SL_pacerBlockFailed(port);
+	TL_RECORD(port, TL_SOURCE_SERIAL, TL_EVENT_CHECK, 0, 0xFFFF);
+	LOG_AS("Port %x last block failed, word delay now %uus\n", port, (unsigned int) SL_getPacer(port)->wordDelay);
+}
 
-					SL_send(connector.gcport, (u32) (NET_CONN_CHCK_RES << 16) | (msgCheckBytes & 0xFFFF));
-					usleep(1000);
-				}
-				else if (NET_CONN_CINF_REQ == (u16) (pkt[0] | pkt[1] << 8))
-				{
-					msgCheckBytes = 0xFFFF;
-					msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-					msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+// --------------------------------------------------------------------------------
+static void checkForRepeatedBlock(u8 port, u8 pkt[4], u32 *lastBlockCmd, u64 *lastBlockEndedAt)
+{
+	u32 blockCmd = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
 
-					if (validatePokeStringMsg(connector.receivedMsgBuffer, 0, msgBytesCount))
-					{
-						bytesToChars(connector.receivedMsgBuffer, 0, msgBytesCount);
-						connector.receivedMsgBuffer[msgBytesCount + 1]  = '\0'; // Make sure the string is actually terminated
-						strcpy(tcpConnector.remoteAddressAndPort, connector.receivedMsgBuffer);
-						LOG_AS("\n----- SERVER INFO -----\nADDRESS: %s\n", &connector.receivedMsgBuffer[0]);
-						startNetworkThread(&tcpConnector);
-					}
+	// The GBA tries a block again on its next frame if the check bytes didn't match, so the last block was too fast for it
+	if (blockCmd == *lastBlockCmd && ticks_to_millisecs(gettime() - *lastBlockEndedAt) < SL_PACER_RETRY_WINDOW)
+		lastBlockFailed(port, lastBlockEndedAt);
 
-					SL_send(connector.gcport, (u32) (NET_CONN_CHCK_RES << 16) | (msgCheckBytes & 0xFFFF));
-					usleep(1000);
-				}
-				else if (NET_CONN_TRAN_ANY == pkt[1])
-				{
-					msgCheckBytes = 0xFFFF;
-					msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-					msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+	*lastBlockCmd = blockCmd;
+	SL_pacerBlockStart(port);
+}
 
+// --------------------------------------------------------------------------------
+static void reportLinkSpeed(u8 port)
+{
+	if (!SL_pacerShouldReport(port))
+		return;
 
-					tcpConnector.trVitrualChannel = pkt[0];
+	char log[MAX_LOG_MSG_LENGTH];
+	SL_Pacer *pacer = SL_getPacer(port);
 
-					if (((u16) (pkt[2] | pkt[3] << 8)) + (VIRTUAL_CHANNEL_SIZE * tcpConnector.trVitrualChannel) <= MAX_TRANS_SIZE) 
-					{
-						LOG_AS("Setting tr size to %x \n", ((u16) (pkt[2] | pkt[3] << 8)));
-						tcpConnector.trSize = (u16) (pkt[2] | pkt[3] << 8);
-					}
-					else
-					{
-						LOG_NS("WARNING - A request was made to transmit more than the max about of data\n");
-						tcpConnector.trVitrualChannel = 0;
-						tcpConnector.trSize = MAX_TRANS_SIZE;
-					}
+	snprintf(log, MAX_LOG_MSG_LENGTH, "PORT %d %u WPS %uUS", port + 1, (unsigned int) pacer->wordsPerSec, (unsigned int) pacer->wordDelay);
+	print_ui_log(log);
+	LOG_AS("Port %x link speed %u words/sec, word delay %uus, settle delay %uus\n", port, (unsigned int) pacer->wordsPerSec, (unsigned int) pacer->wordDelay, (unsigned int) pacer->settleDelay);
+}
+
+// --------------------------------------------------------------------------------
+/**
+* Moves into SERIAL_STATE_SENDING/RECEIVING for the block in msgBytesCount/msgBytesOffset, unless it can't be a real block
+*/
+static void startBlock(SerialPort *port, u8 state)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	u8 framed = connector->linkCaps & NET_CONN_LINK_CAP_FRAMED;
 
+	if (port->msgBytesCount > MAX_MSG_SIZE || port->msgBytesCount == 0 || (framed && port->msgBytesOffset + port->msgBytesCount > MAX_MSG_SIZE))
+	{
+		LOG_AS("Skipping message too long %x \n", port->msgBytesCount);
 
-					SL_send(connector.gcport, (u32) (NET_CONN_CHCK_RES << 16) | (msgCheckBytes & 0xFFFF));
-					tcpConnector.requestSend  = 1;
-					usleep(1000);
-				}
-				else if (NET_CONN_LIFN_REQ == (u16) (pkt[0] | pkt[1] << 8))
+		// This was most likely a stale data word we mistook for a command because we read it before the GBA was finished with the last block
+		lastBlockFailed(connector->gcport, &port->lastBlockEndedAt);
+		TL_COMMAND_END(connector->gcport, 0);
+		return;
+	}
+
+	// Unframed blocks are written a whole word at a time, so can run up to 3 bytes past the end
+	if (state == SERIAL_STATE_RECEIVING)
+		markChannelsDirty(connector, port->msgBytesOffset, port->msgBytesCount + 3);
+
+	memset(block, 0, sizeof(SerialBlock));
+	block->frameSize = framed ? NET_CONN_GET_FRAME_SIZE(port->msgBytesCount) : port->msgBytesCount;
+	block->pendingFrames = (1 << ((port->msgBytesCount + block->frameSize - 1) / block->frameSize)) - 1;
+
+	connector->internalState = state;
+	serialSleep(port, SL_pacerWordDelay(connector->gcport));
+}
+
+// --------------------------------------------------------------------------------
+/**
+* Framed mode, the ack for a round has been moved. Either the block is done or we go round again for the bad frames
+*/
+static int startNextRound(SerialPort *port, u16 badFrames)
+{
+	SerialBlock *block = &port->block;
+
+	block->pendingFrames = badFrames;
+	block->badFrames = 0;
+	block->polls = 0;
+	block->round++;
+
+	if (block->pendingFrames == 0)
+		return BLOCK_DONE;
+
+	if (block->round >= NET_CONN_MAX_FRAME_ROUNDS)
+		return BLOCK_BAD_FRAMES;
+
+	block->frame = getNextPendingFrame(block, 0);
+	block->pos = block->frame * block->frameSize;
+	block->phase = BLOCK_PHASE_WORDS;
+	return BLOCK_IN_PROGRESS;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* Framed mode, a frame and its trailer have been moved. Moves on to the next frame or the ack
+*/
+static void finishFrame(SerialPort *port)
+{
+	SerialBlock *block = &port->block;
+
+	if (block->round > 0)
+		block->framesResent++;
+
+	block->frame = getNextPendingFrame(block, block->frame + 1);
+
+	if (block->frame < NET_CONN_MAX_FRAMES)
+	{
+		block->pos = block->frame * block->frameSize;
+		block->phase = BLOCK_PHASE_WORDS;
+	}
+	else
+	{
+		block->phase = BLOCK_PHASE_ACK;
+	}
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_SENDING, moves the next word of the block to the gba. Returns BLOCK_IN_PROGRESS until the block is finished
+*/
+static int stepSendBlock(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	u8 framed = connector->linkCaps & NET_CONN_LINK_CAP_FRAMED;
+	u16 frameStart = block->frame * block->frameSize;
+	u16 frameEnd = frameStart + block->frameSize < port->msgBytesCount ? frameStart + block->frameSize : port->msgBytesCount;
+	u32 delay = SL_pacerWordDelay(connector->gcport);
+	u8 pkt[4];
+
+	switch (block->phase)
+	{
+		case BLOCK_PHASE_WORDS:
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				// The original mode sends whatever is in the buffer after a block that isn't a multiple of 4, and it's part of the check bytes
+				if (framed)
+					pkt[i] = block->pos + i < frameEnd ? getMsgByte(connector, port->msgBytesOffset + block->pos + i) : 0;
+				else
+					pkt[i] = getMsgByte(connector, port->msgBytesOffset + block->pos + i);
+			}
+
+			if (SL_send(connector->gcport, (pkt[0] << 24) | (pkt[1] << 16) | (pkt[2]<< 8) | pkt[3]) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			if (!framed)
+			{
+				LOG_AS("Written To GBA %x %02X %02X %02X %02X\n", block->pos, pkt[0], pkt[1], pkt[2], pkt[3]);
+
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+			}
+
+			block->pos += 4;
+			if (block->pos >= frameEnd)
+				block->phase = BLOCK_PHASE_TRAILER;
+		} break;
+		case BLOCK_PHASE_TRAILER:
+		{
+			if (!framed)
+			{
+				LOG_AS("MSG CHECK: %x\n", port->msgCheckBytes);
+				return SL_send(connector->gcport, (u32) (NET_CONN_CHCK_RES << 16) | (port->msgCheckBytes & 0xFFFF)) < 0 ? BLOCK_SI_ERROR : BLOCK_DONE;
+			}
+
+			if (SL_send(connector->gcport, (u32) ((NET_CONN_FRAME_MARK << 24) | (block->frame << 16) | SL_crc16((const u8 *) &connector->receivedMsgBuffer[port->msgBytesOffset + frameStart], frameEnd - frameStart))) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			finishFrame(port);
+		} break;
+		case BLOCK_PHASE_ACK:
+		default:
+		{
+			// The gba needs a moment to check the frames, until it's done we'll just read back whatever it last put up
+			if (SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+
+			u32 ack = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
+			if (ack >> 16 != (u32) (NET_CONN_FACK_RES | block->round))
+			{
+				if (++block->polls >= FRAME_ACK_POLLS)
+					return BLOCK_BAD_FRAMES;
+
+				delay += FRAME_ACK_POLL_DELAY;
+				break;
+			}
+
+			if (ack & 0xFFFF)
+				LOG_AS("GBA asked for frames %04X again (round %d)\n", (unsigned int) (ack & 0xFFFF), block->round);
+			TL_RECORD(connector->gcport, TL_SOURCE_SERIAL, TL_EVENT_FRAME_ACK, block->round, (u16) (block->pendingFrames & ack & 0xFFFF));
+
+			int result = startNextRound(port, block->pendingFrames & ack & 0xFFFF);
+			if (result != BLOCK_IN_PROGRESS)
+				return result;
+		} break;
+	}
+
+	serialSleep(port, delay);
+	return BLOCK_IN_PROGRESS;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_RECEIVING, moves the next word of the block from the gba. Returns BLOCK_IN_PROGRESS until the block is finished
+*/
+static int stepReceiveBlock(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	u8 framed = connector->linkCaps & NET_CONN_LINK_CAP_FRAMED;
+	u16 frameStart = block->frame * block->frameSize;
+	u16 frameEnd = frameStart + block->frameSize < port->msgBytesCount ? frameStart + block->frameSize : port->msgBytesCount;
+	u8 pkt[4];
+
+	switch (block->phase)
+	{
+		case BLOCK_PHASE_WORDS:
+		{
+			if (SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (!framed || block->pos + i < frameEnd)
+					setMsgByte(connector, port->msgBytesOffset + block->pos + i, pkt[i]);
+			}
+
+			if (!framed)
+			{
+				LOG_AS("Read From GBA %x %02X %02X %02X %02X\n", block->pos, pkt[0], pkt[1], pkt[2], pkt[3]);
+
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+			}
+
+			block->pos += 4;
+			if (block->pos >= frameEnd)
+				block->phase = BLOCK_PHASE_TRAILER;
+		} break;
+		case BLOCK_PHASE_TRAILER:
+		{
+			if (!framed)
+			{
+				LOG_AS("MSG CHECK: %x\n", port->msgCheckBytes);
+				return SL_send(connector->gcport, (u32) (NET_CONN_CHCK_RES << 16) | (port->msgCheckBytes & 0xFFFF)) < 0 ? BLOCK_SI_ERROR : BLOCK_DONE;
+			}
+
+			if (SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			u32 trailer = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
+			u8 good = trailer == (u32) ((NET_CONN_FRAME_MARK << 24) | (block->frame << 16) | SL_crc16((const u8 *) &connector->receivedMsgBuffer[port->msgBytesOffset + frameStart], frameEnd - frameStart));
+			TL_RECORD(connector->gcport, TL_SOURCE_SERIAL, TL_EVENT_CHECK, good, block->frame);
+
+			if (!good)
+			{
+				LOG_AS("Bad frame %d (round %d) %08X\n", block->frame, block->round, (unsigned int) trailer);
+				block->badFrames |= 1 << block->frame;
+			}
+
+			finishFrame(port);
+		} break;
+		case BLOCK_PHASE_ACK:
+		default:
+		{
+			if (SL_send(connector->gcport, (u32) (((NET_CONN_FACK_RES | block->round) << 16) | block->badFrames)) < 0)
+				return BLOCK_SI_ERROR;
+
+			int result = startNextRound(port, block->badFrames);
+			if (result != BLOCK_IN_PROGRESS)
+				return result;
+		} break;
+	}
+
+	serialSleep(port, SL_pacerWordDelay(connector->gcport));
+	return BLOCK_IN_PROGRESS;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_STREAMING, moves the next word of a stream to the gba. There's no ack until the very end, so
+* the words go out back to back with a trailer after each segment. Returns BLOCK_IN_PROGRESS until the stream is finished
+*/
+static int stepStreamBlock(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	u16 segmentStart = block->frame * NET_CONN_STREAM_SEGMENT_SIZE;
+	u16 segmentEnd = segmentStart + NET_CONN_STREAM_SEGMENT_SIZE < port->msgBytesCount ? segmentStart + NET_CONN_STREAM_SEGMENT_SIZE : port->msgBytesCount;
+	u32 delay = SL_pacerWordDelay(connector->gcport);
+	u8 pkt[4];
+
+	switch (block->phase)
+	{
+		case BLOCK_PHASE_WORDS:
+		{
+			for (int i = 0; i < 4; i++)
+				pkt[i] = block->pos + i < segmentEnd ? getMsgByte(connector, port->msgBytesOffset + block->pos + i) : 0;
+
+			if (SL_send(connector->gcport, (pkt[0] << 24) | (pkt[1] << 16) | (pkt[2]<< 8) | pkt[3]) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			block->pos += 4;
+			if (block->pos >= segmentEnd)
+				block->phase = BLOCK_PHASE_TRAILER;
+		} break;
+		case BLOCK_PHASE_TRAILER:
+		{
+			if (SL_send(connector->gcport, (u32) ((NET_CONN_FRAME_MARK << 24) | (block->frame << 16) | SL_crc16((const u8 *) &connector->receivedMsgBuffer[port->msgBytesOffset + segmentStart], segmentEnd - segmentStart))) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+
+			block->frame++;
+			block->pos = segmentEnd;
+			block->phase = segmentEnd < port->msgBytesCount ? BLOCK_PHASE_WORDS : BLOCK_PHASE_ACK;
+		} break;
+		case BLOCK_PHASE_ACK:
+		default:
+		{
+			// The gba checks every segment before it answers, until then we'll read back the offset it put up
+			if (SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+
+			u32 ack = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
+			if (ack >> 16 != NET_CONN_SACK_RES)
+			{
+				if (++block->polls >= FRAME_ACK_POLLS)
+					return BLOCK_BAD_FRAMES;
+
+				delay += FRAME_ACK_POLL_DELAY;
+				break;
+			}
+
+			TL_RECORD(connector->gcport, TL_SOURCE_SERIAL, TL_EVENT_CHECK, (ack & 0xFFFF) >= port->msgBytesCount, 0xFFFF);
+			if ((ack & 0xFFFF) >= port->msgBytesCount)
+				return BLOCK_DONE;
+
+			LOG_AS("GBA will pick the stream up again from %x\n", (unsigned int) (ack & 0xFFFF));
+			block->framesResent = (port->msgBytesCount - (ack & 0xFFFF) + NET_CONN_STREAM_SEGMENT_SIZE - 1) / NET_CONN_STREAM_SEGMENT_SIZE;
+			return BLOCK_BAD_FRAMES;
+		} break;
+	}
+
+	serialSleep(port, delay);
+	return BLOCK_IN_PROGRESS;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_STREAM_START, reads where the gba wants the stream to start and sets it going
+*/
+static void startStream(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	u8 pkt[4];
+	int commResult = SL_recv(connector->gcport, pkt);
+
+	// The gba hasn't put the offset up yet, give it a moment
+	if (commResult >= 0 && (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24) == port->lastBlockCmd && ++block->polls < FRAME_ACK_POLLS)
+	{
+		serialSleep(port, SL_pacerWordDelay(connector->gcport) + FRAME_ACK_POLL_DELAY);
+		return;
+	}
+
+	connector->internalState = SERIAL_STATE_WAITING;
+
+	u16 from = (u16) (pkt[2] | pkt[3] << 8);
+
+	if (commResult < 0 || (u16) (pkt[0] | pkt[1] << 8) != NET_CONN_STRM_FROM || from % NET_CONN_STREAM_SEGMENT_SIZE != 0 || from >= port->msgBytesCount ||
+		port->msgBytesOffset + port->msgBytesCount > MAX_MSG_SIZE)
+	{
+		LOG_AS("Bad stream start %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+		lastBlockFailed(connector->gcport, &port->lastBlockEndedAt);
+		TL_COMMAND_END(connector->gcport, 0);
+		serialSleep(port, SERIAL_POLL_DELAY);
+		return;
+	}
+
+	LOG_AS("Streaming %x bytes from %x\n", port->msgBytesCount - from, port->msgBytesOffset + from);
+
+	memset(block, 0, sizeof(SerialBlock));
+	block->frameSize = NET_CONN_STREAM_SEGMENT_SIZE;
+	block->frame = from / NET_CONN_STREAM_SEGMENT_SIZE;
+	block->pos = from;
+
+	connector->internalState = SERIAL_STATE_STREAMING;
+	serialSleep(port, SL_pacerWordDelay(connector->gcport));
+}
+
+// --------------------------------------------------------------------------------
+/**
+* Exchanges, the next frame from here that either block still has to move (NET_CONN_MAX_FRAMES once there are none)
+*/
+static u8 getNextExchangeFrame(SerialPort *port, u8 frame)
+{
+	while (frame < NET_CONN_MAX_FRAMES && !((port->block.pendingFrames | port->exchangeBlock.pendingFrames) & (1 << frame)))
+		frame++;
+
+	return frame;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* Exchanges, how much of frame the block moves this round. 0 if the frame isn't pending, the block then sends zeroes in its place
+*/
+static u16 getExchangeFrameLength(SerialBlock *block, u16 count, u8 frame)
+{
+	u16 frameStart = frame * block->frameSize;
+
+	if (!(block->pendingFrames & (1 << frame)))
+		return 0;
+
+	return frameStart + block->frameSize < count ? block->frameSize : count - frameStart;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_EXCHANGING, moves the next slot of an exchange (see NET_CONN_LINK_CAP_DUPLEX): our word of the frame goes to the gba,
+* then we read its word, which it put up before we wrote. Returns BLOCK_IN_PROGRESS until both blocks are finished
+*/
+static int stepExchangeBlock(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	SerialBlock *exchangeBlock = &port->exchangeBlock;
+	u16 recvLength = getExchangeFrameLength(block, port->msgBytesCount, block->frame);
+	u16 sendLength = getExchangeFrameLength(exchangeBlock, port->exchangeCount, block->frame);
+	u16 recvStart = port->msgBytesOffset + block->frame * block->frameSize;
+	u16 sendStart = port->exchangeOffset + block->frame * exchangeBlock->frameSize;
+	u32 delay = SL_pacerWordDelay(connector->gcport);
+	u8 pkt[4];
+
+	switch (block->phase)
+	{
+		case BLOCK_PHASE_WORDS:
+		{
+			for (int i = 0; i < 4; i++)
+				pkt[i] = block->pos + i < sendLength ? getMsgByte(connector, sendStart + block->pos + i) : 0;
+
+			if (SL_send(connector->gcport, (pkt[0] << 24) | (pkt[1] << 16) | (pkt[2]<< 8) | pkt[3]) < 0 || SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+			SL_pacerWordDone(connector->gcport);
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (block->pos + i < recvLength)
+					setMsgByte(connector, recvStart + block->pos + i, pkt[i]);
+			}
+
+			block->pos += 4;
+			if (block->pos >= recvLength && block->pos >= sendLength)
+				block->phase = BLOCK_PHASE_TRAILER;
+		} break;
+		case BLOCK_PHASE_TRAILER:
+		{
+			u32 sendTrailer = 0;
+
+			if (sendLength > 0)
+				sendTrailer = (u32) ((NET_CONN_FRAME_MARK << 24) | (block->frame << 16) | SL_crc16((const u8 *) &connector->receivedMsgBuffer[sendStart], sendLength));
+
+			if (SL_send(connector->gcport, sendTrailer) < 0 || SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+			SL_pacerWordDone(connector->gcport);
+			SL_pacerWordDone(connector->gcport);
+
+			if (recvLength > 0)
+			{
+				u32 trailer = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
+				u8 good = trailer == (u32) ((NET_CONN_FRAME_MARK << 24) | (block->frame << 16) | SL_crc16((const u8 *) &connector->receivedMsgBuffer[recvStart], recvLength));
+				TL_RECORD(connector->gcport, TL_SOURCE_SERIAL, TL_EVENT_CHECK, good, block->frame);
+
+				if (!good)
 				{
-					//LOG_NS("\n----- GBA REQUESTING NETWORK INFO------ \n");
-					u8 networkBusyState = 0; // Not_Ready 
-
-					if (tcpConnector.internalState == TCP_STATE_WAITING && 
-					    tcpConnector.requestStop == 0 && 
-						tcpConnector.requestReset == 0 && 
-						tcpConnector.requestSend == 0 &&
-						tcpConnector.requestFetch == 0)
-					{
-						networkBusyState = 1; // Ready
-					}
+					LOG_AS("Bad frame %d (round %d) %08X\n", block->frame, block->round, (unsigned int) trailer);
+					block->badFrames |= 1 << block->frame;
+				}
+			}
+
+			if (block->round > 0)
+				block->framesResent++;
+
+			block->frame = getNextExchangeFrame(port, block->frame + 1);
+			block->pos = 0;
+			block->phase = block->frame < NET_CONN_MAX_FRAMES ? BLOCK_PHASE_WORDS : BLOCK_PHASE_ACK;
+		} break;
+		case BLOCK_PHASE_ACK:
+		{
+			if (SL_send(connector->gcport, (u32) (((NET_CONN_FACK_RES | block->round) << 16) | block->badFrames)) < 0)
+				return BLOCK_SI_ERROR;
+
+			// The gba only checks our frames now, and has to see our ack before it puts its own up
+			block->polls = 0;
+			block->phase = BLOCK_PHASE_ACK_WAIT;
+		} break;
+		case BLOCK_PHASE_ACK_WAIT:
+		default:
+		{
+			if (SL_recv(connector->gcport, pkt) < 0)
+				return BLOCK_SI_ERROR;
+
+			u32 ack = (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24);
+			if (ack >> 16 != (u32) (NET_CONN_FACK_RES | block->round))
+			{
+				if (++block->polls >= FRAME_ACK_POLLS)
+					return BLOCK_BAD_FRAMES;
+
+				delay += FRAME_ACK_POLL_DELAY;
+				break;
+			}
+
+			if (ack & exchangeBlock->pendingFrames)
+				LOG_AS("GBA asked for frames %04X again (round %d)\n", (unsigned int) (ack & exchangeBlock->pendingFrames), block->round);
+			TL_RECORD(connector->gcport, TL_SOURCE_SERIAL, TL_EVENT_FRAME_ACK, block->round, (u16) (exchangeBlock->pendingFrames & ack & 0xFFFF));
+
+			exchangeBlock->pendingFrames &= ack & 0xFFFF;
+			block->pendingFrames = block->badFrames;
+			block->badFrames = 0;
+			block->round++;
+
+			if ((block->pendingFrames | exchangeBlock->pendingFrames) == 0)
+				return BLOCK_DONE;
+
+			if (block->round >= NET_CONN_MAX_FRAME_ROUNDS)
+				return BLOCK_BAD_FRAMES;
+
+			block->frame = getNextExchangeFrame(port, 0);
+			block->pos = 0;
+			block->phase = BLOCK_PHASE_WORDS;
+		} break;
+	}
+
+	serialSleep(port, delay);
+	return BLOCK_IN_PROGRESS;
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_EXCHANGE_START, reads the receive command for the block the gba wants back and sets the exchange going
+*/
+static void startExchange(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	SerialBlock *block = &port->block;
+	SerialBlock *exchangeBlock = &port->exchangeBlock;
+	u8 pkt[4];
+	int commResult = SL_recv(connector->gcport, pkt);
+
+	// The gba hasn't put the receive command up yet, give it a moment
+	if (commResult >= 0 && (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24) == port->lastBlockCmd && ++block->polls < FRAME_ACK_POLLS)
+	{
+		serialSleep(port, SL_pacerWordDelay(connector->gcport) + FRAME_ACK_POLL_DELAY);
+		return;
+	}
+
+	connector->internalState = SERIAL_STATE_WAITING;
+
+	port->exchangeOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+	port->exchangeCount = (u16) (pkt[2] | pkt[3] << 8);
+
+	// Neither block can be written over by the other part way through, a frame sent again has to be the same as the first time
+	if (commResult < 0 || NET_CONN_RECV_ANY != pkt[1] || port->msgBytesCount == 0 || port->exchangeCount == 0 ||
+		port->msgBytesOffset + port->msgBytesCount > MAX_MSG_SIZE || port->exchangeOffset + port->exchangeCount > MAX_MSG_SIZE ||
+		(port->msgBytesOffset < port->exchangeOffset + port->exchangeCount && port->exchangeOffset < port->msgBytesOffset + port->msgBytesCount))
+	{
+		LOG_AS("Bad exchange %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+		lastBlockFailed(connector->gcport, &port->lastBlockEndedAt);
+		TL_COMMAND_END(connector->gcport, 0);
+		serialSleep(port, SERIAL_POLL_DELAY);
+		return;
+	}
+
+	LOG_AS("Exchanging %x bytes at %x for %x bytes at %x\n", port->msgBytesCount, port->msgBytesOffset, port->exchangeCount, port->exchangeOffset);
+	markChannelsDirty(connector, port->msgBytesOffset, port->msgBytesCount);
+
+	memset(block, 0, sizeof(SerialBlock));
+	block->frameSize = NET_CONN_GET_FRAME_SIZE(port->msgBytesCount);
+	block->pendingFrames = (1 << ((port->msgBytesCount + block->frameSize - 1) / block->frameSize)) - 1;
+
+	memset(exchangeBlock, 0, sizeof(SerialBlock));
+	exchangeBlock->frameSize = NET_CONN_GET_FRAME_SIZE(port->exchangeCount);
+	exchangeBlock->pendingFrames = (1 << ((port->exchangeCount + exchangeBlock->frameSize - 1) / exchangeBlock->frameSize)) - 1;
+
+	connector->internalState = SERIAL_STATE_EXCHANGING;
+	serialSleep(port, SL_pacerWordDelay(connector->gcport));
+}
+
+// --------------------------------------------------------------------------------
+static void finishBlock(SerialPort *port, int result)
+{
+	SerialConnector *connector = &port->connector;
+
+	if (result == BLOCK_DONE && port->block.framesResent == 0)
+	{
+		serialSleep(port, SL_pacerBlockDone(connector->gcport));
+		reportLinkSpeed(connector->gcport);
+		port->lastBlockEndedAt = gettime();
+	}
+	else
+	{
+		// We already know the block had trouble, so don't count it again if the gba has to repeat it
+		SL_pacerBlockFailed(connector->gcport);
+		serialSleep(port, SL_getPacer(connector->gcport)->settleDelay);
+		port->lastBlockEndedAt = 0;
+
+		if (result == BLOCK_DONE)
+			LOG_AS("Port %x block needed %u frames sent again\n", connector->gcport, (unsigned int) port->block.framesResent);
+	}
+
+	if (result != BLOCK_SI_ERROR)
+	{
+		if (connector->internalState == SERIAL_STATE_SENDING || connector->internalState == SERIAL_STATE_STREAMING || connector->internalState == SERIAL_STATE_EXCHANGING)
+			connector->requestSend = 0;
+		if (connector->internalState != SERIAL_STATE_SENDING && connector->internalState != SERIAL_STATE_STREAMING)
+			connector->requestReceive = 1;
+	}
+
+	// What the gba sent, so a replay can send the same
+	if (result == BLOCK_DONE && (connector->internalState == SERIAL_STATE_RECEIVING || connector->internalState == SERIAL_STATE_EXCHANGING) && port->msgBytesOffset + port->msgBytesCount <= MAX_MSG_SIZE)
+		TR_blockData(connector->gcport, port->msgBytesOffset, &connector->receivedMsgBuffer[port->msgBytesOffset], port->msgBytesCount);
+
+	connector->internalState = SERIAL_STATE_WAITING;
+
+	if (port->calling)
+	{
+		port->calling = 0;
+
+		// The gba knows the request didn't make it too, and will make the whole call again
+		if (result == BLOCK_DONE)
+		{
+			port->callRequest = port->tcpConnector.requestsQueued;
+			port->callQueuedAt = gettime();
+
+			// The call is timed until its answer has gone to the gba
+			if (queueRequest(&port->tcpConnector, (u8) (port->msgBytesOffset / VIRTUAL_CHANNEL_SIZE), port->msgBytesCount))
+			{
+				connector->internalState = SERIAL_STATE_CALL_WAITING;
+				return;
+			}
+		}
+	}
+
+	TL_COMMAND_END(connector->gcport, result == BLOCK_DONE);
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_CALL_WAITING, once the server has answered (or we've given up on it) sends NET_CONN_CALL_RES.
+* Nothing goes over the link until then, the gba is just waiting for that one word
+*/
+static void stepCallWaiting(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	TCPConnector *tcpConnector = &port->tcpConnector;
+	u32 waited = ticks_to_millisecs(gettime() - port->callQueuedAt);
+	u8 done = (s32) (tcpConnector->requestsDone - port->callRequest) > 0;
+
+	if (!done && waited < CALL_TIMEOUT)
+	{
+		serialSleep(port, SERIAL_POLL_DELAY);
+		return;
+	}
+
+	TCPRequest *request = &tcpConnector->requests[port->callRequest % TCP_MAX_IN_FLIGHT];
+	u16 answered = done && request->answered ? NET_CONN_CALL_ANSWERED : 0;
+
+	// A shorter answer (a compressed payload, say) is sent as it is rather than padded out to what the gba asked for
+	if (answered && (connector->linkCaps & NET_CONN_LINK_CAP_SIZED_CALL))
+		answered = request->answerSize > 0 && request->answerSize < port->callResponseCount ? request->answerSize : port->callResponseCount;
+
+	if (SL_send(connector->gcport, (u32) (NET_CONN_CALL_RES << 16) | answered) < 0)
+	{
+		// Try again, unless it's been so long the gba will have timed out and started the call again anyway
+		if (waited >= CALL_TIMEOUT * 2)
+		{
+			connector->internalState = SERIAL_STATE_WAITING;
+			TL_COMMAND_END(connector->gcport, 0);
+		}
+
+		serialSleep(port, SERIAL_POLL_DELAY);
+		return;
+	}
+
+	LOG_AS("Port %x call %s after %u ms\n", connector->gcport, answered ? "answered" : "failed", (unsigned int) waited);
+
+	if (!answered)
+	{
+		connector->internalState = SERIAL_STATE_WAITING;
+		TL_COMMAND_END(connector->gcport, 0);
+		serialSleep(port, SERIAL_POLL_DELAY);
+		return;
+	}
+
+	port->callAnswer = answered;
+	port->block.polls = 0;
+	connector->internalState = SERIAL_STATE_CALL_ANSWERED;
+	serialSleep(port, SL_pacerWordDelay(connector->gcport));
+}
+
+// --------------------------------------------------------------------------------
+/**
+* SERIAL_STATE_CALL_ANSWERED, the gba has been waiting a while so it may not be quick to notice NET_CONN_CALL_RES.
+* It puts the word back up once it has it, and only then do we start on the answer
+*/
+static void stepCallAnswered(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	u32 callRes = (u32) (NET_CONN_CALL_RES << 16) | port->callAnswer;
+	u8 pkt[4];
+
+	if (SL_recv(connector->gcport, pkt) < 0 || (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24) != callRes)
+	{
+		// Time rather than polls, a busy gba can take a while to get back round to the link
+		if (ticks_to_millisecs(gettime() - port->callQueuedAt) >= CALL_TIMEOUT * 2)
+		{
+			LOG_AS("Port %x gba never picked up the answer to its call\n", connector->gcport);
+			connector->internalState = SERIAL_STATE_WAITING;
+			TL_COMMAND_END(connector->gcport, 0);
+			serialSleep(port, SERIAL_POLL_DELAY);
+			return;
+		}
+
+		// It could have cleared the word before looking for it, so put it up again every so often
+		if (++port->block.polls % 10 == 0)
+			SL_send(connector->gcport, callRes);
+
+		serialSleep(port, SL_pacerWordDelay(connector->gcport) + FRAME_ACK_POLL_DELAY);
+		return;
+	}
+
+	port->msgBytesOffset = port->callResponseOffset;
+	port->msgBytesCount = (connector->linkCaps & NET_CONN_LINK_CAP_SIZED_CALL) ? port->callAnswer : port->callResponseCount;
+	port->msgCheckBytes = 0xFFFF;
+	connector->internalState = SERIAL_STATE_WAITING;
+
+	// Both halves of a call are framed so we'll know if the gba has to make it again, the next call isn't a sign the link is too fast
+	port->lastBlockCmd = 0;
+	startBlock(port, SERIAL_STATE_SENDING);
+
+	if (connector->internalState != SERIAL_STATE_SENDING)
+		serialSleep(port, SERIAL_POLL_DELAY);
+}
+
+// --------------------------------------------------------------------------------
+static void serialStep(SerialPort *port)
+{
+	SerialConnector *connector = &port->connector;
+	TCPConnector *tcpConnector = &port->tcpConnector;
+	u8 pkt[4];
+	int commResult = 0;
+
+	switch (connector->internalState) 
+	{
+		case SERIAL_STATE_SEARCHING_FOR_GBA:
+		{
+			if (SL_getDeviceType(connector->gcport) & SI_GBA)
+			{
+				port->probing = 0;
+				SL_reset(connector->gcport);
+				connector->internalState = SERIAL_STATE_INIT;
+				serialSleep(port, SERIAL_RESET_DELAY);
+			}
+			else if (!port->probing)
+			{
+				port->probing = 1;
+				SL_resetDeviceType(connector->gcport);
+				SI_GetTypeAsync(connector->gcport, SL_getDeviceTypeCallback(connector->gcport));
+				serialSleep(port, SERIAL_RESET_DELAY);
+			}
+			else
+			{
+				// Nothing plugged in, park the port until it's time to look again
+				port->probing = 0;
+				serialSleep(port, SERIAL_PROBE_INTERVAL * 1000);
+			}
+		} break;
+		case SERIAL_STATE_INIT: 
+		{
+			commResult = SL_getstatus(connector->gcport, pkt);
+
+			if (commResult < 0)
+			{
+				connector->internalState = SERIAL_STATE_ERROR;
+			}
+			else if (pkt[2]&SI_STATUS_CONNECTED)
+			{
+				LOG_AS("Connection Established port %x\n", connector->gcport);
+				connector->internalState = SERIAL_STATE_WAITING;
+				connector->connectionResult = SERIAL_CONNECTED;
+				isPlayerConnected[connector->gcport] = 1;
+				SL_pacerReset(connector->gcport);
+				port->lastBlockCmd = 0;
+				port->statusWatched = 0;
+				connector->linkCaps = 0; // Stay in the original mode until the gba asks for something else
+			}
+			else
+			{
+				// The GBA isn't ready yet, make sure it's still plugged in before we try again
+				SL_resetDeviceType(connector->gcport);
+				SI_GetTypeAsync(connector->gcport, SL_getDeviceTypeCallback(connector->gcport));
+				port->probing = 1;
+				connector->internalState = SERIAL_STATE_SEARCHING_FOR_GBA;
+				serialSleep(port, SERIAL_RESET_DELAY);
+			}
+
+		} break;
+		case SERIAL_STATE_WAITING:
+		{
+			commResult = SL_recv(connector->gcport, pkt);
+
+			//LOG_AS("Reading %x with first %x and second %x\n", (u16) (pkt[0] | pkt[1] << 8), pkt[0], pkt[1]);
+
+			// Anything other than the gba asking again means it's stopped waiting on the server
+			if (commResult >= 0 && pkt[1] != 0 && (u16) (pkt[0] | pkt[1] << 8) != NET_CONN_LIFN_REQ)
+				port->statusWatched = 0;
+
+			if (commResult < 0)
+			{
+				connector->internalState = SERIAL_STATE_WAITING;
+			}
+			else if (NET_CONN_SEND_ANY == pkt[1]) // We are reciving data from the GBA
+			{
+				checkForRepeatedBlock(connector->gcport, pkt, &port->lastBlockCmd, &port->lastBlockEndedAt);
+				port->msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+
+				port->msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+
+				LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				LOG_NS("Receiving message \n");
+				TL_COMMAND_START(connector->gcport, TL_CMD_SEND, port->msgBytesCount);
+
+				port->msgCheckBytes = 0xFFFF;
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+
+				LOG_AS("Check after CMD %x\n", port->msgCheckBytes);
+				startBlock(port, SERIAL_STATE_RECEIVING);
+			}
+			else if (NET_CONN_RECV_ANY == pkt[1])  // We are sending data to the GBA
+			{
+				checkForRepeatedBlock(connector->gcport, pkt, &port->lastBlockCmd, &port->lastBlockEndedAt);
+				port->msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+
+				port->msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+
+				LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				LOG_AS("Check after CMD %x\n", port->msgCheckBytes);
+				LOG_NS("Sending message \n");
+				TL_COMMAND_START(connector->gcport, TL_CMD_RECV, port->msgBytesCount);
+
+				port->msgCheckBytes = 0xFFFF;
+				startBlock(port, SERIAL_STATE_SENDING);
+			}
+			else if (NET_CONN_CALL_ANY == pkt[1] && (connector->linkCaps & NET_CONN_LINK_CAP_CALL)) // The GBA wants a request transmitted and answered
+			{
+				checkForRepeatedBlock(connector->gcport, pkt, &port->lastBlockCmd, &port->lastBlockEndedAt);
+				port->msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+				port->msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+
+				LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				TL_COMMAND_START(connector->gcport, TL_CMD_CALL, port->msgBytesCount);
+				port->block.polls = 0;
+				connector->internalState = SERIAL_STATE_CALL_START;
+				serialSleep(port, SL_pacerWordDelay(connector->gcport));
+			}
+			else if (NET_CONN_STRM_ANY == pkt[1] && (connector->linkCaps & NET_CONN_LINK_CAP_STREAM)) // The GBA wants a whole payload in one go
+			{
+				checkForRepeatedBlock(connector->gcport, pkt, &port->lastBlockCmd, &port->lastBlockEndedAt);
+				port->msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+				port->msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+
+				LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				TL_COMMAND_START(connector->gcport, TL_CMD_STRM, port->msgBytesCount);
+				port->block.polls = 0;
+				connector->internalState = SERIAL_STATE_STREAM_START;
+				serialSleep(port, SL_pacerWordDelay(connector->gcport));
+			}
+			else if (NET_CONN_XCHG_ANY == pkt[1] && (connector->linkCaps & NET_CONN_LINK_CAP_DUPLEX)) // The GBA has a block for us and wants one back
+			{
+				checkForRepeatedBlock(connector->gcport, pkt, &port->lastBlockCmd, &port->lastBlockEndedAt);
+				port->msgBytesCount = (u16) (pkt[2] | pkt[3] << 8);
+				port->msgBytesOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+
+				LOG_AS("Got Cmd %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				TL_COMMAND_START(connector->gcport, TL_CMD_XCHG, port->msgBytesCount);
+				port->block.polls = 0;
+				connector->internalState = SERIAL_STATE_EXCHANGE_START;
+				serialSleep(port, SL_pacerWordDelay(connector->gcport));
+			}
+			else if ((u16) (pkt[0] | pkt[1] << 8) == NET_CONN_HANDSHAKE_REQ)
+			{
+				TL_COMMAND_START(connector->gcport, TL_CMD_HAND, 0);
+				connector->linkCaps = (u16) (pkt[2] | pkt[3] << 8) & NET_CONN_LINK_CAPS;
+				if (!(connector->linkCaps & NET_CONN_LINK_CAP_FRAMED))
+					connector->linkCaps &= ~(NET_CONN_LINK_CAP_CALL | NET_CONN_LINK_CAP_DUPLEX);
+				if (!(connector->linkCaps & NET_CONN_LINK_CAP_CALL))
+					connector->linkCaps &= ~NET_CONN_LINK_CAP_SIZED_CALL;
+				LOG_AS("Handshake port %x link caps %x\n", connector->gcport, connector->linkCaps);
+
+				u16 res = getConnectionResult(tcpConnector) == CONNECTION_SUCCESS ? NET_CONN_HANDSHAKE_RES_ONLINE : NET_CONN_HANDSHAKE_RES_NO_INTERNET;
+				commResult = SL_send(connector->gcport, (u32) (res << 16) | connector->linkCaps);
+				TL_COMMAND_END(connector->gcport, commResult >= 0);
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if ((u16) (pkt[0] | pkt[1] << 8) == NET_CONN_BCLR_REQ)
+			{
+				TL_COMMAND_START(connector->gcport, TL_CMD_BCLR, 0);
+				u32 cleared = clearDirtyChannels(connector);
+				LOG_AS("Resetting MSG Buffer (%u channels)\n", cleared);
+				TL_COMMAND_END(connector->gcport, 1);
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if (NET_CONN_PINF_REQ == (u16) (pkt[0] | pkt[1] << 8))
+			{
+				TL_COMMAND_START(connector->gcport, TL_CMD_PINF, 0);
+				port->msgCheckBytes = 0xFFFF;
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+
+
+				if (validatePokeStringMsg(connector->receivedMsgBuffer, 0, 8))
+				{
+					bytesToChars(connector->receivedMsgBuffer, 0, 8);
+					LOG_AS("\n----- PLAYER INFO -----\nNAME: %s\n", &connector->receivedMsgBuffer[0]);
+
+					for (int i = 0; i < 8; i++) 
+					{
+						connector->playerData.playerName[i] = connector->receivedMsgBuffer[i];
+						playerNames[connector->gcport][i] = connector->receivedMsgBuffer[i];
+					}
+
+
+					if (connector->receivedMsgBuffer[8] % 2 == 0)
+					{
+						LOG_NS("GENDER: BOY\n");
+						connector->playerData.gender = 0;
+					}
+					else 
+					{
+						LOG_NS("GENDER: GIRL\n");
+						connector->playerData.gender = 1;
+					}
+
+					LOG_AS("TRAINER ID: %d\n", (u16) (connector->receivedMsgBuffer[10] + (connector->receivedMsgBuffer[11] << 8)));
+					connector->playerData.trainerId = (u16) (connector->receivedMsgBuffer[10] + (connector->receivedMsgBuffer[11] << 8));
+
+				}
+
+				if (validatePokeStringMsg(connector->receivedMsgBuffer, 32, 20))
+				{
+					bytesToChars(connector->receivedMsgBuffer, 32, 20);
+					LOG_AS("GAME: %s\n\n", &connector->receivedMsgBuffer[32]);
+
+					for (int i = 0; i < 20; i++) 
+						connector->playerData.gameName[i] = connector->receivedMsgBuffer[32+i];
+
+				}
+
+				commResult = SL_send(connector->gcport, (u32) (NET_CONN_CHCK_RES << 16) | (port->msgCheckBytes & 0xFFFF));
+				TL_COMMAND_END(connector->gcport, commResult >= 0);
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if (NET_CONN_CINF_REQ == (u16) (pkt[0] | pkt[1] << 8))
+			{
+				TL_COMMAND_START(connector->gcport, TL_CMD_CINF, 0);
+				port->msgCheckBytes = 0xFFFF;
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+
+				// The last block's size is whatever the gba asked for, even if the block itself was refused, so keep it inside the address
+				u16 addressLength = port->msgBytesCount < sizeof(tcpConnector->remoteAddressAndPort) ? port->msgBytesCount : sizeof(tcpConnector->remoteAddressAndPort) - 1;
+
+				if (validatePokeStringMsg(connector->receivedMsgBuffer, 0, addressLength))
+				{
+					bytesToChars(connector->receivedMsgBuffer, 0, addressLength);
+					memcpy(tcpConnector->remoteAddressAndPort, connector->receivedMsgBuffer, addressLength);
+					tcpConnector->remoteAddressAndPort[addressLength] = '\0'; // Make sure the string is actually terminated
+					LOG_AS("\n----- SERVER INFO -----\nADDRESS: %s\n", tcpConnector->remoteAddressAndPort);
+					startNetworkThread(tcpConnector);
+				}
+
+				commResult = SL_send(connector->gcport, (u32) (NET_CONN_CHCK_RES << 16) | (port->msgCheckBytes & 0xFFFF));
+				TL_COMMAND_END(connector->gcport, commResult >= 0);
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if (NET_CONN_TRAN_ANY == pkt[1])
+			{
+				TL_COMMAND_START(connector->gcport, TL_CMD_TRAN, (u16) (pkt[2] | pkt[3] << 8));
+				port->msgCheckBytes = 0xFFFF;
+				port->msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
+				port->msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+
+				u8 trVirtualChannel = pkt[0];
+				u16 trSize = (u16) (pkt[2] | pkt[3] << 8);
+
+				if (trSize + (VIRTUAL_CHANNEL_SIZE * trVirtualChannel) <= MAX_TRANS_SIZE) 
+				{
+					LOG_AS("Setting tr size to %x \n", trSize);
+				}
+				else
+				{
+					LOG_NS("WARNING - A request was made to transmit more than the max about of data\n");
+					trVirtualChannel = 0;
+					trSize = MAX_TRANS_SIZE;
+				}
+
+
+				commResult = SL_send(connector->gcport, (u32) (NET_CONN_CHCK_RES << 16) | (port->msgCheckBytes & 0xFFFF));
+				TL_COMMAND_END(connector->gcport, commResult >= 0);
+				queueRequest(tcpConnector, trVirtualChannel, trSize);
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if (NET_CONN_LIFN_REQ == (u16) (pkt[0] | pkt[1] << 8))
+			{
+				//LOG_NS("\n----- GBA REQUESTING NETWORK INFO------ \n");
+				TL_COMMAND_START(connector->gcport, TL_CMD_LIFN, 0);
+				u16 linkStatus = getLinkStatus(tcpConnector);
+
+				commResult = SL_send(connector->gcport, (u32) (NET_CONN_LIFN_REQ << 16) | linkStatus);
+				TL_COMMAND_END(connector->gcport, commResult >= 0);
+
+				// The gba will wait for the status to be pushed rather than asking again
+				port->statusWatched = commResult >= 0 && (connector->linkCaps & NET_CONN_LINK_CAP_LIFN_PUSH) && !isFinalStatus(linkStatus);
+				port->pushedStatus = linkStatus;
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else if (port->statusWatched && getLinkStatus(tcpConnector) != port->pushedStatus)
+			{
+				// Left in JOY_RECV for the gba to find, it only looks while it's idle so it can't be mistaken for the start of a block
+				port->pushedStatus = getLinkStatus(tcpConnector);
+				commResult = SL_send(connector->gcport, (u32) (NET_CONN_LIFN_REQ << 16) | port->pushedStatus);
+				LOG_AS("Port %x pushed status %04X\n", connector->gcport, port->pushedStatus);
+
+				if (commResult < 0 || isFinalStatus(port->pushedStatus))
+					port->statusWatched = 0;
+
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+			else 
+			{
+				//VIDEO_WaitVSync();
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+
+		} break;
+		case SERIAL_STATE_SENDING:
+		{
+			commResult = stepSendBlock(port);
+
+			if (commResult != BLOCK_IN_PROGRESS)
+				finishBlock(port, commResult);
+
+		} break;
+		case SERIAL_STATE_RECEIVING:
+		{
+			commResult = stepReceiveBlock(port);
+
+			if (commResult != BLOCK_IN_PROGRESS)
+				finishBlock(port, commResult);
+
+		} break;
+		case SERIAL_STATE_CALL_START:
+		{
+			commResult = SL_recv(connector->gcport, pkt);
+
+			// The gba hasn't put the receive command up yet, give it a moment
+			if (commResult >= 0 && (u32) (pkt[0] | pkt[1] << 8 | pkt[2] << 16 | pkt[3] << 24) == port->lastBlockCmd && ++port->block.polls < FRAME_ACK_POLLS)
+			{
+				serialSleep(port, SL_pacerWordDelay(connector->gcport) + FRAME_ACK_POLL_DELAY);
+				break;
+			}
+
+			connector->internalState = SERIAL_STATE_WAITING;
+
+			if (commResult < 0 || NET_CONN_RECV_ANY != pkt[1])
+			{
+				LOG_AS("Call without a receive command %02X %02X %02X %02X\n", pkt[0], pkt[1], pkt[2], pkt[3]);
+				lastBlockFailed(connector->gcport, &port->lastBlockEndedAt);
+				TL_COMMAND_END(connector->gcport, 0);
+				serialSleep(port, SERIAL_POLL_DELAY);
+				break;
+			}
+
+			port->callResponseOffset = pkt[0] * VIRTUAL_CHANNEL_SIZE;
+			port->callResponseCount = (u16) (pkt[2] | pkt[3] << 8);
+			port->msgCheckBytes = 0xFFFF;
+			port->calling = 1;
+			startBlock(port, SERIAL_STATE_RECEIVING);
+
+			if (connector->internalState != SERIAL_STATE_RECEIVING)
+			{
+				port->calling = 0;
+				serialSleep(port, SERIAL_POLL_DELAY);
+			}
+		} break;
+		case SERIAL_STATE_CALL_WAITING:
+		{
+			stepCallWaiting(port);
+		} break;
+		case SERIAL_STATE_STREAM_START:
+		{
+			startStream(port);
+		} break;
+		case SERIAL_STATE_STREAMING:
+		{
+			commResult = stepStreamBlock(port);
+
+			if (commResult != BLOCK_IN_PROGRESS)
+				finishBlock(port, commResult);
+		} break;
+		case SERIAL_STATE_CALL_ANSWERED:
+		{
+			stepCallAnswered(port);
+		} break;
+		case SERIAL_STATE_EXCHANGE_START:
+		{
+			startExchange(port);
+		} break;
+		case SERIAL_STATE_EXCHANGING:
+		{
+			commResult = stepExchangeBlock(port);
+
+			if (commResult != BLOCK_IN_PROGRESS)
+				finishBlock(port, commResult);
+		} break;
+		case SERIAL_STATE_DONE:
+		{
+			// Nothing asks a port to stop at the moment, if something does it just never gets stepped again
+			connector->internalState = SERIAL_STATE_SEARCHING_FOR_GBA;
+			port->wakeAt = (u64) -1;
+		} break;
+		case SERIAL_STATE_ERROR:
+		{
+			print_ui_log("SERIAL ERROR");
+			LOG_NS("Connection Error Resetting...\n");
+			TL_COMMAND_END(connector->gcport, 0);
+
+			if (!IsDolphin())
+				switchToSlowTransfer();
+
+			connector->requestSend = 0;
+			connector->requestReceive = 0;
+			connector->requestStop = 0;
+			port->calling = 0;
+			connector->internalState = SERIAL_STATE_SEARCHING_FOR_GBA;
+			connector->connectionResult = SERIAL_NO_GBA;
+			port->probing = 0;
+			SL_resetDeviceType(connector->gcport);
+
+			if (updateStatusIf(tcpConnector, TCP_STATUS_STATE | TCP_STATUS_RESET, TCP_STATE_WAITING << TCP_STATUS_STATE_SHIFT | TCP_STATUS_RESET, 1 << TCP_STATE_WAITING | 1 << TCP_STATE_DONE))
+				wakeNetworkThread(tcpConnector);
+
+			port->msgBytesCount = 0;
+			port->msgCheckBytes = 0xFFFF;
+			port->msgBytesOffset = 0;
+		} break;
+	}
+}
+
+// --------------------------------------------------------------------------------
+static void initSerialPort(SerialPort *port, u8 gcport)
+{
+	memset(port, 0, sizeof(SerialPort));
+
+	port->connector.gcport = gcport;
+	port->connector.internalState = SERIAL_STATE_SEARCHING_FOR_GBA;
+	port->connector.connectionResult = SERIAL_NO_GBA;
+	port->msgCheckBytes = 0xFFFF;
+
+	strcpy(port->tcpConnector.remoteAddressAndPort, "127.0.0.1:9000");
+	port->tcpConnector.serialConnector = &port->connector;
+	port->tcpConnector.sock = -1;
+	port->tcpConnector.standbySock = -1;
+	LWP_MutexInit(&port->tcpConnector.wakeLock, false);
+	LWP_CondInit(&port->tcpConnector.wake);
+
+	LOG_AS("Waiting for a GBA (via DOL-011) in port %x...\n", gcport);
+}
+
+// --------------------------------------------------------------------------------
+u32 getConnectTime(u32 port)
+{
+	return port < 4 ? serialPorts[port].tcpConnector.connectTime : 0;
+}
+
+// --------------------------------------------------------------------------------
+static void *seriald (void *arg)
+{
+	(void)(arg);
+	u8 firstPort = 0;
+
+	print_ui_log("STARTING GBA CONN");
+
+	for (u8 i = 0; i < 4; i++)
+		initSerialPort(&serialPorts[i], i);
+
+	while (1)
+	{
+		u64 now = gettime();
+		u64 nextWakeAt = now + microsecs_to_ticks(SERIAL_MAX_SLEEP);
+
+		for (u8 i = 0; i < 4; i++)
+		{
+			SerialPort *port = &serialPorts[(firstPort + i) % 4];
+
+			if (port->wakeAt <= now)
+			{
+				u8 state = port->connector.internalState;
+				serialStep(port);
+
+				if (port->connector.internalState != state)
+					TL_RECORD(port->connector.gcport, TL_SOURCE_SERIAL, TL_EVENT_STATE, port->connector.internalState, state);
+			}
+
+			if (port->wakeAt < nextWakeAt)
+				nextWakeAt = port->wakeAt;
+		}
+
+		firstPort = (firstPort + 1) % 4;
+
+		now = gettime();
+		if (nextWakeAt > now)
+			usleep((u32) ticks_to_microsecs(nextWakeAt - now));
+	}
+
+	return NULL;
+}
+
+// ======================= Request cache ======================================================
+
+/*
+* Answers every player gets the same of (the mart, the battle) are kept once the server says they can be, so the next
+* time any port asks for one it's written straight back to the virtual channels without going to the server at all.
+* The server sends a CACHE_VERSION in front of each answer that can be kept, and again to every session that asked for
+* them (CACHE_REQUEST) whenever that answer changes. A kept answer is only handed out while its version is the latest we've
+* heard of, the TTL covers a change made while no port had a session open to hear it
+*/
+
+/* Call with requestCacheLock held */
+static CacheVersion *findCacheVersion(const char *server, const u8 *request)
+{
+	for (u8 i = 0; i < REQUEST_CACHE_VERSIONS; i++)
+	{
+		CacheVersion *known = &cacheVersions[i];
+
+		if (known->server[0] != 0 && strcmp(known->server, server) == 0 && memcmp(known->request, request, sizeof(known->request)) == 0)
+			return known;
+	}
+
+	return NULL;
+}
+
+/*
+* Call with requestCacheLock held. Versions only ever move on, another port can hear of a change before this one reads
+* a version the server sent before it. Every answer kept from any other version is dropped
+*/
+static void updateCacheVersion(const char *server, const u8 *request, u32 version)
+{
+	CacheVersion *known = findCacheVersion(server, request);
+
+	if (known != NULL && (s32) (version - known->version) <= 0)
+		return;
+
+	if (known == NULL)
+	{
+		known = &cacheVersions[nextCacheVersion];
+		nextCacheVersion = (nextCacheVersion + 1) % REQUEST_CACHE_VERSIONS;
+
+		strncpy(known->server, server, sizeof(known->server) - 1);
+		known->server[sizeof(known->server) - 1] = '\0';
+		memcpy(known->request, request, sizeof(known->request));
+	}
+
+	known->version = version;
+
+	for (u8 i = 0; i < REQUEST_CACHE_ENTRIES; i++)
+	{
+		CachedAnswer *entry = &cachedAnswers[i];
+
+		if (entry->server[0] != 0 && strcmp(entry->server, server) == 0 && memcmp(entry->request, request, sizeof(known->request)) == 0 && entry->version != version)
+			entry->server[0] = 0;
+	}
+}
+
+/* Called for every frame with tag 0, which only a CACHE_VERSION is sent with */
+static void readCacheVersion(TCPConnector *connector)
+{
+	const u8 *msg = connector->reader.other;
+	const char *server = connector->servers[connector->currentServer].address;
+
+	if (connector->reader.otherSize < CACHE_VERSION_MSG_SIZE || memcmp(msg, CACHE_VERSION, strlen(CACHE_VERSION)) != 0)
+	{
+		LOG_NS("Got a response nothing was waiting for\n");
+		return;
+	}
+
+	const u8 *request = &msg[CACHE_VERSION_MSG_REQUEST_OFFSET];
+	u32 version = (u32) msg[CACHE_VERSION_MSG_VERSION_OFFSET] << 24 | msg[CACHE_VERSION_MSG_VERSION_OFFSET + 1] << 16 | msg[CACHE_VERSION_MSG_VERSION_OFFSET + 2] << 8 | msg[CACHE_VERSION_MSG_VERSION_OFFSET + 3];
+	u16 ttl = (u16) (msg[CACHE_VERSION_MSG_TTL_OFFSET] << 8 | msg[CACHE_VERSION_MSG_TTL_OFFSET + 1]);
+	u8 tag = msg[CACHE_VERSION_MSG_TAG_OFFSET];
+
+	LWP_MutexLock(requestCacheLock);
+	updateCacheVersion(server, request, version);
+	LWP_MutexUnlock(requestCacheLock);
+
+	if (tag == 0)
+		return;
+
+	// The answer is the next frame the server sends, the request is marked so it's kept once that's in
+	TCPRequest *waiting = findRequest(connector, tag);
+	if (waiting != NULL && memcmp(waiting->data, request, CACHE_VERSION_MSG_REQUEST_SIZE) == 0)
+	{
+		waiting->cacheable = 1;
+		waiting->cacheVersion = version;
+		waiting->cacheTtl = ttl;
+	}
+}
+
+/* Keeps the answer the reader has just written to the virtual channels, unless its version has already been replaced */
+static void cacheAnswer(TCPConnector *connector, TCPRequest *request)
+{
+	const char *server = connector->servers[connector->currentServer].address;
+	u32 offset = connector->reader.msgChannel * VIRTUAL_CHANNEL_SIZE;
+	u16 size = connector->reader.msgSize;
+	u64 now = gettime();
+
+	if (request->size < CACHE_VERSION_MSG_REQUEST_SIZE || request->size > REQUEST_CACHE_KEY_SIZE || size == 0 || size > REQUEST_CACHE_ANSWER_SIZE || offset + size > MAX_MSG_SIZE)
+		return;
+
+	LWP_MutexLock(requestCacheLock);
+
+	CacheVersion *known = findCacheVersion(server, (const u8 *) request->data);
+
+	if (known != NULL && known->version == request->cacheVersion)
+	{
+		// The same request's old answer, then a free slot, then the one used longest ago
+		CachedAnswer *entry = NULL;
+
+		for (u8 i = 0; i < REQUEST_CACHE_ENTRIES && entry == NULL; i++)
+		{
+			CachedAnswer *candidate = &cachedAnswers[i];
+
+			if (candidate->server[0] != 0 && strcmp(candidate->server, server) == 0 && candidate->requestSize == request->size && memcmp(candidate->request, request->data, request->size) == 0)
+				entry = candidate;
+		}
+
+		for (u8 i = 0; i < REQUEST_CACHE_ENTRIES && entry == NULL; i++)
+		{
+			if (cachedAnswers[i].server[0] == 0)
+				entry = &cachedAnswers[i];
+		}
+
+		if (entry == NULL)
+		{
+			entry = &cachedAnswers[0];
+
+			for (u8 i = 1; i < REQUEST_CACHE_ENTRIES; i++)
+			{
+				if (cachedAnswers[i].usedAt < entry->usedAt)
+					entry = &cachedAnswers[i];
+			}
+		}
+
+		strcpy(entry->server, known->server);
+		memcpy(entry->request, request->data, request->size);
+		entry->requestSize = request->size;
+		entry->version = request->cacheVersion;
+		entry->expiresAt = now + millisecs_to_ticks((u64) request->cacheTtl * 1000);
+		entry->usedAt = now;
+		entry->channel = connector->reader.msgChannel;
+		entry->answerSize = size;
+		memcpy(entry->answer, &(connector->serialConnector->receivedMsgBuffer)[offset], size);
+	}
+
+	LWP_MutexUnlock(requestCacheLock);
+}
+
+/* Writes a kept answer to the request straight to the virtual channels. Returns the size of the answer, 0 if it has to go to the server */
+static u16 answerFromCache(TCPConnector *connector, TCPRequest *request)
+{
+	const char *server = connector->servers[connector->currentServer].address;
+	u16 answerSize = 0;
+	u64 now = gettime();
+
+	if (request->size < CACHE_VERSION_MSG_REQUEST_SIZE || request->size > REQUEST_CACHE_KEY_SIZE)
+		return 0;
+
+	LWP_MutexLock(requestCacheLock);
+
+	CacheVersion *known = findCacheVersion(server, (const u8 *) request->data);
+
+	for (u8 i = 0; i < REQUEST_CACHE_ENTRIES && known != NULL; i++)
+	{
+		CachedAnswer *entry = &cachedAnswers[i];
+
+		if (entry->server[0] == 0 || strcmp(entry->server, server) != 0 || entry->requestSize != request->size || memcmp(entry->request, request->data, request->size) != 0)
+			continue;
+
+		if (entry->version != known->version || now >= entry->expiresAt)
+		{
+			entry->server[0] = 0;
+			break;
+		}
+
+		u32 offset = entry->channel * VIRTUAL_CHANNEL_SIZE;
+		markChannelsDirty(connector->serialConnector, offset, entry->answerSize);
+		memcpy(&(connector->serialConnector->receivedMsgBuffer)[offset], entry->answer, entry->answerSize);
+
+		entry->usedAt = now;
+		answerSize = entry->answerSize;
+		break;
+	}
+
+	// Only requests the server has said can be kept count, the rest were never going to be here
+	if (answerSize > 0)
+		cacheHits++;
+	else if (known != NULL)
+		cacheMisses++;
+
+	LWP_MutexUnlock(requestCacheLock);
+
+	if (answerSize > 0)
+	{
+		request->tag = 0;
+		LOG_AS("Answered ch %x from the cache (%x bytes)\n", request->virtualChannel, answerSize);
+	}
+
+	return answerSize;
+}
+
+void getRequestCacheStats(u32 *hits, u32 *misses)
+{
+	LWP_MutexLock(requestCacheLock);
+	*hits = cacheHits;
+	*misses = cacheMisses;
+	LWP_MutexUnlock(requestCacheLock);
+}
+
+// ======================= Server session ======================================================
+
+/*
+* Once connected the socket is kept open and every transmission from the gba is sent as soon as it's queued.
+* If the server agreed to PIPELINE_REQUEST each request is tagged so several can be waiting on the server at once,
+* and responses are matched back up by their tag in whatever order they arrive. Older servers expect one request 
+* per read, so they are sent the next request only once the last one has been answered.
+* The thread blocks on the socket while anything is in flight and on connector->wake when nothing is.
+* Tagged responses are length prefixed frames (see netframe.h), so they come out right however TCP splits them up.
+*/
+
+// --------------------------------------------------------------------------------
+static s32 sendBytes(TCPConnector *connector, const char *bytes, u16 size)
+{
+	s32 res = net_send(connector->sock, bytes, size, TCP_FLAGS);
+
+	if (res > 0)
+		TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_SEND, bytes, (u16) res);
+
+	return res;
+}
+
+/* Every read from the session's socket goes through here, so a trace has all of them */
+static s32 recordReceived(TCPConnector *connector, const void *buffer, s32 res)
+{
+	if (res > 0)
+		TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_RECV, buffer, (u16) res);
+
+	return res;
+}
+
+/* Used while connecting, the request is copied behind a header if the session is pipelined */
+static s32 sendToServer(TCPConnector *connector, const char *data, u16 size, u8 tag)
+{
+	u16 headerSize = 0;
+
+	if (connector->pipelined)
+		headerSize = NF_writeHeader((u8 *) connector->sendMsgBuffer, NF_REQUEST_MARK, tag, size);
+
+	memcpy(&(connector->sendMsgBuffer)[headerSize], data, size);
+
+	return sendBytes(connector, connector->sendMsgBuffer, headerSize + size);
+}
+
+// --------------------------------------------------------------------------------
+static s32 sendRequest(TCPConnector *connector, TCPRequest *request)
+{
+	if (++connector->nextTag == 0)
+		connector->nextTag = 1;
+
+	request->tag = connector->nextTag;
+	request->cacheable = 0;
+
+	LOG_AS("Doing Transmission of size %x from ch %x (tag %x)\n", request->size, request->virtualChannel, request->tag);
+	LOG_AS("Sending Server Message %02X %02X %02X %02X\n", request->data[0], request->data[1], request->data[2], request->data[3]);
+
+	TL_RECORD(connector->serialConnector->gcport, TL_SOURCE_NET, TL_EVENT_TCP_SEND, request->tag, request->size);
+
+	if (!connector->pipelined)
+		return sendBytes(connector, request->data, request->size);
+
+	// The header goes in the space reserved in front of the data
+	NF_writeHeader((u8 *) request->header, NF_REQUEST_MARK, request->tag, request->size);
+	return sendBytes(connector, request->header, NF_HEADER_SIZE + request->size);
+}
+
+/* Copies a 0x25 message from the server into the virtual channel it names. Returns the size of the message, 0 if it wasn't one */
+static u16 deliverResponse(TCPConnector *connector, const char *msg, u16 length)
+{
+	if (length < 5 || msg[0] != 0x25)
+	{
+		LOG_NS("Error Reading message\n");
+		return 0;
+	}
+
+	u16 msgSize = (u16) (msg[3] | msg[2] << 8);
+	u16 msgBytesOffset = msg[1] * VIRTUAL_CHANNEL_SIZE;
+	u16 receivedSize = length - 5;
+
+	if (msgBytesOffset + msgSize > MAX_MSG_SIZE)
+		msgSize = MAX_MSG_SIZE - msgBytesOffset;
+
+	if (receivedSize > msgSize)
+		receivedSize = msgSize;
+
+	LOG_AS("Copying server response of size %x to v chan %x (offset %x)\n", msgSize, msg[1], msgBytesOffset);
+
+	markChannelsDirty(connector->serialConnector, msgBytesOffset, msgSize);
+
+	// Some responses say they're bigger than they are (the mart sends 12 bytes as 16), the rest of the space is cleared
+	memcpy(&(connector->serialConnector->receivedMsgBuffer)[msgBytesOffset], &msg[5], receivedSize);
+	memset(&(connector->serialConnector->receivedMsgBuffer)[msgBytesOffset + receivedSize], 0, msgSize - receivedSize);
+	return msgSize;
+}
+
+/* Marks a request as answered, and frees up every answered request at the front of the ring */
+static void completeRequest(TCPConnector *connector, TCPRequest *request, u16 answerSize)
+{
+	request->answerSize = answerSize;
+	request->answered = 1;
+	LOG_AS("Server answered ch %x after %u ms\n", request->virtualChannel, (unsigned int) ticks_to_millisecs(gettime() - request->queuedAt));
+	TL_RECORD(connector->serialConnector->gcport, TL_SOURCE_NET, TL_EVENT_TCP_RECV, request->tag, answerSize);
+	TL_SAMPLE(connector->serialConnector->gcport, TL_CMD_SERVER, (u32) ticks_to_microsecs(gettime() - request->queuedAt));
+
+	while (connector->requestsDone != connector->requestsSent && connector->requests[connector->requestsDone % TCP_MAX_IN_FLIGHT].answered)
+		connector->requestsDone++;
+}
+
+// --------------------------------------------------------------------------------
+static TCPRequest *findRequest(TCPConnector *connector, u8 tag)
+{
+	for (u32 i = connector->requestsDone; i != connector->requestsSent; i++)
+	{
+		TCPRequest *request = &connector->requests[i % TCP_MAX_IN_FLIGHT];
+
+		if (!request->answered && (!connector->pipelined || request->tag == tag))
+			return request;
+	}
+
+	return NULL;
+}
+
+/* Waits for the server's next frame (only used while connecting). Returns the NF_commit result */
+static int recvFrame(TCPConnector *connector)
+{
+	int result = NF_NEED_MORE;
+
+	while (result == NF_NEED_MORE)
+	{
+		u8 *buffer;
+		u32 size = NF_getRecvBuffer(&connector->reader, &buffer);
+		s32 res = recordReceived(connector, buffer, recvWithin(connector->sock, buffer, size, HANDSHAKE_TIMEOUT));
+
+		if (res <= 0)
+			return NF_ERROR;
+
+		result = NF_commit(&connector->reader, res);
+	}
+
+	return result;
+}
+
+/* 
+* Older servers answer PIPELINE_REQUEST with a single 0, newer ones with a frame holding PL_ and the version they speak.
+* Returns 1 if the session is pipelined, 0 if not, or < 0 if the server didn't answer
+*/
+static s32 negotiatePipeline(TCPConnector *connector)
+{
+	u8 *buffer;
+	u8 first = 0;
+
+	NF_initReader(&connector->reader, (u8 *) connector->serialConnector->receivedMsgBuffer, MAX_MSG_SIZE);
+	connector->pipelined = 0;
+
+	if (sendToServer(connector, PIPELINE_REQUEST, strlen(PIPELINE_REQUEST), 0) < 0 || recordReceived(connector, &first, recvWithin(connector->sock, &first, 1, HANDSHAKE_TIMEOUT)) <= 0)
+		return -1;
+
+	if (first != NF_RESPONSE_MARK)
+		return 0;
+
+	NF_getRecvBuffer(&connector->reader, &buffer);
+	buffer[0] = first;
+
+	if (NF_commit(&connector->reader, 1) != NF_NEED_MORE || recvFrame(connector) != NF_OTHER)
+		return -1;
+
+	return connector->reader.otherSize > strlen(PIPELINE_REQUEST) && 
+	       memcmp(connector->reader.other, PIPELINE_REQUEST, strlen(PIPELINE_REQUEST)) == 0 &&
+	       connector->reader.other[strlen(PIPELINE_REQUEST)] >= PIPELINE_VERSION;
+}
+
+/* Older servers write each response in one go, so every read is taken to be one whole response */
+static s32 readUnframedResponse(TCPConnector *connector)
+{
+	s32 res = recordReceived(connector, connector->fetchedMsgBuffer, net_recv(connector->sock, connector->fetchedMsgBuffer, sizeof(connector->fetchedMsgBuffer), TCP_FLAGS));
+
+	if (res <= 0 || connector->fetchedMsgBuffer[0] == 0x00)
+	{
+		// We generally get only 0's when the server goes offline. 
+		// If we try fetching more data then dolphin (any maybe a wii) can crash (for some reason?) so the safest things seems to be to stop the thread
+		LOG_NS("No Response From Server/Unknown Command Sent\n");
+		return -1;
+	}
+
+	u16 answerSize = deliverResponse(connector, connector->fetchedMsgBuffer, res);
+
+	TCPRequest *request = findRequest(connector, 0);
+	if (request != NULL)
+		completeRequest(connector, request, answerSize);
+
+	return 0;
+}
+
+/* Reads whatever part of the current frame the server has sent, and completes its request if that was the end of it. Returns < 0 if the connection has gone */
+static s32 readResponses(TCPConnector *connector)
+{
+	u8 *buffer;
+	u32 size;
+	s32 res;
+
+	if (!connector->pipelined)
+		return readUnframedResponse(connector);
+
+	size = NF_getRecvBuffer(&connector->reader, &buffer);
+	res = recordReceived(connector, buffer, net_recv(connector->sock, buffer, size, TCP_FLAGS));
+
+	if (res <= 0)
+		return -1;
+
+	int result = NF_commit(&connector->reader, res);
+
+	switch (result)
+	{
+		case NF_MESSAGE:
+			LOG_AS("Server response of size %x went to v chan %x\n", connector->reader.msgSize, connector->reader.msgChannel);
+			markChannelsDirty(connector->serialConnector, connector->reader.msgChannel * VIRTUAL_CHANNEL_SIZE, connector->reader.msgSize);
+			// fall through
+		case NF_OTHER:
+		{
+			// Requests are never sent with tag 0, so nothing is waiting on these
+			if (result == NF_OTHER && connector->reader.tag == 0)
+			{
+				readCacheVersion(connector);
+				break;
+			}
+
+			// An empty response means the server didn't know the request, but it's still an answer
+			TCPRequest *request = findRequest(connector, connector->reader.tag);
+			if (request != NULL && result == NF_MESSAGE && request->cacheable)
+				cacheAnswer(connector, request);
+
+			if (request != NULL)
+				completeRequest(connector, request, result == NF_MESSAGE ? connector->reader.msgSize : 0);
+			else
+				LOG_NS("Got a response nothing was waiting for\n");
+		} break;
+		case NF_ERROR:
+		{
+			// There's no way to find the start of the next frame, so start the session again
+			LOG_NS("Error Reading message, reconnecting\n");
+			updateStatus(connector, TCP_STATUS_RESET, TCP_STATUS_RESET);
+		} break;
+	}
+
+	return 0;
+}
+
+/* Reads everything the server sent while nothing was in flight (CACHE_VERSIONs), so nothing is answered from the cache past a change we've been told of */
+static void readWaitingResponses(TCPConnector *connector)
+{
+	struct pollsd sd;
+	sd.socket = connector->sock;
+	sd.events = POLLIN;
+	sd.revents = 0;
+
+	while (!(getStatus(connector) & TCP_STATUS_RESET) && net_poll(&sd, 1, 0) > 0 && readResponses(connector) >= 0)
+		sd.revents = 0;
+}
+
+/* Waits until the server sends something or a new request might be ready to go. Returns < 0 if the connection has gone */
+static s32 waitForServer(TCPConnector *connector)
+{
+	if (connector->requestsSent != connector->requestsDone)
+	{
+		struct pollsd sd;
+		sd.socket = connector->sock;
+		sd.events = POLLIN;
+		sd.revents = 0;
+
+		s32 res = net_poll(&sd, 1, TCP_BUSY_POLL_MS);
+
+		if (res < 0)
+			return res;
+
+		return res > 0 ? readResponses(connector) : 0;
+	}
+
+	// The cond is signalled under the lock, so checking for work with it held means we can't miss a wake up
+	struct timespec timeout = { 0, TCP_IDLE_WAIT_MS * 1000000 };
+
+	LWP_MutexLock(connector->wakeLock);
+	if (connector->requestsSent == connector->requestsQueued && !(getStatus(connector) & (TCP_STATUS_RESET | TCP_STATUS_STOP)))
+		LWP_CondTimedWait(connector->wake, connector->wakeLock, &timeout);
+	LWP_MutexUnlock(connector->wakeLock);
+
+	return 0;
+}
+
+/* Works out where one of the servers in an address is. Returns CONNECTION_STARTING or the error to report */
+static u8 resolveAddress(const char *address, struct sockaddr_in *server)
+{
+	char addrCopy[64];
+
+	strcpy(addrCopy, address);
+
+    char * ipOrDomainName; 
+    char * portString = NULL; 
+    char * token = strtok(addrCopy, ":");
+	int port = 80;
+    if(token != NULL) 
+    {
+        ipOrDomainName = token;
+        portString = strtok(NULL, ":");
+		if (portString != NULL  && portString[0] != '\0')
+		{
+			char *temp;
+			port = strtol(portString, &temp, 10);
+		}
+    }
+	else 
+	{
+		return CONNECTION_ERROR_INVALID_IP;
+	}
+
+	struct in_addr ipTest;
+
+	memset (server, 0, sizeof (struct sockaddr_in));
+	memset (&ipTest, 0, sizeof (ipTest));
+
+	server->sin_family = AF_INET;
+	server->sin_len = sizeof (struct sockaddr_in); 
+	server->sin_port = htons (port);
+
+    if (inet_aton(ipOrDomainName, &ipTest))
+	{
+		server->sin_addr.s_addr = inet_addr(ipOrDomainName);
+		LOG_AS("Creating Connection port %s at address %s\n\n", portString, ipOrDomainName);
+	}
+	else 
+    {
+		LOG_NS("Resolving host name\n");
+
+		struct hostent *hp = net_gethostbyname(ipOrDomainName);
+		
+		if (hp == NULL || !(hp->h_addrtype == PF_INET)) 
+        {
+			LOG_AS("Failed - IPV4 returned for address %s (may only be ipv6)", ipOrDomainName);
+			return CONNECTION_ERROR_COULD_NOT_RESOLVE_IPV4;
+		} 
+
+		struct in_addr **addr_list;
+		addr_list = (struct in_addr **)hp->h_addr_list;
+		char* resolvedIP = inet_ntoa(*addr_list[0]);
+		server->sin_addr.s_addr = inet_addr(resolvedIP);
+		LOG_AS("Creating Connection port %s at address %s using ip (%s)\n\n", portString, ipOrDomainName, resolvedIP);
+	} 
+
+	return CONNECTION_STARTING;
+}
+
+/* 
+* Works out servers from the address the gba sent, only looking it up if it's changed since last time. A server that can't be
+* looked up is left out. Returns CONNECTION_STARTING, or the error to report if none of them could be
+*/
+static u8 resolveServer(TCPConnector *connector)
+{
+	char addresses[SERVER_ENDPOINTS_MAX][64];
+
+	connector->remoteAddressAndPort[63] = '\0'; // Make sure the string is actually terminated
+	const char *address = overrideAddress[0] != 0 ? overrideAddress : connector->remoteAddressAndPort;
+
+	if (address[0] == '\0')
+		return CONNECTION_ERROR_INVALID_IP;
+
+	if (strcmp(address, connector->resolvedAddress) != 0)
+	{
+		u8 count = splitServerAddress(address, addresses);
+		u8 result = CONNECTION_ERROR_INVALID_IP;
+
+		// A standby socket to the old server is no use to us now
+		if (connector->standbySock >= 0)
+		{
+			net_close(connector->standbySock);
+			connector->standbySock = -1;
+		}
+
+		connector->resolvedAddress[0] = '\0';
+		connector->serverCount = 0;
+
+		for (u8 i = 0; i < count; i++)
+		{
+			ServerAddress *server = &connector->servers[connector->serverCount];
+
+			result = resolveAddress(addresses[i], &server->server);
+			if (result == CONNECTION_STARTING)
+			{
+				strcpy(server->address, addresses[i]);
+				connector->serverCount++;
+			}
+		}
+
+		if (connector->serverCount == 0)
+			return result;
+
+		strcpy(connector->resolvedAddress, address);
+	}
+
+	// So the pool is ready the next time any port connects to them
+	for (u8 i = 0; i < connector->serverCount; i++)
+		watchServer(&connector->servers[i]);
+
+	return CONNECTION_STARTING;
+}
+
+/* Opens the spare connection a reset will use, while there's nothing else for the thread to do */
+static void openStandby(TCPConnector *connector)
+{
+	connector->standbyTried = 1;
+
+	s32 sock = connectToServer(&connector->servers[connector->currentServer].server);
+	if (sock < 0)
+	{
+		LOG_NS("Could not open a standby connection\n");
+		return;
+	}
+
+	recvGreeting(sock, connector->fetchedMsgBuffer);
+	connector->standbySock = sock;
+}
+
+/* PL_ then NR_ on a socket the greeting has already been read from, as far as a pooled session gets. Returns CONNECTION_SUCCESS or the error to report */
+static u8 greetServer(TCPConnector *connector)
+{
+	s32 res;
+
+	// Ask for tagged requests first, so that everything after this is framed
+	res = negotiatePipeline(connector);
+	if (res < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
+
+	connector->pipelined = res;
+	LOG_AS("Server %s tagged requests\n", connector->pipelined ? "supports" : "does not support");
+
+    // Send the string SERVER_NAME_REQUEST to the server
+	if (sendToServer(connector, SERVER_NAME_REQUEST, strlen(SERVER_NAME_REQUEST), 0) < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
+
+    // Read response (which should be server name like SN_<NAME_OF_SERVER>)
+	memset (connector->fetchedMsgBuffer, 0, 1024);
+	if (!connector->pipelined)
+	{
+		res = recordReceived(connector, connector->fetchedMsgBuffer, recvWithin(connector->sock, connector->fetchedMsgBuffer, 1023, HANDSHAKE_TIMEOUT));
+	}
+	else
+	{
+		res = recvFrame(connector);
+
+		if (res == NF_OTHER)
+			memcpy(connector->fetchedMsgBuffer, connector->reader.other, connector->reader.otherSize);
+		
+		res = res == NF_ERROR ? -1 : 1;
+	}
+
+	if (res <= 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
+
+	if (connector->fetchedMsgBuffer[0] != 'S' || 
+        connector->fetchedMsgBuffer[1] != 'N' || 
+        connector->fetchedMsgBuffer[2] != '_') 
+    {
+		connector->fetchedMsgBuffer[64] = '\0';
+		LOG_AS("Handshake Failed got response:\n%s\n", connector->fetchedMsgBuffer);
+		return CONNECTION_ERROR_INVALID_RESPONSE;
+	}
+
+	if (!hasServerName())
+	{
+		for (int i = 3; i < SERVER_NAME_SIZE - 1; i++)
+		{
+			serverName[i - 3] = connector->fetchedMsgBuffer[i];
+		}
+	}
+
+	LOG_AS("Connected to %s\n", connector->fetchedMsgBuffer + 3);
+	return CONNECTION_SUCCESS;
+}
+
+/*
+* WR_ and then PD_ once the session has been greeted, these are for the gba so a pooled session only does them once it's claimed.
+* A session fresh from the greeting carries on without a welcome as it always has, but no welcome on a pooled one means the
+* server has dropped it, so that's an error and the caller connects again
+*/
+static u8 joinServer(TCPConnector *connector, bool pooled)
+{
+	s32 res;
+	bool welcomed;
+	sendToServer(connector, WELCOME_REQUEST, strlen(WELCOME_REQUEST), 0);
+
+	if (connector->pipelined)
+	{
+		// Framed 0x25 messages are written straight to the virtual channels
+		welcomed = recvFrame(connector) == NF_MESSAGE;
+
+		if (welcomed)
+			markChannelsDirty(connector->serialConnector, connector->reader.msgChannel * VIRTUAL_CHANNEL_SIZE, connector->reader.msgSize);
+	}
+	else
+	{
+		res = recordReceived(connector, connector->fetchedMsgBuffer, recvWithin(connector->sock, connector->fetchedMsgBuffer, 1024, HANDSHAKE_TIMEOUT));
+		welcomed = res > 0 && connector->fetchedMsgBuffer[0] == 0x25;
+
+		if (welcomed)
+			deliverResponse(connector, connector->fetchedMsgBuffer, res);
+	}
+
+	if (!welcomed)
+	{
+		LOG_NS("Error Reading Welcome message\n");
+
+		if (pooled)
+			return CONNECTION_ERROR_CONNECTION_FAILED;
+	}
+
+	char playerDataMsg[sizeof(SEND_PLAYER_DATA) + sizeof(PlayerData)];
+	memcpy(playerDataMsg, SEND_PLAYER_DATA, strlen(SEND_PLAYER_DATA));
+	memcpy(&playerDataMsg[strlen(SEND_PLAYER_DATA)], &connector->serialConnector->playerData, sizeof(connector->serialConnector->playerData));
+
+	// The server doesn't answer player data, so it gets the tag that's never waited on
+	if (sendToServer(connector, playerDataMsg, strlen(SEND_PLAYER_DATA) + sizeof connector->serialConnector->playerData, 0) < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
+
+	// Nor the cache request, the versions it sends back are read along with the first answers
+	if (connector->pipelined && sendToServer(connector, CACHE_REQUEST, strlen(CACHE_REQUEST), 0) < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
+
+	return CONNECTION_SUCCESS;
+}
+
+/* PL_, NR_, WR_ and then PD_ on a socket the greeting has already been read from. Returns CONNECTION_SUCCESS or the error to report */
+static u8 handshake(TCPConnector *connector)
+{
+	u8 result = greetServer(connector);
+	return result == CONNECTION_SUCCESS ? joinServer(connector, false) : result;
+}
+
+/* Closes the session's socket, leaving the standby one alone */
+static void closeSession(TCPConnector *connector)
+{
+	if (connector->sock >= 0)
+	{
+		net_close (connector->sock);
+		TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_CLOSE, NULL, 0);
+	}
+
+	connector->sock = -1;
+}
+
+static void closeSockets(TCPConnector *connector)
+{
+	closeSession(connector);
+
+	if (connector->standbySock >= 0)
+		net_close (connector->standbySock);
+
+	connector->standbySock = -1;
+}
+
+// ======================= Server pool ======================================================
+
+/*
+* Every server a port (or the menu) has asked for is health checked by one thread, which also keeps up to SERVER_POOL_SIZE
+* sessions open to each one that's up. A pooled session has read the greeting and done PL_ and NR_, so a gba that's just
+* been plugged in only has WR_ and PD_ left to do once it claims one. Each check opens a fresh session and retires the
+* oldest, so nothing sits in the pool long enough for the server to give up on it. A server that fails a check, or that a
+* port can't get into, is down until it passes one again and is tried last (see connectToAnyServer). Checks on a server
+* that keeps failing them back off up to SERVER_CHECK_BACKOFF_MAX
+*/
+
+#define POOL_GCPORT 4 // Not a real port, so nothing the pool thread sends or receives ends up in a trace
+
+static TCPConnector poolConnector; // Only the pool thread uses these, so sessions are greeted with the same code a port uses
+static SerialConnector poolSerialConnector;
+
+// --------------------------------------------------------------------------------
+/* endpointsLock must be held for everything up to openPooledSession */
+static ServerEndpoint *findEndpoint(const char *address)
+{
+	for (u8 i = 0; i < SERVER_ENDPOINTS_MAX; i++)
+	{
+		if (endpoints[i].address.address[0] != '\0' && strcmp(endpoints[i].address.address, address) == 0)
+			return &endpoints[i];
+	}
+
+	return NULL;
+}
 
-					SL_send(connector.gcport, (u32) (NET_CONN_LIFN_REQ << 16) | ((u16) (tcpConnector.connectionResult | networkBusyState << 8)));
-					usleep(1000);
-				}
-                else 
-                {
-                    //VIDEO_WaitVSync();
-					usleep(1000);
-                }
+static void closePooledSessions(ServerEndpoint *endpoint)
+{
+	for (u8 i = 0; i < endpoint->pooled; i++)
+		net_close(endpoint->sessions[i].sock);
 
-            } break;
-            case SERIAL_STATE_SENDING:
-            {
-				if (msgBytesCount > MAX_MSG_SIZE || msgBytesCount == 0)
-				{
-					LOG_AS("Skipping message too long %x \n", msgBytesCount);
-				}
-				else
-				{
-					msgCheckBytes = 0xFFFF;
+	endpoint->pooled = 0;
+}
 
-					for(int i = 0; i <= msgBytesCount - 1; i+=4)
-					{
-						// Timeing can be quite precise so we give a generous delay to avoid duplicate messages
-						usleep(500);
+/* A session sitting in the pool has nothing to read, if it has the server has closed it (or isn't speaking the protocol) */
+static bool isSessionAlive(int sock)
+{
+	struct pollsd sd;
 
-						if (i <= MAX_MSG_SIZE)
-						{
-							pkt[0] = connector.receivedMsgBuffer[msgBytesOffset + i];
-						}
-						else 
-						{
-							pkt[0] = 0;
-						}
+	sd.socket = sock;
+	sd.events = POLLIN;
+	sd.revents = 0;
 
-						if (i + 1 <= MAX_MSG_SIZE)
-						{
-							pkt[1] = connector.receivedMsgBuffer[msgBytesOffset + i + 1];
-						}
-						else 
-						{
-							pkt[1] = 0;
-						}
+	return net_poll(&sd, 1, 0) == 0;
+}
 
-						if (i + 2 <= MAX_MSG_SIZE)
-						{
-							pkt[2] = connector.receivedMsgBuffer[msgBytesOffset + i + 2];
-						}
-						else
-						{
-							pkt[2] = 0;
-						}
+/* ms until a server that has failed failures times in a row is checked again */
+static u32 getCheckDelay(u8 failures)
+{
+	u32 delay = SERVER_CHECK_INTERVAL;
 
-						if (i + 3 <= MAX_MSG_SIZE)
-						{
-							pkt[3] = connector.receivedMsgBuffer[msgBytesOffset + i + 3];
-						}
-						else
-						{
-							pkt[3] = 0;
-						}
+	for (u8 i = 1; i < failures && delay < SERVER_CHECK_BACKOFF_MAX; i++)
+		delay *= 2;
 
-						commResult = SL_send(connector.gcport, (pkt[0] << 24) | (pkt[1] << 16) | (pkt[2]<< 8) | pkt[3]);
+	return delay < SERVER_CHECK_BACKOFF_MAX ? delay : SERVER_CHECK_BACKOFF_MAX;
+}
 
-						LOG_AS("Written To GBA %x %02X %02X %02X %02X\n", i, pkt[0], pkt[1], pkt[2], pkt[3]);
+static void setServerHealth(ServerEndpoint *endpoint, bool up)
+{
+	if (up)
+	{
+		endpoint->health = SERVER_HEALTH_UP;
+		endpoint->failures = 0;
+		endpoint->nextCheckAt = gettime() + millisecs_to_ticks(SERVER_CHECK_INTERVAL);
+		return;
+	}
 
-						if (commResult < 0)
-						{
-							msgBytesCount = 0;
-						}
+	if (endpoint->failures < 0xFF)
+		endpoint->failures++;
 
-						msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-						msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+	endpoint->health = SERVER_HEALTH_DOWN;
+	endpoint->nextCheckAt = gettime() + millisecs_to_ticks(getCheckDelay(endpoint->failures));
 
-						LOG_AS("Check after %d %x\n", i, msgCheckBytes);
+	// Whatever took it down has most likely taken the pooled sessions with it
+	closePooledSessions(endpoint);
+}
 
-					}
+// --------------------------------------------------------------------------------
+/* Starts (or carries on) checking a server and pooling sessions to it */
+static void watchServer(const ServerAddress *address)
+{
+	LWP_MutexLock(endpointsLock);
 
-					usleep(500);
+	ServerEndpoint *endpoint = findEndpoint(address->address);
 
-					commResult = SL_send(connector.gcport, (u32) (NET_CONN_CHCK_RES << 16) | (msgCheckBytes & 0xFFFF));
-					LOG_AS("MSG CHECK: %x\n", msgCheckBytes);
+	if (endpoint == NULL)
+	{
+		// A free slot, or the server nothing has asked for in the longest
+		endpoint = &endpoints[0];
 
-					usleep(50000);
+		for (u8 i = 1; i < SERVER_ENDPOINTS_MAX && endpoint->address.address[0] != '\0'; i++)
+		{
+			if (endpoints[i].address.address[0] == '\0' || endpoints[i].wantedAt < endpoint->wantedAt)
+				endpoint = &endpoints[i];
+		}
 
+		closePooledSessions(endpoint);
+		memset(endpoint, 0, sizeof(ServerEndpoint));
+		LOG_AS("Watching server %s\n", address->address);
+	}
 
-					if (commResult < 0)
-					{
-						connector.internalState = SERIAL_STATE_SENDING;
-					}
-					else 
-					{
-						connector.requestSend = 0;
-						connector.internalState = SERIAL_STATE_WAITING;
-					}
-				}
+	// It may have been looked up again since
+	endpoint->address = *address;
+	endpoint->wantedAt = gettime();
 
-            } break;
-            case SERIAL_STATE_RECEIVING:
-            {
-				if (msgBytesCount > MAX_MSG_SIZE || msgBytesCount == 0)
-				{
-					LOG_AS("Skipping message too long %x \n", msgBytesCount);
-				}
-				else
-				{
-					for(int i = 0; i <= msgBytesCount - 1; i+=4)
-					{
-						// Timeing can be quite precise so we give a generous delay to avoid duplicate messages
-						usleep(500);
+	LWP_MutexUnlock(endpointsLock);
+}
 
-						commResult = SL_recv(connector.gcport, pkt);
-						LOG_AS("Read From GBA %x %02X %02X %02X %02X\n", i, pkt[0], pkt[1], pkt[2], pkt[3]);
+static u8 getServerHealth(const char *address)
+{
+	LWP_MutexLock(endpointsLock);
 
-						if (i <= MAX_MSG_SIZE)
-							connector.receivedMsgBuffer[msgBytesOffset + i]     =  pkt[0];
+	ServerEndpoint *endpoint = findEndpoint(address);
+	u8 health = endpoint != NULL ? endpoint->health : SERVER_HEALTH_UNKNOWN;
 
-						if (i + 1 <= MAX_MSG_SIZE)
-							connector.receivedMsgBuffer[msgBytesOffset + i + 1] =  pkt[1];
+	LWP_MutexUnlock(endpointsLock);
+	return health;
+}
 
-						if (i + 2 <= MAX_MSG_SIZE)
-							connector.receivedMsgBuffer[msgBytesOffset + i + 2] =  pkt[2];
+/* Called by a port once it has got into a server, or failed to */
+static void reportServer(const char *address, bool up)
+{
+	LWP_MutexLock(endpointsLock);
 
-						if (i + 3 <= MAX_MSG_SIZE)
-							connector.receivedMsgBuffer[msgBytesOffset + i + 3] =  pkt[3];
+	ServerEndpoint *endpoint = findEndpoint(address);
+	if (endpoint != NULL)
+		setServerHealth(endpoint, up);
 
+	LWP_MutexUnlock(endpointsLock);
+}
 
-						if (commResult < 0)
-						{
-							msgBytesCount = 0;
-						}
+/* Takes the newest pooled session to a server that's still open. Returns its socket, or < 0 if there isn't one */
+static s32 claimSession(const char *address, bool *pipelined)
+{
+	s32 sock = -1;
 
-						msgCheckBytes ^= (u16) (pkt[0] | pkt[1] << 8);
-						msgCheckBytes ^= (u16) (pkt[2] | pkt[3] << 8);
+	LWP_MutexLock(endpointsLock);
 
-						LOG_AS("Check after %d %x\n", i, msgCheckBytes);
+	ServerEndpoint *endpoint = findEndpoint(address);
 
-					}
-					
-					commResult = SL_send(connector.gcport, (u32) (NET_CONN_CHCK_RES << 16) | (msgCheckBytes & 0xFFFF));
-					LOG_AS("MSG CHECK: %x\n", msgCheckBytes);
+	while (endpoint != NULL && endpoint->pooled > 0 && sock < 0)
+	{
+		PooledSession *session = &endpoint->sessions[--endpoint->pooled];
 
-					usleep(500);
+		if (isSessionAlive(session->sock))
+		{
+			sock = session->sock;
+			*pipelined = session->pipelined;
+		}
+		else
+		{
+			net_close(session->sock);
+		}
+	}
 
-					if (commResult < 0)
-					{
-						connector.internalState = SERIAL_STATE_RECEIVING;
-					}
-					else
-					{
-						connector.requestReceive = 1;
-						connector.internalState = SERIAL_STATE_WAITING;
-					}
-				}
+	LWP_MutexUnlock(endpointsLock);
+	return sock;
+}
 
-            } break;
-            case SERIAL_STATE_DONE:
-            {
-              connector.internalState = SERIAL_STATE_INIT;
-              active = 0;
-            } break;
-			case SERIAL_STATE_ERROR:
-            {
-			  print_ui_log("SERIAL ERROR");
-			  LOG_NS("Connection Error Resetting...\n");
-
-			  if (!IsDolphin())
-				switchToSlowTransfer();
+u32 getPooledSessions()
+{
+	u32 pooled = 0;
 
-			  connector.requestSend = 0;
-			  connector.requestReceive = 0;
-			  connector.requestStop = 0;
-			  connector.internalState = SERIAL_STATE_INIT;
-			  connector.connectionResult = SERIAL_NO_GBA;
-
-			  if (tcpConnector.internalState != TCP_STATE_INIT)
-			  {
-				tcpConnector.internalState = TCP_STATE_WAITING;
-				tcpConnector.requestReset = 1;
-			  }
-
-			  msgBytesCount = 0;
-			  pkt[0] = 0;
-			  pkt[1] = 0;
-			  pkt[2] = 0;
-			  pkt[3] = 0;
-			  commResult = 0;
-			  msgCheckBytes = 0xFFFF;
-			  msgBytesOffset = 0;
-            } break;
-            
-        }
+	LWP_MutexLock(endpointsLock);
 
-    }
+	for (u8 i = 0; i < SERVER_ENDPOINTS_MAX; i++)
+		pooled += endpoints[i].pooled;
 
-   free(port);
-   return NULL;
+	LWP_MutexUnlock(endpointsLock);
+	return pooled;
 }
 
-//---------------------------------------------------------------------------------
-void *httpd (TCPConnector *connector) {
-//---------------------------------------------------------------------------------
+// --------------------------------------------------------------------------------
+/* Connects and greets a session for the pool. Returns CONNECTION_SUCCESS or the error that says the server is down */
+static u8 openPooledSession(ServerAddress *address, PooledSession *session)
+{
+	TCPConnector *connector = &poolConnector;
 
-	LOG_NS("Starting Network Thread\n");
-	usleep(100000);
+	connector->sock = connectToServer(&address->server);
+	if (connector->sock < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
 
-	char addrCopy[64];
+	recvGreeting(connector->sock, connector->fetchedMsgBuffer);
 
-	connector->internalState = TCP_STATE_INIT;
+	u8 result = greetServer(connector);
 
-	if (connector->remoteAddressAndPort[0] == '\0')
-	{
-		connector->connectionResult = CONNECTION_ERROR_INVALID_IP;
-		connector->threadActive = 0;
-		return NULL;
-	}
-	
-	connector->remoteAddressAndPort[63] = '\0'; // Make sure the string is actually terminated
-	if (overrideAddress[0] != 0)
+	if (result == CONNECTION_SUCCESS)
 	{
-		strcpy(addrCopy, overrideAddress);
+		session->sock = connector->sock;
+		session->pipelined = connector->pipelined;
+		session->openedAt = gettime();
 	}
 	else
 	{
-		strcpy(addrCopy, connector->remoteAddressAndPort);
+		net_close(connector->sock);
 	}
 
-	usleep(100000);
+	connector->sock = -1;
+	return result;
+}
 
-    char * ipOrDomainName; 
-    char * portString; 
-    char * token = strtok(addrCopy, ":");
-	int port = 80;
-    if(token != NULL) 
-    {
-        ipOrDomainName = token;
-        portString = strtok(NULL, ":");
-		if (portString != NULL  && portString[0] != '\0')
+static void *poold(void *arg)
+{
+	(void)(arg);
+
+	poolSerialConnector.gcport = POOL_GCPORT;
+	poolConnector.serialConnector = &poolSerialConnector;
+	poolConnector.sock = -1;
+	poolConnector.standbySock = -1;
+
+	while (1)
+	{
+		for (u8 i = 0; i < SERVER_ENDPOINTS_MAX; i++)
 		{
-			char *temp;
-			port = strtol(portString, &temp, 10);
+			ServerEndpoint *endpoint = &endpoints[i];
+			ServerAddress address;
+			PooledSession session;
+
+			LWP_MutexLock(endpointsLock);
+
+			u64 now = gettime();
+
+			if (endpoint->address.address[0] != '\0' && ticks_to_millisecs(now - endpoint->wantedAt) >= SERVER_UNWANTED_AFTER)
+			{
+				LOG_AS("No longer watching server %s\n", endpoint->address.address);
+				closePooledSessions(endpoint);
+				endpoint->address.address[0] = '\0';
+			}
+
+			// A server that's up has its pool filled straight away, otherwise it waits for its next check
+			address = endpoint->address;
+			bool due = address.address[0] != '\0' && (now >= endpoint->nextCheckAt || (endpoint->health == SERVER_HEALTH_UP && endpoint->pooled < SERVER_POOL_SIZE));
+
+			LWP_MutexUnlock(endpointsLock);
+
+			if (!due)
+				continue;
+
+			u8 result = openPooledSession(&address, &session);
+
+			LWP_MutexLock(endpointsLock);
+
+			if (strcmp(endpoint->address.address, address.address) != 0)
+			{
+				// The slot went to another server while the session was being opened
+				if (result == CONNECTION_SUCCESS)
+					net_close(session.sock);
+			}
+			else if (result == CONNECTION_SUCCESS)
+			{
+				// The oldest session makes way for the new one
+				if (endpoint->pooled == SERVER_POOL_SIZE)
+				{
+					net_close(endpoint->sessions[0].sock);
+					memmove(&endpoint->sessions[0], &endpoint->sessions[1], sizeof(PooledSession) * (SERVER_POOL_SIZE - 1));
+					endpoint->pooled--;
+				}
+
+				endpoint->sessions[endpoint->pooled++] = session;
+				setServerHealth(endpoint, 1);
+			}
+			else
+			{
+				LOG_AS("Server %s failed its health check (%d)\n", address.address, result);
+				setServerHealth(endpoint, 0);
+			}
+
+			LWP_MutexUnlock(endpointsLock);
 		}
-    }
-	else 
+
+		usleep(SERVER_POOL_POLL_DELAY);
+	}
+
+	return NULL;
+}
+
+// --------------------------------------------------------------------------------
+/* 
+* Gets a session with one server, from the pool if it has one ready. The server may have closed a pooled session since
+* it was last checked on, in which case we connect again. Returns CONNECTION_SUCCESS or the error to report
+*/
+static u8 openSession(TCPConnector *connector, ServerAddress *server)
+{
+	bool pipelined = 0;
+	s32 sock = claimSession(server->address, &pipelined);
+
+	if (sock >= 0)
 	{
-		connector->connectionResult = CONNECTION_ERROR_INVALID_IP;
-		connector->threadActive = 0;
-		return NULL;
+		LOG_AS("Using a pooled session to %s\n", server->address);
+		connector->sock = sock;
+		connector->pipelined = pipelined;
+		NF_initReader(&connector->reader, (u8 *) connector->serialConnector->receivedMsgBuffer, MAX_MSG_SIZE);
+		TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_CONNECT, server->address, (u16) strlen(server->address));
+
+		if (joinServer(connector, true) == CONNECTION_SUCCESS)
+			return CONNECTION_SUCCESS;
+
+		// Nothing from it can be trusted now, the new session negotiates its own framing
+		LOG_NS("Pooled session was dropped, connecting again\n");
+		closeSession(connector);
+		connector->pipelined = 0;
 	}
 
-	usleep(100000);
+	LOG_AS("Trying to start connection to %s\n", server->address);
+	connector->sock = connectToServer(&server->server);
 
-	struct sockaddr_in server;
-	struct in_addr ipTest;
+	if (connector->sock < 0)
+		return CONNECTION_ERROR_CONNECTION_FAILED;
 
-	memset (&server, 0, sizeof (server));
-	memset (&ipTest, 0, sizeof (ipTest));
+	recvGreeting(connector->sock, connector->fetchedMsgBuffer);
+	TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_CONNECT, server->address, (u16) strlen(server->address));
+	return handshake(connector);
+}
 
-    if (inet_aton(ipOrDomainName, &ipTest))
+/*
+* Tries each server the address lists until one lets us in. The ones that are up (or haven't been checked yet) go first in
+* the order they were given, then the ones that are down in case they've come back. Returns CONNECTION_SUCCESS or the last error
+*/
+static u8 connectToAnyServer(TCPConnector *connector)
+{
+	u8 health[SERVER_ENDPOINTS_MAX];
+	u8 result = CONNECTION_ERROR_CONNECTION_FAILED;
+
+	// Taken once up front, a server that fails on the first pass is down by the second
+	for (u8 i = 0; i < connector->serverCount; i++)
+		health[i] = getServerHealth(connector->servers[i].address);
+
+	for (u8 pass = 0; pass < 2; pass++)
 	{
-		server.sin_family= AF_INET;
-		server.sin_len = sizeof (struct sockaddr_in); 
-		usleep(100000);
-		server.sin_port= htons (port);
-		usleep(100000);
-		server.sin_addr.s_addr = inet_addr(ipOrDomainName);
-		LOG_AS("Creating Connection port %s at address %s\n\n", portString, ipOrDomainName);
+		for (u8 i = 0; i < connector->serverCount; i++)
+		{
+			ServerAddress *server = &connector->servers[i];
+
+			if ((health[i] == SERVER_HEALTH_DOWN) != (pass == 1))
+				continue;
+
+			connector->currentServer = i;
+			result = openSession(connector, server);
+			reportServer(server->address, result == CONNECTION_SUCCESS);
+
+			if (result == CONNECTION_SUCCESS)
+				return result;
+
+			LOG_AS("Could not get into %s (%d)\n", server->address, result);
+			closeSession(connector);
+		}
 	}
-	else 
-    {
-		LOG_NS("Resolving host name\n");
-		usleep(100000);
 
-		struct hostent *hp = net_gethostbyname(ipOrDomainName);
-		
-		if (!(hp->h_addrtype == PF_INET)) 
-        {
-			LOG_AS("Failed - IPV4 returned for address %s (may only be ipv6)", addrCopy);
-			connector->connectionResult = CONNECTION_ERROR_COULD_NOT_RESOLVE_IPV4;
-			connector->threadActive = 0;
-			return NULL;
-		} 
+	return result;
+}
 
-		memset (&server, 0, sizeof (struct sockaddr_in));
-		server.sin_family = AF_INET;
-		server.sin_len = sizeof (struct sockaddr_in); 
-		server.sin_port = htons (port);
+//---------------------------------------------------------------------------------
+void *httpd (TCPConnector *connector) {
+//---------------------------------------------------------------------------------
 
-		struct in_addr **addr_list;
-		addr_list = (struct in_addr **)hp->h_addr_list;
-		char* resolvedIP = inet_ntoa(*addr_list[0]);
-		server.sin_addr.s_addr = inet_addr(resolvedIP);
-		LOG_AS("Creating Connection port %s at address %s using ip (%s)\n\n", portString, ipOrDomainName, resolvedIP);
-	} 
+	LOG_NS("Starting Network Thread\n");
 
-	connector->connectionResult = CONNECTION_STARTING;
+	updateStatus(connector, TCP_STATUS_STATE | TCP_STATUS_RESULT, TCP_STATE_INIT << TCP_STATUS_STATE_SHIFT | CONNECTION_STARTING);
 
 	connector->sock = -1;
 	int active = 1;
 	s32 conn = 0;
 
 	while(active) {
-		switch (connector->internalState) 
+		switch (getTcpState(connector)) 
 		{
 			case TCP_STATE_INIT: 
 			{
-				LOG_NS("Trying to start connection\n");
-				connector->sock = net_socket (AF_INET, SOCK_STREAM, IPPROTO_IP);
-				s32 conn = net_connect(connector->sock, (struct sockaddr *) &server, sizeof server);
-				if (conn < 0) 
-                {
-					connector->connectionResult = CONNECTION_ERROR_CONNECTION_FAILED;
-					LOG_NS("Connection Failed - Connection To Socket\n");
+				u8 result = resolveServer(connector);
+				if (result != CONNECTION_STARTING)
+				{
+					setConnectionResult(connector, result);
+					closeSockets(connector);
 					connector->threadActive = 0;
 					return NULL;
 				}
 
-				usleep(5000);
-
-				connector->waitingForServer = 1;
+				updateStatus(connector, TCP_STATUS_RESET, 0);
 
-				// Make sure we've already read data that was sent when starting the connection
-				conn = net_recv (connector->sock, connector->fetchedMsgBuffer, 100, TCP_FLAGS);
+				// A reset picks up the standby socket, so there's no connect (or greeting) to wait for
+				bool usedStandby = connector->standbySock >= 0;
 
-                // Send the string SERVER_NAME_REQUEST to the server
-				conn = net_send(connector->sock, SERVER_NAME_REQUEST, strlen(SERVER_NAME_REQUEST), TCP_FLAGS);
-
-                // Read response (which should be server name like SN_<NAME_OF_SERVER>)
-				memset (connector->fetchedMsgBuffer, 0, 1024);
-				conn = net_recv (connector->sock, connector->fetchedMsgBuffer, 1024, TCP_FLAGS);
-
-				connector->waitingForServer = 0;
+				if (usedStandby)
+				{
+					ServerAddress *server = &connector->servers[connector->currentServer];
 
-				if (!hasServerName())
+					LOG_NS("Using standby connection\n");
+					connector->sock = connector->standbySock;
+					connector->standbySock = -1;
+					TR_RECORD(connector->serialConnector->gcport, TR_SOURCE_NET, TR_TCP_CONNECT, server->address, (u16) strlen(server->address));
+					result = handshake(connector);
+				}
+				else
 				{
-					for (int i = 3; i < SERVER_NAME_SIZE - 1; i++)
-					{
-						serverName[i - 3] = connector->fetchedMsgBuffer[i];
-					}
+					result = connectToAnyServer(connector);
 				}
 
-				if (connector->fetchedMsgBuffer[0] == 'S' && 
-                    connector->fetchedMsgBuffer[1] == 'N' && 
-                    connector->fetchedMsgBuffer[2] == '_') 
-                {
-					LOG_AS("Connected to %s\n", connector->fetchedMsgBuffer + 3);
-
-					connector->waitingForServer = 1;
-
-					conn = net_send(connector->sock, WELCOME_REQUEST, strlen(WELCOME_REQUEST), TCP_FLAGS);
-					conn = net_recv (connector->sock, connector->fetchedMsgBuffer, 1024, TCP_FLAGS);
-
-					connector->waitingForServer = 0;
-
-					if (connector->fetchedMsgBuffer[0] == 0x25)
-					{
-						u16 msgSize = (u16) (connector->fetchedMsgBuffer[3] | connector->fetchedMsgBuffer[2] << 8);
-						u16 msgBytesOffset = connector->fetchedMsgBuffer[1] * VIRTUAL_CHANNEL_SIZE;
-						
-						for (int i = 0; i < msgSize; i++)
-						{
-							connector->serialConnector->receivedMsgBuffer[msgBytesOffset + i] = connector->fetchedMsgBuffer[i + 5];
-						}
-
-					}
-					else
-					{
-						LOG_NS("Error Reading Welcome message\n");
-					}
-
-					for (unsigned int i = 0; i < strlen(SEND_PLAYER_DATA); i++) 
-						connector->sendMsgBuffer[i] = SEND_PLAYER_DATA[i];
+				connector->standbyTried = 0;
 
-					memcpy(&(connector->sendMsgBuffer)[strlen(SEND_PLAYER_DATA)], &connector->serialConnector->playerData, sizeof(connector->serialConnector->playerData));
-
-					connector->waitingForServer = 1;
-					conn = net_send(connector->sock, connector->sendMsgBuffer, strlen(SEND_PLAYER_DATA) + sizeof connector->serialConnector->playerData, TCP_FLAGS);
-					connector->waitingForServer = 0;
-					connector->connectionResult = CONNECTION_SUCCESS;
-					connector->internalState = TCP_STATE_WAITING;
-
-				} 
-                else 
-                {
-					connector->fetchedMsgBuffer[64] = '\0';
-					LOG_AS("Handshake Failed got response:\n%s\n", connector->fetchedMsgBuffer);
-					connector->connectionResult = CONNECTION_ERROR_INVALID_RESPONSE;
-					connector->internalState = TCP_STATE_DONE;
+				if (result == CONNECTION_SUCCESS)
+				{
+					connector->connectTime = ticks_to_millisecs(gettime() - connector->connectStartedAt);
+					LOG_AS("Connected %u ms after getting the server address\n", connector->connectTime);
+					updateStatus(connector, TCP_STATUS_STATE | TCP_STATUS_RESULT, TCP_STATE_WAITING << TCP_STATUS_STATE_SHIFT | CONNECTION_SUCCESS);
 				}
-			}	break;
-    		case TCP_STATE_WAITING:
-			{
-
-				if (connector->requestReset == 1)
+				else if (result == CONNECTION_ERROR_CONNECTION_FAILED && usedStandby)
 				{
-					if (connector->sock >= 0)
-					{
-						net_close (connector->sock);
-					}
-					
-					connector->internalState = TCP_STATE_INIT;
-					connector->requestSend = 0;
-					connector->requestFetch = 0;
-					connector->requestReset = 0;
-					connector->requestStop = 0;
+					// The server may have dropped the standby socket while it sat there, so try a fresh one
+					LOG_NS("Standby connection was dropped, connecting again\n");
+					closeSession(connector);
 				}
-                else if (connector->requestSend == 1)
-                {
-                    connector->internalState = TCP_STATE_SENDING;
-                }
-                else if (connector->requestFetch == 1)
-                {
-                    connector->internalState = TCP_STATE_FETCHING;
-                }
-                else if (connector->requestStop == 1)
-                {
-                    connector->internalState = TCP_STATE_DONE;
-                }
-                else 
-                {
-                    usleep(5000);
-                }
-			}	break;
-			case TCP_STATE_SENDING:
-			{
-				LOG_AS("Doing Transmission of size %x from ch %x\n", connector->trSize, connector->trVitrualChannel);
-				memset (connector->sendMsgBuffer, 0, 1024);
-				memcpy(connector->sendMsgBuffer, &(connector->serialConnector->receivedMsgBuffer)[connector->trVitrualChannel * VIRTUAL_CHANNEL_SIZE], connector->trSize);
-				connector->waitingForServer = 1;
-                conn = net_send(connector->sock, connector->sendMsgBuffer, connector->trSize, TCP_FLAGS);
-				connector->waitingForServer = 0;
-				LOG_AS("Sending Server Message %02X %02X %02X %02X\n", connector->sendMsgBuffer[0], connector->sendMsgBuffer[1], connector->sendMsgBuffer[2], connector->sendMsgBuffer[3]);
-				if (conn < 0) 
-                {
-					LOG_NS("Connection Failed - Sending Data\n");
+				else if (result == CONNECTION_ERROR_CONNECTION_FAILED)
+				{
+					setConnectionResult(connector, CONNECTION_ERROR_CONNECTION_FAILED);
+					LOG_NS("Connection Failed - Connection To Socket\n");
+					closeSockets(connector);
 					connector->threadActive = 0;
 					return NULL;
-				} 
+				}
 				else
 				{
-					connector->requestFetch = 1;
+					updateStatus(connector, TCP_STATUS_STATE | TCP_STATUS_RESULT, TCP_STATE_DONE << TCP_STATUS_STATE_SHIFT | result);
 				}
-
-                connector->requestSend = 0;
-				connector->internalState = TCP_STATE_WAITING;
 			}	break;
-            case TCP_STATE_FETCHING: 
+    		case TCP_STATE_WAITING:
 			{
-				LOG_NS("Doing Fetch\n");
-            	memset (connector->fetchedMsgBuffer, 0, 1024);
-				connector->waitingForServer = 1;
-				conn = net_recv (connector->sock, connector->fetchedMsgBuffer, 1024, TCP_FLAGS);
-				connector->waitingForServer = 0;
-				if (conn < 0) 
-                {
-					LOG_NS("Connection Failed - Fetching Data\n");
-					connector->threadActive = 0;
-					return NULL;
-				} 
+				u32 status = getStatus(connector);
 
-				if (connector->fetchedMsgBuffer[0] == 0x25)
+				if (status & TCP_STATUS_RESET)
 				{
-					u16 msgSize = (u16) (connector->fetchedMsgBuffer[3] | connector->fetchedMsgBuffer[2] << 8);
-					u16 msgBytesOffset = connector->fetchedMsgBuffer[1] * VIRTUAL_CHANNEL_SIZE;
-
-					LOG_AS("Copying server response of size %x to v chan %x (offset %x)\n", msgSize, connector->fetchedMsgBuffer[1], msgBytesOffset);
+					closeSession(connector);
 					
-					for (int i = 0; i < msgSize; i++)
+					connector->requestsSent = connector->requestsQueued;
+					connector->requestsDone = connector->requestsQueued;
+					updateStatus(connector, TCP_STATUS_STATE | TCP_STATUS_RESET | TCP_STATUS_STOP, TCP_STATE_INIT << TCP_STATUS_STATE_SHIFT);
+				}
+                else if (status & TCP_STATUS_STOP)
+                {
+                    setTcpState(connector, TCP_STATE_DONE);
+                }
+                else 
+                {
+					while (connector->requestsSent != connector->requestsQueued && 
+					       (connector->pipelined || connector->requestsSent == connector->requestsDone))
 					{
-						connector->serialConnector->receivedMsgBuffer[msgBytesOffset + i] = connector->fetchedMsgBuffer[i + 5];
-					}
+						TCPRequest *request = &connector->requests[connector->requestsSent % TCP_MAX_IN_FLIGHT];
+
+						// Only with nothing in flight, so a kept answer can't land in front of one the server is still sending
+						if (connector->pipelined && connector->requestsSent == connector->requestsDone)
+						{
+							readWaitingResponses(connector);
+							u16 answerSize = answerFromCache(connector, request);
+
+							if (answerSize > 0)
+							{
+								connector->requestsSent++;
+								completeRequest(connector, request, answerSize);
+								continue;
+							}
+						}
 
-					LOG_AS("Before Copied Data %02X %02X %02X %02X\n", connector->fetchedMsgBuffer[0 + 5], 
-					                                                   connector->fetchedMsgBuffer[1 + 5], 
-																	   connector->fetchedMsgBuffer[2 + 5], 
-																	   connector->fetchedMsgBuffer[3 + 5]);
+						conn = sendRequest(connector, request);
+						if (conn < 0) 
+						{
+							LOG_NS("Connection Failed - Sending Data\n");
+							reportServer(connector->servers[connector->currentServer].address, 0);
+							closeSockets(connector);
+							connector->threadActive = 0;
+							return NULL;
+						} 
+
+						connector->requestsSent++;
+					}
 
-					LOG_AS("Final Copied Data %02X %02X %02X %02X\n", connector->serialConnector->receivedMsgBuffer[msgBytesOffset + 0], 
-					                                                  connector->serialConnector->receivedMsgBuffer[msgBytesOffset + 1], 
-																	  connector->serialConnector->receivedMsgBuffer[msgBytesOffset + 2], 
-																	  connector->serialConnector->receivedMsgBuffer[msgBytesOffset + 3]);
-					
-				}
-				else if (connector->fetchedMsgBuffer[0] == 0x00)
-				{
-					LOG_NS("No Response From Server/Unknown Command Sent\n");
-					// We generally get only 0's when the server goes offline. 
-					// If we try fetching more data then dolphin (any maybe a wii) can crash (for some reason?) so the safest things seems to be to stop the thread
-					connector->threadActive = 0;
-					return NULL;
-				}
-				else
-				{
-					LOG_NS("Error Reading message\n");
-				}
+					if (!connector->standbyTried && connector->requestsSent == connector->requestsQueued && connector->requestsDone == connector->requestsSent)
+						openStandby(connector);
 
-                connector->requestFetch = 0;
-                connector->internalState = TCP_STATE_WAITING;
+					if (waitForServer(connector) < 0)
+					{
+						LOG_NS("Connection Failed - Fetching Data\n");
+						reportServer(connector->servers[connector->currentServer].address, 0);
+						closeSockets(connector);
+						connector->threadActive = 0;
+						return NULL;
+					}
+                }
 			}	break;
     		case TCP_STATE_DONE:
 			{
-                net_close (connector->sock);
+                closeSockets(connector);
 				active = 0;
-				connector->internalState = TCP_STATE_INIT;
+				setTcpState(connector, TCP_STATE_INIT);
 			}	break;
 		}
-		usleep(50000);
 	}
 
 	LOG_NS("Stopping Network Thread");
@@ -29,11 +29,14 @@ u32 hasServerName();
 char* getServerName();
 
 u32 isConnected(u32 port);
+u32 getConnectTime(u32 port); // ms from the gba sending the server address to the server being ready, the last time the port connected
 
 u32 hasPlayerName(u32 port);
 char* getPlayerName(u32 port);
 
-u32 testTCPConnection(char* ipv4);
+u32 testTCPConnection(char* ipv4); // ipv4 can list several servers separated by commas, it's a success if any of them are up
 void setOverrideAddress(char* ipv4);
+u32 getPooledSessions(); // Sessions open and waiting for a gba to claim, across every server
+void getRequestCacheStats(u32 *hits, u32 *misses); // Requests the server said could be kept that were answered from the cache, and that had to go to it
 
 #endif
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <wiiuse/wpad.h>
 #include <string.h>
 #include <string>
+#include <fat.h>
 
 #include "libwiigui/gui.h"
 #include "menu.h"
@@ -24,9 +25,13 @@
 extern "C" {
 	#include "linkcableclient.h"
 	#include "uilogger.h"
+	#include "telemetry.h"
+	#include "trace.h"
 }
 
 #define THREAD_SLEEP 10000
+#define TELEMETRY_PATH "sd:/pokecom-telemetry.txt"
+#define TRACE_PATH "sd:/pokecom-trace.bin"
 
 static GuiImageData * pointer[4];
 static GuiImage * bgImg = nullptr;
@@ -435,6 +440,45 @@ static void *UpdateGUI (void *arg)
 	return nullptr;
 }
 
+/****************************************************************************
+ * MountSD
+ *
+ * Mounts the SD card the first time something is saved to it
+ ***************************************************************************/
+static bool MountSD()
+{
+	static bool sdMounted = false;
+
+	if (!sdMounted)
+		sdMounted = fatInitDefault();
+
+	return sdMounted;
+}
+
+/****************************************************************************
+ * SaveTelemetry
+ *
+ * Writes the link timings (see telemetry.h) to the SD card
+ ***************************************************************************/
+static void SaveTelemetry()
+{
+	print_ui_log(MountSD() && TL_dumpToFile(TELEMETRY_PATH) == 0 ? "TELEMETRY SAVED TO SD" : "TELEMETRY NOT SAVED");
+}
+
+/****************************************************************************
+ * ToggleTrace
+ *
+ * Starts or stops recording every SI word and TCP frame (see trace.h) to
+ * the SD card, for replaying with the simulator's linkreplay
+ ***************************************************************************/
+static void ToggleTrace()
+{
+	if (TR_isRecording())
+		print_ui_log(TR_stop() == 0 ? "TRACE SAVED TO SD" : "TRACE NOT SAVED");
+	else
+		print_ui_log(MountSD() && TR_start(TRACE_PATH) == 0 ? "TRACE RECORDING TO SD" : "TRACE NOT STARTED");
+}
+
 /****************************************************************************
  * DebugMenu
  ***************************************************************************/
@@ -525,6 +569,12 @@ static int DebugMenu(GuiSound* bgMusic)
 		else if (WPAD_ButtonsDown(0) & WPAD_BUTTON_MINUS) {
 			menu = MENU_SETTINGS;
 		}
+		else if (WPAD_ButtonsDown(0) & WPAD_BUTTON_PLUS) {
+			SaveTelemetry();
+		}
+		else if (WPAD_ButtonsDown(0) & WPAD_BUTTON_1) {
+			ToggleTrace();
+		}
 
 		bgMusic->Play();
 	}
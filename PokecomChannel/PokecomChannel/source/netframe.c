@@ -0,0 +1,197 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * netframe.c
+ * Length prefixed frames used between the channel and the server
+ ***************************************************************************/
+
+#include "netframe.h"
+
+#include <string.h>
+
+enum {
+	NF_PHASE_HEADER,
+	NF_PHASE_BODY_START, // Enough of the body to tell if it's a 0x25 message
+	NF_PHASE_PAYLOAD, // The rest of a 0x25 message, straight into the virtual channels
+	NF_PHASE_OTHER,
+	NF_PHASE_SKIP // Whatever is left of a body we have no room for
+};
+
+// Skipped bytes are thrown away, so every reader can share this
+static u8 discard[NF_MAX_OTHER_SIZE];
+
+// --------------------------------------------------------------------------------
+static void startFrame(NFReader *reader)
+{
+	reader->phase = NF_PHASE_HEADER;
+	reader->headerBytes = 0;
+}
+
+// --------------------------------------------------------------------------------
+static int finishFrame(NFReader *reader, int result)
+{
+	if (result == NF_MESSAGE && reader->clearSize > 0)
+	{
+		memset(&reader->virtualChannels[reader->payloadOffset], 0, reader->clearSize);
+		reader->clearSize = 0;
+	}
+
+	if (reader->bodyRemaining > 0)
+	{
+		reader->phase = NF_PHASE_SKIP;
+		reader->pendingResult = result;
+		return NF_NEED_MORE;
+	}
+
+	startFrame(reader);
+	return result;
+}
+
+/* The first few bytes of the body decide where the rest of it goes */
+static int startBody(NFReader *reader, u16 startSize)
+{
+	u8 *start = &reader->header[NF_HEADER_SIZE];
+
+	if (startSize == NF_MSG_HEADER_SIZE && start[0] == NF_MSG_ID)
+	{
+		u16 msgSize = (u16) (start[3] | start[2] << 8);
+
+		reader->msgChannel = start[1];
+		reader->payloadOffset = reader->msgChannel * NF_VIRTUAL_CHANNEL_SIZE;
+
+		if (reader->payloadOffset > reader->virtualChannelsSize)
+			reader->payloadOffset = reader->virtualChannelsSize;
+
+		if (msgSize > reader->virtualChannelsSize - reader->payloadOffset)
+			msgSize = reader->virtualChannelsSize - reader->payloadOffset;
+
+		// Some messages say they're bigger than they are (the mart sends 12 bytes as 16), the rest is cleared
+		reader->msgSize = msgSize;
+		reader->payloadRemaining = msgSize < reader->bodyRemaining ? msgSize : reader->bodyRemaining;
+		reader->clearSize = msgSize - reader->payloadRemaining;
+		reader->phase = NF_PHASE_PAYLOAD;
+
+		return reader->payloadRemaining == 0 ? finishFrame(reader, NF_MESSAGE) : NF_NEED_MORE;
+	}
+
+	memcpy(reader->other, start, startSize);
+	reader->otherSize = startSize;
+	reader->phase = NF_PHASE_OTHER;
+
+	return reader->bodyRemaining == 0 ? finishFrame(reader, NF_OTHER) : NF_NEED_MORE;
+}
+
+// --------------------------------------------------------------------------------
+void NF_initReader(NFReader *reader, u8 *virtualChannels, u32 virtualChannelsSize)
+{
+	memset(reader, 0, sizeof(NFReader));
+	reader->virtualChannels = virtualChannels;
+	reader->virtualChannelsSize = virtualChannelsSize;
+	startFrame(reader);
+}
+
+// --------------------------------------------------------------------------------
+u32 NF_getRecvBuffer(NFReader *reader, u8 **buffer)
+{
+	switch (reader->phase)
+	{
+		case NF_PHASE_HEADER:
+			*buffer = &reader->header[reader->headerBytes];
+			return NF_HEADER_SIZE - reader->headerBytes;
+		case NF_PHASE_BODY_START:
+			*buffer = &reader->header[reader->headerBytes];
+			return NF_HEADER_SIZE + (reader->bodySize < NF_MSG_HEADER_SIZE ? reader->bodySize : NF_MSG_HEADER_SIZE) - reader->headerBytes;
+		case NF_PHASE_PAYLOAD:
+			*buffer = &reader->virtualChannels[reader->payloadOffset];
+			return reader->payloadRemaining;
+		case NF_PHASE_OTHER:
+			*buffer = &reader->other[reader->otherSize];
+			return reader->bodyRemaining < NF_MAX_OTHER_SIZE - reader->otherSize ? reader->bodyRemaining : NF_MAX_OTHER_SIZE - reader->otherSize;
+		default:
+			*buffer = discard;
+			return reader->bodyRemaining < sizeof(discard) ? reader->bodyRemaining : sizeof(discard);
+	}
+}
+
+// --------------------------------------------------------------------------------
+int NF_commit(NFReader *reader, u32 received)
+{
+	switch (reader->phase)
+	{
+		case NF_PHASE_HEADER:
+		{
+			reader->headerBytes += received;
+
+			if (reader->headerBytes < NF_HEADER_SIZE)
+				return NF_NEED_MORE;
+
+			if (reader->header[0] != NF_RESPONSE_MARK)
+			{
+				startFrame(reader);
+				return NF_ERROR;
+			}
+
+			reader->tag = reader->header[1];
+			reader->bodySize = (u16) (reader->header[3] | reader->header[2] << 8);
+			reader->bodyRemaining = reader->bodySize;
+			reader->msgSize = 0;
+			reader->otherSize = 0;
+
+			if (reader->bodySize == 0)
+				return finishFrame(reader, NF_OTHER);
+
+			reader->phase = NF_PHASE_BODY_START;
+			return NF_NEED_MORE;
+		}
+		case NF_PHASE_BODY_START:
+		{
+			u16 startSize = reader->bodySize < NF_MSG_HEADER_SIZE ? reader->bodySize : NF_MSG_HEADER_SIZE;
+
+			reader->headerBytes += received;
+			reader->bodyRemaining -= received;
+
+			if (reader->headerBytes < NF_HEADER_SIZE + startSize)
+				return NF_NEED_MORE;
+
+			return startBody(reader, startSize);
+		}
+		case NF_PHASE_PAYLOAD:
+		{
+			reader->payloadOffset += received;
+			reader->payloadRemaining -= received;
+			reader->bodyRemaining -= received;
+
+			return reader->payloadRemaining == 0 ? finishFrame(reader, NF_MESSAGE) : NF_NEED_MORE;
+		}
+		case NF_PHASE_OTHER:
+		{
+			reader->otherSize += received;
+			reader->bodyRemaining -= received;
+
+			if (reader->bodyRemaining == 0 || reader->otherSize == NF_MAX_OTHER_SIZE)
+				return finishFrame(reader, NF_OTHER);
+
+			return NF_NEED_MORE;
+		}
+		default:
+		{
+			reader->bodyRemaining -= received;
+
+			if (reader->bodyRemaining > 0)
+				return NF_NEED_MORE;
+
+			startFrame(reader);
+			return reader->pendingResult;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+u16 NF_writeHeader(u8 *out, u8 mark, u8 tag, u16 size)
+{
+	out[0] = mark;
+	out[1] = tag;
+	out[2] = size >> 8;
+	out[3] = size & 0xFF;
+	return NF_HEADER_SIZE;
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * netframe.h
+ * Length prefixed frames used between the channel and the server once the
+ * server has agreed to tagged requests (see CelioServer/netFrame.js)
+ ***************************************************************************/
+
+#ifndef _NETFRAME_H_
+#define _NETFRAME_H_
+
+#include <gccore.h>
+#include "net_protocol.h"
+
+// The marks, sizes and requests are in net_protocol.h
+#define NF_MAX_OTHER_SIZE 64 // Anything that isn't a 0x25 message (SN_, PL_, unknown request) is kept up to this size
+
+// Sent after SEND_PLAYER_DATA as it is in memory, the wii is big endian so that's how the server reads trainerId
+typedef struct {
+	char playerName[8];
+	u16 trainerId;
+	u8 gender;
+	char gameName[20];
+} PlayerData;
+
+// Results of NF_commit
+enum {
+	NF_NEED_MORE = 0, // Keep receiving
+	NF_MESSAGE, // A 0x25 message has been written to the virtual channels, see msgChannel/msgSize
+	NF_OTHER, // Any other response, it's in other/otherSize
+	NF_ERROR // The stream doesn't start with a frame, there's no way to find the next one
+};
+
+/*
+* Reads frames straight out of the socket. Instead of receiving into a buffer and parsing it, ask NF_getRecvBuffer
+* where the next bytes should go and receive into that. Headers are received into the reader, but the payload of a
+* 0x25 message is received straight into its virtual channel. A frame split over any number of reads, or several frames
+* arriving at once, come out the same
+*/
+typedef struct {
+	u8 phase;
+	u8 pendingResult; //!< What the frame turned out to be, while the end of it is being skipped
+	u8 header[NF_HEADER_SIZE + NF_MSG_HEADER_SIZE]; //!< The frame header followed by the start of the body
+	u16 headerBytes; //!< How much of header we have
+	u16 bodySize; //!< From the frame header
+	u16 bodyRemaining; //!< Body bytes still to come after the current phase
+
+	u8 *virtualChannels; //!< Where 0x25 messages are written
+	u32 virtualChannelsSize;
+	u32 payloadOffset; //!< Where in virtualChannels the next payload byte goes
+	u16 payloadRemaining; //!< Payload bytes still to receive into virtualChannels
+	u16 clearSize; //!< Bytes the message said it had but didn't send, cleared once it's done
+
+	// Set once a frame is complete
+	u8 tag; //!< The tag of the request the frame answers
+	u8 msgChannel; //!< Virtual channel a 0x25 message went to
+	u16 msgSize; //!< Bytes of the virtual channels it covers
+	u8 other[NF_MAX_OTHER_SIZE]; //!< Body of any other response (cut off at NF_MAX_OTHER_SIZE)
+	u16 otherSize;
+} NFReader;
+
+void NF_initReader(NFReader *reader, u8 *virtualChannels, u32 virtualChannelsSize);
+
+/* Where the next received bytes should be written and the most that should be received, so nothing after the current part of the frame is read */
+u32 NF_getRecvBuffer(NFReader *reader, u8 **buffer);
+
+/* Call with however many bytes were received into the NF_getRecvBuffer buffer */
+int NF_commit(NFReader *reader, u32 received);
+
+/* Writes a frame header, returns its size */
+u16 NF_writeHeader(u8 *out, u8 mark, u8 tag, u16 size);
+
+#endif
@@ -8,6 +8,9 @@
 #include <ogcsys.h>
 #include <gccore.h>
 #include <string.h>
+#include <ogc/lwp_watchdog.h>
+#include "telemetry.h"
+#include "net_protocol.h"
 
 /**
 * Be aware we are using SIO_MULTI_MODE (SIOMULTI) with (i.e 16-bit multiplayer comms)
@@ -24,10 +27,6 @@
 
 u32 transDelay = SI_TRANS_DELAY_FAST;
 
-#define MAX_MSG_SIZE 4096
-
-#define VIRTUAL_CHANNEL_SIZE 16
-
 #define MAX_CONNECTION_LOOPS 1000
 
 static void switchToSlowTransfer()
@@ -96,8 +95,10 @@ static void SL_resetDeviceType(u8 channel)
     {
         ch1DeviceType = 0;
     }
-
-    ch0DeviceType = 0;
+    else
+    {
+        ch0DeviceType = 0;
+    }
 }
 
 static u32 SL_getDeviceType(u8 channel)
@@ -123,11 +124,15 @@ volatile u32 ch1TransmissionFinished = 0;
 volatile u32 ch2TransmissionFinished = 0;
 volatile u32 ch3TransmissionFinished = 0;
 
+u64 transmissionStartedAt[4];
+volatile u64 transmissionFinishedAt[4];
+
 static void ch0TransmissionFinishedCallback(s32 res, u32 val)
 {
     (void)(res);
     (void)(val);
 	ch0TransmissionFinished = 1;
+	transmissionFinishedAt[0] = gettime();
 }
 
 static void ch1TransmissionFinishedCallback(s32 res, u32 val)
@@ -135,6 +140,7 @@ static void ch1TransmissionFinishedCallback(s32 res, u32 val)
     (void)(res);
     (void)(val);
 	ch1TransmissionFinished = 1;
+	transmissionFinishedAt[1] = gettime();
 }
 
 static void ch2TransmissionFinishedCallback(s32 res, u32 val)
@@ -142,6 +148,7 @@ static void ch2TransmissionFinishedCallback(s32 res, u32 val)
     (void)(res);
     (void)(val);
 	ch2TransmissionFinished = 1;
+	transmissionFinishedAt[2] = gettime();
 }
 
 static void ch3TransmissionFinishedCallback(s32 res, u32 val)
@@ -149,6 +156,7 @@ static void ch3TransmissionFinishedCallback(s32 res, u32 val)
     (void)(res);
     (void)(val);
 	ch3TransmissionFinished = 1;
+	transmissionFinishedAt[3] = gettime();
 }
 
 static SICallback SL_getTransmissionFinishedCallback(u8 channel)
@@ -183,8 +191,10 @@ static void SL_resetTransmissionFinished(u8 channel)
     {
         ch1TransmissionFinished = 0;
     }
-
-    ch0TransmissionFinished = 0;
+    else
+    {
+        ch0TransmissionFinished = 0;
+    }
 }
 
 static u32 SL_isTransmissionFinished(u8 channel)
@@ -205,11 +215,25 @@ static u32 SL_isTransmissionFinished(u8 channel)
     return ch0TransmissionFinished;
 }
 
+/**
+* How long the last SL_send or SL_recv took from being queued to its callback firing (in microseconds)
+*/
+static u32 SL_getLastRoundTrip(u8 channel)
+{
+    if (transmissionFinishedAt[channel] < transmissionStartedAt[channel])
+    {
+        return 0;
+    }
+
+    return (u32) ticks_to_microsecs(transmissionFinishedAt[channel] - transmissionStartedAt[channel]);
+}
+
 static int SL_recv(u8 channel, u8 pktIn[4])
 {
     u8 pktOut[1];
     pktOut[0] = SI_READ;
     SL_resetTransmissionFinished(channel);
+    transmissionStartedAt[channel] = gettime();
 
     SI_Transfer(channel,                                     // Channel (which gc port)
                 pktOut,                                      // Out buffer 
@@ -223,10 +247,16 @@ static int SL_recv(u8 channel, u8 pktIn[4])
     {
         if (i > MAX_CONNECTION_LOOPS)
         {
+            TL_RECORD(channel, TL_SOURCE_SERIAL, TL_EVENT_SI_READ, 1, 0);
+            TR_RECORD(channel, TR_SOURCE_SERIAL, TR_SI_READ_FAILED, NULL, 0);
             return -1;
         }
         usleep(transDelay);
     }
+
+    TL_RECORD(channel, TL_SOURCE_SERIAL, TL_EVENT_SI_READ, 0, (u16) (pktIn[0] | pktIn[1] << 8));
+    TR_RECORD(channel, TR_SOURCE_SERIAL, TR_SI_READ, pktIn, 4);
+    TL_SAMPLE(channel, TL_CMD_SI, SL_getLastRoundTrip(channel));
     return 0;
 }
 
@@ -242,6 +272,7 @@ static int SL_send(u8 channel, u32 msg)
     pktOut[3]=(msg>>16)&0xFF; 
     pktOut[4]=(msg>>24)&0xFF;
 	SL_resetTransmissionFinished(channel);
+	transmissionStartedAt[channel] = gettime();
 	
 	SI_Transfer(channel,
                 pktOut,
@@ -255,10 +286,16 @@ static int SL_send(u8 channel, u32 msg)
     {
         if (i > MAX_CONNECTION_LOOPS)
         {
+            TL_RECORD(channel, TL_SOURCE_SERIAL, TL_EVENT_SI_WRITE, 1, (u16) (msg >> 16));
+            TR_RECORD(channel, TR_SOURCE_SERIAL, TR_SI_WRITE_FAILED, NULL, 0);
             return -1;
         }
         usleep(transDelay);
     }
+
+    TL_RECORD(channel, TL_SOURCE_SERIAL, TL_EVENT_SI_WRITE, 0, (u16) (msg >> 16));
+    TR_RECORD(channel, TR_SOURCE_SERIAL, TR_SI_WRITE, &pktOut[1], 4);
+    TL_SAMPLE(channel, TL_CMD_SI, SL_getLastRoundTrip(channel));
     return 0;
 }
 
@@ -314,3 +351,175 @@ static int SL_getstatus(u8 channel, u8 pktIn[4])
     return 0;
 }
 
+// ======================= Pacing ======================================================
+
+/**
+* The GBA only polls JOYCNT between frames of its own work, so if we write/read words faster than it can
+* keep up the block fails its check bytes and the GBA sends it again. Rather than sleeping a fixed amount
+* before every word each port has a pacer that starts at the old (safe) delays, speeds up after every
+* clean block and backs off when the GBA has to repeat one.
+*/
+#define SL_PACER_START_WORD_DELAY 500     // The delay we used to always use before each word
+#define SL_PACER_MAX_WORD_DELAY 4000
+#define SL_PACER_START_SETTLE_DELAY 50000 // The delay we used to always use after a block
+#define SL_PACER_MIN_SETTLE_DELAY 1000    // The same delay we give the GBA after replying to any other command
+#define SL_PACER_MAX_SETTLE_DELAY 50000
+#define SL_PACER_FORGET_BLOCKS 64         // Clean blocks before we try going faster than the last delay that failed
+#define SL_PACER_REPORT_INTERVAL 5000     // ms between words/sec reports
+#define SL_PACER_RETRY_WINDOW 250         // ms after a block in which the GBA asking for the same block again means it failed
+
+typedef struct {
+    u32 wordDelay; //!< Microseconds to wait before each word of a block
+    u32 settleDelay; //!< Microseconds to wait after a block for the GBA to finish with it
+    u32 unsafeWordDelay; //!< One more than the word delay we last had a failure at, 0 if there hasn't been one (we won't go below this until it's forgotten)
+    u32 cleanBlocks; //!< Blocks since the last failure
+    u32 avgRoundTrip; //!< Rolling average of SL_getLastRoundTrip, used to size the steps we take
+
+    u64 blockStartedAt; //!< When the current block started
+    u32 blockWords; //!< Words moved in the current block
+    u32 reportWords; //!< Words moved since the last report
+    u64 reportBusyTime; //!< Time spent in blocks since the last report
+    u64 reportedAt; //!< When we last reported
+    u32 wordsPerSec; //!< Throughput over the last report interval (only counting time spent in blocks)
+} SL_Pacer;
+
+static SL_Pacer pacers[4];
+
+static void SL_pacerReset(u8 channel)
+{
+    SL_Pacer *pacer = &pacers[channel];
+    memset(pacer, 0, sizeof(SL_Pacer));
+    pacer->wordDelay = SL_PACER_START_WORD_DELAY;
+    pacer->settleDelay = SL_PACER_START_SETTLE_DELAY;
+    pacer->reportedAt = gettime();
+}
+
+static void SL_pacerBlockStart(u8 channel)
+{
+    pacers[channel].blockStartedAt = gettime();
+    pacers[channel].blockWords = 0;
+}
+
+/**
+* How long to leave a port before each word of a block is sent or received
+*/
+static u32 SL_pacerWordDelay(u8 channel)
+{
+    return pacers[channel].wordDelay;
+}
+
+/**
+* Call after each word of a block has been sent or received
+*/
+static void SL_pacerWordDone(u8 channel)
+{
+    SL_Pacer *pacer = &pacers[channel];
+    pacer->avgRoundTrip = (pacer->avgRoundTrip * 7 + SL_getLastRoundTrip(channel)) / 8;
+    pacer->blockWords++;
+}
+
+/**
+* Call once the check bytes for a block have been sent. Returns how long to wait before reading the next command
+*/
+static u32 SL_pacerBlockDone(u8 channel)
+{
+    SL_Pacer *pacer = &pacers[channel];
+    // Steps are sized off the current delay and round trip so we converge in about the same number of blocks on any link
+    u32 step = pacer->wordDelay / 16 + pacer->avgRoundTrip / 8 + 1;
+    u32 nextDelay = pacer->wordDelay > step ? pacer->wordDelay - step : 0;
+
+    pacer->reportWords += pacer->blockWords;
+    pacer->reportBusyTime += ticks_to_microsecs(gettime() - pacer->blockStartedAt);
+    pacer->cleanBlocks++;
+
+    if (pacer->cleanBlocks >= SL_PACER_FORGET_BLOCKS)
+    {
+        pacer->unsafeWordDelay = 0;
+    }
+
+    if (nextDelay >= pacer->unsafeWordDelay)
+    {
+        pacer->wordDelay = nextDelay;
+    }
+
+    pacer->settleDelay = pacer->settleDelay * 3 / 4;
+    if (pacer->settleDelay < SL_PACER_MIN_SETTLE_DELAY)
+    {
+        pacer->settleDelay = SL_PACER_MIN_SETTLE_DELAY;
+    }
+
+    return pacer->settleDelay;
+}
+
+/**
+* Call when the GBA repeats a block (its check bytes didn't match) or a word couldn't be transferred
+*/
+static void SL_pacerBlockFailed(u8 channel)
+{
+    SL_Pacer *pacer = &pacers[channel];
+
+    if (pacer->wordDelay + 1 > pacer->unsafeWordDelay)
+    {
+        pacer->unsafeWordDelay = pacer->wordDelay + 1;
+    }
+
+    pacer->wordDelay = pacer->wordDelay * 2 + pacer->avgRoundTrip / 2 + 1;
+    if (pacer->wordDelay > SL_PACER_MAX_WORD_DELAY)
+    {
+        pacer->wordDelay = SL_PACER_MAX_WORD_DELAY;
+    }
+
+    pacer->settleDelay *= 2;
+    if (pacer->settleDelay > SL_PACER_MAX_SETTLE_DELAY)
+    {
+        pacer->settleDelay = SL_PACER_MAX_SETTLE_DELAY;
+    }
+
+    pacer->cleanBlocks = 0;
+}
+
+/**
+* Returns 1 every SL_PACER_REPORT_INTERVAL (if any blocks were moved), after updating wordsPerSec
+*/
+static u32 SL_pacerShouldReport(u8 channel)
+{
+    SL_Pacer *pacer = &pacers[channel];
+    u64 now = gettime();
+
+    if (ticks_to_millisecs(now - pacer->reportedAt) < SL_PACER_REPORT_INTERVAL || pacer->reportBusyTime == 0)
+    {
+        return 0;
+    }
+
+    pacer->wordsPerSec = (u32) ((u64) pacer->reportWords * 1000000 / pacer->reportBusyTime);
+    pacer->reportWords = 0;
+    pacer->reportBusyTime = 0;
+    pacer->reportedAt = now;
+    return 1;
+}
+
+static SL_Pacer *SL_getPacer(u8 channel)
+{
+    return &pacers[channel];
+}
+
+// ======================= Checks ======================================================
+
+/**
+* CRC16 used to check frames in framed mode. It's the same CRC as CalcCRC16WithTable in the game (reflected 0x1021, starting from 0x1121)
+*/
+static u16 SL_crc16(const u8 *data, u32 length)
+{
+    u16 crc = 0x1121;
+
+    for (u32 i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
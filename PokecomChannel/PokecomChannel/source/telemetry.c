@@ -0,0 +1,272 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * telemetry.c
+ * Per port record of what went over the link and the network
+ ***************************************************************************/
+
+#include "telemetry.h"
+
+#include <string.h>
+#include <ogc/lwp_watchdog.h>
+
+/*
+* Recording is a read of the time base and one 8 byte store, there's no lock and no printf so it can stay on
+* while the link runs flat out. Each ring has a single writer that never waits for a reader: it just keeps going
+* round, and a reader that falls behind is told how many events it missed. Histograms are only added to by the one
+* thread too, so a reader can look at them whenever it likes (it might see a count a sample ahead of the total)
+*/
+typedef struct {
+	TLEvent events[TL_RING_SIZE];
+	vu32 head; //!< Events ever written, the next one goes in events[head % TL_RING_SIZE]
+} TLRing;
+
+typedef struct {
+	TLRing rings[TL_SOURCE_COUNT];
+	TLHistogram histograms[TL_CMD_COUNT];
+
+	u8 timing; //!< If a command is being timed
+	u8 command; //!< TL_CMD_* being timed
+	u64 commandStartedAt;
+} TLPort;
+
+static TLPort ports[TL_PORTS];
+
+static const char *commandNames[TL_CMD_COUNT] = { "SEND", "RECV", "TRAN", "CALL", "STRM", "LIFN", "HAND", "BCLR", "PINF", "CINF", "SERVER", "SI", "XCHG" };
+static const char *eventNames[TL_EVENT_COUNT] = { "SI_READ", "SI_WRITE", "CMD", "CMD_DONE", "CHECK", "FRAME_ACK", "STATE", "TCP_SEND", "TCP_RECV" };
+static const char *sourceNames[TL_SOURCE_COUNT] = { "serial", "net" };
+
+// --------------------------------------------------------------------------------
+void TL_record(u8 port, u8 source, u8 type, u8 arg, u16 value)
+{
+	if (port >= TL_PORTS || source >= TL_SOURCE_COUNT)
+		return;
+
+	TLRing *ring = &ports[port].rings[source];
+	u32 head = ring->head;
+	TLEvent *event = &ring->events[head & (TL_RING_SIZE - 1)];
+
+	event->time = (u32) gettime();
+	event->type = type;
+	event->arg = arg;
+	event->value = value;
+
+	// The event has to be in place before a reader can see the new head
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// --------------------------------------------------------------------------------
+void TL_addSample(u8 port, u8 command, u32 us)
+{
+	if (port >= TL_PORTS || command >= TL_CMD_COUNT)
+		return;
+
+	TLHistogram *histogram = &ports[port].histograms[command];
+	u32 bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+
+	if (bucket >= TL_BUCKETS)
+		bucket = TL_BUCKETS - 1;
+
+	histogram->buckets[bucket]++;
+	histogram->totalUs += us;
+	if (us > histogram->maxUs)
+		histogram->maxUs = us;
+	histogram->count++;
+}
+
+// --------------------------------------------------------------------------------
+void TL_commandStart(u8 port, u8 command, u16 size)
+{
+	if (port >= TL_PORTS)
+		return;
+
+	// A command that never finished (the gba gave up on it) is just forgotten
+	ports[port].timing = 1;
+	ports[port].command = command;
+	ports[port].commandStartedAt = gettime();
+	TL_record(port, TL_SOURCE_SERIAL, TL_EVENT_COMMAND, command, size);
+}
+
+// --------------------------------------------------------------------------------
+void TL_commandEnd(u8 port, u8 ok)
+{
+	if (port >= TL_PORTS || !ports[port].timing)
+		return;
+
+	ports[port].timing = 0;
+	TL_addSample(port, ports[port].command, (u32) ticks_to_microsecs(gettime() - ports[port].commandStartedAt));
+	TL_record(port, TL_SOURCE_SERIAL, TL_EVENT_COMMAND_DONE, ports[port].command, ok);
+}
+
+// --------------------------------------------------------------------------------
+u32 TL_readEvents(u8 port, u8 source, u32 *cursor, TLEvent *out, u32 max, u32 *lost)
+{
+	*lost = 0;
+
+	if (port >= TL_PORTS || source >= TL_SOURCE_COUNT)
+		return 0;
+
+	TLRing *ring = &ports[port].rings[source];
+	u32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	u32 from = *cursor;
+
+	if (head - from > TL_RING_SIZE)
+	{
+		*lost = head - from - TL_RING_SIZE;
+		from = head - TL_RING_SIZE;
+	}
+
+	u32 count = head - from < max ? head - from : max;
+
+	for (u32 i = 0; i < count; i++)
+		out[i] = ring->events[(from + i) & (TL_RING_SIZE - 1)];
+
+	// The writer could have gone round onto the oldest of them while we copied, including the one it's writing now
+	u32 after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	u32 overwritten = after + 1 - TL_RING_SIZE - from;
+
+	if ((s32) overwritten > 0)
+	{
+		if (overwritten > count)
+			overwritten = count;
+
+		memmove(out, &out[overwritten], (count - overwritten) * sizeof(TLEvent));
+		*lost += overwritten;
+		count -= overwritten;
+		from += overwritten;
+	}
+
+	*cursor = from + count;
+	return count;
+}
+
+// --------------------------------------------------------------------------------
+void TL_getHistogram(u8 port, u8 command, TLHistogram *histogram)
+{
+	if (port >= TL_PORTS || command >= TL_CMD_COUNT)
+	{
+		memset(histogram, 0, sizeof(TLHistogram));
+		return;
+	}
+
+	*histogram = ports[port].histograms[command];
+}
+
+// --------------------------------------------------------------------------------
+u32 TL_getPercentile(const TLHistogram *histogram, u32 percentile)
+{
+	u32 total = 0;
+
+	for (u32 bucket = 0; bucket < TL_BUCKETS; bucket++)
+		total += histogram->buckets[bucket];
+
+	if (total == 0)
+		return 0;
+
+	u32 seen = 0;
+	for (u32 bucket = 0; bucket < TL_BUCKETS; bucket++)
+	{
+		seen += histogram->buckets[bucket];
+
+		// Nothing is over the max, so it's a tighter bound when the top bucket is only part full
+		if ((u64) seen * 100 >= (u64) total * percentile)
+			return bucket == TL_BUCKETS - 1 || histogram->maxUs < (1u << bucket) ? histogram->maxUs : 1u << bucket;
+	}
+
+	return histogram->maxUs;
+}
+
+// --------------------------------------------------------------------------------
+const char *TL_getCommandName(u8 command)
+{
+	return command < TL_CMD_COUNT ? commandNames[command] : "?";
+}
+
+// --------------------------------------------------------------------------------
+static void dumpEvents(FILE *file, u8 port, u8 source, u32 now)
+{
+	TLEvent events[TL_DUMP_EVENTS];
+	u32 head = __atomic_load_n(&ports[port].rings[source].head, __ATOMIC_ACQUIRE);
+	u32 cursor = head > TL_DUMP_EVENTS ? head - TL_DUMP_EVENTS : 0;
+	u32 lost;
+	u32 count = TL_readEvents(port, source, &cursor, events, TL_DUMP_EVENTS, &lost);
+
+	fprintf(file, "last %u of %u %s events (ms before the dump)\n", (unsigned int) count, (unsigned int) head, sourceNames[source]);
+
+	for (u32 i = 0; i < count; i++)
+	{
+		fprintf(file, "  %10.3f %-9s %3u %04X\n", ticks_to_microsecs(now - events[i].time) / 1000.0,
+		        events[i].type < TL_EVENT_COUNT ? eventNames[events[i].type] : "?", events[i].arg, events[i].value);
+	}
+}
+
+// --------------------------------------------------------------------------------
+int TL_dump(FILE *file)
+{
+	u32 now = (u32) gettime();
+
+	for (u8 port = 0; port < TL_PORTS; port++)
+	{
+		if (ports[port].rings[TL_SOURCE_SERIAL].head == 0 && ports[port].rings[TL_SOURCE_NET].head == 0)
+			continue;
+
+		fprintf(file, "=== PORT %d ===\n", port + 1);
+		fprintf(file, "%-7s %8s %10s %10s %10s %10s\n", "CMD", "COUNT", "MEAN_US", "P50_US", "P99_US", "MAX_US");
+
+		for (u8 command = 0; command < TL_CMD_COUNT; command++)
+		{
+			TLHistogram histogram;
+			TL_getHistogram(port, command, &histogram);
+
+			if (histogram.count == 0)
+				continue;
+
+			fprintf(file, "%-7s %8u %10u %10u %10u %10u\n", commandNames[command], (unsigned int) histogram.count,
+			        (unsigned int) (histogram.totalUs / histogram.count), (unsigned int) TL_getPercentile(&histogram, 50),
+			        (unsigned int) TL_getPercentile(&histogram, 99), (unsigned int) histogram.maxUs);
+		}
+
+		// Each column is the count of samples under that many us (and over the column before)
+		fprintf(file, "%-7s", "US<");
+		for (u32 bucket = 0; bucket < TL_BUCKETS - 1; bucket++)
+			fprintf(file, " %u", 1u << bucket);
+		fprintf(file, " more\n");
+
+		for (u8 command = 0; command < TL_CMD_COUNT; command++)
+		{
+			TLHistogram histogram;
+			TL_getHistogram(port, command, &histogram);
+
+			if (histogram.count == 0)
+				continue;
+
+			fprintf(file, "%-7s", commandNames[command]);
+			for (u32 bucket = 0; bucket < TL_BUCKETS; bucket++)
+				fprintf(file, " %u", (unsigned int) histogram.buckets[bucket]);
+			fprintf(file, "\n");
+		}
+
+		for (u8 source = 0; source < TL_SOURCE_COUNT; source++)
+			dumpEvents(file, port, source, now);
+
+		fprintf(file, "\n");
+	}
+
+	return ferror(file) ? -1 : 0;
+}
+
+// --------------------------------------------------------------------------------
+int TL_dumpToFile(const char *path)
+{
+	FILE *file = fopen(path, "w");
+
+	if (file == NULL)
+		return -1;
+
+	int result = TL_dump(file);
+
+	if (fclose(file) != 0)
+		return -1;
+
+	return result;
+}
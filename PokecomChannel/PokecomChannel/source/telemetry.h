@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * telemetry.h
+ * Per port record of what went over the link and the network, cheap enough
+ * to leave on without changing the timing it measures
+ ***************************************************************************/
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <gccore.h>
+#include <stdio.h>
+
+#include "trace.h"
+
+#define ENABLE_TELEMETRY // Comment out to take every hook out of the build
+
+#define TL_PORTS 4
+#define TL_RING_SIZE 4096 // Events kept per port for each thread (a few seconds of an idle link), must be a power of 2
+#define TL_BUCKETS 24 // Bucket 0 is under 1us, bucket n is 2^(n-1) to 2^n us and the last one is everything longer
+#define TL_DUMP_EVENTS 64 // Most recent events per ring written by TL_dump
+
+// Who wrote the event. Each ring only ever has the one writer, so recording never has to wait on anything
+enum {
+	TL_SOURCE_SERIAL, // The serial scheduler (SI commands, blocks, states)
+	TL_SOURCE_NET, // The port's network thread (requests to and from the server)
+	TL_SOURCE_COUNT
+};
+
+enum {
+	TL_EVENT_SI_READ, // arg is 1 if the transfer failed, value the first 16 bits read
+	TL_EVENT_SI_WRITE, // arg is 1 if the transfer failed, value the top 16 bits written
+	TL_EVENT_COMMAND, // A command from the gba started, arg is the TL_CMD_*, value its size
+	TL_EVENT_COMMAND_DONE, // arg is the TL_CMD_*, value is 1 if it went through
+	TL_EVENT_CHECK, // arg is 1 if the check passed, value the frame (or 0xFFFF for a whole block or stream)
+	TL_EVENT_FRAME_ACK, // The gba's ack for a round of frames we sent, arg is the round, value the frames it wants again
+	TL_EVENT_STATE, // arg is the new SERIAL_STATE_*, value the old one
+	TL_EVENT_TCP_SEND, // arg is the tag, value the size
+	TL_EVENT_TCP_RECV, // arg is the tag, value the size of the answer
+	TL_EVENT_COUNT
+};
+
+// What the histograms are kept for, the NET_CONN_* commands plus the server and single SI transfers
+enum {
+	TL_CMD_SEND, // NET_CONN_SEND_REQ, from the command word to the end of the block
+	TL_CMD_RECV, // NET_CONN_RECV_REQ
+	TL_CMD_TRAN, // NET_CONN_TRAN_ANY
+	TL_CMD_CALL, // NET_CONN_CALL_ANY, from the command word to the end of the answer
+	TL_CMD_STRM, // NET_CONN_STRM_ANY
+	TL_CMD_LIFN, // NET_CONN_LIFN_REQ
+	TL_CMD_HAND, // NET_CONN_HANDSHAKE_REQ
+	TL_CMD_BCLR, // NET_CONN_BCLR_REQ
+	TL_CMD_PINF, // NET_CONN_PINF_REQ
+	TL_CMD_CINF, // NET_CONN_CINF_REQ
+	TL_CMD_SERVER, // A request from being queued to the server's answer
+	TL_CMD_SI, // One SI transfer, from being queued to its callback
+	TL_CMD_XCHG, // NET_CONN_XCHG_ANY, from the command word to the end of both blocks
+	TL_CMD_COUNT
+};
+
+typedef struct {
+	u32 time; //!< Low bits of gettime(), only differences between events mean anything
+	u8 type; //!< TL_EVENT_*
+	u8 arg;
+	u16 value;
+} TLEvent;
+
+typedef struct {
+	u32 count;
+	u32 buckets[TL_BUCKETS];
+	u64 totalUs;
+	u32 maxUs;
+} TLHistogram;
+
+// A trace (see trace.h) marks where each command starts and ends in the same places, with or without telemetry
+#ifdef ENABLE_TELEMETRY
+#define TL_RECORD(port, source, type, arg, value) TL_record(port, source, type, arg, value)
+#define TL_COMMAND_START(port, command, size) do { TL_commandStart(port, command, size); TR_COMMAND_START(port, command, size); } while (0)
+#define TL_COMMAND_END(port, ok) do { TL_commandEnd(port, ok); TR_COMMAND_END(port, ok); } while (0)
+#define TL_SAMPLE(port, command, us) TL_addSample(port, command, us)
+#else
+#define TL_RECORD(port, source, type, arg, value) { /*Nothing*/ }
+#define TL_COMMAND_START(port, command, size) TR_COMMAND_START(port, command, size)
+#define TL_COMMAND_END(port, ok) TR_COMMAND_END(port, ok)
+#define TL_SAMPLE(port, command, us) { /*Nothing*/ }
+#endif
+
+void TL_record(u8 port, u8 source, u8 type, u8 arg, u16 value);
+
+/* Starts timing a command from the gba, it's added to its histogram by TL_commandEnd. Only called from the serial thread */
+void TL_commandStart(u8 port, u8 command, u16 size);
+void TL_commandEnd(u8 port, u8 ok);
+
+/* Adds a time to a histogram. Each histogram must only be added to from one thread */
+void TL_addSample(u8 port, u8 command, u32 us);
+
+/*
+* Copies the events written since *cursor (start it at 0) into out, oldest first, and moves *cursor on.
+* If the writer lapped the reader the events in between are gone, *lost says how many. Never blocks the writer
+*/
+u32 TL_readEvents(u8 port, u8 source, u32 *cursor, TLEvent *out, u32 max, u32 *lost);
+
+/* Copy of a histogram as it is now, counts can be a sample or two behind each other if it's being added to */
+void TL_getHistogram(u8 port, u8 command, TLHistogram *histogram);
+
+/* us under which the given percentile of samples fall (the top of their bucket, or the max if that is lower), 0 if there aren't any */
+u32 TL_getPercentile(const TLHistogram *histogram, u32 percentile);
+
+const char *TL_getCommandName(u8 command);
+
+/* Writes the histograms of every port that's seen anything and its most recent events. Returns < 0 if nothing could be written */
+int TL_dump(FILE *file);
+int TL_dumpToFile(const char *path);
+
+#endif
@@ -0,0 +1,247 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * trace.c
+ * Binary recording of a whole session written to SD
+ ***************************************************************************/
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ogc/lwp_watchdog.h>
+
+/*
+* The same idea as the telemetry rings, but of bytes rather than fixed size events since a record can be a whole TCP frame.
+* A record is copied in with no lock and the head moved on after it, the writer thread only ever moves the tail. When a
+* ring is full the record is dropped and counted, the next one that fits is preceded by a TR_LOST so the replay knows.
+* Nothing is written to the SD card from the serial or network threads, that can stall for far longer than a block takes
+*/
+typedef struct {
+	u8 bytes[TR_RING_SIZE];
+	vu32 head; //!< Bytes ever written
+	vu32 tail; //!< Bytes ever taken by the writer
+	u32 lost; //!< Records dropped since the last TR_LOST
+} TRRing;
+
+static TRRing rings[TR_PORTS][TR_SOURCE_COUNT];
+static FILE *traceFile = NULL;
+static lwp_t writerThread = LWP_THREAD_NULL;
+static vu32 recording = 0;
+static vu32 writerRunning = 0;
+static u64 startedAt = 0;
+static u32 totalLost = 0;
+static u64 bytesWritten = 0;
+static int writeFailed = 0;
+
+// --------------------------------------------------------------------------------
+static void putU16(u8 *out, u16 value)
+{
+	out[0] = value & 0xFF;
+	out[1] = value >> 8;
+}
+
+static void putU32(u8 *out, u32 value)
+{
+	putU16(out, value & 0xFFFF);
+	putU16(&out[2], value >> 16);
+}
+
+/* Copies into the ring at position pos, going round the end if it has to */
+static void copyIn(TRRing *ring, u32 pos, const void *data, u32 length)
+{
+	u32 start = pos & (TR_RING_SIZE - 1);
+	u32 first = length < TR_RING_SIZE - start ? length : TR_RING_SIZE - start;
+
+	if (length == 0)
+		return;
+
+	memcpy(&ring->bytes[start], data, first);
+	memcpy(ring->bytes, (const u8 *) data + first, length - first);
+}
+
+/* Returns 0 if there wasn't room */
+static int putRecord(TRRing *ring, u8 port, u8 source, u8 type, const void *head, u16 headLength, const void *body, u16 bodyLength)
+{
+	u32 length = (u32) headLength + bodyLength;
+	u32 used = ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	u8 header[TR_RECORD_HEADER_SIZE];
+
+	if (length > 0xFFFF || TR_RECORD_HEADER_SIZE + length > TR_RING_SIZE - used)
+		return 0;
+
+	putU32(header, (u32) ticks_to_microsecs(gettime() - startedAt));
+	header[4] = type;
+	header[5] = (u8) (port | source << 4);
+	putU16(&header[6], (u16) length);
+
+	u32 pos = ring->head;
+	copyIn(ring, pos, header, sizeof(header));
+	copyIn(ring, pos + sizeof(header), head, headLength);
+	copyIn(ring, pos + sizeof(header) + headLength, body, bodyLength);
+
+	// The record has to be in place before the writer can see the new head
+	__atomic_store_n(&ring->head, pos + sizeof(header) + length, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// --------------------------------------------------------------------------------
+void TR_record(u8 port, u8 source, u8 type, const void *head, u16 headLength, const void *body, u16 bodyLength)
+{
+	if (!recording || port >= TR_PORTS || source >= TR_SOURCE_COUNT)
+		return;
+
+	TRRing *ring = &rings[port][source];
+
+	if (ring->lost != 0)
+	{
+		u8 lost[4];
+		putU32(lost, ring->lost);
+
+		if (!putRecord(ring, port, source, TR_LOST, NULL, 0, lost, sizeof(lost)))
+		{
+			ring->lost++;
+			__atomic_add_fetch(&totalLost, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		ring->lost = 0;
+	}
+
+	if (!putRecord(ring, port, source, type, head, headLength, body, bodyLength))
+	{
+		ring->lost++;
+		__atomic_add_fetch(&totalLost, 1, __ATOMIC_RELAXED);
+	}
+}
+
+// --------------------------------------------------------------------------------
+void TR_commandStart(u8 port, u8 command, u16 size)
+{
+	u8 payload[3];
+
+	payload[0] = command;
+	putU16(&payload[1], size);
+	TR_record(port, TR_SOURCE_SERIAL, TR_COMMAND_START, NULL, 0, payload, sizeof(payload));
+}
+
+void TR_commandEnd(u8 port, u8 ok)
+{
+	TR_record(port, TR_SOURCE_SERIAL, TR_COMMAND_END, NULL, 0, &ok, 1);
+}
+
+void TR_blockData(u8 port, u16 offset, const void *data, u16 length)
+{
+	u8 head[2];
+
+	putU16(head, offset);
+	TR_record(port, TR_SOURCE_SERIAL, TR_BLOCK_DATA, head, sizeof(head), data, length);
+}
+
+// --------------------------------------------------------------------------------
+/* Writes everything in the rings out, in at most two goes per ring */
+static void drainRings()
+{
+	for (u8 port = 0; port < TR_PORTS; port++)
+	{
+		for (u8 source = 0; source < TR_SOURCE_COUNT; source++)
+		{
+			TRRing *ring = &rings[port][source];
+			u32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+			u32 tail = ring->tail;
+			u32 length = head - tail;
+
+			if (length == 0)
+				continue;
+
+			u32 start = tail & (TR_RING_SIZE - 1);
+			u32 first = length < TR_RING_SIZE - start ? length : TR_RING_SIZE - start;
+
+			if (fwrite(&ring->bytes[start], 1, first, traceFile) != first
+			 || fwrite(ring->bytes, 1, length - first, traceFile) != length - first)
+				writeFailed = 1;
+
+			bytesWritten += length;
+			__atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+static void *traceWriter(void *arg)
+{
+	(void)(arg);
+
+	while (writerRunning)
+	{
+		drainRings();
+		usleep(TR_FLUSH_INTERVAL * 1000);
+	}
+
+	return NULL;
+}
+
+// --------------------------------------------------------------------------------
+int TR_start(const char *path)
+{
+	u8 header[TR_FILE_HEADER_SIZE];
+
+	if (traceFile != NULL)
+		return -1;
+
+	traceFile = fopen(path, "wb");
+	if (traceFile == NULL)
+		return -1;
+
+	memcpy(header, TR_MAGIC, 4);
+	putU16(&header[4], TR_VERSION);
+	putU16(&header[6], 0);
+	writeFailed = fwrite(header, 1, sizeof(header), traceFile) != sizeof(header);
+
+	memset(rings, 0, sizeof(rings));
+	totalLost = 0;
+	bytesWritten = 0;
+	startedAt = gettime();
+
+	writerRunning = 1;
+	LWP_CreateThread(&writerThread, traceWriter, NULL, NULL, 16*1024, 40);
+
+	// Last, so nothing is recorded into rings that are still being cleared
+	__atomic_store_n(&recording, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int TR_stop(void)
+{
+	if (traceFile == NULL)
+		return -1;
+
+	__atomic_store_n(&recording, 0, __ATOMIC_RELEASE);
+
+	writerRunning = 0;
+	LWP_JoinThread(writerThread, NULL);
+	writerThread = LWP_THREAD_NULL;
+
+	// A record that was being copied in as recording stopped is done well within a writer interval
+	usleep(TR_FLUSH_INTERVAL * 1000);
+	drainRings();
+
+	int closeFailed = fclose(traceFile) != 0;
+	traceFile = NULL;
+	return writeFailed || closeFailed ? -1 : 0;
+}
+
+int TR_isRecording(void)
+{
+	return recording;
+}
+
+u32 TR_getLost(void)
+{
+	return totalLost;
+}
+
+u64 TR_getBytesWritten(void)
+{
+	return bytesWritten;
+}
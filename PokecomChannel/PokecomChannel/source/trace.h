@@ -0,0 +1,88 @@
+/****************************************************************************
+ * Pokecom Channel
+ *
+ * trace.h
+ * Binary recording of a whole session (every SI word, command and TCP
+ * frame) written to SD, so a slow session can be replayed off the wii
+ * with the simulator's linkreplay
+ ***************************************************************************/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <gccore.h>
+
+#define ENABLE_TRACE // Comment out to take every hook out of the build
+
+#define TR_PORTS 4
+#define TR_RING_SIZE (256 * 1024) // Bytes per port for each thread, enough for a few seconds of a flat out link if the SD card stalls, must be a power of 2
+#define TR_FLUSH_INTERVAL 50 // ms between the writer emptying the rings onto the SD card
+
+/*
+* The file is TR_FILE_HEADER_SIZE bytes ("PKTR", then the version as a little endian u16 and two unused bytes), then records of
+*   u32 time   us since TR_start, wraps after 71 minutes
+*   u8  type   TR_*
+*   u8  port   the gc port in the low 4 bits, the TR_SOURCE_* that wrote it in the high 4
+*   u16 length of the payload that follows
+* all little endian. Records from the same port and source are in order, the rest can be up to TR_FLUSH_INTERVAL apart in the file
+*/
+#define TR_MAGIC "PKTR"
+#define TR_VERSION 1
+#define TR_FILE_HEADER_SIZE 8
+#define TR_RECORD_HEADER_SIZE 8
+
+// Who wrote the record. Each ring only ever has the one writer, so recording never has to wait on anything
+enum {
+	TR_SOURCE_SERIAL, // The serial scheduler (SI transfers, commands, blocks)
+	TR_SOURCE_NET, // The port's network thread (the server's socket)
+	TR_SOURCE_COUNT
+};
+
+enum {
+	TR_SI_READ, // The 4 bytes read from the gba
+	TR_SI_READ_FAILED, // Nothing
+	TR_SI_WRITE, // The 4 bytes written, in the order they went
+	TR_SI_WRITE_FAILED, // Nothing
+	TR_COMMAND_START, // A command from the gba was taken up (the last TR_SI_READ is its word), the TL_CMD_* then the size as a u16
+	TR_COMMAND_END, // 1 if the command went through, 0 if not
+	TR_BLOCK_DATA, // What the gba sent in a block that just went through, its offset in the virtual channels as a u16 then the bytes
+	TR_TCP_CONNECT, // The address, once connected
+	TR_TCP_SEND, // The bytes as they were sent
+	TR_TCP_RECV, // The bytes as they were received
+	TR_TCP_CLOSE, // Nothing
+	TR_LOST, // The u32 count of records that didn't fit in the ring since the last one that did
+	TR_RECORD_COUNT
+};
+
+#ifdef ENABLE_TRACE
+#define TR_RECORD(port, source, type, data, length) TR_record(port, source, type, NULL, 0, data, length)
+#define TR_COMMAND_START(port, command, size) TR_commandStart(port, command, size)
+#define TR_COMMAND_END(port, ok) TR_commandEnd(port, ok)
+#else
+#define TR_RECORD(port, source, type, data, length) { /*Nothing*/ }
+#define TR_COMMAND_START(port, command, size) { /*Nothing*/ }
+#define TR_COMMAND_END(port, ok) { /*Nothing*/ }
+#endif
+
+/* Starts recording to path (which is overwritten), returns < 0 if it can't be opened or a recording is already going */
+int TR_start(const char *path);
+
+/* Writes out whatever is still in the rings and closes the file, returns < 0 if any of the recording couldn't be written */
+int TR_stop(void);
+
+int TR_isRecording(void);
+
+/* Records head then body as one payload. Does nothing (beyond one load) unless recording */
+void TR_record(u8 port, u8 source, u8 type, const void *head, u16 headLength, const void *body, u16 bodyLength);
+
+void TR_commandStart(u8 port, u8 command, u16 size);
+void TR_commandEnd(u8 port, u8 ok);
+
+/* TR_BLOCK_DATA for a block the gba sent to offset in the virtual channels */
+void TR_blockData(u8 port, u16 offset, const void *data, u16 length);
+
+/* Records and bytes lost since TR_start because the rings were full */
+u32 TR_getLost(void);
+u64 TR_getBytesWritten(void);
+
+#endif
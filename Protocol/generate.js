@@ -0,0 +1,213 @@
+/**
+ * Writes the headers the gba, the wii channels and the server build against from protocol.json.
+ * Run with `node generate.js` after changing protocol.json, or `node generate.js --check` to only check the files are up to date
+ *
+ * Each target gets the groups it needs:
+ *   link     the JOYBUS constants both ends of the cable use, and the macros both ends work out sizes with (C only)
+ *   commands the NET_CONN_* commands the wii recognises (the channel also gets the *_ANY first byte of the ones that take a channel)
+ *   channel  constants only the wii side uses
+ *   server   what goes over TCP between the channel and the server
+ *   layouts  offsets and sizes of each request and answer
+ */
+var fs = require('fs');
+var path = require('path');
+
+const ROOT = path.join(__dirname, '..');
+const GENERATED_NOTE = 'Generated by Protocol/generate.js from Protocol/protocol.json, change those instead of this file';
+
+const TARGETS = [
+    { file: 'pokeemerald/include/constants/net_protocol.h', lang: 'c', guard: 'GUARD_CONSTANTS_NET_PROTOCOL_H', groups: ['link', 'commands'] },
+    { file: 'PokecomChannel/PokecomChannel/source/net_protocol.h', lang: 'c', guard: '_NET_PROTOCOL_H_', groups: ['channel', 'link', 'commands', 'server', 'layouts'] },
+    { file: 'PokecomChannel/NoUITestChannel/source/net_protocol.h', lang: 'c', guard: '_NET_PROTOCOL_H_', groups: ['channel', 'link', 'commands', 'server', 'layouts'] },
+    { file: 'CelioServer/protocol.js', lang: 'js', groups: ['link', 'server', 'layouts'] }
+];
+
+/**
+ * Every name once, with its value worked out (a value of "=NAME" is the same as that earlier entry)
+ * @returns a Map of name to { value, text } where text is how the value is written out
+ */
+function resolveValues(schema) {
+    let values = new Map();
+    let entries = [...schema.constants, ...schema.commands, ...schema.server];
+
+    for (let entry of entries) {
+        if (values.has(entry.name)) {
+            throw new Error("Duplicate name " + entry.name);
+        }
+
+        if (entry.string !== undefined) {
+            values.set(entry.name, { value: entry.string, text: JSON.stringify(entry.string) });
+            continue;
+        }
+
+        let text = entry.value;
+        if (text.startsWith('=')) {
+            let other = values.get(text.substring(1));
+            if (!other) {
+                throw new Error(entry.name + " refers to " + text.substring(1) + " which isn't defined before it");
+            }
+            text = other.text;
+        }
+
+        let value = Number(text);
+        if (!Number.isInteger(value) || value < 0) {
+            throw new Error(entry.name + " has a value that isn't a whole number: " + entry.value);
+        }
+
+        values.set(entry.name, { value: value, text: text });
+
+        if (entry.any) {
+            if (values.has(entry.any)) {
+                throw new Error("Duplicate name " + entry.any);
+            }
+            values.set(entry.any, { value: value >> 8, text: '0x' + (value >> 8).toString(16).toUpperCase().padStart(2, '0') });
+        }
+    }
+
+    let commandValues = new Set();
+    for (let command of schema.commands) {
+        if (commandValues.has(values.get(command.name).value)) {
+            throw new Error(command.name + " has the same value as another command");
+        }
+        commandValues.add(values.get(command.name).value);
+    }
+
+    return values;
+}
+
+/**
+ * The lines for one target as { name, text, comment } (or { section } to start a new block), in schema order
+ */
+function collectLines(schema, values, groups) {
+    let lines = [];
+    let add = (name, comment, bytes) => lines.push({ name: name, text: values.get(name).text, comment: [comment, bytes ? 'msg bytes ' + bytes : null].filter(c => c).join(' | ') });
+
+    for (let group of ['channel', 'link']) {
+        if (!groups.includes(group)) {
+            continue;
+        }
+
+        lines.push({ section: group == 'link' ? 'Both ends of the cable' : 'The wii side of the cable' });
+        schema.constants.filter(c => c.group == group).forEach(c => add(c.name, c.comment, c.bytes));
+        (schema.macros || []).filter(m => m.group == group).forEach(m => lines.push({ macro: m }));
+    }
+
+    if (groups.includes('commands')) {
+        lines.push({ section: 'Commands the wii recognises, the low byte of those with an *_ANY is the virtual channel' });
+        for (let command of schema.commands) {
+            if (command.group == 'channel' && !groups.includes('channel')) {
+                continue;
+            }
+
+            add(command.name, command.comment, command.bytes);
+            if (command.any && groups.includes('channel')) {
+                add(command.any, 'First byte of any ' + command.name);
+            }
+        }
+    }
+
+    if (groups.includes('server')) {
+        lines.push({ section: 'Between the wii and the server' });
+        schema.server.forEach(s => add(s.name, s.comment, s.bytes));
+    }
+
+    if (groups.includes('layouts')) {
+        for (let layout of schema.layouts) {
+            let offset = 0;
+
+            lines.push({ section: layout.name + (layout.comment ? ': ' + layout.comment : '') });
+            for (let field of layout.fields) {
+                values.set(layout.name + '_' + field.name + '_OFFSET', { value: offset, text: String(offset) });
+                values.set(layout.name + '_' + field.name + '_SIZE', { value: field.size, text: String(field.size) });
+                add(layout.name + '_' + field.name + '_OFFSET', field.comment);
+                add(layout.name + '_' + field.name + '_SIZE');
+                offset += field.size;
+            }
+
+            values.set(layout.name + '_SIZE', { value: offset, text: String(offset) });
+            add(layout.name + '_SIZE');
+        }
+    }
+
+    return lines;
+}
+
+function renderC(target, lines) {
+    let width = Math.max(...lines.filter(l => l.name).map(l => ('#define ' + l.name + ' ' + l.text).length));
+    let out = ['// ' + GENERATED_NOTE, '', '#ifndef ' + target.guard, '#define ' + target.guard];
+
+    for (let line of lines) {
+        if (line.section) {
+            out.push('', '// ' + line.section);
+            continue;
+        }
+
+        // Too long to line up with the rest, so the comment goes above
+        if (line.macro) {
+            out.push('', '// ' + line.macro.comment, '#define ' + line.macro.name + '(' + line.macro.params.join(', ') + ') ' + line.macro.expr);
+            continue;
+        }
+
+        let define = '#define ' + line.name + ' ' + line.text;
+        out.push(line.comment ? define.padEnd(width) + ' // ' + line.comment : define);
+    }
+
+    out.push('', '#endif // ' + target.guard, '');
+    return out.join('\n');
+}
+
+function renderJs(target, lines) {
+    let width = Math.max(...lines.filter(l => l.name).map(l => ('    ' + l.name + ': ' + l.text + ',').length));
+    let out = ['// ' + GENERATED_NOTE, '', 'module.exports = Object.freeze({'];
+
+    for (let line of lines) {
+        if (line.section) {
+            out.push('', '    // ' + line.section);
+            continue;
+        }
+
+        // The server never works these out
+        if (line.macro) {
+            continue;
+        }
+
+        let property = '    ' + line.name + ': ' + line.text + ',';
+        out.push(line.comment ? property.padEnd(width) + ' // ' + line.comment : property);
+    }
+
+    out.push('});', '');
+    return out.join('\n');
+}
+
+function main() {
+    let check = process.argv.includes('--check');
+    let schema = JSON.parse(fs.readFileSync(path.join(__dirname, 'protocol.json'), 'utf8'));
+    let stale = 0;
+
+    for (let target of TARGETS) {
+        let values = resolveValues(schema);
+        let lines = collectLines(schema, values, target.groups);
+        let text = target.lang == 'c' ? renderC(target, lines) : renderJs(target, lines);
+        let file = path.join(ROOT, target.file);
+        let current = fs.existsSync(file) ? fs.readFileSync(file, 'utf8') : null;
+
+        if (current == text) {
+            continue;
+        }
+
+        if (check) {
+            console.log("%s is out of date", target.file);
+            stale++;
+        } else {
+            fs.writeFileSync(file, text);
+            console.log("Wrote %s", target.file);
+        }
+    }
+
+    if (check) {
+        console.log(stale == 0 ? "Everything is up to date" : "Run `node generate.js` and commit what it changes");
+        process.exitCode = stale == 0 ? 0 : 1;
+    }
+}
+
+main();
@@ -0,0 +1,47 @@
+// Generated by Protocol/generate.js from Protocol/protocol.json, change those instead of this file
+
+#ifndef GUARD_CONSTANTS_NET_PROTOCOL_H
+#define GUARD_CONSTANTS_NET_PROTOCOL_H
+
+// Both ends of the cable
+#define NET_CONN_HANDSHAKE_REQ 0xCAD0             // Sent by the gba to handshake | msg bytes CA D0 XX XX (X are the capabilities the gba supports)
+#define NET_CONN_HANDSHAKE_RES_NO_INTERNET 0xCAD1 // Response to the gba if we have no internet | msg bytes CA D1 XX XX (X are the capabilities to use)
+#define NET_CONN_HANDSHAKE_RES_ONLINE 0xCAD2      // Response to the gba if we have internet | msg bytes CA D2 XX XX (X are the capabilities to use)
+#define NET_CONN_LINK_CAP_FRAMED 0x0001
+#define NET_CONN_LINK_CAP_CALL 0x0002             // Only ever agreed along with NET_CONN_LINK_CAP_FRAMED
+#define NET_CONN_LINK_CAP_STREAM 0x0004
+#define NET_CONN_LINK_CAP_SIZED_CALL 0x0008       // Only ever agreed along with NET_CONN_LINK_CAP_CALL
+#define NET_CONN_LINK_CAP_LIFN_PUSH 0x0010        // The wii writes a waiting gba the NET_CONN_LIFN_REQ answer again whenever it changes
+#define NET_CONN_LINK_CAP_DUPLEX 0x0020           // NET_CONN_XCHG_REQ, only ever agreed along with NET_CONN_LINK_CAP_FRAMED
+#define NET_CONN_FACK_RES 0x1180                  // Frame ack, the low bits are the round | msg bytes 11 8R XX XX (X is a bitmap of the frames that need to be sent again)
+#define NET_CONN_FRAME_MARK 0xF7                  // First byte of every frame trailer | msg bytes F7 SS XX XX (S is the frame sequence number, X is the CRC16 of the frame)
+#define NET_CONN_FRAME_SIZE 16
+#define NET_CONN_MAX_FRAMES 16
+#define NET_CONN_MAX_FRAME_ROUNDS 4
+#define NET_CONN_CALL_RES 0x11C0                  // The server has answered a call | msg bytes 11 C0 XX XX (X is NET_CONN_CALL_ANSWERED, or 0 if the server never answered. With NET_CONN_LINK_CAP_SIZED_CALL X is the size of the answer instead)
+#define NET_CONN_CALL_ANSWERED 0x0001
+#define NET_CONN_STRM_FROM 0x11D0                 // Sent straight after NET_CONN_STRM_REQ | msg bytes 11 D0 XX XX (X is the offset to start from, always a multiple of NET_CONN_STREAM_SEGMENT_SIZE)
+#define NET_CONN_SACK_RES 0x11E0                  // Stream ack, sent by the gba at the end | msg bytes 11 E0 XX XX (X is how much of the payload the gba has, the next stream starts there)
+#define NET_CONN_STREAM_SEGMENT_SIZE 256
+#define NET_CONN_STREAM_MAX_SIZE 4096             // The wii's buffer for each gba
+#define NET_CONN_CHCK_RES 0x1101                  // Returning check bytes for the last data sent | msg bytes 11 01 XX XX (X are the 16bit check bytes, made by XORing each seq 16bits of the msg)
+#define NET_CONN_LZ77_MARK 0x4C5A                 // "LZ", put after a request's own data to say the gba can take the answer compressed
+#define NET_CONN_LZ77_TYPE 0x10                   // First byte of the LZ77 header, the other 3 are the size once uncompressed
+#define NET_CONN_RAW_MARK 0x5257                  // "RW", where NET_CONN_LZ77_MARK would be to say an answer that could have come compressed didn't
+#define NET_CONN_PACKED_HEADER_SIZE 4             // In front of the payload of an answer to a request with NET_CONN_LZ77_MARK | msg bytes MM MM SS SS (M is NET_CONN_LZ77_MARK or NET_CONN_RAW_MARK, S is the big endian size of the payload as sent)
+
+// Bytes in each frame of a length byte block, NET_CONN_FRAME_SIZE unless that needs more than NET_CONN_MAX_FRAMES frames, then as few (whole words) as fit it in that many
+#define NET_CONN_GET_FRAME_SIZE(length) ((length) > NET_CONN_FRAME_SIZE * NET_CONN_MAX_FRAMES ? ((((length) + NET_CONN_MAX_FRAMES - 1) / NET_CONN_MAX_FRAMES) + 3) & ~3 : NET_CONN_FRAME_SIZE)
+
+// Commands the wii recognises, the low byte of those with an *_ANY is the virtual channel
+#define NET_CONN_LIFN_REQ 0x2005                  // Return information about this devices network connection | msg bytes 20 05 XX XX (last 16 bits are unused, the answer is the one word 20 05 RR SS, R is 1 once ready and S the connection state)
+#define NET_CONN_RECV_REQ 0x2500                  // Tell wii to send us data from the buffer for this devices port | msg bytes 25 YY XX XX (X is the 16bit size of msg to receive, YY is the virtual channel)
+#define NET_CONN_SEND_REQ 0x1500                  // Tell wii you want to send it data | msg bytes 15 YY XX XX (X is the 16bit size of msg to send, YY is the virtual channel)
+#define NET_CONN_TRAN_REQ 0x1300                  // Tell wii to send it current data to the server | msg bytes 13 YY XX XX (last 16 bits are size of message to transsmit, YY is the virtual channel)
+#define NET_CONN_CALL_REQ 0x1600                  // Send a request, transmit it and receive the answer | msg bytes 16 YY XX XX then 25 ZZ RR RR (X is the size of the request for channel Y, R the size of the answer read from channel Z)
+#define NET_CONN_STRM_REQ 0x2700                  // Stream a whole payload from the wii | msg bytes 27 YY XX XX then 11 D0 OO OO (X is the 16bit size of the whole payload, YY is the virtual channel, O where to start)
+#define NET_CONN_XCHG_REQ 0x1700                  // Send a block and read one back in the same exchange, a word each way per slot | msg bytes 17 YY XX XX then 25 ZZ RR RR (X is the size of the block for channel Y, R the size of the block read from channel Z)
+#define NET_CONN_PINF_REQ 0x1201                  // Tell wii to use current data as player info | msg bytes 12 01 XX XX (last 16 bits are unused)
+#define NET_CONN_CINF_REQ 0x1202                  // Tell wii to use current data as server info | msg bytes 12 02 XX XX (last 16 bits are unused)
+
+#endif // GUARD_CONSTANTS_NET_PROTOCOL_H
@@ -1,6 +1,8 @@
 #ifndef GUARD_CONSTANTS_NETWORK_H
 #define GUARD_CONSTANTS_NETWORK_H
 
+#include "constants/net_protocol.h" // The commands and link constants shared with the wii, see Protocol/protocol.json
+
 #define NET_STAT_OFFLINE 0
 #define NET_STAT_ATTACHED_NO_INTERNET 1 
 #define NET_STAT_ONLINE 2
@@ -13,6 +15,7 @@
 #define NETWORK_MIN_ERROR 3
 
 #define MINIMUM_CHUNK_SIZE 16
+#define FRAMED_CHUNK_SIZE 256 // Framed blocks check each 16 byte frame on its own, so they don't need chunking nearly as much
 
 /**
 * Communicating with the wii while the game is running presents a number of challenges. 
@@ -50,22 +53,18 @@
 * 4. Transmitting data between the wii and the server is much faster but may have a high latency. 
 */
 
-// Special Commands Recognised by the wii
+// Special Commands Recognised by the wii (the rest are in constants/net_protocol.h)
 
-#define NET_CONN_LIFN_REQ 0x2005 // Return information about this devices network connection 
-// Result Value bytes 2005 XX YY IF XX = 0 means tcp connection still busy doing something YY is the state of the connector as seen on the next line)
+// NET_CONN_LIFN_REQ result value bytes 2005 XX YY IF XX = 0 means tcp connection still busy doing something YY is the state of the connector as seen on the next line)
 // CONNECTION_INIT = 0, CONNECTION_SUCCESS, CONNECTION_STARTING, CONNECTION_ERROR_INVALID_IP, CONNECTION_ERROR_COULD_NOT_RESOLVE_IPV4, CONNECTION_ERROR_NO_NETWORK_DEVICE, CONNECTION_ERROR_CONNECTION_FAILED, CONNECTION_ERROR_INVALID_RESPONSE
 
-#define NET_CONN_RECV_REQ 0x2500 // Tell wii to send us data from the buffer for this devices port | msg bytes 25 YY XX XX (X is the 16bit size of msg to receive, YY is the virtual channel)  
 #define NET_CONN_RCHF0_REQ 0x25F0  
 #define NET_CONN_RCHF1_REQ 0x25F1
 
-#define NET_CONN_SEND_REQ 0x1500 // Tell wii you want to send it data              | msg bytes 15 YY XX XX (X is the 16bit size of msg to send, YY is the virtual channel)
 #define NET_CONN_SCH1_REQ 0x1501
 #define NET_CONN_SCH2_REQ 0x1502
 #define NET_CONN_SCH3_REQ 0x1503
 
-#define NET_CONN_TRAN_REQ 0x1300 // Tell wii to send it current data to the server | msg bytes 13 YY XX XX (last 16 bits are size of message to transsmit, YY is the virtual channel)
 #define NET_CONN_TCH1_REQ 0x1301 
 #define NET_CONN_TCH2_REQ 0x1302 
 #define NET_CONN_TCH3_REQ 0x1303 
@@ -74,11 +73,52 @@
 // DO NOT USE THIS! There's a memory allocation issue in the wii channel so you start gettting weird resutls back 
 // #define NET_CONN_BCLR_REQ 0x1200 // Tell wii to clear the whole message buffer     | msg bytes 12 00 XX XX (last 16 bits are unused)
 
-#define NET_CONN_PINF_REQ 0x1201 // Tell wii to use current data as player info    | msg bytes 12 01 XX XX (last 16 bits are unused)
-#define NET_CONN_CINF_REQ 0x1202 // Tell wii to use current data as server info    | msg bytes 12 02 XX XX (last 16 bits are unused)
+/**
+* Link modes
+* Every time a network function starts the gba sends NET_CONN_HANDSHAKE_REQ with the link capabilities it supports,
+* the wii answers with one of the NET_CONN_HANDSHAKE_RES values and the capabilities both sides will use.
+* A channel that doesn't know the handshake never answers, in which case we stay in the original (legacy) mode.
+*
+* NET_CONN_LINK_CAP_FRAMED: NET_CONN_SEND_REQ / NET_CONN_RECV_REQ blocks are split into frames of up to NET_CONN_FRAME_SIZE bytes
+* (bigger blocks use bigger frames so there are never more than NET_CONN_MAX_FRAMES). Each frame is followed by a trailer word
+* (NET_CONN_FRAME_MARK, sequence number, CRC16 of the frame) and once all frames are sent the receiver answers with an ack word
+* (NET_CONN_FACK_RES + round, bitmap of bad frames). Only the bad frames are sent again, for up to NET_CONN_MAX_FRAME_ROUNDS rounds,
+* before the whole block is given up on and retried like a legacy check failure.
+*
+* NET_CONN_LINK_CAP_CALL: (only with NET_CONN_LINK_CAP_FRAMED) a NET_CONN_CALL_REQ does the work of a SEND, TRAN and RECV in one exchange.
+* The gba sends the call command, then the RECV command it wants answered with, then the request as a framed block.
+* Once every frame is good the wii transmits the request and stays quiet until the server has answered, at which point
+* it sends a single NET_CONN_CALL_RES word. The gba puts that word back up to say it's listening, then the wii sends the
+* response as a framed block.
+* If the server doesn't answer within the wii's own timeout NET_CONN_CALL_RES says so and no response follows.
+* A call is repeated in full if anything goes wrong, so only use it for requests the server doesn't mind seeing twice.
+*
+* NET_CONN_LINK_CAP_SIZED_CALL: (only with NET_CONN_LINK_CAP_CALL) NET_CONN_CALL_RES carries how many bytes of the answer
+* the wii is about to send, which is less than the gba asked for when the server's message is shorter (e.g. a compressed payload).
+*
+* NET_CONN_LINK_CAP_STREAM: a NET_CONN_STRM_REQ reads a whole payload (up to NET_CONN_STREAM_MAX_SIZE) from a virtual channel as one run of words.
+* The gba sends the stream command with the payload's total size, then NET_CONN_STRM_FROM with the offset to start from.
+* The wii sends every word from there to the end without waiting, with a trailer word (NET_CONN_FRAME_MARK, segment number,
+* CRC16 of the segment) after every NET_CONN_STREAM_SEGMENT_SIZE bytes. The gba doesn't answer until the stream is over,
+* then answers with NET_CONN_SACK_RES and how much of the payload it now has. If that's short of the total (or the link dropped
+* part way through) the next NET_CONN_STRM_REQ starts from there, so nothing that already arrived safely is sent again.
+*
+* NET_CONN_LINK_CAP_LIFN_PUSH: once the wii has answered a NET_CONN_LIFN_REQ with anything short of ready (and not an error), it writes
+* the answer word to the gba again every time it changes, until it's ready or the gba sends another command. The gba doesn't put
+* anything up while it waits, it just checks JOY_RECV once a frame (see NetConnLink_TakeStatusPush) so it finds out the server is
+* there without polling the wii. It still asks again every so often in case a push was missed.
+*
+* NET_CONN_LINK_CAP_DUPLEX: (only with NET_CONN_LINK_CAP_FRAMED) a NET_CONN_XCHG_REQ moves a block each way in one exchange, for when
+* both ends have something to send. The gba sends the exchange command with the size of its block, then the RECV command for the
+* block it wants back (as a call does). A JOYBUS command only ever carries data one way, so every word still costs a command, what's
+* saved is the second command, its acks and the frames the game waits between two blocks. Frame n of both blocks moves in the same slots:
+* the wii writes its next word of the frame and reads the gba's, with zeroes for whichever side has run out, then the two trailers
+* the same way. At the end of a round the wii writes its ack for the gba's frames and the gba answers with its ack for the wii's,
+* then both send again whatever the other asked for. The two blocks can't overlap in the wii's buffer.
+*/
+#define NET_CONN_LINK_CAPS (NET_CONN_LINK_CAP_FRAMED | NET_CONN_LINK_CAP_CALL | NET_CONN_LINK_CAP_STREAM | NET_CONN_LINK_CAP_SIZED_CALL | NET_CONN_LINK_CAP_LIFN_PUSH | NET_CONN_LINK_CAP_DUPLEX) // Everything this rom supports
 
-// Special Commands Comming from the wii
-#define NET_CONN_CHCK_RES 0x1101 // Returning check bytes for the last data sent   | msg bytes 12 01 XX XX (X are the 16bit check bytes, made by XORing each seq 16bits of the msg)
+#define NET_CONN_CCH2_REQ 0x1602
 
 /**
 *
@@ -97,13 +137,30 @@
 **/
 
 #define MAX_CONNECTION_LOOPS 20000
+#define MAX_HANDSHAKE_LOOPS 4000 // Shorter, as an older channel will never answer
+#define MAX_HANDSHAKE_TRIES 3 // A lost answer looks the same as an older channel, so a few tries before settling on legacy
+#define MAX_CALL_LOOPS 750000 // Longer, the wii is waiting on the server. Comfortably more than the wii's own call timeout (about 1.5 seconds)
 #define MAX_CONNECTION_RETRIES 20
+#define MAX_STREAM_STALLS 3 // Link errors a stream can have without getting any further before the payload is read in chunks instead
+#define MAX_BACKGROUND_IDLE_FRAMES 3 // Frames a background block can go without a word moving before we decide the wii has stopped
+#define MAX_BACKGROUND_CALL_FRAMES 150 // Longer, the wii is waiting on the server (see MAX_CALL_LOOPS)
 #define RETRIES_LEFT_CANCEL -2
 
 #define R_JOYBUS  0xC000
 #define JOY_WRITE 0x2
 #define JOY_READ  0x4
 #define JOY_RW    0x6
+#define JOY_IRQ   0x40
+
+/**
+* Compressed payloads
+* Requests for the bigger payloads put NET_CONN_LZ77_MARK after their own data to say the gba can take the answer compressed.
+* Older servers never look there. Newer ones answer in the BIOS's LZ77 format (see LZ77UnCompWram) whenever that's smaller:
+* - A battle team is just sent compressed. A raw team can't start with the LZ77 header for its size, the first species would be 0x3010
+* - A trade keeps its 16 byte header raw so the partner check still works, and puts NET_CONN_LZ77_MARK and the compressed size
+*   (big endian) in the last 4 bytes of the header's padding. The compressed mon follows in place of the raw one
+* The wii passes them on untouched, with NET_CONN_LINK_CAP_SIZED_CALL a call only moves what the server actually sent.
+*/
 
 // The list of network functions that are available to call
 #define NET_CONN_START_LINK_FUNC        0
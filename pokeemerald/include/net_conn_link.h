@@ -0,0 +1,64 @@
+#ifndef GUARD_NET_CONN_LINK_H
+#define GUARD_NET_CONN_LINK_H
+
+/**
+* The JOYBUS half of the network code. This only knows how to move a block of data to/from the wii
+* and verify it against the check bytes the wii returns. Everything about what the data means lives in net_conn.c
+*
+* It's kept separate (and free of any game headers) so the exact same code can be built on a PC
+* against the link simulator in PokecomChannel/LinkSimulator
+*
+* Framed blocks, calls and streams can be moved in the background by the JOY interrupt (see NetConnLink_SetBackground).
+* Starting one then returns NET_CONN_LINK_BUSY straight away and NetConnLink_PollBlock says how it went, so the game
+* carries on while the data moves. Everything else is still polled as before, those are only ever a few words
+*/
+
+// Outcome of a single block transfer
+enum {
+    NET_CONN_LINK_OK = 0,       // Block was transferred and the check bytes matched (or checks were disabled)
+    NET_CONN_LINK_CHECK_FAILED, // Block was transferred but the check bytes didn't match, it's safe to try again straight away
+    NET_CONN_LINK_ERROR,        // The wii stopped responding / the player canceled
+    NET_CONN_LINK_BUSY          // Block is moving in the background, check on it with NetConnLink_PollBlock
+};
+
+// Send length bytes of data to the wii, prefixed by the 4 byte command (cmd + length)
+u8 NetConnLink_TransferBlock(u16 cmd, const u8 *data, u16 length, bool8 disableChecks, u8 taskId);
+// Send the 4 byte command (cmd + length) then read length bytes back from the wii
+u8 NetConnLink_ReceiveBlock(u16 cmd, u8 *data, u16 length, bool8 disableChecks, u8 taskId);
+// NET_CONN_CALL_REQ, send length bytes of data to be transmitted and read back responseLength bytes of the server's answer (as if by recvCmd).
+// Needs NET_CONN_LINK_CAP_CALL, a check failure means the whole call has to be made again
+u8 NetConnLink_CallBlock(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength, u8 taskId);
+// How much of the answer the last call read back. Only ever less than responseLength with NET_CONN_LINK_CAP_SIZED_CALL
+u16 NetConnLink_GetCallResponseLength(void);
+// NET_CONN_STRM_REQ, read the length byte payload from *offset onwards. *offset is moved on past whatever arrived safely, even when
+// the result isn't NET_CONN_LINK_OK, so calling again with it carries on from there. Needs NET_CONN_LINK_CAP_STREAM
+u8 NetConnLink_StreamBlock(u16 cmd, u8 *data, u16 length, u16 *offset, u8 taskId);
+// NET_CONN_XCHG_REQ, send length bytes of data and read back responseLength bytes (as if by recvCmd) in the same exchange.
+// Needs NET_CONN_LINK_CAP_DUPLEX, and is always polled. A check failure in either direction means the whole exchange has to be made again
+u8 NetConnLink_ExchangeBlock(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength, u8 taskId);
+
+// With NET_CONN_LINK_CAP_LIFN_PUSH, once a NET_CONN_LIFN_REQ answer wasn't ready the wii writes the answer again whenever it changes.
+// Returns TRUE with it (in the same 4 bytes the receive gave) if one has come in, nothing goes over the link. Only between blocks
+bool8 NetConnLink_TakeStatusPush(u8 *data);
+
+// Only turn this on once NetConnLink_SerialIntr is the serial interrupt callback and the serial interrupt is enabled
+void NetConnLink_SetBackground(bool8 enabled);
+// Once a frame while a block is NET_CONN_LINK_BUSY. Gives the block's result once it's over (the data and offset aren't safe to use until then)
+u8 NetConnLink_PollBlock(void);
+// Drops whatever block is moving in the background, e.g. when the player cancels
+void NetConnLink_StopBlock(void);
+void NetConnLink_SerialIntr(void);
+
+// Agree the link mode with the wii (see NET_CONN_HANDSHAKE_REQ). Returns the NET_CONN_LINK_CAP_* flags now in use, 0 means legacy mode
+// Tries a few times, as a lost answer looks the same as an older channel. If none gets through the caps agreed before are kept
+u16 NetConnLink_Handshake(u8 taskId);
+// Back to legacy mode until the next handshake gets an answer, for when a new connection starts
+void NetConnLink_ForgetCaps(void);
+u16 NetConnLink_GetCaps(void);
+// Frames that had to be sent again during the last framed block
+u16 NetConnLink_GetFramesResent(void);
+
+// Must be provided by whatever drives the link. It's polled while waiting on the wii so a stuck transfer can be backed out of
+bool32 NetConnLink_CheckCanceled(u8 taskId);
+
+#endif //GUARD_NET_CONN_LINK_H
@@ -12,6 +12,7 @@
 #include "libgcnmultiboot.h"
 #include "gpu_regs.h"
 #include "net_conn.h"
+#include "net_conn_link.h"
 #include "constants/network.h"
 #include "battle_tower.h"
 #include "constants/trainers.h"
@@ -23,6 +24,7 @@
 #include "mail.h"
 #include "item_menu.h"
 #include "overworld.h"
+#include "decompress.h"
 
 // Player name + 1 + Gender + Special Warp Flag + Trainer ID)
 #define PLAYER_INFO_LENGTH (PLAYER_NAME_LENGTH + 1 + 1 + 1 + TRAINER_ID_LENGTH)
@@ -32,6 +34,7 @@
 #define NET_GAME_NAME_LENGTH 20
 static const u8 sNetGameName[] = _("Emerald Net 0.1.3   ");
 
+// Can list backup servers after a comma (up to 4, 63 characters in all), the channel moves on to the next if one is down
 #define NET_SERVER_ADDR_LENGTH 14
 static const u8 sNetServerAddr[] = _("127.0.0.1:9000");
 
@@ -43,6 +46,12 @@ static const u8 sServerName[] = _("INCOMMING...\n");
 
 #define DOWNLOAD_MART_SIZE 6
 
+// Payloads that can come back compressed (see NET_CONN_LZ77_MARK) are received here, then unpacked to wherever they're used
+#define PAYLOAD_RECEIVE_OFFSET 0x80
+
+// The end of a trade's 16 byte header is the packed header for the mon that follows it
+#define TRADE_PACKED_HEADER_OFFSET 12
+
 static const u8 sDot[] = _("·");
 static const u8 sWaitingMessage[] = _("Connecting To Server:");
 static const u8 sExchangeMessage[] = _("Partner Found! Link starting:");
@@ -108,11 +117,14 @@ static void Task_EndReadMailConnection(u8 taskId);
 
 static void DoTransferDataBlock(u8 taskId);
 static void DoReceiveDataBlock(u8 taskId);
-
-void xfer16(u16 data1, u16 data2, u8 taskId);
-void xfer32(u32 data, u8 taskId);
-u32 recv32(u8 taskId);
-void waitForTransmissionFinish(u8 taskId, u16 readOrWriteFlag); // i.e JOY_READ or JOY_WRITE
+static void DoCallDataBlock(u8 taskId);
+static void DoStreamDataBlock(u8 taskId);
+static bool8 CanUseCall(void);
+static bool8 CanUseStream(void);
+static bool8 CanUseStatusPush(void);
+static u16 GetChunkSize(void);
+static bool8 ReadPackedHeader(const u8 *header, u16 size, bool8 *compressed, u16 *packedSize);
+static bool8 UnpackPayload(void *dest, u16 size);
 
 // WARNING! configureSendRecvMgrChunked has only been tested sending multiples of 16 bytes. 
 // It should work correctly sending any amount of data, this is just and FYI you will be running untested code if you don't send mutiples of 16 
@@ -121,9 +133,23 @@ void waitForTransmissionFinish(u8 taskId, u16 readOrWriteFlag); // i.e JOY_READ
 * In the chunked version messages are split into chunks and verified separately. This adds some overhead 
 * as more verification messages need to be sent. However it reduces the amount of data we need to discard if there is an issue.
 * As a rule of thumb if you are sending 16 bytes or less don't use chunked. If you are sending more, then chunk to 16 byte blocks.
+* Framed blocks (NET_CONN_LINK_CAP_FRAMED) already only resend the 16 byte frames that went wrong, so use GetChunkSize() to get bigger chunks with them.
 */
 void configureSendRecvMgr(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep);
-void configureSendRecvMgrChunked(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep, u8 chunkSize);
+void configureSendRecvMgrChunked(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep, u16 chunkSize);
+
+/*
+* Only when the wii supports NET_CONN_LINK_CAP_CALL (see CanUseCall). Sends the request, has the wii transmit it and reads back the answer
+* in a single exchange, instead of a SEND, a TRAN, a wait and a RECV. If anything goes wrong we go back to retryPoint, so the request can be rebuilt
+*/
+void configureSendRecvMgrCall(u16 cmd, vu32 * dataStart, u16 length, u16 recvCmd, vu32 * recvStart, u16 recvLength, u8 nextProcessStep);
+
+/*
+* Only when the wii supports NET_CONN_LINK_CAP_STREAM (see CanUseStream). Reads the whole of what cmd (a NET_CONN_RECV_REQ) would, however
+* big, in one go with a single check at the end. If that check fails or the link drops we carry on from the last good segment rather than starting again.
+* If the link keeps dropping without the stream getting any further, the rest of the function reads in chunks instead (see MAX_STREAM_STALLS)
+*/
+void configureSendRecvMgrStream(u16 cmd, vu32 * dataStart, u16 length, u8 nextProcessStep);
 
 enum {
     NET_CONN_STATE_INIT = 0,
@@ -131,7 +157,9 @@ enum {
     NET_CONN_STATE_RECEIVE,
     NET_CONN_STATE_PROCESS,
     NET_CONN_STATE_ERROR,
-    NET_CONN_STATE_DONE
+    NET_CONN_STATE_DONE,
+    NET_CONN_STATE_CALL,
+    NET_CONN_STATE_STREAM
 };
 
 struct SendRecvMgr
@@ -149,6 +177,15 @@ struct SendRecvMgr
     u8 retryPoint;         // Where to pick up from when doing a retry 
     bool8 disableChecks;   // If true all msg check bytes will be ignored. Turning this off is a bad idea unless you're A) only sending a 32 bit value /  B) need speed over accuracy and can ignore junk
     u8 repeatedStepCount;  // Times we've sucessfully sequentially done a process step. Allows for steps the need to run x many times / large transfers that need to be spit 
+    u16 recvCmd;           // NET_CONN_STATE_CALL only, the receive command the answer is read with
+    vu32 *recvStart;       // NET_CONN_STATE_CALL only, where the answer goes
+    u16 recvLength;        // NET_CONN_STATE_CALL only, length of the answer
+    u16 streamOffset;      // NET_CONN_STATE_STREAM only, how much of the payload has arrived safely
+    bool8 streamLost;      // NET_CONN_STATE_STREAM only, the link dropped so we need to handshake again before carrying on
+    u16 streamErrorOffset; // NET_CONN_STATE_STREAM only, streamOffset when the link last dropped
+    u8 streamStalls;       // NET_CONN_STATE_STREAM only, times the link dropped without the stream getting any further
+    bool8 streamFallback;  // The link is too noisy for streams, so CanUseStream says no until the next network function
+    bool8 blockRunning;    // The current block is moving in the background (see NetConnLink_SetBackground), so it's only checked on each frame
 };
 static struct SendRecvMgr sSendRecvMgr;
 
@@ -167,7 +204,10 @@ static void (* const sNetConnFunctions[])(void) =
 void CallNetworkFunction(void)
 {
     if (sSendRecvMgr.state == 0)
+    {
         CpuFill32(0, &sSendRecvMgr, sizeof(sSendRecvMgr));
+        NetConnLink_ForgetCaps();
+    }
 
     sNetConnFunctions[gSpecialVar_0x8004]();
 
@@ -210,10 +250,11 @@ static void Task_NetworkTaskLoop(u8 taskId)
     switch (sSendRecvMgr.state)
     {
         case NET_CONN_STATE_INIT:
-            if (REG_RCNT != R_JOYBUS)
+            if (REG_RCNT != R_JOYBUS || gMain.serialCallback != NetConnLink_SerialIntr)
                 NetConnResetSerial();
 
             SetSuppressLinkErrorMessage(TRUE);
+            NetConnLink_Handshake(taskId);
             sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
             break;
         case NET_CONN_STATE_SEND:
@@ -222,6 +263,12 @@ static void Task_NetworkTaskLoop(u8 taskId)
         case NET_CONN_STATE_RECEIVE:
             DoReceiveDataBlock(taskId);
             break;
+        case NET_CONN_STATE_CALL:
+            DoCallDataBlock(taskId);
+            break;
+        case NET_CONN_STATE_STREAM:
+            DoStreamDataBlock(taskId);
+            break;
         case NET_CONN_STATE_PROCESS: 
             gTasks[taskId].func = sSendRecvMgr.onProcess;
             break;
@@ -251,6 +298,8 @@ static bool32 CheckLinkCanceled(u8 taskId)
     if (((JOY_NEW(B_BUTTON)) || JOY_HELD(B_BUTTON)) && sSendRecvMgr.allowCancel == TRUE)
     {
         sSendRecvMgr.retriesLeft = RETRIES_LEFT_CANCEL + 1;
+        sSendRecvMgr.blockRunning = FALSE;
+        NetConnLink_StopBlock();
         gTasks[taskId].func = sSendRecvMgr.onCancel;
         return TRUE;
     }
@@ -260,6 +309,9 @@ static bool32 CheckLinkCanceled(u8 taskId)
 static void NetConnDisableSerial(void)
 {
     sSendRecvMgr.state = NET_CONN_STATE_INIT;
+    sSendRecvMgr.blockRunning = FALSE;
+    NetConnLink_SetBackground(FALSE);
+    SetSerialCallback(NULL);
 
     // I have no idea if his is the proper way to end the link  ¯\_(ツ)_/¯
     DisableInterrupts(INTR_FLAG_TIMER3 | INTR_FLAG_SERIAL);
@@ -277,6 +329,10 @@ static void NetConnEnableSerial(void)
     DisableInterrupts(INTR_FLAG_TIMER3 | INTR_FLAG_SERIAL);
     REG_RCNT = R_JOYBUS;
     EnableInterrupts(INTR_FLAG_VBLANK | INTR_FLAG_VCOUNT | INTR_FLAG_TIMER3 | INTR_FLAG_SERIAL); // These may not all be needed? needs checking
+
+    // Framed blocks are moved by the JOY interrupt from here on, so the game keeps running while they're on the wire
+    SetSerialCallback(NetConnLink_SerialIntr);
+    NetConnLink_SetBackground(TRUE);
 }
 
 static void NetConnResetSerial(void) 
@@ -287,164 +343,198 @@ static void NetConnResetSerial(void)
 
 static void DoTransferDataBlock(u8 taskId)
 {
-    u32 i = 0;
-    u8 * dataStart;
-    u16 checkBytes = 0xFFFF;
-    u8 transBuff[4];
-    u32 resBuff = 0;
-
-    JOY_CNT |= JOY_RW;
-    for (i = 0; JOY_CNT&JOY_READ && i <= MAX_CONNECTION_LOOPS; i++) 
-    { 
-        /* Wait for the connection to become ready */ 
-        if (CheckLinkCanceled(taskId) == TRUE || i == MAX_CONNECTION_LOOPS)
-        {
-            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
-            return;
-        }
-
-    }
-
-    xfer16(sSendRecvMgr.cmd, sSendRecvMgr.length, taskId);
-    checkBytes ^= sSendRecvMgr.cmd;
-    checkBytes ^= sSendRecvMgr.length;
+    u8 result;
 
-    if (sSendRecvMgr.state == NET_CONN_STATE_ERROR)
-        return;
+    if (sSendRecvMgr.blockRunning)
+        result = NetConnLink_PollBlock();
+    else
+        result = NetConnLink_TransferBlock(sSendRecvMgr.cmd, (const u8 *) sSendRecvMgr.dataStart, sSendRecvMgr.length, sSendRecvMgr.disableChecks, taskId);
 
-    dataStart = (u8 *) sSendRecvMgr.dataStart;
+    sSendRecvMgr.blockRunning = (result == NET_CONN_LINK_BUSY);
 
-    for(i = 0; i < sSendRecvMgr.length; i+=4)
+    switch (result)
     {
-        transBuff[0] = dataStart[i];
-        transBuff[1] = i + 1 < sSendRecvMgr.length ? dataStart[i + 1] : 0;
-        transBuff[2] = i + 2 < sSendRecvMgr.length ? dataStart[i + 2] : 0;
-        transBuff[3] = i + 3 < sSendRecvMgr.length ? dataStart[i + 3] : 0;
-
-        xfer32((u32) (transBuff[0] + (transBuff[1] << 8) + (transBuff[2] << 16) + (transBuff[3] << 24)), taskId);
+        case NET_CONN_LINK_BUSY:
+            break;
+        case NET_CONN_LINK_OK:
+            sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
+            break;
+        case NET_CONN_LINK_ERROR:
+            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+            break;
+        case NET_CONN_LINK_CHECK_FAILED:
+        default:
+            // Stay in the send state so the whole block is sent again next frame
+            break;
+    }
+}
 
-        if (sSendRecvMgr.state == NET_CONN_STATE_ERROR)
-            return;
+static void DoReceiveDataBlock(u8 taskId)
+{
+    u8 result;
 
-        checkBytes ^= (u16) (transBuff[0] + (transBuff[1] << 8));
-        checkBytes ^= (u16) (transBuff[2] + (transBuff[3] << 8));
+    if (sSendRecvMgr.blockRunning)
+        result = NetConnLink_PollBlock();
+    else
+        result = NetConnLink_ReceiveBlock(sSendRecvMgr.cmd, (u8 *) sSendRecvMgr.dataStart, sSendRecvMgr.length, sSendRecvMgr.disableChecks, taskId);
 
-    }
-    
-    resBuff = recv32(taskId);
+    sSendRecvMgr.blockRunning = (result == NET_CONN_LINK_BUSY);
 
-    if (sSendRecvMgr.disableChecks || (resBuff ^ (u32) ((NET_CONN_CHCK_RES << 16) | (checkBytes & 0xFFFF))) == 0)
+    switch (result)
     {
-        JOY_TRANS = 0;
-        sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
-    }
-    else
-    {
-        for (i = 0; i < 300; i++) {}
+        case NET_CONN_LINK_BUSY:
+            break;
+        case NET_CONN_LINK_OK:
+            sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
+            break;
+        case NET_CONN_LINK_ERROR:
+            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+            break;
+        case NET_CONN_LINK_CHECK_FAILED:
+        default:
+            break;
     }
 }
 
-static void DoReceiveDataBlock(u8 taskId)
+static void DoCallDataBlock(u8 taskId)
 {
-    u32 i = 0;
-    u8 * dataStart;
-    u16 checkBytes = 0xFFFF;
-    u8 transBuff[4];
-    u32 resBuff = 0;
-
-    JOY_CNT |= JOY_RW;
-    for (i = 0; JOY_CNT&JOY_READ && i <= MAX_CONNECTION_LOOPS; i++) 
-    { 
-        /* Wait for the connection to become ready */ 
-        if (CheckLinkCanceled(taskId) == TRUE || i == MAX_CONNECTION_LOOPS)
-        {
-            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
-            return;
-        }
+    u8 result;
 
-    }
+    if (sSendRecvMgr.blockRunning)
+        result = NetConnLink_PollBlock();
+    else
+        result = NetConnLink_CallBlock(sSendRecvMgr.cmd, (const u8 *) sSendRecvMgr.dataStart, sSendRecvMgr.length, sSendRecvMgr.recvCmd, (u8 *) sSendRecvMgr.recvStart, sSendRecvMgr.recvLength, taskId);
 
-    xfer16(sSendRecvMgr.cmd, (u16) sSendRecvMgr.length, taskId);
+    sSendRecvMgr.blockRunning = (result == NET_CONN_LINK_BUSY);
 
-    if (sSendRecvMgr.state == NET_CONN_STATE_ERROR)
-        return;
+    switch (result)
+    {
+        case NET_CONN_LINK_BUSY:
+            break;
+        case NET_CONN_LINK_OK:
+            sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
+            break;
+        case NET_CONN_LINK_ERROR:
+            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+            break;
+        case NET_CONN_LINK_CHECK_FAILED:
+        default:
+            // The answer may have been written over the request, so build it again before the next try
+            sSendRecvMgr.nextProcessStep = sSendRecvMgr.retryPoint;
+            sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
+            break;
+    }
+}
 
-    dataStart = (u8 *) sSendRecvMgr.dataStart;
+static void DoStreamDataBlock(u8 taskId)
+{
+    u8 result;
 
-    for(i = 0; i < sSendRecvMgr.length; i+=4)
+    if (sSendRecvMgr.streamLost)
     {
-        resBuff = recv32((u32) (taskId));
+        // Like NET_CONN_STATE_INIT, except we stay on the stream instead of going back to the retry point
+        sSendRecvMgr.streamLost = FALSE;
+        NetConnResetSerial();
+        NetConnLink_Handshake(taskId);
 
-        transBuff[0] = (resBuff >> 24) & 0xFF;
-        transBuff[1] = (resBuff >> 16) & 0xFF;
-        transBuff[2] = (resBuff >> 8) & 0xFF;
-        transBuff[3] = resBuff & 0xFF;
-
-        dataStart[i] = transBuff[0];
-        if (i + 1 < sSendRecvMgr.length) dataStart[i + 1] = transBuff[1];
-        if (i + 2 < sSendRecvMgr.length) dataStart[i + 2] = transBuff[2];
-        if (i + 3 < sSendRecvMgr.length) dataStart[i + 3] = transBuff[3];
+        if (!CanUseStream())
+            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+        return;
+    }
 
-        if (sSendRecvMgr.state == NET_CONN_STATE_ERROR)
-            return;
+    if (sSendRecvMgr.blockRunning)
+        result = NetConnLink_PollBlock();
+    else
+        result = NetConnLink_StreamBlock(sSendRecvMgr.cmd, (u8 *) sSendRecvMgr.dataStart, sSendRecvMgr.length, &sSendRecvMgr.streamOffset, taskId);
 
-        checkBytes ^= (u16) (transBuff[0] + (transBuff[1] << 8));
-        checkBytes ^= (u16) (transBuff[2] + (transBuff[3] << 8));
+    sSendRecvMgr.blockRunning = (result == NET_CONN_LINK_BUSY);
 
+    switch (result)
+    {
+        case NET_CONN_LINK_BUSY:
+            break;
+        case NET_CONN_LINK_OK:
+            sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
+            break;
+        case NET_CONN_LINK_ERROR:
+            JOY_TRANS = 0;
+            if (sSendRecvMgr.streamOffset == sSendRecvMgr.streamErrorOffset && ++sSendRecvMgr.streamStalls >= MAX_STREAM_STALLS)
+            {
+                // Going back to the retry point picks the chunked receive, which gets through where a whole stream can't
+                sSendRecvMgr.streamFallback = TRUE;
+                sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+            }
+            else if (sSendRecvMgr.retriesLeft-- <= 0)
+            {
+                sSendRecvMgr.state = NET_CONN_STATE_ERROR;
+            }
+            else
+            {
+                sSendRecvMgr.streamErrorOffset = sSendRecvMgr.streamOffset;
+                sSendRecvMgr.streamLost = TRUE;
+            }
+            break;
+        case NET_CONN_LINK_CHECK_FAILED:
+        default:
+            // streamOffset has moved on past the good segments, so the next frame only asks for the rest
+            break;
     }
+}
 
-    resBuff = recv32(taskId);
+static bool8 CanUseCall(void)
+{
+    return (NetConnLink_GetCaps() & NET_CONN_LINK_CAP_CALL) != 0;
+}
 
-    if (sSendRecvMgr.disableChecks || (resBuff ^ (u32) ((NET_CONN_CHCK_RES << 16) | (checkBytes & 0xFFFF))) == 0)
-    {
-        JOY_RECV = 0;
-        sSendRecvMgr.state = NET_CONN_STATE_PROCESS;
-    }
-    else
-    {
-        for (i = 0; i < 300; i++) {}
-    }
+static bool8 CanUseStream(void)
+{
+    return (NetConnLink_GetCaps() & NET_CONN_LINK_CAP_STREAM) != 0 && !sSendRecvMgr.streamFallback;
 }
 
-/**
-* The way joybus coms work is that the wii is always master and the GBA always slave
-* This means that the GBA cannot initiate a transfer, only respond with up to 4 bytes
-* each time the wii sends a 4 byte message
-*/
-void xfer16(u16 data1, u16 data2, u8 taskId) 
+static bool8 CanUseStatusPush(void)
 {
-    JOY_CNT |= JOY_RW;
-    JOY_TRANS_L = data1;
-    JOY_TRANS_H = data2;
-    waitForTransmissionFinish(taskId, JOY_READ);
+    return (NetConnLink_GetCaps() & NET_CONN_LINK_CAP_LIFN_PUSH) != 0;
 }
 
-void xfer32(u32 data, u8 taskId) 
+static u16 GetChunkSize(void)
 {
-    JOY_CNT |= JOY_RW;
-    JOY_TRANS = data;
-    waitForTransmissionFinish(taskId, JOY_READ);
+    return (NetConnLink_GetCaps() & NET_CONN_LINK_CAP_FRAMED) ? FRAMED_CHUNK_SIZE : MINIMUM_CHUNK_SIZE;
 }
 
-u32 recv32(u8 taskId) 
+/*
+* Reads the NET_CONN_PACKED_HEADER_SIZE header the server puts in front of a payload of size bytes when we asked with
+* NET_CONN_LZ77_MARK, which says whether it's compressed and how many bytes were sent. Returns FALSE if it's neither
+* NET_CONN_LZ77_MARK nor NET_CONN_RAW_MARK, or gives a size that can't be right, rather than guess from the payload
+*/
+static bool8 ReadPackedHeader(const u8 *header, u16 size, bool8 *compressed, u16 *packedSize)
 {
-    JOY_CNT |= JOY_RW;
-    waitForTransmissionFinish(taskId, JOY_WRITE);
-    return JOY_RECV;
+    u16 mark = (u16) (header[0] << 8 | header[1]);
+
+    *packedSize = (u16) (header[2] << 8 | header[3]);
+    *compressed = (mark == NET_CONN_LZ77_MARK);
+
+    if (mark == NET_CONN_RAW_MARK)
+        return *packedSize == size;
+
+    // The server only compresses what comes out smaller, and there's always the LZ77 header
+    return *compressed && *packedSize > 4 && *packedSize < size;
 }
 
-void waitForTransmissionFinish(u8 taskId, u16 readOrWriteFlag)
+// Unpacks a compressed payload received at PAYLOAD_RECEIVE_OFFSET to dest. Returns FALSE without touching dest if its LZ77 header isn't for size bytes
+static bool8 UnpackPayload(void *dest, u16 size)
 {
-    u32 i = 0;
+    const u32 *src = (const u32 *) &gStringVar3[PAYLOAD_RECEIVE_OFFSET];
 
-    for (i = 0; (JOY_CNT&readOrWriteFlag) == 0; i++)
-    {
-        if (i > MAX_CONNECTION_LOOPS || CheckLinkCanceled(taskId) == TRUE)
-        {
-            sSendRecvMgr.state = NET_CONN_STATE_ERROR;
-            return;
-        }
-    }
+    if (*src != (u32) (NET_CONN_LZ77_TYPE | (size << 8)))
+        return FALSE;
+
+    LZDecompressWram(src, dest);
+    return TRUE;
+}
+
+bool32 NetConnLink_CheckCanceled(u8 taskId)
+{
+    return CheckLinkCanceled(taskId);
 }
 
 void configureSendRecvMgr(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep)
@@ -466,7 +556,7 @@ void configureSendRecvMgr(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 ne
     sSendRecvMgr.nextProcessStep = nextProcessStep;
 }   
 
-void configureSendRecvMgrChunked(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep, u8 chunkSize)
+void configureSendRecvMgrChunked(u16 cmd, vu32 * dataStart, u16 length, u8 state, u8 nextProcessStep, u16 chunkSize)
 {
     if (length <= chunkSize || chunkSize <= 0)
     {
@@ -486,6 +576,22 @@ void configureSendRecvMgrChunked(u16 cmd, vu32 * dataStart, u16 length, u8 state
     }
 }
 
+void configureSendRecvMgrCall(u16 cmd, vu32 * dataStart, u16 length, u16 recvCmd, vu32 * recvStart, u16 recvLength, u8 nextProcessStep)
+{
+    configureSendRecvMgr(cmd, dataStart, length, NET_CONN_STATE_CALL, nextProcessStep);
+    sSendRecvMgr.recvCmd    = recvCmd;
+    sSendRecvMgr.recvStart  = recvStart;
+    sSendRecvMgr.recvLength = recvLength;
+}
+
+void configureSendRecvMgrStream(u16 cmd, vu32 * dataStart, u16 length, u8 nextProcessStep)
+{
+    configureSendRecvMgr(NET_CONN_STRM_REQ | (cmd & 0xFF), dataStart, length, NET_CONN_STATE_STREAM, nextProcessStep);
+    sSendRecvMgr.streamOffset      = 0;
+    sSendRecvMgr.streamLost        = FALSE;
+    sSendRecvMgr.streamErrorOffset = 0;
+    sSendRecvMgr.streamStalls      = 0;
+}
 
 /**
 *   =====================================================================
@@ -545,12 +651,20 @@ static void Task_LinkupProcess(u8 taskId)
             break;
 
         case LINKUP_USE_DATA_AS_NETWORK_INFO:
-            configureSendRecvMgr(NET_CONN_CINF_REQ, 0, 0, NET_CONN_STATE_SEND, LINKUP_WAIT_FOR_SERVER_TO_CONNECT);
+            // The wii tells us when the server is there if it can, so ask straight away rather than after the first wait
+            configureSendRecvMgr(NET_CONN_CINF_REQ, 0, 0, NET_CONN_STATE_SEND, CanUseStatusPush() ? LINKUP_REQUEST_NETWORK_STATUS : LINKUP_WAIT_FOR_SERVER_TO_CONNECT);
             break;
 
         case LINKUP_WAIT_FOR_SERVER_TO_CONNECT:
-            if (DoWaitTextAnimation(60, sWaitingMessage) > 0)
+            if (NetConnLink_TakeStatusPush((u8 *) &gStringVar3[0]))
+            {
+                sSendRecvMgr.repeatedStepCount = 0;
+                sSendRecvMgr.nextProcessStep = LINKUP_HANDLE_NETWORK_STATUS_OUTCOME;
+            }
+            else if (DoWaitTextAnimation(60, sWaitingMessage) > 0)
+            {
                 sSendRecvMgr.nextProcessStep = LINKUP_REQUEST_NETWORK_STATUS;
+            }
             break;
 
         case LINKUP_REQUEST_NETWORK_STATUS:
@@ -587,7 +701,10 @@ static void Task_LinkupProcess(u8 taskId)
                 sSendRecvMgr.retryPoint = LINKUP_RECEIVE_WELCOME_MESSAGE;
                 StringCopy(gStringVar3, sServerName);
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[SERVER_NAME_LENGTH], WELCOME_MSG_LENGTH, NET_CONN_STATE_RECEIVE, LINKUP_FINISH, MINIMUM_CHUNK_SIZE);
+            if (CanUseStream())
+                configureSendRecvMgrStream(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[SERVER_NAME_LENGTH], WELCOME_MSG_LENGTH, LINKUP_FINISH);
+            else
+                configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[SERVER_NAME_LENGTH], WELCOME_MSG_LENGTH, NET_CONN_STATE_RECEIVE, LINKUP_FINISH, GetChunkSize());
             break;
 
         case LINKUP_FINISH:
@@ -646,14 +763,22 @@ static void Task_DownloadBattleProcess(u8 taskId)
     {
         case DOWNLOAD_BATTLE_SEND_REQUEST: // Puts request data on the wii  (at address channel 2)
             gStringVar3[0] = 'B'; gStringVar3[1] = 'A'; gStringVar3[2] = '_'; gStringVar3[3] = '1'; // The '1' at the end is for if we want multiple downloadable trainers
-            configureSendRecvMgr(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_SEND, DOWNLOAD_BATTLE_TRANSMIT_REQUEST);
+            gStringVar3[4] = NET_CONN_LZ77_MARK >> 8; gStringVar3[5] = NET_CONN_LZ77_MARK & 0xFF; gStringVar3[6] = 0; gStringVar3[7] = 0; // We can take the team compressed
+            if (CanUseCall())
+            {
+                // Newer channels can do the send, transmit, wait and receive below in one go
+                sSendRecvMgr.retryPoint = DOWNLOAD_BATTLE_SEND_REQUEST;
+                configureSendRecvMgrCall(NET_CONN_CCH2_REQ, (vu32 *) &gStringVar3[0], 8, NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[PAYLOAD_RECEIVE_OFFSET - NET_CONN_PACKED_HEADER_SIZE], NET_CONN_PACKED_HEADER_SIZE + DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE, DOWNLOAD_BATTLE_FINISH);
+                break;
+            }
+            configureSendRecvMgr(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 8, NET_CONN_STATE_SEND, DOWNLOAD_BATTLE_TRANSMIT_REQUEST);
             break;
 
         case DOWNLOAD_BATTLE_TRANSMIT_REQUEST: // Sends request data to the server (from address channel 2)
             sSendRecvMgr.disableChecks = TRUE; // The wii code currently dosn't support transmit checks so they need to be off for transmit
             sSendRecvMgr.retryPoint = DOWNLOAD_BATTLE_TRANSMIT_REQUEST;
             CpuFill32(0, &gStringVar3, sizeof(gStringVar3));  
-            configureSendRecvMgr(NET_CONN_TCH2_REQ, 0, 4, NET_CONN_STATE_SEND, DOWNLOAD_BATTLE_WAIT_FOR_SERVER);
+            configureSendRecvMgr(NET_CONN_TCH2_REQ, 0, 8, NET_CONN_STATE_SEND, DOWNLOAD_BATTLE_WAIT_FOR_SERVER);
             break;
 
         case DOWNLOAD_BATTLE_WAIT_FOR_SERVER: // Wait for data to be pulled from the server
@@ -669,7 +794,7 @@ static void Task_DownloadBattleProcess(u8 taskId)
             {
                 sSendRecvMgr.retryPoint = DOWNLOAD_BATTLE_RECIEVE_DATA;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE, NET_CONN_STATE_RECEIVE, DOWNLOAD_BATTLE_FINISH, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[PAYLOAD_RECEIVE_OFFSET - NET_CONN_PACKED_HEADER_SIZE], NET_CONN_PACKED_HEADER_SIZE + DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE, NET_CONN_STATE_RECEIVE, DOWNLOAD_BATTLE_FINISH, GetChunkSize());
             break;
 
 
@@ -678,6 +803,21 @@ static void Task_DownloadBattleProcess(u8 taskId)
         {
             u32 i;
             u32 offset = 0;
+            bool8 compressed;
+            u16 packedSize;
+
+            // The packed header goes just in front of the team, which is copied or unpacked down to the start of gStringVar3.
+            // One that doesn't make sense is a failed download, rather than a team made of whatever came back
+            if (!ReadPackedHeader(&gStringVar3[PAYLOAD_RECEIVE_OFFSET - NET_CONN_PACKED_HEADER_SIZE], DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE, &compressed, &packedSize)
+             || (compressed && !UnpackPayload(gStringVar3, DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE)))
+            {
+                gSpecialVar_0x8003 = 0;
+                sSendRecvMgr.state = NET_CONN_STATE_DONE;
+                break;
+            }
+
+            if (!compressed)
+                memcpy(gStringVar3, &gStringVar3[PAYLOAD_RECEIVE_OFFSET], DOWNLOAD_TRAINER_POKEMON_SIZE * DOWNLOAD_TRAINER_PARTY_SIZE);
 
             FillEReaderTrainerWithPlayerData();
             StringFill(gSaveBlock2Ptr->frontier.ereaderTrainer.name, CHAR_SPACER, PLAYER_NAME_LENGTH);
@@ -784,6 +924,12 @@ static void Task_OnlineMartProcess(u8 taskId)
     {
         case DOWNLOAD_MART_SEND_REQUEST:
             gStringVar3[0] = 'M'; gStringVar3[1] = 'A'; gStringVar3[2] = '_'; gStringVar3[3] = '1';
+            if (CanUseCall())
+            {
+                sSendRecvMgr.retryPoint = DOWNLOAD_MART_SEND_REQUEST;
+                configureSendRecvMgrCall(NET_CONN_CCH2_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 16, DOWNLOAD_MART_FINISH);
+                break;
+            }
             configureSendRecvMgr(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_SEND, DOWNLOAD_MART_TRANSMIT_REQUEST);
             break;
 
@@ -805,7 +951,7 @@ static void Task_OnlineMartProcess(u8 taskId)
             {
                 sSendRecvMgr.retryPoint = DOWNLOAD_MART_RECEIVE_DATA;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 16, NET_CONN_STATE_RECEIVE, DOWNLOAD_MART_FINISH, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 16, NET_CONN_STATE_RECEIVE, DOWNLOAD_MART_FINISH, GetChunkSize());
             break;
 
         case DOWNLOAD_MART_FINISH:
@@ -881,6 +1027,12 @@ static void Task_GiftEggProcess(u8 taskId)
     {
         case DOWNLOAD_GIFT_EGG_SEND_REQUEST:
             gStringVar3[0] = 'G'; gStringVar3[1] = 'E'; gStringVar3[2] = '_'; gStringVar3[3] = '1';
+            if (CanUseCall())
+            {
+                sSendRecvMgr.retryPoint = DOWNLOAD_GIFT_EGG_SEND_REQUEST;
+                configureSendRecvMgrCall(NET_CONN_CCH2_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 4, DOWNLOAD_GIFT_EGG_FINISH);
+                break;
+            }
             configureSendRecvMgr(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_SEND, DOWNLOAD_GIFT_EGG_TRANSMIT_REQUEST);
             break;
 
@@ -902,7 +1054,7 @@ static void Task_GiftEggProcess(u8 taskId)
             {
                 sSendRecvMgr.retryPoint = DOWNLOAD_MART_RECEIVE_DATA;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_RECEIVE, DOWNLOAD_GIFT_EGG_FINISH, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_RECEIVE, DOWNLOAD_GIFT_EGG_FINISH, GetChunkSize());
             break;
 
         case DOWNLOAD_GIFT_EGG_FINISH:
@@ -990,6 +1142,7 @@ static void Task_TradeProcess(u8 taskId)
         {
             u32 i;
             bool8 useFriendLink = TRUE;
+            CpuFill32(0, &gStringVar3, 16);
             gStringVar3[0] = 'T'; gStringVar3[1] = 'R'; gStringVar3[2] = '_';
 
             // If the trainer profile starts with 'FRIEND LINK' 
@@ -1004,18 +1157,21 @@ static void Task_TradeProcess(u8 taskId)
                 gStringVar3[5] = gSaveBlock1Ptr->easyChatProfile[2] & 0xFF;
                 gStringVar3[6] = gSaveBlock1Ptr->easyChatProfile[3] >> 8;
                 gStringVar3[7] = gSaveBlock1Ptr->easyChatProfile[3] & 0xFF;
-                configureSendRecvMgrChunked(NET_CONN_SEND_REQ, (vu32 *) &gStringVar3[0], 8, NET_CONN_STATE_SEND, TRADE_APPEND_MON_DATA, MINIMUM_CHUNK_SIZE);
             }
             else
             {
                 gStringVar3[3] = '0';
-                configureSendRecvMgr(NET_CONN_SEND_REQ, (vu32 *) &gStringVar3[0], 4, NET_CONN_STATE_SEND, TRADE_APPEND_MON_DATA);
             }
+
+            // The rest of the 16 bytes in front of the mon are padding, which is where we say we can take the partner's mon compressed
+            gStringVar3[8] = NET_CONN_LZ77_MARK >> 8;
+            gStringVar3[9] = NET_CONN_LZ77_MARK & 0xFF;
+            configureSendRecvMgrChunked(NET_CONN_SEND_REQ, (vu32 *) &gStringVar3[0], 16, NET_CONN_STATE_SEND, TRADE_APPEND_MON_DATA, GetChunkSize());
             break;
         }
         case TRADE_APPEND_MON_DATA:
             sSendRecvMgr.retryPoint = TRADE_APPEND_MON_DATA;
-            configureSendRecvMgrChunked(NET_CONN_SCH1_REQ, (vu32 *) &gPlayerParty[gSpecialVar_0x8005], sizeof(struct Pokemon), NET_CONN_STATE_SEND, TRADE_TRANSMIT_REQUEST, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_SCH1_REQ, (vu32 *) &gPlayerParty[gSpecialVar_0x8005], sizeof(struct Pokemon), NET_CONN_STATE_SEND, TRADE_TRANSMIT_REQUEST, GetChunkSize());
             break;
 
         case TRADE_TRANSMIT_REQUEST:
@@ -1038,7 +1194,7 @@ static void Task_TradeProcess(u8 taskId)
             {
                 sSendRecvMgr.retryPoint = TRADE_RECEIVE_NAME_DATA;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 16, NET_CONN_STATE_RECEIVE, TRADE_VERIFY_PARTNER_FOUND, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 16, NET_CONN_STATE_RECEIVE, TRADE_VERIFY_PARTNER_FOUND, GetChunkSize());
             break;
 
         case TRADE_VERIFY_PARTNER_FOUND:
@@ -1063,19 +1219,52 @@ static void Task_TradeProcess(u8 taskId)
             break;
 
         case TRADE_RECEIVE_FULL_DATA:
+        {
+            // The header we already have says if the mon is compressed, in which case only that much is read and it's unpacked at the end
+            bool8 compressed;
+            u16 size;
+            vu32 *dest;
+
+            if (!ReadPackedHeader(&gStringVar3[TRADE_PACKED_HEADER_OFFSET], sizeof(struct Pokemon), &compressed, &size))
+            {
+                // Rather than read whatever follows as a raw mon
+                gSpecialVar_0x8003 = 0;
+                sSendRecvMgr.state = NET_CONN_STATE_DONE;
+                break;
+            }
+
+            dest = compressed ? (vu32 *) &gStringVar3[PAYLOAD_RECEIVE_OFFSET] : (vu32 *) &gEnemyParty[0];
+
             if (sSendRecvMgr.repeatedStepCount == 0)
             {
                 CpuFill32(0, &gEnemyParty, sizeof(gEnemyParty));     
                 sSendRecvMgr.retryPoint = TRADE_RECEIVE_FULL_DATA;
                 sSendRecvMgr.retriesLeft = MAX_CONNECTION_RETRIES + 20;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF1_REQ, (vu32 *) &gEnemyParty[0], sizeof(struct Pokemon), NET_CONN_STATE_RECEIVE, TRADE_FINISH, MINIMUM_CHUNK_SIZE);
+            if (CanUseStream())
+                configureSendRecvMgrStream(NET_CONN_RCHF1_REQ, dest, size, TRADE_FINISH);
+            else
+                configureSendRecvMgrChunked(NET_CONN_RCHF1_REQ, dest, size, NET_CONN_STATE_RECEIVE, TRADE_FINISH, GetChunkSize());
             break;
+        }
 
         case TRADE_FINISH:
         default:
         {
-            u16 species = GetMonData(&gEnemyParty[0], MON_DATA_SPECIES);
+            u16 species;
+            bool8 compressed;
+            u16 size;
+
+            // The header was checked before the mon was read
+            if (gSpecialVar_0x8003 != 1 && ReadPackedHeader(&gStringVar3[TRADE_PACKED_HEADER_OFFSET], sizeof(struct Pokemon), &compressed, &size) && compressed
+             && !UnpackPayload(&gEnemyParty[0], sizeof(struct Pokemon)))
+            {
+                gSpecialVar_0x8003 = 0;
+                sSendRecvMgr.state = NET_CONN_STATE_DONE;
+                break;
+            }
+
+            species = GetMonData(&gEnemyParty[0], MON_DATA_SPECIES);
 
             if (gSpecialVar_0x8003 != 1)
             {
@@ -1187,7 +1376,14 @@ static void Task_PostMailProcess(u8 taskId)
                     gStringVar3[8 + 2 + (2 * i) + 1] = gSaveBlock1Ptr->mail[mailId].words[i] & 0xFF;
                 }
 
-                configureSendRecvMgrChunked(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 8 + 2 + (2 * 9), NET_CONN_STATE_SEND, POST_MAIL_TRANSMIT_REQUEST, MINIMUM_CHUNK_SIZE);
+                if (CanUseCall())
+                {
+                    // Posting again just replaces the mail, so it's safe for the call to be repeated
+                    sSendRecvMgr.retryPoint = POST_MAIL_SEND_REQUEST;
+                    configureSendRecvMgrCall(NET_CONN_CCH2_REQ, (vu32 *) &gStringVar3[0], 8 + 2 + (2 * 9), NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 2, POST_MAIL_FINISH);
+                    break;
+                }
+                configureSendRecvMgrChunked(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 8 + 2 + (2 * 9), NET_CONN_STATE_SEND, POST_MAIL_TRANSMIT_REQUEST, GetChunkSize());
             }
 
             break;
@@ -1210,7 +1406,7 @@ static void Task_PostMailProcess(u8 taskId)
             {
                 sSendRecvMgr.retryPoint = POST_MAIL_RECEIVE_DATA;
             }
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 2, NET_CONN_STATE_RECEIVE, POST_MAIL_FINISH, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 2, NET_CONN_STATE_RECEIVE, POST_MAIL_FINISH, GetChunkSize());
             break;
 
         case POST_MAIL_FINISH:
@@ -1298,7 +1494,7 @@ static void Task_ReadMailProcess(u8 taskId)
                 gStringVar3[6] = gSaveBlock1Ptr->easyChatProfile[3] >> 8;
                 gStringVar3[7] = gSaveBlock1Ptr->easyChatProfile[3] & 0xFF;
 
-                configureSendRecvMgrChunked(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 8, NET_CONN_STATE_SEND, READ_MAIL_TRANSMIT_REQUEST, MINIMUM_CHUNK_SIZE);
+                configureSendRecvMgrChunked(NET_CONN_SCH2_REQ, (vu32 *) &gStringVar3[0], 8, NET_CONN_STATE_SEND, READ_MAIL_TRANSMIT_REQUEST, GetChunkSize());
             }
             else
             {
@@ -1326,7 +1522,7 @@ static void Task_ReadMailProcess(u8 taskId)
                 sSendRecvMgr.retryPoint = DOWNLOAD_MART_RECEIVE_DATA;
             }
             // 8 byte player name + mail type + 9 * 16-bit easy chat words
-            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 8 + 2 + (9 * 2), NET_CONN_STATE_RECEIVE, READ_MAIL_FINISH, MINIMUM_CHUNK_SIZE);
+            configureSendRecvMgrChunked(NET_CONN_RCHF0_REQ, (vu32 *) &gStringVar3[0], 8 + 2 + (9 * 2), NET_CONN_STATE_RECEIVE, READ_MAIL_FINISH, GetChunkSize());
             break;
 
         case READ_MAIL_FINISH:
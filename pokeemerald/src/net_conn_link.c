@@ -0,0 +1,1346 @@
+#include "global.h"
+#include "net_conn_link.h"
+#include "util.h"
+#include "constants/network.h"
+
+static u8 transferFramedBlock(u16 cmd, const u8 *data, u16 length, bool8 disableChecks, u8 taskId);
+static u8 receiveFramedBlock(u16 cmd, u8 *data, u16 length, bool8 disableChecks, u8 taskId);
+static u16 transferFrames(const u8 *data, u16 length, u8 taskId);
+static u16 receiveFrames(u8 *data, u16 length, u8 taskId);
+static u16 exchangeFrames(const u8 *data, u16 length, u8 *response, u16 responseLength, u16 *recvPending, u8 taskId);
+static u16 checkStreamSegments(const u8 *data, u16 length, u16 from, u16 to, const u32 *trailers);
+static u8 receiveStatus(u8 *data, u8 taskId);
+static void statusToBytes(u32 status, u8 *data);
+static u8 startBackgroundBlock(u8 kind, u32 header0, u32 header1, u8 *data, u16 length, bool8 disableChecks, u8 taskId);
+static void startBackgroundFrames(u8 *data, u16 length, bool8 sending);
+static void startBackgroundRound(void);
+static void nextBackgroundFrame(u8 frame);
+static void startBackgroundFrame(u8 frame);
+static void putBackgroundWord(void);
+static void finishBackgroundFrames(u16 pendingFrames);
+static void finishBackgroundBlock(u8 result);
+static void backgroundWordRead(void);
+static void backgroundWordWritten(u32 word);
+static u16 continueCrc16(u16 crc, const u8 *data, u16 length);
+static u16 getCallAnswerLength(u32 callRes, u16 responseLength);
+static bool8 isFramedCmd(u16 cmd);
+static void xfer16(u16 data1, u16 data2, u8 taskId);
+static void xfer32(u32 data, u8 taskId);
+static u32 recv32(u8 taskId);
+static u32 xferDuplex(u32 data, u8 taskId);
+static void waitForTransmissionFinish(u8 taskId, u16 readOrWriteFlag); // i.e JOY_READ or JOY_WRITE
+static void waitForTransmissionFinishWithin(u8 taskId, u16 readOrWriteFlag, u32 maxLoops);
+static bool8 waitForConnectionReady(u8 taskId);
+
+#define CRC16_START 0x1121 // Same seed CalcCRC16WithTable uses
+
+enum {
+    BACKGROUND_SEND,
+    BACKGROUND_RECEIVE,
+    BACKGROUND_CALL,
+    BACKGROUND_STREAM
+};
+
+enum {
+    BACKGROUND_STEP_IDLE,
+    BACKGROUND_STEP_HEADER,       // The command words are going up
+    BACKGROUND_STEP_SEND_WORDS,   // A frame is going up
+    BACKGROUND_STEP_SEND_TRAILER, // Its trailer is up
+    BACKGROUND_STEP_SEND_ACK,     // Waiting on the wii's ack for the round
+    BACKGROUND_STEP_CALL_WAIT,    // Waiting on NET_CONN_CALL_RES while the wii talks to the server
+    BACKGROUND_STEP_CALL_ECHO,    // NET_CONN_CALL_RES is back up for the wii to see
+    BACKGROUND_STEP_RECV_WORDS,   // A frame (or stream segment) is coming down
+    BACKGROUND_STEP_RECV_TRAILER,
+    BACKGROUND_STEP_RECV_ACK,     // Our ack is up
+    BACKGROUND_STEP_DONE
+};
+
+// A block being moved by NetConnLink_SerialIntr. Words go straight from/to the caller's buffer as they move, nothing is staged
+struct BackgroundBlock
+{
+    vu8 step;
+    vu8 result;
+    vu32 words;           // Words moved so far, so a poll can tell whether the wii has gone quiet
+    u32 wordsAtLastPoll;
+    u8 idleFrames;
+    u8 kind;
+    bool8 disableChecks;
+    bool8 sending;        // The frames currently moving are ours
+    u8 headerWords;
+    u8 headerSent;
+    u32 header[2];
+    u8 *data;
+    u16 length;
+    u8 *response;         // BACKGROUND_CALL only
+    u16 responseLength;
+    u16 *streamOffset;    // BACKGROUND_STREAM only
+    u16 streamGood;       // How much of the stream has arrived safely so far
+    u16 frameSize;
+    u16 pendingFrames;
+    u16 badFrames;
+    u8 frame;
+    u8 round;
+    u16 pos;
+    u16 frameEnd;
+    u16 crc;              // Of the frame so far
+};
+
+static EWRAM_DATA bool8 sLinkError = FALSE; // Set when the wii stops responding part way through a block
+static EWRAM_DATA u16 sLinkCaps = 0;        // Capabilities agreed with the wii at the last handshake
+static EWRAM_DATA u16 sFramesResent = 0;
+static EWRAM_DATA u16 sCallResponseLength = 0;
+static EWRAM_DATA bool8 sBackgroundEnabled = FALSE;
+static EWRAM_DATA struct BackgroundBlock sBackground = {0};
+
+u16 NetConnLink_Handshake(u8 taskId)
+{
+    u32 resBuff;
+    u8 tries;
+
+    for (tries = 0; tries < MAX_HANDSHAKE_TRIES; tries++)
+    {
+        sLinkError = FALSE;
+        JOY_TRANS = 0;
+
+        if (!waitForConnectionReady(taskId))
+            break;
+
+        xfer16(NET_CONN_HANDSHAKE_REQ, NET_CONN_LINK_CAPS, taskId);
+
+        if (sLinkError)
+            continue;
+
+        JOY_CNT |= JOY_RW;
+        waitForTransmissionFinishWithin(taskId, JOY_WRITE, MAX_HANDSHAKE_LOOPS);
+        resBuff = JOY_RECV;
+
+        if (!sLinkError && (resBuff >> 16 == NET_CONN_HANDSHAKE_RES_ONLINE || resBuff >> 16 == NET_CONN_HANDSHAKE_RES_NO_INTERNET))
+        {
+            sLinkCaps = resBuff & NET_CONN_LINK_CAPS;
+            break;
+        }
+    }
+
+    // An older channel won't answer, that's not an error it just means we stay in legacy mode. Neither will a newer one whose
+    // answer was lost on a noisy link though, so whatever was agreed before (if anything) is kept rather than dropping to legacy
+    sLinkError = FALSE;
+    JOY_TRANS = 0;
+    JOY_RECV = 0;
+    return sLinkCaps;
+}
+
+void NetConnLink_ForgetCaps(void)
+{
+    sLinkCaps = 0;
+}
+
+u16 NetConnLink_GetCaps(void)
+{
+    return sLinkCaps;
+}
+
+u16 NetConnLink_GetFramesResent(void)
+{
+    return sFramesResent;
+}
+
+u16 NetConnLink_GetCallResponseLength(void)
+{
+    return sCallResponseLength;
+}
+
+u8 NetConnLink_TransferBlock(u16 cmd, const u8 *data, u16 length, bool8 disableChecks, u8 taskId)
+{
+    u32 i = 0;
+    u16 checkBytes = 0xFFFF;
+    u8 transBuff[4];
+    u32 resBuff = 0;
+
+    if (isFramedCmd(cmd) && sBackgroundEnabled)
+        return startBackgroundBlock(BACKGROUND_SEND, (u32) (cmd | (length << 16)), 0, (u8 *) data, length, disableChecks, taskId);
+
+    if (isFramedCmd(cmd))
+        return transferFramedBlock(cmd, data, length, disableChecks, taskId);
+
+    sLinkError = FALSE;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+    checkBytes ^= cmd;
+    checkBytes ^= length;
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    for(i = 0; i < length; i+=4)
+    {
+        transBuff[0] = data[i];
+        transBuff[1] = i + 1 < length ? data[i + 1] : 0;
+        transBuff[2] = i + 2 < length ? data[i + 2] : 0;
+        transBuff[3] = i + 3 < length ? data[i + 3] : 0;
+
+        xfer32((u32) (transBuff[0] + (transBuff[1] << 8) + (transBuff[2] << 16) + (transBuff[3] << 24)), taskId);
+
+        if (sLinkError)
+            return NET_CONN_LINK_ERROR;
+
+        checkBytes ^= (u16) (transBuff[0] + (transBuff[1] << 8));
+        checkBytes ^= (u16) (transBuff[2] + (transBuff[3] << 8));
+
+    }
+
+    resBuff = recv32(taskId);
+
+    // Clear the last word we put up so the wii doesn't read it again as a new command while we're between blocks
+    JOY_TRANS = 0;
+
+    if (disableChecks || (resBuff ^ (u32) ((NET_CONN_CHCK_RES << 16) | (checkBytes & 0xFFFF))) == 0)
+        return NET_CONN_LINK_OK;
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+u8 NetConnLink_ReceiveBlock(u16 cmd, u8 *data, u16 length, bool8 disableChecks, u8 taskId)
+{
+    u32 i = 0;
+    u16 checkBytes = 0xFFFF;
+    u8 transBuff[4];
+    u32 resBuff = 0;
+
+    if (isFramedCmd(cmd) && sBackgroundEnabled)
+        return startBackgroundBlock(BACKGROUND_RECEIVE, (u32) (cmd | (length << 16)), 0, data, length, disableChecks, taskId);
+
+    if (isFramedCmd(cmd))
+        return receiveFramedBlock(cmd, data, length, disableChecks, taskId);
+
+    if (cmd == NET_CONN_LIFN_REQ && length == 4)
+        return receiveStatus(data, taskId);
+
+    sLinkError = FALSE;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    for(i = 0; i < length; i+=4)
+    {
+        resBuff = recv32(taskId);
+
+        transBuff[0] = (resBuff >> 24) & 0xFF;
+        transBuff[1] = (resBuff >> 16) & 0xFF;
+        transBuff[2] = (resBuff >> 8) & 0xFF;
+        transBuff[3] = resBuff & 0xFF;
+
+        data[i] = transBuff[0];
+        if (i + 1 < length) data[i + 1] = transBuff[1];
+        if (i + 2 < length) data[i + 2] = transBuff[2];
+        if (i + 3 < length) data[i + 3] = transBuff[3];
+
+        if (sLinkError)
+            return NET_CONN_LINK_ERROR;
+
+        checkBytes ^= (u16) (transBuff[0] + (transBuff[1] << 8));
+        checkBytes ^= (u16) (transBuff[2] + (transBuff[3] << 8));
+
+    }
+
+    resBuff = recv32(taskId);
+
+    // The command is still up in JOY_TRANS, clear it so the wii doesn't take it as a request for the block again
+    JOY_TRANS = 0;
+
+    if (disableChecks || (resBuff ^ (u32) ((NET_CONN_CHCK_RES << 16) | (checkBytes & 0xFFFF))) == 0)
+    {
+        JOY_RECV = 0;
+        return NET_CONN_LINK_OK;
+    }
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+/**
+* The wii answers NET_CONN_LIFN_REQ with the one word. The check word a receive waits for after that only ever came from the
+* wii reading the command again (it's still up until the receive is over) and answering it a second time, so it isn't waited for.
+* Every channel answers this way, so it doesn't need a link mode
+*/
+static u8 receiveStatus(u8 *data, u8 taskId)
+{
+    u32 resBuff;
+
+    sLinkError = FALSE;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(NET_CONN_LIFN_REQ, 4, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    resBuff = recv32(taskId);
+    JOY_TRANS = 0;
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    // So NetConnLink_TakeStatusPush only sees what the wii writes from now on
+    JOY_CNT |= JOY_RW;
+    statusToBytes(resBuff, data);
+    return NET_CONN_LINK_OK;
+}
+
+bool8 NetConnLink_TakeStatusPush(u8 *data)
+{
+    u32 resBuff;
+
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_LIFN_PUSH) || sBackground.step != BACKGROUND_STEP_IDLE || !(JOY_CNT & JOY_WRITE))
+        return FALSE;
+
+    resBuff = JOY_RECV;
+    JOY_CNT |= JOY_RW;
+
+    // Whatever else was left in JOY_RECV (e.g. the end of the last block) isn't a status
+    if (resBuff >> 16 != NET_CONN_LIFN_REQ)
+        return FALSE;
+
+    statusToBytes(resBuff, data);
+    return TRUE;
+}
+
+// In the same order a receive puts the words it reads in data
+static void statusToBytes(u32 status, u8 *data)
+{
+    data[0] = (status >> 24) & 0xFF;
+    data[1] = (status >> 16) & 0xFF;
+    data[2] = (status >> 8) & 0xFF;
+    data[3] = status & 0xFF;
+}
+
+u8 NetConnLink_CallBlock(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength, u8 taskId)
+{
+    u32 i;
+    u16 pendingFrames;
+    u32 resBuff = 0;
+
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_CALL))
+        return NET_CONN_LINK_ERROR;
+
+    sCallResponseLength = 0;
+
+    if (sBackgroundEnabled)
+    {
+        // Has to be set before the block starts, the interrupt takes over from there
+        sBackground.response = response;
+        sBackground.responseLength = responseLength;
+        return startBackgroundBlock(BACKGROUND_CALL, (u32) (cmd | (length << 16)), (u32) (recvCmd | (responseLength << 16)), (u8 *) data, length, FALSE, taskId);
+    }
+
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (!sLinkError)
+        xfer16(recvCmd, responseLength, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    pendingFrames = transferFrames(data, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    if (pendingFrames != 0)
+    {
+        // The wii won't transmit a request it didn't get all of, so the whole call can just be tried again
+        JOY_TRANS = 0;
+        for (i = 0; i < 300; i++) {}
+        return NET_CONN_LINK_CHECK_FAILED;
+    }
+
+    // The wii has the request and is waiting on the server, it won't touch the link again until it has an answer
+    JOY_CNT |= JOY_RW;
+    waitForTransmissionFinishWithin(taskId, JOY_WRITE, MAX_CALL_LOOPS);
+    resBuff = JOY_RECV;
+
+    if (!sLinkError)
+        sCallResponseLength = getCallAnswerLength(resBuff, responseLength);
+
+    if (sLinkError || sCallResponseLength == 0)
+    {
+        JOY_TRANS = 0;
+        return NET_CONN_LINK_ERROR;
+    }
+
+    // Put it back up so the wii knows we're ready for the answer
+    xfer32(resBuff, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    pendingFrames = receiveFrames(response, sCallResponseLength, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    JOY_TRANS = 0;
+
+    if (pendingFrames == 0)
+    {
+        JOY_RECV = 0;
+        return NET_CONN_LINK_OK;
+    }
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+u8 NetConnLink_StreamBlock(u16 cmd, u8 *data, u16 length, u16 *offset, u8 taskId)
+{
+    u32 i;
+    u32 trailers[NET_CONN_STREAM_MAX_SIZE / NET_CONN_STREAM_SEGMENT_SIZE];
+    u16 segmentStart;
+    u16 segmentEnd;
+    u16 good;
+    u32 resBuff = 0;
+
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_STREAM) || length > NET_CONN_STREAM_MAX_SIZE)
+        return NET_CONN_LINK_ERROR;
+
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (*offset >= length)
+        return NET_CONN_LINK_OK;
+
+    if (sBackgroundEnabled)
+    {
+        sBackground.streamOffset = offset;
+        sBackground.streamGood = *offset;
+        return startBackgroundBlock(BACKGROUND_STREAM, (u32) (cmd | (length << 16)), (u32) (NET_CONN_STRM_FROM | (*offset << 16)), data, length, FALSE, taskId);
+    }
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (!sLinkError)
+        xfer16(NET_CONN_STRM_FROM, *offset, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    // Nothing is checked until the end, so the wii never has to wait on us in the middle of the stream
+    for (segmentStart = *offset; segmentStart < length; segmentStart = segmentEnd)
+    {
+        segmentEnd = segmentStart + NET_CONN_STREAM_SEGMENT_SIZE < length ? segmentStart + NET_CONN_STREAM_SEGMENT_SIZE : length;
+
+        for (i = segmentStart; i < segmentEnd; i+=4)
+        {
+            resBuff = recv32(taskId);
+
+            if (sLinkError)
+                break;
+
+            data[i] = (resBuff >> 24) & 0xFF;
+            if (i + 1 < segmentEnd) data[i + 1] = (resBuff >> 16) & 0xFF;
+            if (i + 2 < segmentEnd) data[i + 2] = (resBuff >> 8) & 0xFF;
+            if (i + 3 < segmentEnd) data[i + 3] = resBuff & 0xFF;
+        }
+
+        if (!sLinkError)
+            trailers[segmentStart / NET_CONN_STREAM_SEGMENT_SIZE] = recv32(taskId);
+
+        if (sLinkError)
+            break;
+    }
+
+    // Even if the link dropped, whatever came through whole before that is kept
+    good = checkStreamSegments(data, length, *offset, segmentStart, trailers);
+    sFramesResent = (segmentStart - good + NET_CONN_STREAM_SEGMENT_SIZE - 1) / NET_CONN_STREAM_SEGMENT_SIZE;
+    *offset = good;
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    xfer32((u32) ((NET_CONN_SACK_RES << 16) | good), taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    JOY_TRANS = 0;
+
+    if (good == length)
+    {
+        JOY_RECV = 0;
+        return NET_CONN_LINK_OK;
+    }
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+u8 NetConnLink_ExchangeBlock(u16 cmd, const u8 *data, u16 length, u16 recvCmd, u8 *response, u16 responseLength, u8 taskId)
+{
+    u32 i;
+    u16 sendPending;
+    u16 recvPending;
+
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_DUPLEX) || length == 0 || responseLength == 0)
+        return NET_CONN_LINK_ERROR;
+
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (!sLinkError)
+        xfer16(recvCmd, responseLength, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    sendPending = exchangeFrames(data, length, response, responseLength, &recvPending, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    JOY_TRANS = 0;
+
+    if (sendPending == 0 && recvPending == 0)
+    {
+        JOY_RECV = 0;
+        return NET_CONN_LINK_OK;
+    }
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+static u8 transferFramedBlock(u16 cmd, const u8 *data, u16 length, bool8 disableChecks, u8 taskId)
+{
+    u32 i;
+    u16 pendingFrames;
+
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    pendingFrames = transferFrames(data, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    JOY_TRANS = 0;
+
+    if (disableChecks || pendingFrames == 0)
+        return NET_CONN_LINK_OK;
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+static u8 receiveFramedBlock(u16 cmd, u8 *data, u16 length, bool8 disableChecks, u8 taskId)
+{
+    u32 i;
+    u16 pendingFrames;
+
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    xfer16(cmd, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    pendingFrames = receiveFrames(data, length, taskId);
+
+    if (sLinkError)
+        return NET_CONN_LINK_ERROR;
+
+    JOY_TRANS = 0;
+
+    if (disableChecks || pendingFrames == 0)
+    {
+        JOY_RECV = 0;
+        return NET_CONN_LINK_OK;
+    }
+
+    for (i = 0; i < 300; i++) {}
+    return NET_CONN_LINK_CHECK_FAILED;
+}
+
+// Sends the frames of a block (the command has already gone), returns a bitmap of the frames the wii still didn't have after the last round
+static u16 transferFrames(const u8 *data, u16 length, u8 taskId)
+{
+    u32 i;
+    u16 frameSize = NET_CONN_GET_FRAME_SIZE(length);
+    u8 frame;
+    u8 round;
+    u16 frameStart;
+    u16 frameEnd;
+    u16 pendingFrames;
+    u8 transBuff[4];
+    u32 resBuff = 0;
+
+    pendingFrames = (1 << ((length + frameSize - 1) / frameSize)) - 1;
+
+    for (round = 0; round < NET_CONN_MAX_FRAME_ROUNDS && pendingFrames != 0; round++)
+    {
+        for (frame = 0; frame < NET_CONN_MAX_FRAMES; frame++)
+        {
+            if (!(pendingFrames & (1 << frame)))
+                continue;
+
+            frameStart = frame * frameSize;
+            frameEnd = frameStart + frameSize < length ? frameStart + frameSize : length;
+
+            for (i = frameStart; i < frameEnd; i+=4)
+            {
+                transBuff[0] = data[i];
+                transBuff[1] = i + 1 < frameEnd ? data[i + 1] : 0;
+                transBuff[2] = i + 2 < frameEnd ? data[i + 2] : 0;
+                transBuff[3] = i + 3 < frameEnd ? data[i + 3] : 0;
+
+                xfer32((u32) (transBuff[0] + (transBuff[1] << 8) + (transBuff[2] << 16) + (transBuff[3] << 24)), taskId);
+
+                if (sLinkError)
+                    return pendingFrames;
+            }
+
+            xfer32((u32) ((NET_CONN_FRAME_MARK << 24) | (frame << 16) | CalcCRC16WithTable(&data[frameStart], frameEnd - frameStart)), taskId);
+
+            if (sLinkError)
+                return pendingFrames;
+
+            if (round > 0)
+                sFramesResent++;
+        }
+
+        resBuff = recv32(taskId);
+
+        if (sLinkError)
+            return pendingFrames;
+
+        // If the ack is for the wrong round we're out of step with the wii, so start the block again
+        if (resBuff >> 16 != (NET_CONN_FACK_RES | round))
+            break;
+
+        pendingFrames = resBuff & pendingFrames;
+    }
+
+    return pendingFrames;
+}
+
+// Reads the frames of a block (the command has already gone), returns a bitmap of the frames that were still bad after the last round
+static u16 receiveFrames(u8 *data, u16 length, u8 taskId)
+{
+    u32 i;
+    u16 frameSize = NET_CONN_GET_FRAME_SIZE(length);
+    u8 frame;
+    u8 round;
+    u16 frameStart;
+    u16 frameEnd;
+    u16 pendingFrames;
+    u16 badFrames = 0;
+    u32 resBuff = 0;
+
+    pendingFrames = (1 << ((length + frameSize - 1) / frameSize)) - 1;
+
+    for (round = 0; round < NET_CONN_MAX_FRAME_ROUNDS && pendingFrames != 0; round++)
+    {
+        badFrames = 0;
+
+        for (frame = 0; frame < NET_CONN_MAX_FRAMES; frame++)
+        {
+            if (!(pendingFrames & (1 << frame)))
+                continue;
+
+            frameStart = frame * frameSize;
+            frameEnd = frameStart + frameSize < length ? frameStart + frameSize : length;
+
+            for (i = frameStart; i < frameEnd; i+=4)
+            {
+                resBuff = recv32(taskId);
+
+                if (sLinkError)
+                    return pendingFrames;
+
+                data[i] = (resBuff >> 24) & 0xFF;
+                if (i + 1 < frameEnd) data[i + 1] = (resBuff >> 16) & 0xFF;
+                if (i + 2 < frameEnd) data[i + 2] = (resBuff >> 8) & 0xFF;
+                if (i + 3 < frameEnd) data[i + 3] = resBuff & 0xFF;
+            }
+
+            resBuff = recv32(taskId);
+
+            if (sLinkError)
+                return pendingFrames;
+
+            if (resBuff != (u32) ((NET_CONN_FRAME_MARK << 24) | (frame << 16) | CalcCRC16WithTable(&data[frameStart], frameEnd - frameStart)))
+                badFrames |= 1 << frame;
+
+            if (round > 0)
+                sFramesResent++;
+        }
+
+        xfer32((u32) (((NET_CONN_FACK_RES | round) << 16) | badFrames), taskId);
+
+        if (sLinkError)
+            return pendingFrames;
+
+        pendingFrames = badFrames;
+    }
+
+    return pendingFrames;
+}
+
+/**
+* Moves the frames of both blocks of an exchange (the commands have already gone), see NET_CONN_LINK_CAP_DUPLEX.
+* Returns a bitmap of our frames the wii still didn't have after the last round, *recvPending gets the same for the frames it sent us.
+* The frames the wii sent are only checked once the round is over, so it never has to wait on us between slots
+*/
+static u16 exchangeFrames(const u8 *data, u16 length, u8 *response, u16 responseLength, u16 *recvPending, u8 taskId)
+{
+    u32 i;
+    u16 sendFrameSize = NET_CONN_GET_FRAME_SIZE(length);
+    u16 recvFrameSize = NET_CONN_GET_FRAME_SIZE(responseLength);
+    u8 frame;
+    u8 round;
+    u16 sendStart;
+    u16 sendEnd;
+    u16 recvStart;
+    u16 recvEnd;
+    u16 sendPending;
+    u16 badFrames;
+    u32 trailers[NET_CONN_MAX_FRAMES];
+    u8 transBuff[4];
+    u32 resBuff = 0;
+
+    sendPending = (1 << ((length + sendFrameSize - 1) / sendFrameSize)) - 1;
+    *recvPending = (1 << ((responseLength + recvFrameSize - 1) / recvFrameSize)) - 1;
+
+    for (round = 0; round < NET_CONN_MAX_FRAME_ROUNDS && (sendPending | *recvPending) != 0; round++)
+    {
+        for (frame = 0; frame < NET_CONN_MAX_FRAMES; frame++)
+        {
+            if (!((sendPending | *recvPending) & (1 << frame)))
+                continue;
+
+            // A side with nothing to move in this frame takes part with an empty one
+            sendStart = frame * sendFrameSize;
+            sendEnd = sendStart;
+            if (sendPending & (1 << frame))
+                sendEnd = sendStart + sendFrameSize < length ? sendStart + sendFrameSize : length;
+
+            recvStart = frame * recvFrameSize;
+            recvEnd = recvStart;
+            if (*recvPending & (1 << frame))
+                recvEnd = recvStart + recvFrameSize < responseLength ? recvStart + recvFrameSize : responseLength;
+
+            for (i = 0; i < (u32) (sendEnd - sendStart) || i < (u32) (recvEnd - recvStart); i+=4)
+            {
+                transBuff[0] = sendStart + i < sendEnd ? data[sendStart + i] : 0;
+                transBuff[1] = sendStart + i + 1 < sendEnd ? data[sendStart + i + 1] : 0;
+                transBuff[2] = sendStart + i + 2 < sendEnd ? data[sendStart + i + 2] : 0;
+                transBuff[3] = sendStart + i + 3 < sendEnd ? data[sendStart + i + 3] : 0;
+
+                resBuff = xferDuplex((u32) (transBuff[0] + (transBuff[1] << 8) + (transBuff[2] << 16) + (transBuff[3] << 24)), taskId);
+
+                if (sLinkError)
+                    return sendPending;
+
+                if (recvStart + i < recvEnd) response[recvStart + i] = (resBuff >> 24) & 0xFF;
+                if (recvStart + i + 1 < recvEnd) response[recvStart + i + 1] = (resBuff >> 16) & 0xFF;
+                if (recvStart + i + 2 < recvEnd) response[recvStart + i + 2] = (resBuff >> 8) & 0xFF;
+                if (recvStart + i + 3 < recvEnd) response[recvStart + i + 3] = resBuff & 0xFF;
+            }
+
+            if (sendEnd > sendStart)
+                resBuff = xferDuplex((u32) ((NET_CONN_FRAME_MARK << 24) | (frame << 16) | CalcCRC16WithTable(&data[sendStart], sendEnd - sendStart)), taskId);
+            else
+                resBuff = xferDuplex(0, taskId);
+
+            if (sLinkError)
+                return sendPending;
+
+            trailers[frame] = resBuff;
+
+            if (round > 0)
+                sFramesResent++;
+        }
+
+        // The wii acks our frames first, then waits on its own ack while we check the frames it sent
+        resBuff = recv32(taskId);
+
+        if (sLinkError)
+            return sendPending;
+
+        // If the ack is for the wrong round we're out of step with the wii, so start the exchange again
+        if (resBuff >> 16 != (NET_CONN_FACK_RES | round))
+            break;
+
+        sendPending = resBuff & sendPending;
+        badFrames = 0;
+
+        for (frame = 0; frame < NET_CONN_MAX_FRAMES; frame++)
+        {
+            if (!(*recvPending & (1 << frame)))
+                continue;
+
+            recvStart = frame * recvFrameSize;
+            recvEnd = recvStart + recvFrameSize < responseLength ? recvStart + recvFrameSize : responseLength;
+
+            if (trailers[frame] != (u32) ((NET_CONN_FRAME_MARK << 24) | (frame << 16) | CalcCRC16WithTable(&response[recvStart], recvEnd - recvStart)))
+                badFrames |= 1 << frame;
+        }
+
+        xfer32((u32) (((NET_CONN_FACK_RES | round) << 16) | badFrames), taskId);
+
+        if (sLinkError)
+            return sendPending;
+
+        *recvPending = badFrames;
+    }
+
+    return sendPending;
+}
+
+// Returns where the first bad segment between from and to starts (or to if they're all good), the stream picks up again from there
+static u16 checkStreamSegments(const u8 *data, u16 length, u16 from, u16 to, const u32 *trailers)
+{
+    u16 segmentStart;
+    u16 segmentEnd;
+    u16 segment;
+
+    for (segmentStart = from; segmentStart < to; segmentStart = segmentEnd)
+    {
+        segment = segmentStart / NET_CONN_STREAM_SEGMENT_SIZE;
+        segmentEnd = segmentStart + NET_CONN_STREAM_SEGMENT_SIZE < length ? segmentStart + NET_CONN_STREAM_SEGMENT_SIZE : length;
+
+        if (trailers[segment] != (u32) ((NET_CONN_FRAME_MARK << 24) | (segment << 16) | CalcCRC16WithTable(&data[segmentStart], segmentEnd - segmentStart)))
+            break;
+    }
+
+    return segmentStart < to ? segmentStart : to;
+}
+
+void NetConnLink_SetBackground(bool8 enabled)
+{
+    if (!enabled)
+        NetConnLink_StopBlock();
+
+    sBackgroundEnabled = enabled;
+}
+
+u8 NetConnLink_PollBlock(void)
+{
+    u8 result;
+    u16 ime;
+
+    if (sBackground.step == BACKGROUND_STEP_IDLE)
+        return NET_CONN_LINK_ERROR;
+
+    if (sBackground.step != BACKGROUND_STEP_DONE)
+    {
+        if (sBackground.words != sBackground.wordsAtLastPoll)
+        {
+            sBackground.wordsAtLastPoll = sBackground.words;
+            sBackground.idleFrames = 0;
+            return NET_CONN_LINK_BUSY;
+        }
+
+        if (++sBackground.idleFrames <= (sBackground.step == BACKGROUND_STEP_CALL_WAIT ? MAX_BACKGROUND_CALL_FRAMES : MAX_BACKGROUND_IDLE_FRAMES))
+            return NET_CONN_LINK_BUSY;
+
+        // The wii has stopped responding, unless the last word came in just now
+        ime = REG_IME;
+        REG_IME = 0;
+        if (sBackground.step != BACKGROUND_STEP_DONE)
+            finishBackgroundBlock(NET_CONN_LINK_ERROR);
+        REG_IME = ime;
+    }
+
+    // Even if the link dropped, whatever came through whole before that is kept
+    if (sBackground.kind == BACKGROUND_STREAM)
+        *sBackground.streamOffset = sBackground.streamGood;
+
+    result = sBackground.result;
+    sBackground.step = BACKGROUND_STEP_IDLE;
+    return result;
+}
+
+void NetConnLink_StopBlock(void)
+{
+    u16 ime = REG_IME;
+
+    REG_IME = 0;
+    if (sBackground.step != BACKGROUND_STEP_IDLE)
+        JOY_CNT = 0;
+    sBackground.step = BACKGROUND_STEP_IDLE;
+    REG_IME = ime;
+}
+
+/**
+* The JOY interrupt, raised every time the wii reads the word we put up or writes one to us.
+* Each one moves the block on by a word, so a background block costs the game a few microseconds per word
+* instead of the whole frame. The flags are cleared here, the polled code never sees them while a block is running
+*/
+void NetConnLink_SerialIntr(void)
+{
+    u16 joyCnt = JOY_CNT;
+
+    if (sBackground.step == BACKGROUND_STEP_IDLE || sBackground.step == BACKGROUND_STEP_DONE)
+        return;
+
+    JOY_CNT = (joyCnt & JOY_RW) | JOY_IRQ;
+
+    if (joyCnt & JOY_READ)
+        backgroundWordRead();
+
+    if ((joyCnt & JOY_WRITE) && sBackground.step != BACKGROUND_STEP_DONE)
+        backgroundWordWritten(JOY_RECV);
+}
+
+// Same exchange as the polled blocks, the only difference is who's waiting on the wii
+static u8 startBackgroundBlock(u8 kind, u32 header0, u32 header1, u8 *data, u16 length, bool8 disableChecks, u8 taskId)
+{
+    sLinkError = FALSE;
+    sFramesResent = 0;
+
+    if (!waitForConnectionReady(taskId))
+        return NET_CONN_LINK_ERROR;
+
+    sBackground.kind = kind;
+    sBackground.header[0] = header0;
+    sBackground.header[1] = header1;
+    sBackground.headerWords = (kind == BACKGROUND_CALL || kind == BACKGROUND_STREAM) ? 2 : 1;
+    sBackground.headerSent = 0;
+    sBackground.data = data;
+    sBackground.length = length;
+    sBackground.disableChecks = disableChecks;
+    sBackground.words = 0;
+    sBackground.wordsAtLastPoll = 0;
+    sBackground.idleFrames = 0;
+    sBackground.result = NET_CONN_LINK_BUSY;
+    sBackground.step = BACKGROUND_STEP_HEADER;
+
+    // Flags are only cleared once the command is up, so a read of whatever was there before can't be taken for it
+    JOY_TRANS = header0;
+    JOY_CNT = JOY_RW | JOY_IRQ;
+    return NET_CONN_LINK_BUSY;
+}
+
+// Starts on the frames of a block (the command has already gone), see transferFrames/receiveFrames
+static void startBackgroundFrames(u8 *data, u16 length, bool8 sending)
+{
+    sBackground.data = data;
+    sBackground.length = length;
+    sBackground.sending = sending;
+    sBackground.round = 0;
+
+    if (sBackground.kind == BACKGROUND_STREAM)
+    {
+        sBackground.frameSize = NET_CONN_STREAM_SEGMENT_SIZE;
+        startBackgroundFrame(*sBackground.streamOffset / NET_CONN_STREAM_SEGMENT_SIZE);
+        return;
+    }
+
+    sBackground.frameSize = NET_CONN_GET_FRAME_SIZE(length);
+    sBackground.pendingFrames = (1 << ((length + sBackground.frameSize - 1) / sBackground.frameSize)) - 1;
+
+    if (sBackground.pendingFrames == 0)
+        finishBackgroundFrames(0);
+    else
+        startBackgroundRound();
+}
+
+static void startBackgroundRound(void)
+{
+    sBackground.badFrames = 0;
+    nextBackgroundFrame(0);
+}
+
+// Moves on to the first frame from here that's still pending, or to the ack for the round once there are none left
+static void nextBackgroundFrame(u8 frame)
+{
+    if (sBackground.kind == BACKGROUND_STREAM)
+    {
+        if (frame * NET_CONN_STREAM_SEGMENT_SIZE < sBackground.length)
+        {
+            startBackgroundFrame(frame);
+        }
+        else
+        {
+            JOY_TRANS = (u32) ((NET_CONN_SACK_RES << 16) | sBackground.streamGood);
+            sBackground.step = BACKGROUND_STEP_RECV_ACK;
+        }
+        return;
+    }
+
+    while (frame < NET_CONN_MAX_FRAMES && !(sBackground.pendingFrames & (1 << frame)))
+        frame++;
+
+    if (frame < NET_CONN_MAX_FRAMES)
+    {
+        startBackgroundFrame(frame);
+    }
+    else if (sBackground.sending)
+    {
+        sBackground.step = BACKGROUND_STEP_SEND_ACK;
+    }
+    else
+    {
+        JOY_TRANS = (u32) (((NET_CONN_FACK_RES | sBackground.round) << 16) | sBackground.badFrames);
+        sBackground.step = BACKGROUND_STEP_RECV_ACK;
+    }
+}
+
+static void startBackgroundFrame(u8 frame)
+{
+    sBackground.frame = frame;
+    sBackground.pos = frame * sBackground.frameSize;
+    sBackground.frameEnd = sBackground.pos + sBackground.frameSize < sBackground.length ? sBackground.pos + sBackground.frameSize : sBackground.length;
+    sBackground.crc = CRC16_START;
+
+    if (sBackground.sending)
+        putBackgroundWord();
+    else
+        sBackground.step = BACKGROUND_STEP_RECV_WORDS;
+}
+
+static void putBackgroundWord(void)
+{
+    const u8 *data = &sBackground.data[sBackground.pos];
+    u16 count = sBackground.frameEnd - sBackground.pos < 4 ? sBackground.frameEnd - sBackground.pos : 4;
+    u8 transBuff[4];
+
+    transBuff[0] = data[0];
+    transBuff[1] = count > 1 ? data[1] : 0;
+    transBuff[2] = count > 2 ? data[2] : 0;
+    transBuff[3] = count > 3 ? data[3] : 0;
+
+    JOY_TRANS = (u32) (transBuff[0] + (transBuff[1] << 8) + (transBuff[2] << 16) + (transBuff[3] << 24));
+    sBackground.crc = continueCrc16(sBackground.crc, data, count);
+    sBackground.pos += 4;
+    sBackground.step = BACKGROUND_STEP_SEND_WORDS;
+}
+
+// The frames are over one way or another, as at the end of transferFramedBlock/receiveFramedBlock/NetConnLink_CallBlock
+static void finishBackgroundFrames(u16 pendingFrames)
+{
+    if (sBackground.kind == BACKGROUND_CALL && sBackground.sending && pendingFrames == 0)
+    {
+        // The wii has the request and is waiting on the server, it won't touch the link again until it has an answer
+        sBackground.step = BACKGROUND_STEP_CALL_WAIT;
+        return;
+    }
+
+    JOY_TRANS = 0;
+
+    if (pendingFrames == 0 || sBackground.disableChecks)
+    {
+        if (!sBackground.sending)
+            JOY_RECV = 0;
+        finishBackgroundBlock(NET_CONN_LINK_OK);
+    }
+    else
+    {
+        finishBackgroundBlock(NET_CONN_LINK_CHECK_FAILED);
+    }
+}
+
+static void finishBackgroundBlock(u8 result)
+{
+    sBackground.result = result;
+    sBackground.step = BACKGROUND_STEP_DONE;
+
+    // Interrupt off, the flags are left for the next polled block to clear
+    JOY_CNT = 0;
+}
+
+// The wii has read the word we put up
+static void backgroundWordRead(void)
+{
+    switch (sBackground.step)
+    {
+        case BACKGROUND_STEP_HEADER:
+            sBackground.words++;
+            if (++sBackground.headerSent < sBackground.headerWords)
+                JOY_TRANS = sBackground.header[sBackground.headerSent];
+            else
+                startBackgroundFrames(sBackground.data, sBackground.length, sBackground.kind == BACKGROUND_SEND || sBackground.kind == BACKGROUND_CALL);
+            break;
+        case BACKGROUND_STEP_SEND_WORDS:
+            sBackground.words++;
+            if (sBackground.pos < sBackground.frameEnd)
+            {
+                putBackgroundWord();
+            }
+            else
+            {
+                JOY_TRANS = (u32) ((NET_CONN_FRAME_MARK << 24) | (sBackground.frame << 16) | (u16) ~sBackground.crc);
+                sBackground.step = BACKGROUND_STEP_SEND_TRAILER;
+            }
+            break;
+        case BACKGROUND_STEP_SEND_TRAILER:
+            sBackground.words++;
+            if (sBackground.round > 0)
+                sFramesResent++;
+            nextBackgroundFrame(sBackground.frame + 1);
+            break;
+        case BACKGROUND_STEP_CALL_ECHO:
+            sBackground.words++;
+            startBackgroundFrames(sBackground.response, sBackground.responseLength, FALSE);
+            break;
+        case BACKGROUND_STEP_RECV_ACK:
+            sBackground.words++;
+            if (sBackground.kind == BACKGROUND_STREAM)
+            {
+                JOY_TRANS = 0;
+                if (sBackground.streamGood == sBackground.length)
+                    JOY_RECV = 0;
+                finishBackgroundBlock(sBackground.streamGood == sBackground.length ? NET_CONN_LINK_OK : NET_CONN_LINK_CHECK_FAILED);
+            }
+            else if (sBackground.badFrames == 0 || ++sBackground.round >= NET_CONN_MAX_FRAME_ROUNDS)
+            {
+                finishBackgroundFrames(sBackground.badFrames);
+            }
+            else
+            {
+                sBackground.pendingFrames = sBackground.badFrames;
+                startBackgroundRound();
+            }
+            break;
+        default:
+            // The wii reading the same word again, e.g. while it waits for us to put up an ack
+            break;
+    }
+}
+
+// The wii has written a word to us
+static void backgroundWordWritten(u32 word)
+{
+    u8 *data;
+    u16 frameStart;
+
+    switch (sBackground.step)
+    {
+        case BACKGROUND_STEP_SEND_ACK:
+            sBackground.words++;
+
+            // If the ack is for the wrong round we're out of step with the wii, so start the block again
+            if (word >> 16 != (u32) (NET_CONN_FACK_RES | sBackground.round))
+            {
+                finishBackgroundFrames(sBackground.pendingFrames);
+                break;
+            }
+
+            sBackground.pendingFrames &= word;
+
+            if (sBackground.pendingFrames == 0 || ++sBackground.round >= NET_CONN_MAX_FRAME_ROUNDS)
+                finishBackgroundFrames(sBackground.pendingFrames);
+            else
+                startBackgroundRound();
+            break;
+        case BACKGROUND_STEP_CALL_WAIT:
+            sBackground.words++;
+            sCallResponseLength = getCallAnswerLength(word, sBackground.responseLength);
+
+            if (sCallResponseLength == 0)
+            {
+                JOY_TRANS = 0;
+                finishBackgroundBlock(NET_CONN_LINK_ERROR);
+                break;
+            }
+
+            sBackground.responseLength = sCallResponseLength;
+
+            // Put it back up so the wii knows we're ready for the answer
+            JOY_TRANS = word;
+            sBackground.step = BACKGROUND_STEP_CALL_ECHO;
+            break;
+        case BACKGROUND_STEP_RECV_WORDS:
+            sBackground.words++;
+            data = &sBackground.data[sBackground.pos];
+
+            data[0] = (word >> 24) & 0xFF;
+            if (sBackground.pos + 1 < sBackground.frameEnd) data[1] = (word >> 16) & 0xFF;
+            if (sBackground.pos + 2 < sBackground.frameEnd) data[2] = (word >> 8) & 0xFF;
+            if (sBackground.pos + 3 < sBackground.frameEnd) data[3] = word & 0xFF;
+
+            sBackground.crc = continueCrc16(sBackground.crc, data, sBackground.frameEnd - sBackground.pos < 4 ? sBackground.frameEnd - sBackground.pos : 4);
+            sBackground.pos += 4;
+
+            if (sBackground.pos >= sBackground.frameEnd)
+                sBackground.step = BACKGROUND_STEP_RECV_TRAILER;
+            break;
+        case BACKGROUND_STEP_RECV_TRAILER:
+            sBackground.words++;
+            frameStart = sBackground.frame * sBackground.frameSize;
+
+            if (sBackground.round > 0)
+                sFramesResent++;
+
+            if (sBackground.kind == BACKGROUND_STREAM)
+            {
+                // Only the good segments straight after what we already have count, the next stream starts at the first bad one
+                if (word == (u32) ((NET_CONN_FRAME_MARK << 24) | (sBackground.frame << 16) | (u16) ~sBackground.crc) && sBackground.streamGood == frameStart)
+                    sBackground.streamGood = sBackground.frameEnd;
+                else
+                    sFramesResent++;
+            }
+            else if (word != (u32) ((NET_CONN_FRAME_MARK << 24) | (sBackground.frame << 16) | (u16) ~sBackground.crc))
+            {
+                sBackground.badFrames |= 1 << sBackground.frame;
+            }
+
+            nextBackgroundFrame(sBackground.frame + 1);
+            break;
+        default:
+            break;
+    }
+}
+
+// How much of the answer follows a NET_CONN_CALL_RES, 0 if the server never answered (or the word isn't one)
+static u16 getCallAnswerLength(u32 callRes, u16 responseLength)
+{
+    u16 answered = callRes & 0xFFFF;
+
+    if (callRes >> 16 != NET_CONN_CALL_RES)
+        return 0;
+
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_SIZED_CALL))
+        return answered == NET_CONN_CALL_ANSWERED ? responseLength : 0;
+
+    return answered <= responseLength ? answered : 0;
+}
+
+// CalcCRC16WithTable a few bytes at a time, so a background frame is checked as its words move instead of all at once at the end.
+// Start from CRC16_START, the frame's CRC is ~crc
+static u16 continueCrc16(u16 crc, const u8 *data, u16 length)
+{
+    u16 i;
+    u8 bit;
+
+    for (i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+
+    return crc;
+}
+
+// Only data blocks are framed, every other command is a single word either way
+static bool8 isFramedCmd(u16 cmd)
+{
+    if (!(sLinkCaps & NET_CONN_LINK_CAP_FRAMED))
+        return FALSE;
+
+    return (cmd >> 8) == (NET_CONN_SEND_REQ >> 8) || (cmd >> 8) == (NET_CONN_RECV_REQ >> 8);
+}
+
+static bool8 waitForConnectionReady(u8 taskId)
+{
+    u32 i = 0;
+
+    JOY_CNT |= JOY_RW;
+    for (i = 0; JOY_CNT&JOY_READ && i <= MAX_CONNECTION_LOOPS; i++)
+    {
+        /* Wait for the connection to become ready */
+        if (NetConnLink_CheckCanceled(taskId) == TRUE || i == MAX_CONNECTION_LOOPS)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+* The way joybus coms work is that the wii is always master and the GBA always slave
+* This means that the GBA cannot initiate a transfer, only respond with up to 4 bytes
+* each time the wii sends a 4 byte message
+*/
+static void xfer16(u16 data1, u16 data2, u8 taskId)
+{
+    JOY_CNT |= JOY_RW;
+    JOY_TRANS_L = data1;
+    JOY_TRANS_H = data2;
+    waitForTransmissionFinish(taskId, JOY_READ);
+}
+
+static void xfer32(u32 data, u8 taskId)
+{
+    JOY_CNT |= JOY_RW;
+    JOY_TRANS = data;
+    waitForTransmissionFinish(taskId, JOY_READ);
+}
+
+static u32 recv32(u8 taskId)
+{
+    JOY_CNT |= JOY_RW;
+    waitForTransmissionFinish(taskId, JOY_WRITE);
+    return JOY_RECV;
+}
+
+// One slot of an exchange, data is up for the wii to read straight after it writes us a word. Returns the word it wrote
+static u32 xferDuplex(u32 data, u8 taskId)
+{
+    u32 resBuff;
+
+    JOY_CNT |= JOY_RW;
+    JOY_TRANS = data;
+    waitForTransmissionFinish(taskId, JOY_WRITE);
+    resBuff = JOY_RECV;
+
+    if (!sLinkError)
+        waitForTransmissionFinish(taskId, JOY_READ);
+
+    return resBuff;
+}
+
+static void waitForTransmissionFinish(u8 taskId, u16 readOrWriteFlag)
+{
+    waitForTransmissionFinishWithin(taskId, readOrWriteFlag, MAX_CONNECTION_LOOPS);
+}
+
+static void waitForTransmissionFinishWithin(u8 taskId, u16 readOrWriteFlag, u32 maxLoops)
+{
+    u32 i = 0;
+
+    for (i = 0; (JOY_CNT&readOrWriteFlag) == 0; i++)
+    {
+        if (i > maxLoops || NetConnLink_CheckCanceled(taskId) == TRUE)
+        {
+            sLinkError = TRUE;
+            return;
+        }
+    }
+}
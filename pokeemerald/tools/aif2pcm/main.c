@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include "assetcache.h"
 
 /* extended.c */
 void ieee754_write_extended (double, uint8_t*);
@@ -97,6 +98,7 @@ struct Bytes *read_bytearray(const char *filename)
 
 void write_bytearray(const char *filename, struct Bytes *bytes)
 {
+	AssetCacheReleaseOutput(filename);
 	FILE *f = fopen(filename, "wb");
 	if (!f)
 	{
@@ -908,37 +910,43 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (strcmp(extension, "aif") == 0 || strcmp(extension, "aiff") == 0)
+	bool to_pcm = strcmp(extension, "aif") == 0 || strcmp(extension, "aiff") == 0;
+
+	if (!to_pcm && strcmp(extension, "bin") != 0)
 	{
-		if (argc >= 3)
-		{
-			output_file = argv[2];
-			aif2pcm(input_file, output_file, compressed);
-		}
-		else
-		{
-			output_file = new_file_extension(input_file, "bin");
-			aif2pcm(input_file, output_file, compressed);
-			free(output_file);
-		}
+		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+	}
+
+	if (argc >= 3)
+	{
+		output_file = argv[2];
 	}
-	else if (strcmp(extension, "bin") == 0)
+	else
+	{
+		output_file = new_file_extension(input_file, to_pcm ? "bin" : "aif");
+	}
+
+	struct AssetCacheEntry cache_entry;
+
+	AssetCacheInit("aif2pcm", argv[0]);
+
+	if (!AssetCacheFetch(&cache_entry, argc, argv, output_file))
 	{
-		if (argc >= 3)
+		if (to_pcm)
 		{
-			output_file = argv[2];
-			pcm2aif(input_file, output_file, 60);
+			aif2pcm(input_file, output_file, compressed);
 		}
 		else
 		{
-			output_file = new_file_extension(input_file, "aif");
 			pcm2aif(input_file, output_file, 60);
-			free(output_file);
 		}
+
+		AssetCacheStore(&cache_entry);
 	}
-	else
+
+	if (output_file != argv[2])
 	{
-		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+		free(output_file);
 	}
 
 	return 0;
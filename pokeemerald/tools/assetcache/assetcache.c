@@ -0,0 +1,924 @@
+// A cache of the files gbagfx, aif2pcm and mid2agb make, shared by the three of
+// them and by every checkout on the machine. It's off unless ASSET_CACHE_DIR is
+// set.
+//
+// Each conversion is keyed by a SHA-256 of the tool's executable, its command
+// line (with only the name of the output, not its directory) and the contents of
+// every file the command line names. Switching branches or `make clean` then
+// finds the output of anything that was converted before, and a tool that's been
+// changed never gets an old output. Entries are kept in 16 shards, by the first
+// digit of their key, each with a KEY.sum beside it holding a SHA-256 of its
+// contents. A hit checks the entry against it, so one that's been changed since
+// is thrown away rather than used. Each shard keeps rough counts in a stats file,
+// which a tool adds a line to as it exits. Once a shard is over its share of
+// ASSET_CACHE_SIZE (in MB, 512 by default) the entries used least recently (by
+// the time on their .sum) are removed. A hit copies the entry to the output, or
+// hard links it if ASSET_CACHE_LINK is set. Entries are read only, and the tools
+// remove a linked output before writing one (AssetCacheReleaseOutput), so a
+// conversion never writes into an entry, even with the cache off.
+//
+// Any number of tools can use the cache at once: files only ever appear in it
+// whole, by renaming them into place. The counts can miss a tool's line if it's
+// added while the file is being compacted, and are put right whenever that shard
+// is trimmed. If the cache can't be read or written the tool just converts as if
+// it weren't there.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "assetcache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#define MakeDirectory(path) _mkdir(path)
+#define MakeReadOnly(path) _chmod(path, _S_IREAD)
+#else
+#include <unistd.h>
+#include <utime.h>
+#define MakeDirectory(path) mkdir(path, 0777)
+#define MakeReadOnly(path) chmod(path, 0444)
+#endif
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#define SHARD_COUNT 16
+#define KEY_LENGTH 64 // hex digits
+#define SUM_SUFFIX ".sum"
+#define DEFAULT_CACHE_MEGABYTES 512
+#define STALE_TEMP_SECONDS (60 * 60)
+#define STATS_LOG_SIZE 4096
+#define MAX_DIR_LENGTH (ASSET_CACHE_MAX_PATH - KEY_LENGTH - 64) // room for the shard, key and temporary file suffix
+
+struct Sha256
+{
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    int blockSize;
+};
+
+struct ShardStats
+{
+    long long hits;
+    long long misses;
+    long long files;
+    long long bytes;
+};
+
+struct CachedFile
+{
+    char name[KEY_LENGTH + 1];
+    time_t lastUsed;
+    long long size;
+};
+
+static bool sEnabled;
+static bool sLink;
+static char sCacheDir[MAX_DIR_LENGTH];
+static const char *sToolName;
+static unsigned char sToolHash[32];
+static long long sShardLimit;
+static atomic_int sHits;
+static atomic_int sMisses;
+static atomic_int sTempCount;
+// What this process has added to each shard, written out when it exits
+static atomic_llong sShardHits[SHARD_COUNT];
+static atomic_llong sShardMisses[SHARD_COUNT];
+static atomic_llong sShardFiles[SHARD_COUNT];
+static atomic_llong sShardBytes[SHARD_COUNT];
+
+static const uint32_t sSha256Constants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTATE_RIGHT(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Sha256Init(struct Sha256 *sha)
+{
+    static const uint32_t initialState[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(sha->state, initialState, sizeof(initialState));
+    sha->length = 0;
+    sha->blockSize = 0;
+}
+
+static void Sha256Block(struct Sha256 *sha, const unsigned char *block)
+{
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTATE_RIGHT(w[i - 15], 7) ^ ROTATE_RIGHT(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTATE_RIGHT(w[i - 2], 17) ^ ROTATE_RIGHT(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    uint32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (ROTATE_RIGHT(e, 6) ^ ROTATE_RIGHT(e, 11) ^ ROTATE_RIGHT(e, 25)) + ((e & f) ^ (~e & g)) + sSha256Constants[i] + w[i];
+        uint32_t t2 = (ROTATE_RIGHT(a, 2) ^ ROTATE_RIGHT(a, 13) ^ ROTATE_RIGHT(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+static void Sha256Update(struct Sha256 *sha, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    sha->length += size;
+
+    while (size > 0)
+    {
+        size_t count = 64 - sha->blockSize;
+
+        if (count > size)
+            count = size;
+
+        memcpy(&sha->block[sha->blockSize], bytes, count);
+        sha->blockSize += count;
+        bytes += count;
+        size -= count;
+
+        if (sha->blockSize == 64)
+        {
+            Sha256Block(sha, sha->block);
+            sha->blockSize = 0;
+        }
+    }
+}
+
+static void Sha256Final(struct Sha256 *sha, unsigned char *digest)
+{
+    uint64_t bitLength = sha->length * 8;
+    unsigned char padding = 0x80;
+
+    Sha256Update(sha, &padding, 1);
+    padding = 0;
+
+    while (sha->blockSize != 56)
+        Sha256Update(sha, &padding, 1);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        unsigned char byte = (unsigned char)(bitLength >> (i * 8));
+        Sha256Update(sha, &byte, 1);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (unsigned char)(sha->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(sha->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(sha->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)sha->state[i];
+    }
+}
+
+static void ToHex(const unsigned char *digest, char *hex)
+{
+    for (int i = 0; i < 32; i++)
+        sprintf(&hex[i * 2], "%02x", digest[i]);
+}
+
+// Returns NULL if it can't be read
+static unsigned char *LoadFile(const char *path, long *size)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return NULL;
+
+    unsigned char *data = NULL;
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (*size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        data = malloc(*size > 0 ? *size : 1);
+
+        if (data != NULL && fread(data, 1, *size, fp) != (size_t)*size)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(fp);
+    return data;
+}
+
+static void MakeTempPath(char *temp, size_t tempSize, const char *path)
+{
+    snprintf(temp, tempSize, "%s.tmp.%d.%d", path, (int)getpid(), atomic_fetch_add(&sTempCount, 1));
+}
+
+static bool MoveOver(const char *from, const char *to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+static bool RemoveFile(const char *path)
+{
+#ifdef _WIN32
+    // Windows won't remove a read only file
+    _chmod(path, _S_IREAD | _S_IWRITE);
+#endif
+    return remove(path) == 0;
+}
+
+static bool MakeLink(const char *existing, const char *path)
+{
+#ifdef _WIN32
+    return CreateHardLinkA(path, existing, NULL) != 0;
+#else
+    return link(existing, path) == 0;
+#endif
+}
+
+// Only done when a write fails, so a tool that's run thousands of times doesn't try every time
+static void MakeCacheDirectories(void)
+{
+    const char *path = sCacheDir;
+    char partial[ASSET_CACHE_MAX_PATH];
+
+    for (size_t i = 1; path[i - 1] != 0; i++)
+    {
+        if (path[i] == '/' || path[i] == '\\' || path[i] == 0)
+        {
+            memcpy(partial, path, i);
+            partial[i] = 0;
+            MakeDirectory(partial);
+        }
+    }
+
+    snprintf(partial, sizeof(partial), "%s/tools", sCacheDir);
+    MakeDirectory(partial);
+
+    for (int shard = 0; shard < SHARD_COUNT; shard++)
+    {
+        snprintf(partial, sizeof(partial), "%s/%x", sCacheDir, shard);
+        MakeDirectory(partial);
+    }
+}
+
+// Writes to a temporary file and renames it into place, so nothing ever sees half of it
+static bool SaveFile(const char *path, const unsigned char *data, long size, bool readOnly)
+{
+    char temp[ASSET_CACHE_MAX_PATH + 32];
+
+    MakeTempPath(temp, sizeof(temp), path);
+
+    FILE *fp = fopen(temp, "wb");
+
+    if (fp == NULL)
+    {
+        MakeCacheDirectories();
+        fp = fopen(temp, "wb");
+    }
+
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite(data, 1, size, fp) == (size_t)size;
+
+    ok = fclose(fp) == 0 && ok;
+
+    if (ok && readOnly)
+        MakeReadOnly(temp);
+
+    ok = ok && MoveOver(temp, path);
+
+    if (!ok)
+        RemoveFile(temp);
+
+    return ok;
+}
+
+static void FlushStats(void);
+
+static bool GetExecutablePath(const char *argv0, char *path, size_t size)
+{
+#if defined(_WIN32)
+    DWORD length = GetModuleFileNameA(NULL, path, size);
+
+    if (length > 0 && length < size)
+        return true;
+#elif defined(__APPLE__)
+    uint32_t length = size;
+
+    if (_NSGetExecutablePath(path, &length) == 0)
+        return true;
+#elif defined(__linux__)
+    ssize_t length = readlink("/proc/self/exe", path, size - 1);
+
+    if (length > 0)
+    {
+        path[length] = 0;
+        return true;
+    }
+#endif
+
+    if (argv0 == NULL || strlen(argv0) >= size)
+        return false;
+
+    strcpy(path, argv0);
+    return true;
+}
+
+// Hashes the tool's executable, so a rebuilt tool that's changed misses and one
+// that hasn't still hits. The hash is kept in the cache by the executable's path,
+// size and time, so it's only worked out once per build of the tool.
+static bool HashTool(const char *argv0)
+{
+    char exePath[ASSET_CACHE_MAX_PATH];
+    struct stat st;
+
+    if (!GetExecutablePath(argv0, exePath, sizeof(exePath)) || stat(exePath, &st) != 0)
+        return false;
+
+    struct Sha256 sha;
+    unsigned char digest[32];
+    char hex[KEY_LENGTH + 1];
+    char memoPath[ASSET_CACHE_MAX_PATH + KEY_LENGTH + 8];
+    long long size = st.st_size;
+    long long mtime = st.st_mtime;
+
+    Sha256Init(&sha);
+    Sha256Update(&sha, exePath, strlen(exePath) + 1);
+    Sha256Update(&sha, &size, sizeof(size));
+    Sha256Update(&sha, &mtime, sizeof(mtime));
+    Sha256Final(&sha, digest);
+    ToHex(digest, hex);
+    snprintf(memoPath, sizeof(memoPath), "%s/tools/%s", sCacheDir, hex);
+
+    long memoSize;
+    unsigned char *memo = LoadFile(memoPath, &memoSize);
+
+    if (memo != NULL && memoSize == sizeof(sToolHash))
+    {
+        memcpy(sToolHash, memo, sizeof(sToolHash));
+        free(memo);
+        return true;
+    }
+
+    free(memo);
+
+    long exeSize;
+    unsigned char *exe = LoadFile(exePath, &exeSize);
+
+    if (exe == NULL)
+        return false;
+
+    Sha256Init(&sha);
+    Sha256Update(&sha, exe, exeSize);
+    Sha256Final(&sha, sToolHash);
+    free(exe);
+    SaveFile(memoPath, sToolHash, sizeof(sToolHash), false);
+    return true;
+}
+
+void AssetCacheInit(const char *tool, const char *argv0)
+{
+    const char *dir = getenv("ASSET_CACHE_DIR");
+    const char *megabytes = getenv("ASSET_CACHE_SIZE");
+    const char *link = getenv("ASSET_CACHE_LINK");
+
+    if (dir == NULL || dir[0] == 0 || strlen(dir) >= MAX_DIR_LENGTH)
+        return;
+
+    strcpy(sCacheDir, dir);
+
+    size_t length = strlen(sCacheDir);
+
+    while (length > 1 && (sCacheDir[length - 1] == '/' || sCacheDir[length - 1] == '\\'))
+        sCacheDir[--length] = 0;
+
+    long long limit = megabytes != NULL ? strtoll(megabytes, NULL, 10) : 0;
+
+    if (limit <= 0)
+        limit = DEFAULT_CACHE_MEGABYTES;
+
+    sShardLimit = limit * 1024 * 1024 / SHARD_COUNT;
+    sLink = link != NULL && link[0] != 0 && strcmp(link, "0") != 0;
+    sToolName = tool;
+
+    sEnabled = HashTool(argv0);
+
+    if (sEnabled)
+        atexit(FlushStats);
+}
+
+bool AssetCacheEnabled(void)
+{
+    return sEnabled;
+}
+
+static void ReadStats(int shard, struct ShardStats *stats)
+{
+    char path[ASSET_CACHE_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%x/stats", sCacheDir, shard);
+    memset(stats, 0, sizeof(*stats));
+
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return;
+
+    struct ShardStats line;
+
+    // A line for each tool that's added to it since it was last compacted
+    while (fscanf(fp, "%lld %lld %lld %lld", &line.hits, &line.misses, &line.files, &line.bytes) == 4)
+    {
+        stats->hits += line.hits;
+        stats->misses += line.misses;
+        stats->files += line.files;
+        stats->bytes += line.bytes;
+    }
+
+    fclose(fp);
+}
+
+static void WriteStats(int shard, const struct ShardStats *stats)
+{
+    char path[ASSET_CACHE_MAX_PATH];
+    char text[128];
+
+    snprintf(path, sizeof(path), "%s/%x/stats", sCacheDir, shard);
+    snprintf(text, sizeof(text), "%lld %lld %lld %lld\n", stats->hits, stats->misses, stats->files, stats->bytes);
+    SaveFile(path, (const unsigned char *)text, strlen(text), false);
+}
+
+static int CompareLastUsed(const void *a, const void *b)
+{
+    const struct CachedFile *fileA = a;
+    const struct CachedFile *fileB = b;
+
+    return (fileA->lastUsed > fileB->lastUsed) - (fileA->lastUsed < fileB->lastUsed);
+}
+
+// Removes the shard's least recently used entries until it's back under 80% of its
+// share, so this isn't done again on the very next store, and counts what's left
+static void TrimShard(int shard, struct ShardStats *stats, long long limit)
+{
+    char dirPath[ASSET_CACHE_MAX_PATH];
+    char path[ASSET_CACHE_MAX_PATH + 300];
+
+    snprintf(dirPath, sizeof(dirPath), "%s/%x", sCacheDir, shard);
+
+    DIR *dir = opendir(dirPath);
+
+    if (dir == NULL)
+        return;
+
+    struct CachedFile *files = NULL;
+    int count = 0;
+    int capacity = 0;
+    long long total = 0;
+    time_t now = time(NULL);
+    struct dirent *dirEntry;
+
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        size_t nameLength = strlen(dirEntry->d_name);
+
+        snprintf(path, sizeof(path), "%s/%s", dirPath, dirEntry->d_name);
+
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (nameLength == KEY_LENGTH)
+        {
+            if (count == capacity)
+            {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+
+                struct CachedFile *grown = realloc(files, sizeof(struct CachedFile) * capacity);
+
+                if (grown == NULL)
+                    break;
+
+                files = grown;
+            }
+
+            strcpy(files[count].name, dirEntry->d_name);
+            files[count].size = st.st_size;
+
+            // The entry itself may be linked to an output, so it's the .sum that's touched on a hit.
+            // One without a .sum can't be used, so it goes first
+            strcat(path, SUM_SUFFIX);
+            files[count].lastUsed = stat(path, &st) == 0 ? st.st_mtime : 0;
+            total += files[count].size;
+            count++;
+        }
+        else if (strstr(dirEntry->d_name, ".tmp.") != NULL && now - st.st_mtime > STALE_TEMP_SECONDS)
+        {
+            // Left behind by a tool that was killed partway through a write
+            RemoveFile(path);
+        }
+        else if (nameLength == KEY_LENGTH + strlen(SUM_SUFFIX) && (limit == 0 || now - st.st_mtime > STALE_TEMP_SECONDS))
+        {
+            struct stat entrySt;
+
+            // A .sum whose entry was never written (or was removed without it). Unless the cache is being cleared,
+            // newer ones may be from a store that's still writing its entry, as the .sum goes first
+            path[strlen(path) - strlen(SUM_SUFFIX)] = 0;
+
+            if (stat(path, &entrySt) != 0)
+            {
+                strcat(path, SUM_SUFFIX);
+                RemoveFile(path);
+            }
+        }
+    }
+
+    closedir(dir);
+
+    if (files != NULL)
+        qsort(files, count, sizeof(struct CachedFile), CompareLastUsed);
+
+    int removed = 0;
+
+    while (removed < count && total > limit * 4 / 5)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dirPath, files[removed].name);
+        RemoveFile(path);
+        strcat(path, SUM_SUFFIX);
+        RemoveFile(path);
+        total -= files[removed].size;
+        removed++;
+    }
+
+    free(files);
+    stats->files = count - removed;
+    stats->bytes = total;
+}
+
+// Adds this process's counts to the shards it used. Each one's stats file is only
+// appended to, and is read back after a store to see if the shard needs trimming.
+// It's rewritten as one line when it's trimmed or has grown a while.
+static void FlushStats(void)
+{
+    for (int shard = 0; shard < SHARD_COUNT; shard++)
+    {
+        struct ShardStats added =
+        {
+            atomic_exchange(&sShardHits[shard], 0),
+            atomic_exchange(&sShardMisses[shard], 0),
+            atomic_exchange(&sShardFiles[shard], 0),
+            atomic_exchange(&sShardBytes[shard], 0),
+        };
+
+        if (added.hits == 0 && added.misses == 0)
+            continue;
+
+        char path[ASSET_CACHE_MAX_PATH];
+
+        snprintf(path, sizeof(path), "%s/%x/stats", sCacheDir, shard);
+
+        FILE *fp = fopen(path, "ab");
+
+        if (fp == NULL)
+            continue;
+
+        fprintf(fp, "%lld %lld %lld %lld\n", added.hits, added.misses, added.files, added.bytes);
+
+        long logSize = ftell(fp);
+
+        fclose(fp);
+
+        if (added.bytes == 0 && logSize <= STATS_LOG_SIZE)
+            continue;
+
+        struct ShardStats stats;
+
+        ReadStats(shard, &stats);
+
+        if (stats.bytes > sShardLimit)
+            TrimShard(shard, &stats, sShardLimit);
+        else if (logSize <= STATS_LOG_SIZE)
+            continue;
+
+        WriteStats(shard, &stats);
+    }
+}
+
+static int GetShard(const struct AssetCacheEntry *entry)
+{
+    char digit = entry->path[strlen(entry->path) - KEY_LENGTH];
+
+    return digit <= '9' ? digit - '0' : digit - 'a' + 10;
+}
+
+static const char *GetBaseName(const char *path)
+{
+    const char *name = path;
+
+    for (const char *c = path; *c != 0; c++)
+    {
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+
+    return name;
+}
+
+// Works out the entry's key, false if something the command line names can't be read
+static bool HashConversion(struct Sha256 *sha, int argc, char **argv, const char *outputPath)
+{
+    static const char version[] = "asset cache 1";
+    const char *outputName = GetBaseName(outputPath);
+
+    Sha256Init(sha);
+    Sha256Update(sha, version, sizeof(version));
+    Sha256Update(sha, sToolName, strlen(sToolName) + 1);
+    Sha256Update(sha, sToolHash, sizeof(sToolHash));
+    Sha256Update(sha, outputName, strlen(outputName) + 1);
+
+    // argv[0] is left out, it's only where the tool happens to be
+    for (int i = 1; i < argc; i++)
+    {
+        struct stat st;
+
+        if (strcmp(argv[i], outputPath) == 0)
+        {
+            Sha256Update(sha, "\1", 1);
+            continue;
+        }
+
+        Sha256Update(sha, "", 1);
+        Sha256Update(sha, argv[i], strlen(argv[i]) + 1);
+
+        if (stat(argv[i], &st) == 0 && S_ISREG(st.st_mode))
+        {
+            long size;
+            unsigned char *data = LoadFile(argv[i], &size);
+
+            if (data == NULL)
+                return false;
+
+            long long size64 = size;
+
+            Sha256Update(sha, &size64, sizeof(size64));
+            Sha256Update(sha, data, size);
+            free(data);
+        }
+    }
+
+    return true;
+}
+
+static void GetSumPath(const struct AssetCacheEntry *entry, char *path, size_t size)
+{
+    snprintf(path, size, "%s%s", entry->path, SUM_SUFFIX);
+}
+
+// Whether data is what was stored under the entry. Anything that isn't (or has lost its .sum) is removed
+static bool CheckEntry(struct AssetCacheEntry *entry, const unsigned char *data, long size)
+{
+    char sumPath[ASSET_CACHE_MAX_PATH + 8];
+    long sumSize;
+    struct Sha256 sha;
+    unsigned char digest[32];
+
+    GetSumPath(entry, sumPath, sizeof(sumPath));
+
+    unsigned char *sum = LoadFile(sumPath, &sumSize);
+
+    Sha256Init(&sha);
+    Sha256Update(&sha, data, size);
+    Sha256Final(&sha, digest);
+
+    bool ok = sum != NULL && sumSize == sizeof(digest) && memcmp(sum, digest, sizeof(digest)) == 0;
+
+    free(sum);
+
+    if (!ok)
+    {
+        RemoveFile(entry->path);
+        RemoveFile(sumPath);
+    }
+
+    return ok;
+}
+
+// Puts a cached output in place. One that's already right is left alone, timestamp
+// and all, like gbagfx does, so nothing made from it is rebuilt.
+static bool PutOutput(struct AssetCacheEntry *entry, const unsigned char *data, long size)
+{
+    long existingSize;
+    unsigned char *existing = LoadFile(entry->outputPath, &existingSize);
+    bool unchanged = existing != NULL && existingSize == size && memcmp(existing, data, size) == 0;
+
+    free(existing);
+
+    if (unchanged)
+    {
+        entry->outputUnchanged = true;
+        return true;
+    }
+
+    if (sLink)
+    {
+        char temp[ASSET_CACHE_MAX_PATH + 32];
+
+        MakeTempPath(temp, sizeof(temp), entry->outputPath);
+
+        // The link has the entry's time, and make needs to see the output as newer than what it's made from
+        if (MakeLink(entry->path, temp) && MoveOver(temp, entry->outputPath))
+        {
+            utime(entry->outputPath, NULL);
+            return true;
+        }
+
+        RemoveFile(temp);
+    }
+
+    AssetCacheReleaseOutput(entry->outputPath);
+
+    FILE *fp = fopen(entry->outputPath, "wb");
+
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite(data, 1, size, fp) == (size_t)size;
+
+    return fclose(fp) == 0 && ok;
+}
+
+bool AssetCacheFetch(struct AssetCacheEntry *entry, int argc, char **argv, const char *outputPath)
+{
+    struct Sha256 sha;
+    unsigned char digest[32];
+    char key[KEY_LENGTH + 1];
+
+    entry->path[0] = 0;
+    entry->outputUnchanged = false;
+
+    if (!sEnabled || strlen(outputPath) >= ASSET_CACHE_MAX_PATH || !HashConversion(&sha, argc, argv, outputPath))
+        return false;
+
+    Sha256Final(&sha, digest);
+    ToHex(digest, key);
+    strcpy(entry->outputPath, outputPath);
+    snprintf(entry->path, sizeof(entry->path), "%s/%c/%s", sCacheDir, key[0], key);
+
+    long size;
+    unsigned char *data = LoadFile(entry->path, &size);
+    bool hit = data != NULL && CheckEntry(entry, data, size) && PutOutput(entry, data, size);
+
+    free(data);
+
+    if (!hit)
+    {
+        // An output hard linked from the cache has to be its own file again before the tool writes over it
+        AssetCacheReleaseOutput(outputPath);
+        atomic_fetch_add(&sMisses, 1);
+        return false;
+    }
+
+    char sumPath[ASSET_CACHE_MAX_PATH + 8];
+
+    // The entries used least recently are the first to go
+    GetSumPath(entry, sumPath, sizeof(sumPath));
+    utime(sumPath, NULL);
+    atomic_fetch_add(&sHits, 1);
+    atomic_fetch_add(&sShardHits[GetShard(entry)], 1);
+    return true;
+}
+
+void AssetCacheStore(struct AssetCacheEntry *entry)
+{
+    if (entry->path[0] == 0)
+        return;
+
+    long size;
+    unsigned char *data = LoadFile(entry->outputPath, &size);
+
+    if (data == NULL)
+        return;
+
+    char sumPath[ASSET_CACHE_MAX_PATH + 8];
+    struct Sha256 sha;
+    unsigned char digest[32];
+
+    Sha256Init(&sha);
+    Sha256Update(&sha, data, size);
+    Sha256Final(&sha, digest);
+    GetSumPath(entry, sumPath, sizeof(sumPath));
+
+    // The .sum goes first, so an entry is never without one
+    if (SaveFile(sumPath, digest, sizeof(digest), false) && SaveFile(entry->path, data, size, true))
+    {
+        int shard = GetShard(entry);
+
+        atomic_fetch_add(&sShardMisses[shard], 1);
+        atomic_fetch_add(&sShardFiles[shard], 1);
+        atomic_fetch_add(&sShardBytes[shard], size);
+    }
+
+    free(data);
+}
+
+void AssetCacheReleaseOutput(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == 0 && st.st_nlink > 1)
+        RemoveFile(path);
+}
+
+void AssetCacheGetCounts(int *hits, int *misses)
+{
+    *hits = atomic_load(&sHits);
+    *misses = atomic_load(&sMisses);
+}
+
+void AssetCachePrintStats(void)
+{
+    struct ShardStats total = { 0 };
+
+    for (int shard = 0; shard < SHARD_COUNT; shard++)
+    {
+        struct ShardStats stats;
+
+        ReadStats(shard, &stats);
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.files += stats.files;
+        total.bytes += stats.bytes;
+    }
+
+    long long lookups = total.hits + total.misses;
+
+    printf("%s: %lld files, %.1f of %.0f MB, %lld hits, %lld misses (%.1f%% hit)\n", sCacheDir, total.files,
+           total.bytes / (1024.0 * 1024.0), sShardLimit * SHARD_COUNT / (1024.0 * 1024.0),
+           total.hits, total.misses, lookups > 0 ? 100.0 * total.hits / lookups : 0.0);
+}
+
+void AssetCacheClear(void)
+{
+    for (int shard = 0; shard < SHARD_COUNT; shard++)
+    {
+        struct ShardStats stats = { 0 };
+
+        // Trimming to nothing removes every entry, the counts start again from 0
+        TrimShard(shard, &stats, 0);
+        WriteStats(shard, &stats);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASSET_CACHE_MAX_PATH 1024
+
+// One conversion's place in the cache, see assetcache.c
+struct AssetCacheEntry
+{
+    char path[ASSET_CACHE_MAX_PATH]; // empty when the cache is off or the conversion can't be cached
+    char outputPath[ASSET_CACHE_MAX_PATH];
+    bool outputUnchanged; // the hit found the output already right and left it alone, timestamp and all
+};
+
+// Turns the cache on if ASSET_CACHE_DIR is set. Call it once, before any threads start.
+void AssetCacheInit(const char *tool, const char *argv0);
+bool AssetCacheEnabled(void);
+
+// Looks for a conversion with the same command line, the same input contents and
+// the same build of the tool. If there is one, its output is put at outputPath and
+// this returns true. Otherwise the tool should convert as usual and then call
+// AssetCacheStore with the same entry.
+bool AssetCacheFetch(struct AssetCacheEntry *entry, int argc, char **argv, const char *outputPath);
+void AssetCacheStore(struct AssetCacheEntry *entry);
+
+// Call before writing an output, whether or not the cache is on. If the output is
+// hard linked to a cache entry (ASSET_CACHE_LINK) it's removed first, so the new
+// contents don't end up in the entry too.
+void AssetCacheReleaseOutput(const char *path);
+
+// Hits and misses in this process
+void AssetCacheGetCounts(int *hits, int *misses);
+// Hits, misses and size of the whole cache, across every tool that's used it
+void AssetCachePrintStats(void);
+void AssetCacheClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ASSETCACHE_H
@@ -0,0 +1,387 @@
+// gbagfx batch MANIFEST [-j THREADS] [-skip-missing] [-unchanged FILE]
+//
+// Each line of the manifest is what would follow gbagfx on the command line,
+// e.g. "graphics/bag/menu.png graphics/bag/menu.4bpp -num_tiles 40". Blank
+// lines and lines starting with # are skipped, and MANIFEST can be - for
+// stdin. The conversions run across all the cores (or THREADS), but one that
+// reads a file an earlier line writes (as its input or in any of its options)
+// waits for that line and reads it from memory rather than the disk, so a
+// png -> 4bpp -> lz chain only ever decodes the png once. A file that already
+// has the contents a conversion gives isn't written again, and keeps its
+// timestamp so nothing made from it is rebuilt.
+//
+// With -skip-missing a line whose input doesn't exist (or comes from a line
+// that was skipped) is left out instead of stopping the batch, for when some
+// inputs are made by something other than gbagfx (e.g. `make graphics`).
+//
+// -unchanged FILE lists the files that were left alone, one per line. Make
+// still sees them as older than their inputs, so `make graphics` passes them
+// to the make that follows as -o to stop it converting them again.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "global.h"
+#include "util.h"
+#include "batch.h"
+#include "assetcache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_BATCH_THREADS 64
+
+struct BatchJob {
+    int line;
+    int argc;
+    char **argv; // argv[0] is "gbagfx", so it's laid out the same as the command line
+    int *waitFor; // earlier jobs that write a file this one uses
+    int waitCount;
+    int producer; // the job that writes argv[1], -1 if it's only on the disk
+    bool done;
+    bool skipped;
+};
+
+struct Batch {
+    struct BatchJob *jobs;
+    int jobCount;
+    int nextJob;
+    int skippedCount;
+    bool skipMissing;
+    void (*convert)(int argc, char **argv);
+    pthread_mutex_t lock;
+    pthread_cond_t jobDone;
+};
+
+static _Thread_local struct BatchJob *sCurrentJob;
+
+// FATAL_ERROR exits from whichever thread hit it, this says which line it was on
+static void ReportFailedJob(void)
+{
+    struct BatchJob *job = sCurrentJob;
+
+    if (job != NULL)
+        fprintf(stderr, "gbagfx batch: line %d (\"%s\" to \"%s\") failed.\n", job->line, job->argv[1], job->argv[2]);
+}
+
+static char *ReadManifest(char *path)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char *text = malloc(capacity);
+
+    for (;;)
+    {
+        if (text == NULL)
+            FATAL_ERROR("Failed to allocate memory for the manifest.\n");
+
+        size += fread(&text[size], 1, capacity - size - 1, fp);
+
+        if (size < capacity - 1)
+            break;
+
+        capacity *= 2;
+        text = realloc(text, capacity);
+    }
+
+    if (ferror(fp))
+        FATAL_ERROR("Failed to read \"%s\".\n", path);
+
+    if (fp != stdin)
+        fclose(fp);
+
+    text[size] = 0;
+    return text;
+}
+
+// Splits the manifest into jobs in place
+static void ParseManifest(struct Batch *batch, char *text)
+{
+    int maxJobs = 1;
+
+    for (char *c = text; *c != 0; c++)
+        maxJobs += *c == '\n';
+
+    batch->jobs = calloc(maxJobs, sizeof(struct BatchJob));
+
+    if (batch->jobs == NULL)
+        FATAL_ERROR("Failed to allocate memory for the manifest.\n");
+
+    char *line = text;
+
+    for (int lineNum = 1; line != NULL; lineNum++)
+    {
+        char *next = strchr(line, '\n');
+
+        if (next != NULL)
+            *next++ = 0;
+
+        int tokenCount = 0;
+
+        for (char *c = line; *c != 0; c++)
+            tokenCount += !strchr(" \t\r", *c) && (c == line || strchr(" \t\r", c[-1]));
+
+        if (tokenCount > 0 && line[strspn(line, " \t\r")] != '#')
+        {
+            if (tokenCount < 2)
+                FATAL_ERROR("Line %d of the manifest needs an input and an output path.\n", lineNum);
+
+            struct BatchJob *job = &batch->jobs[batch->jobCount++];
+
+            job->line = lineNum;
+            job->argv = malloc(sizeof(char *) * (tokenCount + 2));
+
+            if (job->argv == NULL)
+                FATAL_ERROR("Failed to allocate memory for the manifest.\n");
+
+            job->argv[job->argc++] = "gbagfx";
+
+            for (char *token = strtok(line, " \t\r"); token != NULL; token = strtok(NULL, " \t\r"))
+                job->argv[job->argc++] = token;
+
+            job->argv[job->argc] = NULL;
+        }
+
+        line = next;
+    }
+}
+
+// Works out which jobs have to wait for which, from the paths each one writes
+static void FindWaits(struct Batch *batch)
+{
+    int tableSize = 1;
+
+    while (tableSize < batch->jobCount * 2)
+        tableSize *= 2;
+
+    int *writers = malloc(sizeof(int) * tableSize); // the last job so far that writes each output, by hash of its path
+
+    if (writers == NULL)
+        FATAL_ERROR("Failed to allocate memory for the manifest.\n");
+
+    for (int i = 0; i < tableSize; i++)
+        writers[i] = -1;
+
+    for (int i = 0; i < batch->jobCount; i++)
+    {
+        struct BatchJob *job = &batch->jobs[i];
+
+        job->producer = -1;
+        job->waitFor = malloc(sizeof(int) * job->argc);
+
+        if (job->waitFor == NULL)
+            FATAL_ERROR("Failed to allocate memory for the manifest.\n");
+
+        // Every path it reads, and its own output in case an earlier line writes the same file
+        for (int j = 1; j < job->argc; j++)
+        {
+            unsigned int hash = 5381;
+
+            for (char *c = job->argv[j]; *c != 0; c++)
+                hash = hash * 33 + (unsigned char)*c;
+
+            int slot = hash & (tableSize - 1);
+
+            while (writers[slot] >= 0 && strcmp(batch->jobs[writers[slot]].argv[2], job->argv[j]) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+
+            if (writers[slot] >= 0)
+            {
+                job->waitFor[job->waitCount++] = writers[slot];
+
+                if (j == 1)
+                    job->producer = writers[slot];
+            }
+
+            if (j == 2)
+                writers[slot] = i;
+        }
+    }
+
+    free(writers);
+}
+
+static bool FileExists(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp != NULL)
+        fclose(fp);
+
+    return fp != NULL;
+}
+
+static void *RunJobs(void *arg)
+{
+    struct Batch *batch = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+
+        if (batch->nextJob == batch->jobCount)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+
+        // Jobs are taken in order, so anything this waits for has already been taken
+        struct BatchJob *job = &batch->jobs[batch->nextJob++];
+
+        for (int i = 0; i < job->waitCount; i++)
+        {
+            while (!batch->jobs[job->waitFor[i]].done)
+                pthread_cond_wait(&batch->jobDone, &batch->lock);
+        }
+
+        pthread_mutex_unlock(&batch->lock);
+
+        bool skip = false;
+
+        if (batch->skipMissing)
+            skip = job->producer >= 0 ? batch->jobs[job->producer].skipped : !FileExists(job->argv[1]);
+
+        if (!skip)
+        {
+            sCurrentJob = job;
+            batch->convert(job->argc, job->argv);
+            sCurrentJob = NULL;
+        }
+
+        pthread_mutex_lock(&batch->lock);
+        job->skipped = skip;
+        job->done = true;
+        batch->skippedCount += skip;
+        pthread_cond_broadcast(&batch->jobDone);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    return NULL;
+}
+
+static int GetCoreCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    return 1;
+#endif
+}
+
+void HandleBatchCommand(int argc, char **argv, void (*convert)(int argc, char **argv))
+{
+    struct Batch batch = { .convert = convert };
+    int threadCount = GetCoreCount();
+    char *unchangedListPath = NULL;
+
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx batch MANIFEST [-j THREADS] [-skip-missing] [-unchanged FILE]\n");
+
+    for (int i = 3; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No number of threads following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &threadCount))
+                FATAL_ERROR("Failed to parse number of threads.\n");
+        }
+        else if (strcmp(option, "-skip-missing") == 0)
+        {
+            batch.skipMissing = true;
+        }
+        else if (strcmp(option, "-unchanged") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file following \"-unchanged\".\n");
+
+            unchangedListPath = argv[++i];
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    if (threadCount < 1)
+        threadCount = 1;
+
+    if (threadCount > MAX_BATCH_THREADS)
+        threadCount = MAX_BATCH_THREADS;
+
+    char *manifest = ReadManifest(argv[2]);
+
+    ParseManifest(&batch, manifest);
+    FindWaits(&batch);
+
+    struct timespec start, end;
+    pthread_t threads[MAX_BATCH_THREADS];
+
+    timespec_get(&start, TIME_UTC);
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.jobDone, NULL);
+    KeepWrittenFiles();
+    atexit(ReportFailedJob);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        if (pthread_create(&threads[i], NULL, RunJobs, &batch) != 0)
+            FATAL_ERROR("Failed to start batch thread.\n");
+    }
+
+    for (int i = 0; i < threadCount; i++)
+        pthread_join(threads[i], NULL);
+
+    timespec_get(&end, TIME_UTC);
+
+    int written, unchanged;
+
+    if (unchangedListPath != NULL)
+        WriteUnchangedFileList(unchangedListPath);
+
+    GetWrittenFileCounts(&written, &unchanged);
+    printf("gbagfx batch: %d conversions in %.2fs on %d threads, %d files written, %d unchanged, %d skipped\n",
+           batch.jobCount - batch.skippedCount,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+           threadCount, written, unchanged, batch.skippedCount);
+
+    if (AssetCacheEnabled())
+    {
+        int hits, misses;
+
+        AssetCacheGetCounts(&hits, &misses);
+        printf("gbagfx batch: %d from the asset cache, %d converted\n", hits, misses);
+    }
+
+    for (int i = 0; i < batch.jobCount; i++)
+    {
+        free(batch.jobs[i].argv);
+        free(batch.jobs[i].waitFor);
+    }
+
+    free(batch.jobs);
+    free(manifest);
+}
@@ -0,0 +1,8 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Runs every conversion in a manifest (one "INPUT_PATH OUTPUT_PATH [options...]"
+// per line) across all the cores, see batch.c
+void HandleBatchCommand(int argc, char **argv, void (*convert)(int argc, char **argv));
+
+#endif // BATCH_H
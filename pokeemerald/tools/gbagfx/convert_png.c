@@ -1,11 +1,14 @@
 // Copyright (c) 2015 YamaArashi
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <setjmp.h>
 #include <png.h>
 #include "global.h"
 #include "convert_png.h"
 #include "gfx.h"
+#include "assetcache.h"
 
 static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
 {
@@ -45,43 +48,74 @@ static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
     return fp;
 }
 
-static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int destBitDepth, int numPixels)
+struct PngReader {
+    char *path;
+    FILE *fp;
+    png_structp png_ptr;
+    png_infop info_ptr;
+    int height;
+    int rowbytes;
+    int rowsRead;
+    unsigned char *wholeImage; // only for interlaced pngs, which have to be read all at once
+    // Repacking the png's pixels at the image's bit depth
+    bool repack;
+    int srcBitDepth;
+    int destBitDepth;
+    unsigned char *row;
+    int srcBytesLeft;
+    int destBytesLeft;
+    int destBit;
+};
+
+static void ReadPalette(png_structp png_ptr, png_infop info_ptr, char *path, struct Palette *palette)
 {
-    // Round the number of bits up to the next 8 and divide by 8 to get the number of bytes.
-    int srcSize = ((numPixels * srcBitDepth + 7) & ~7) / 8;
-    int destSize = ((numPixels * destBitDepth + 7) & ~7) / 8;
-    unsigned char *output = calloc(destSize, 1);
-    unsigned char *dest = output;
-    int i;
-    int j;
-    int destBit = 8 - destBitDepth;
-
-    for (i = 0; i < srcSize; i++)
-    {
-        unsigned char srcByte = src[i];
+    png_colorp colors;
+    int numColors;
 
-        for (j = 8 - srcBitDepth; j >= 0; j -= srcBitDepth)
-        {
-            unsigned char pixel = (srcByte >> j) % (1 << destBitDepth);
-            *dest |= pixel << destBit;
-            destBit -= destBitDepth;
-            if (destBit < 0)
-            {
-                dest++;
-                destBit = 8 - destBitDepth;
-            }
-        }
+    if (png_get_PLTE(png_ptr, info_ptr, &colors, &numColors) != PNG_INFO_PLTE)
+        FATAL_ERROR("Failed to retrieve palette from \"%s\".\n", path);
+
+    if (numColors > 256)
+        FATAL_ERROR("Images with more than 256 colors are not supported.\n");
+
+    palette->numColors = numColors;
+    for (int i = 0; i < numColors; i++) {
+        palette->colors[i].red = colors[i].red;
+        palette->colors[i].green = colors[i].green;
+        palette->colors[i].blue = colors[i].blue;
     }
+}
+
+static void ReadInterlacedImage(struct PngReader *reader)
+{
+    png_bytepp row_pointers = malloc(reader->height * sizeof(png_bytep));
+
+    reader->wholeImage = malloc(reader->height * reader->rowbytes);
+
+    if (row_pointers == NULL || reader->wholeImage == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
 
-    return output;
+    for (int i = 0; i < reader->height; i++)
+        row_pointers[i] = (png_bytep)(reader->wholeImage + (i * reader->rowbytes));
+
+    png_read_image(reader->png_ptr, row_pointers);
+
+    free(row_pointers);
 }
 
-void ReadPng(char *path, struct Image *image)
+// Reads the png's header and palette into image, leaving the pixels to ReadPngRows
+struct PngReader *OpenPng(char *path, struct Image *image)
 {
-    png_structp png_ptr;
-    png_infop info_ptr;
+    struct PngReader *reader = calloc(1, sizeof(struct PngReader));
 
-    FILE *fp = PngReadOpen(path, &png_ptr, &info_ptr);
+    if (reader == NULL)
+        FATAL_ERROR("Failed to allocate PNG reader.\n");
+
+    reader->path = path;
+    reader->fp = PngReadOpen(path, &reader->png_ptr, &reader->info_ptr);
+
+    png_structp png_ptr = reader->png_ptr;
+    png_infop info_ptr = reader->info_ptr;
 
     int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
 
@@ -91,72 +125,171 @@ void ReadPng(char *path, struct Image *image)
         FATAL_ERROR("\"%s\" has an unsupported color type.\n", path);
 
     // Check if the image has a palette so that we can tell if the colors need to be inverted later.
-    // Don't read the palette because it's not needed for now.
     image->hasPalette = (color_type == PNG_COLOR_TYPE_PALETTE);
 
+    if (image->hasPalette)
+        ReadPalette(png_ptr, info_ptr, path, &image->palette);
+    else
+        image->palette.numColors = 0;
+
     image->width = png_get_image_width(png_ptr, info_ptr);
     image->height = png_get_image_height(png_ptr, info_ptr);
 
-    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-
-    image->pixels = malloc(image->height * rowbytes);
+    reader->height = image->height;
+    reader->rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
-    if (image->pixels == NULL)
-        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+    if (bit_depth != image->bitDepth && image->tilemap.data.affine == NULL)
+    {
+        if (bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
+            FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
 
-    png_bytepp row_pointers = malloc(image->height * sizeof(png_bytep));
+        int numPixels = image->width * image->height;
 
-    if (row_pointers == NULL)
-        FATAL_ERROR("Failed to allocate row pointers.\n");
+        reader->repack = true;
+        reader->srcBitDepth = bit_depth;
+        reader->destBitDepth = image->bitDepth;
+        reader->srcBytesLeft = ((numPixels * bit_depth + 7) & ~7) / 8;
+        reader->destBytesLeft = ((numPixels * image->bitDepth + 7) & ~7) / 8;
+        reader->destBit = 8 - image->bitDepth;
+        reader->row = malloc(reader->rowbytes);
 
-    for (int i = 0; i < image->height; i++)
-        row_pointers[i] = (png_bytep)(image->pixels + (i * rowbytes));
+        if (reader->row == NULL)
+            FATAL_ERROR("Failed to allocate pixel buffer.\n");
+    }
 
     if (setjmp(png_jmpbuf(png_ptr)))
         FATAL_ERROR("Error reading from \"%s\".\n", path);
 
-    png_read_image(png_ptr, row_pointers);
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+        ReadInterlacedImage(reader);
 
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    return reader;
+}
 
-    free(row_pointers);
-    fclose(fp);
+// Repacks a png row's pixels into dest at the image's bit depth. Rows that don't
+// end on a byte boundary run on into the next one, as they always have.
+static unsigned char *RepackRow(struct PngReader *reader, unsigned char *src, unsigned char *dest)
+{
+    int srcSize = reader->rowbytes < reader->srcBytesLeft ? reader->rowbytes : reader->srcBytesLeft;
+    int srcBitDepth = reader->srcBitDepth;
+    int destBitDepth = reader->destBitDepth;
+    int destBytesLeft = reader->destBytesLeft;
+    int destBit = reader->destBit;
+    int i = 0;
 
-    if (bit_depth != image->bitDepth && image->tilemap.data.affine == NULL)
+    reader->srcBytesLeft -= srcSize;
+
+    // 8bpp pngs of 16 colors or fewer, two pixels to a byte
+    if (srcBitDepth == 8 && destBitDepth == 4 && destBit == 4)
     {
-        unsigned char *src = image->pixels;
+        for (; i + 1 < srcSize && destBytesLeft > 0; i += 2, destBytesLeft--)
+            *dest++ = (src[i] << 4) | (src[i + 1] & 0xF);
+    }
 
-        if (bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
-            FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
-        image->pixels = ConvertBitDepth(image->pixels, bit_depth, image->bitDepth, image->width * image->height);
-        free(src);
+    for (; i < srcSize; i++)
+    {
+        unsigned char srcByte = src[i];
+
+        for (int j = 8 - srcBitDepth; j >= 0 && destBytesLeft > 0; j -= srcBitDepth)
+        {
+            if (destBit == 8 - destBitDepth)
+                *dest = 0;
+
+            unsigned char pixel = (srcByte >> j) % (1 << destBitDepth);
+            *dest |= pixel << destBit;
+            destBit -= destBitDepth;
+            if (destBit < 0)
+            {
+                dest++;
+                destBytesLeft--;
+                destBit = 8 - destBitDepth;
+            }
+        }
     }
+
+    reader->destBytesLeft = destBytesLeft;
+    reader->destBit = destBit;
+    return dest;
+}
+
+static void ReadRows(struct PngReader *reader, unsigned char *dest, int numRows)
+{
+    if (reader->rowsRead + numRows > reader->height)
+        FATAL_ERROR("Tried to read past the last row of \"%s\".\n", reader->path);
+
+    for (int i = 0; i < numRows; i++)
+    {
+        // Rows already at the image's bit depth go straight to dest
+        unsigned char *row = reader->repack ? reader->row : dest;
+
+        if (reader->wholeImage != NULL)
+            row = reader->wholeImage + reader->rowsRead * reader->rowbytes;
+        else
+            png_read_row(reader->png_ptr, row, NULL);
+
+        if (reader->repack)
+        {
+            dest = RepackRow(reader, row, dest);
+        }
+        else
+        {
+            if (row != dest)
+                memcpy(dest, row, reader->rowbytes);
+
+            dest += reader->rowbytes;
+        }
+
+        reader->rowsRead++;
+    }
+}
+
+// The next numRows rows of the png, packed at the image's bit depth into buffer
+unsigned char *ReadPngRows(void *source, unsigned char *buffer, int numRows)
+{
+    struct PngReader *reader = source;
+
+    if (setjmp(png_jmpbuf(reader->png_ptr)))
+        FATAL_ERROR("Error reading from \"%s\".\n", reader->path);
+
+    ReadRows(reader, buffer, numRows);
+
+    return buffer;
+}
+
+void ClosePng(struct PngReader *reader)
+{
+    png_destroy_read_struct(&reader->png_ptr, &reader->info_ptr, NULL);
+    fclose(reader->fp);
+    free(reader->wholeImage);
+    free(reader->row);
+    free(reader);
+}
+
+void ReadPng(char *path, struct Image *image)
+{
+    struct PngReader *reader = OpenPng(path, image);
+    int size = reader->repack ? reader->destBytesLeft : image->height * reader->rowbytes;
+
+    image->pixels = calloc(size, 1);
+
+    if (image->pixels == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+    ReadPngRows(reader, image->pixels, image->height);
+    ClosePng(reader);
 }
 
 void ReadPngPalette(char *path, struct Palette *palette)
 {
     png_structp png_ptr;
     png_infop info_ptr;
-    png_colorp colors;
-    int numColors;
 
     FILE *fp = PngReadOpen(path, &png_ptr, &info_ptr);
 
     if (png_get_color_type(png_ptr, info_ptr) != PNG_COLOR_TYPE_PALETTE)
         FATAL_ERROR("The image \"%s\" does not contain a palette.\n", path);
 
-    if (png_get_PLTE(png_ptr, info_ptr, &colors, &numColors) != PNG_INFO_PLTE)
-        FATAL_ERROR("Failed to retrieve palette from \"%s\".\n", path);
-
-    if (numColors > 256)
-        FATAL_ERROR("Images with more than 256 colors are not supported.\n");
-
-    palette->numColors = numColors;
-    for (int i = 0; i < numColors; i++) {
-        palette->colors[i].red = colors[i].red;
-        palette->colors[i].green = colors[i].green;
-        palette->colors[i].blue = colors[i].blue;
-    }
+    ReadPalette(png_ptr, info_ptr, path, palette);
 
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
@@ -183,6 +316,8 @@ void SetPngPalette(png_structp png_ptr, png_infop info_ptr, struct Palette *pale
 
 void WritePng(char *path, struct Image *image)
 {
+    AssetCacheReleaseOutput(path);
+
     FILE *fp = fopen(path, "wb");
 
     if (fp == NULL)
@@ -5,7 +5,12 @@
 
 #include "gfx.h"
 
+struct PngReader;
+
 void ReadPng(char *path, struct Image *image);
+struct PngReader *OpenPng(char *path, struct Image *image);
+unsigned char *ReadPngRows(void *reader, unsigned char *buffer, int numRows);
+void ClosePng(struct PngReader *reader);
 void WritePng(char *path, struct Image *image);
 void ReadPngPalette(char *path, struct Palette *palette);
 
@@ -8,6 +8,7 @@
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
+#include "tile_kernels.h"
 
 #define GET_GBA_PAL_RED(x)   (((x) >>  0) & 0x1F)
 #define GET_GBA_PAL_GREEN(x) (((x) >>  5) & 0x1F)
@@ -36,6 +37,10 @@ static void AdvanceMetatilePosition(int *subTileX, int *subTileY, int *metatileX
 	}
 }
 
+// Each of these only moves whole rows of a tile around, what happens to the
+// pixels themselves is done over the whole buffer in one go, see tile_kernels.c
+
+// src is changed, the pixels are put right before they're moved
 static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
@@ -44,18 +49,15 @@ static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int nu
 	int metatileY = 0;
 	int pitch = metatilesWide * metatileWidth;
 
+	ReverseBits(src, numTiles * 8, invertColors);
+
 	for (int i = 0; i < numTiles; i++) {
+		int destX = metatileX * metatileWidth + subTileX;
+
 		for (int j = 0; j < 8; j++) {
 			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
-			int destX = metatileX * metatileWidth + subTileX;
-			unsigned char srcPixelOctet = *src++;
-			unsigned char *destPixelOctet = &dest[destY * pitch + destX];
-
-			for (int k = 0; k < 8; k++) {
-				*destPixelOctet <<= 1;
-				*destPixelOctet |= (srcPixelOctet & 1) ^ invertColors;
-				srcPixelOctet >>= 1;
-			}
+
+			dest[destY * pitch + destX] = *src++;
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
@@ -70,23 +72,16 @@ static void ConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int nu
 	int metatileY = 0;
 	int pitch = (metatilesWide * metatileWidth) * 4;
 
+	SwapNybbles(src, numTiles * 32, invertColors);
+
 	for (int i = 0; i < numTiles; i++) {
+		int destX = (metatileX * metatileWidth + subTileX) * 4;
+
 		for (int j = 0; j < 8; j++) {
 			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
 
-			for (int k = 0; k < 4; k++) {
-				int destX = (metatileX * metatileWidth + subTileX) * 4 + k;
-				unsigned char srcPixelPair = *src++;
-				unsigned char leftPixel = srcPixelPair & 0xF;
-				unsigned char rightPixel = srcPixelPair >> 4;
-
-				if (invertColors) {
-					leftPixel = 15 - leftPixel;
-					rightPixel = 15 - rightPixel;
-				}
-
-				dest[destY * pitch + destX] = (leftPixel << 4) | rightPixel;
-			}
+			memcpy(&dest[destY * pitch + destX], src, 4);
+			src += 4;
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
@@ -101,19 +96,17 @@ static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int nu
 	int metatileY = 0;
 	int pitch = (metatilesWide * metatileWidth) * 8;
 
+	if (invertColors)
+		InvertBytes(src, numTiles * 64);
+
 	for (int i = 0; i < numTiles; i++) {
+		int destX = (metatileX * metatileWidth + subTileX) * 8;
+
 		for (int j = 0; j < 8; j++) {
 			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
 
-			for (int k = 0; k < 8; k++) {
-				int destX = (metatileX * metatileWidth + subTileX) * 8 + k;
-				unsigned char srcPixel = *src++;
-
-				if (invertColors)
-					srcPixel = 255 - srcPixel;
-
-				dest[destY * pitch + destX] = srcPixel;
-			}
+			memcpy(&dest[destY * pitch + destX], src, 8);
+			src += 8;
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
@@ -127,23 +120,21 @@ static void ConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numT
 	int metatileX = 0;
 	int metatileY = 0;
 	int pitch = metatilesWide * metatileWidth;
+	unsigned char *tiles = dest;
 
 	for (int i = 0; i < numTiles; i++) {
+		int srcX = metatileX * metatileWidth + subTileX;
+
 		for (int j = 0; j < 8; j++) {
 			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
-			int srcX = metatileX * metatileWidth + subTileX;
-			unsigned char srcPixelOctet = src[srcY * pitch + srcX];
-			unsigned char *destPixelOctet = dest++;
-
-			for (int k = 0; k < 8; k++) {
-				*destPixelOctet <<= 1;
-				*destPixelOctet |= (srcPixelOctet & 1) ^ invertColors;
-				srcPixelOctet >>= 1;
-			}
+
+			*dest++ = src[srcY * pitch + srcX];
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
+
+	ReverseBits(tiles, numTiles * 8, invertColors);
 }
 
 static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
@@ -153,28 +144,22 @@ static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numT
 	int metatileX = 0;
 	int metatileY = 0;
 	int pitch = (metatilesWide * metatileWidth) * 4;
+	unsigned char *tiles = dest;
 
 	for (int i = 0; i < numTiles; i++) {
+		int srcX = (metatileX * metatileWidth + subTileX) * 4;
+
 		for (int j = 0; j < 8; j++) {
 			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
 
-			for (int k = 0; k < 4; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 4 + k;
-				unsigned char srcPixelPair = src[srcY * pitch + srcX];
-				unsigned char leftPixel = srcPixelPair >> 4;
-				unsigned char rightPixel = srcPixelPair & 0xF;
-
-				if (invertColors) {
-					leftPixel = 15 - leftPixel;
-					rightPixel = 15 - rightPixel;
-				}
-
-				*dest++ = (rightPixel << 4) | leftPixel;
-			}
+			memcpy(dest, &src[srcY * pitch + srcX], 4);
+			dest += 4;
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
+
+	SwapNybbles(tiles, numTiles * 32, invertColors);
 }
 
 static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
@@ -184,24 +169,53 @@ static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numT
 	int metatileX = 0;
 	int metatileY = 0;
 	int pitch = (metatilesWide * metatileWidth) * 8;
+	unsigned char *tiles = dest;
 
 	for (int i = 0; i < numTiles; i++) {
+		int srcX = (metatileX * metatileWidth + subTileX) * 8;
+
 		for (int j = 0; j < 8; j++) {
 			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
 
-			for (int k = 0; k < 8; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 8 + k;
-				unsigned char srcPixel = src[srcY * pitch + srcX];
-
-				if (invertColors)
-					srcPixel = 255 - srcPixel;
-
-				*dest++ = srcPixel;
-			}
+			memcpy(dest, &src[srcY * pitch + srcX], 8);
+			dest += 8;
 		}
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
+
+	if (invertColors)
+		InvertBytes(tiles, numTiles * 64);
+}
+
+void ConvertFromTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	switch (bitDepth) {
+	case 1:
+		ConvertFromTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		ConvertFromTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		ConvertFromTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
+}
+
+void ConvertToTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	switch (bitDepth) {
+	case 1:
+		ConvertToTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		ConvertToTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		ConvertToTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
 }
 
 // For untiled, plain images
@@ -224,92 +238,7 @@ static void DecodeAffineTilemap(unsigned char *input, unsigned char *output, uns
     }
 }
 
-#define REVERSE_BIT_ORDER(x) ({ \
-      ((((x) >> 7) & 1) << 0)   \
-    | ((((x) >> 6) & 1) << 1)   \
-    | ((((x) >> 5) & 1) << 2)   \
-    | ((((x) >> 4) & 1) << 3)   \
-    | ((((x) >> 3) & 1) << 4)   \
-    | ((((x) >> 2) & 1) << 5)   \
-    | ((((x) >> 1) & 1) << 6)   \
-    | ((((x) >> 0) & 1) << 7);  \
-})
-
-#define SWAP_BYTES(a, b) ({   \
-    unsigned char tmp = *(a); \
-    *(a) = *(b);              \
-    *(b) = tmp;               \
-})
-
-#define NSWAP(x) ({ (((x) >> 4) & 0xF) | (((x) << 4) & 0xF0); })
-
-#define SWAP_NYBBLES(a, b) ({        \
-    unsigned char tmp = NSWAP(*(a)); \
-    *(a) = NSWAP(*(b));              \
-    *(b) = tmp;                      \
-})
-
-static void VflipTile(unsigned char * tile, int bitDepth)
-{
-    int i;
-    switch (bitDepth)
-    {
-    case 1:
-        SWAP_BYTES(&tile[0], &tile[7]);
-        SWAP_BYTES(&tile[1], &tile[6]);
-        SWAP_BYTES(&tile[2], &tile[5]);
-        SWAP_BYTES(&tile[3], &tile[4]);
-        break;
-    case 4:
-        for (i = 0; i < 4; i++)
-        {
-            SWAP_BYTES(&tile[i + 0], &tile[i + 28]);
-            SWAP_BYTES(&tile[i + 4], &tile[i + 24]);
-            SWAP_BYTES(&tile[i + 8], &tile[i + 20]);
-            SWAP_BYTES(&tile[i + 12], &tile[i + 16]);
-        }
-        break;
-    case 8:
-        for (i = 0; i < 8; i++)
-        {
-            SWAP_BYTES(&tile[i + 0], &tile[i + 56]);
-            SWAP_BYTES(&tile[i + 8], &tile[i + 48]);
-            SWAP_BYTES(&tile[i + 16], &tile[i + 40]);
-            SWAP_BYTES(&tile[i + 24], &tile[i + 32]);
-        }
-        break;
-    }
-}
-
-static void HflipTile(unsigned char * tile, int bitDepth)
-{
-    int i;
-    switch (bitDepth)
-    {
-    case 1:
-        for (i = 0; i < 8; i++)
-            tile[i] = REVERSE_BIT_ORDER(tile[i]);
-        break;
-    case 4:
-        for (i = 0; i < 8; i++)
-        {
-            SWAP_NYBBLES(&tile[4 * i + 0], &tile[4 * i + 3]);
-            SWAP_NYBBLES(&tile[4 * i + 1], &tile[4 * i + 2]);
-        }
-        break;
-    case 8:
-        for (i = 0; i < 8; i++)
-        {
-            SWAP_BYTES(&tile[8 * i + 0], &tile[8 * i + 7]);
-            SWAP_BYTES(&tile[8 * i + 1], &tile[8 * i + 6]);
-            SWAP_BYTES(&tile[8 * i + 2], &tile[8 * i + 5]);
-            SWAP_BYTES(&tile[8 * i + 3], &tile[8 * i + 4]);
-        }
-        break;
-    }
-}
-
-static void DecodeNonAffineTilemap(unsigned char *input, unsigned char *output, struct NonAffineTile *tilemap, int tileSize, int outTileSize, int bitDepth, int numTiles)
+void DecodeNonAffineTilemap(unsigned char *input, unsigned char *output, struct NonAffineTile *tilemap, int tileSize, int outTileSize, int bitDepth, int numTiles)
 {
     unsigned char * in_tile;
     unsigned char * out_tile = output;
@@ -320,25 +249,11 @@ static void DecodeNonAffineTilemap(unsigned char *input, unsigned char *output,
         if (tileSize == outTileSize)
             memcpy(out_tile, in_tile, tileSize);
         else
-        {
-            for (int j = 0; j < 64; j++)
-            {
-                int shift = (j & 1) * 4;
-                out_tile[j] = (in_tile[j / 2] & (0xF << shift)) >> shift;
-            }
-        }
+            UnpackNybbles(in_tile, out_tile, tileSize, (15 - tilemap[i].palno) << 4); // Only 4bpp tiles are ever unpacked
         if (tilemap[i].hflip)
             HflipTile(out_tile, effectiveBitDepth);
         if (tilemap[i].vflip)
             VflipTile(out_tile, effectiveBitDepth);
-        if (bitDepth == 4 && effectiveBitDepth == 8)
-        {
-            for (int j = 0; j < 64; j++)
-            {
-                out_tile[j] &= 0xF;
-                out_tile[j] |= (15 - tilemap[i].palno) << 4;
-            }
-        }
         out_tile += outTileSize;
     }
 }
@@ -393,22 +308,14 @@ void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHe
 
 	int metatilesWide = tilesWidth / metatileWidth;
 
-	switch (image->bitDepth) {
-	case 1:
-		ConvertFromTiles1Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertFromTiles4Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertFromTiles8Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	ConvertFromTiles(buffer, image->pixels, image->bitDepth, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
 
 	free(buffer);
 }
 
-void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+// Converts the image a band of metatiles at a time as readRows hands over its rows,
+// so the whole image never has to be in memory at once
+void WriteTileImageFromRows(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, ReadRowsFunc readRows, void *source, bool invertColors)
 {
 	int tileSize = image->bitDepth * 8;
 
@@ -442,19 +349,21 @@ void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, in
 		FATAL_ERROR("Failed to allocate memory for pixels.\n");
 
 	int metatilesWide = tilesWidth / metatileWidth;
+	int bandHeight = metatileHeight * 8;
+	int bandTiles = tilesWidth * metatileHeight;
+	unsigned char *band = malloc(bandHeight * image->width * image->bitDepth / 8);
 
-	switch (image->bitDepth) {
-	case 1:
-		ConvertToTiles1Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertToTiles4Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertToTiles8Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
+	if (band == NULL)
+		FATAL_ERROR("Failed to allocate memory for pixels.\n");
+
+	for (int tile = 0; tile < maxNumTiles; tile += bandTiles) {
+		unsigned char *rows = readRows(source, band, bandHeight);
+
+		ConvertToTiles(rows, buffer + tile * tileSize, image->bitDepth, bandTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
 	}
 
+	free(band);
+
 	bool zeroPadded = true;
 	for (int i = bufferSize; i < maxBufferSize && zeroPadded; i++) {
 		if (buffer[i] != 0)
@@ -479,6 +388,28 @@ void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, in
 	free(buffer);
 }
 
+// Rows straight out of an image that's already in memory
+struct ImageRows {
+	unsigned char *next;
+	int rowSize;
+};
+
+static unsigned char *ReadImageRows(void *source, unsigned char *buffer UNUSED, int numRows)
+{
+	struct ImageRows *rows = source;
+	unsigned char *first = rows->next;
+
+	rows->next += numRows * rows->rowSize;
+	return first;
+}
+
+void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+{
+	struct ImageRows rows = { image->pixels, image->width * image->bitDepth / 8 };
+
+	WriteTileImageFromRows(path, numTilesMode, numTiles, metatileWidth, metatileHeight, image, ReadImageRows, &rows, invertColors);
+}
+
 void ReadPlainImage(char *path, int dataWidth, struct Image *image, bool invertColors)
 {
 	int fileSize;
@@ -569,10 +500,7 @@ void ReadGbaPalette(char *path, struct Palette *palette)
 
 void WriteGbaPalette(char *path, struct Palette *palette)
 {
-	FILE *fp = fopen(path, "wb");
-
-	if (fp == NULL)
-		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+	unsigned char buffer[256 * 2];
 
 	for (int i = 0; i < palette->numColors; i++) {
 		unsigned char red = DOWNCONVERT_BIT_DEPTH(palette->colors[i].red);
@@ -581,9 +509,9 @@ void WriteGbaPalette(char *path, struct Palette *palette)
 
 		uint16_t paletteEntry = SET_GBA_PAL(red, green, blue);
 
-		fputc(paletteEntry & 0xFF, fp);
-		fputc(paletteEntry >> 8, fp);
+		buffer[i * 2] = paletteEntry & 0xFF;
+		buffer[i * 2 + 1] = paletteEntry >> 8;
 	}
 
-	fclose(fp);
+	WriteWholeFile(path, buffer, palette->numColors * 2);
 }
@@ -50,11 +50,18 @@ enum NumTilesMode {
     NUM_TILES_ERROR,
 };
 
+// Returns the next numRows rows of an image, packed at its bit depth, either in buffer or somewhere of its own
+typedef unsigned char *(*ReadRowsFunc)(void *source, unsigned char *buffer, int numRows);
+
 void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
+void WriteTileImageFromRows(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, ReadRowsFunc readRows, void *source, bool invertColors);
 void ReadPlainImage(char *path, int dataWidth, struct Image *image, bool invertColors);
 void WritePlainImage(char *path, int dataWidth, struct Image *image, bool invertColors);
 void FreeImage(struct Image *image);
+void ConvertFromTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors);
+void ConvertToTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors);
+void DecodeNonAffineTilemap(unsigned char *input, unsigned char *output, struct NonAffineTile *tilemap, int tileSize, int outTileSize, int bitDepth, int numTiles);
 void ReadGbaPalette(char *path, struct Palette *palette);
 void WriteGbaPalette(char *path, struct Palette *palette);
 
@@ -5,6 +5,7 @@
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
+#include "assetcache.h"
 
 // Read/write Paint Shop Pro palette files.
 
@@ -156,6 +157,8 @@ void ReadJascPalette(char *path, struct Palette *palette)
 
 void WriteJascPalette(char *path, struct Palette *palette)
 {
+    AssetCacheReleaseOutput(path);
+
     FILE *fp = fopen(path, "wb");
 
     fputs("JASC-PAL\r\n", fp);
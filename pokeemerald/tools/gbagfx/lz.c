@@ -69,85 +69,254 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+// Every earlier position that starts with the same 3 bytes (or ones that
+// hash the same) is on one chain, newest first, so a search only ever
+// compares the few positions that could start a block.
+#define LZ_HASH_BITS 15
+#define LZ_MAX_DISTANCE 0x1000
+#define LZ_MIN_BLOCK_SIZE 3
+#define LZ_MAX_BLOCK_SIZE 18
+
+struct LZMatchFinder {
+	int *head; // newest position for each hash, -1 if there isn't one
+	int *prev; // the position before each one with the same hash
+	int inserted; // positions below this are on the chains
+};
+
+static unsigned int LZHash(unsigned char *src)
 {
-	if (srcSize <= 0)
-		goto fail;
+	unsigned int key = (src[0] << 16) | (src[1] << 8) | src[2];
+
+	return (key * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void InitMatchFinder(struct LZMatchFinder *finder, int srcSize)
+{
+	finder->head = malloc(sizeof(int) << LZ_HASH_BITS);
+	finder->prev = malloc(sizeof(int) * srcSize);
+
+	if (finder->head == NULL || finder->prev == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ match finder.\n");
+
+	for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+		finder->head[i] = -1;
+
+	finder->inserted = 0;
+}
+
+static void FreeMatchFinder(struct LZMatchFinder *finder)
+{
+	free(finder->head);
+	free(finder->prev);
+}
+
+// Finds the longest block for srcPos, and the shortest distance of the ones
+// that long. That's the one the brute force search from minDistance up to
+// 0x1000 used to find, so the output hasn't changed.
+static int FindBlock(struct LZMatchFinder *finder, unsigned char *src, int srcSize, int srcPos, int minDistance, int *blockDistance)
+{
+	int maxBlockSize = srcSize - srcPos;
+
+	if (maxBlockSize < LZ_MIN_BLOCK_SIZE)
+		return 0;
+
+	if (maxBlockSize > LZ_MAX_BLOCK_SIZE)
+		maxBlockSize = LZ_MAX_BLOCK_SIZE;
+
+	// Only positions at least minDistance back go on the chains
+	while (finder->inserted <= srcPos - minDistance) {
+		unsigned int hash = LZHash(&src[finder->inserted]);
+
+		finder->prev[finder->inserted] = finder->head[hash];
+		finder->head[hash] = finder->inserted;
+		finder->inserted++;
+	}
+
+	int bestBlockSize = 0;
 
+	for (int blockStart = finder->head[LZHash(&src[srcPos])]; blockStart >= 0; blockStart = finder->prev[blockStart]) {
+		int distance = srcPos - blockStart;
+
+		if (distance > LZ_MAX_DISTANCE)
+			break;
+
+		// Anything that can't beat the best so far differs at that byte
+		if (src[blockStart + bestBlockSize] != src[srcPos + bestBlockSize])
+			continue;
+
+		int blockSize = 0;
+
+		while (blockSize < maxBlockSize && src[blockStart + blockSize] == src[srcPos + blockSize])
+			blockSize++;
+
+		if (blockSize > bestBlockSize) {
+			*blockDistance = distance;
+			bestBlockSize = blockSize;
+
+			if (blockSize == maxBlockSize)
+				break;
+		}
+	}
+
+	return bestBlockSize >= LZ_MIN_BLOCK_SIZE ? bestBlockSize : 0;
+}
+
+struct LZWriter {
+	unsigned char *dest;
+	int destPos;
+	int flagsPos;
+	int count; // blocks and literal bytes written
+};
+
+static void StartWriter(struct LZWriter *writer, int srcSize)
+{
 	int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
 
 	// Round up to the next multiple of four.
 	worstCaseDestSize = (worstCaseDestSize + 3) & ~3;
 
-	unsigned char *dest = malloc(worstCaseDestSize);
+	writer->dest = malloc(worstCaseDestSize);
 
-	if (dest == NULL)
-		goto fail;
+	if (writer->dest == NULL)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
 
 	// header
-	dest[0] = 0x10; // LZ compression type
-	dest[1] = (unsigned char)srcSize;
-	dest[2] = (unsigned char)(srcSize >> 8);
-	dest[3] = (unsigned char)(srcSize >> 16);
+	writer->dest[0] = 0x10; // LZ compression type
+	writer->dest[1] = (unsigned char)srcSize;
+	writer->dest[2] = (unsigned char)(srcSize >> 8);
+	writer->dest[3] = (unsigned char)(srcSize >> 16);
+
+	writer->destPos = 4;
+	writer->count = 0;
+}
+
+// Each group of 8 starts with its flags byte
+static void NextFlag(struct LZWriter *writer)
+{
+	if (writer->count % 8 == 0) {
+		writer->flagsPos = writer->destPos++;
+		writer->dest[writer->flagsPos] = 0;
+	}
+
+	writer->count++;
+}
+
+static void WriteLiteral(struct LZWriter *writer, unsigned char value)
+{
+	NextFlag(writer);
+	writer->dest[writer->destPos++] = value;
+}
+
+static void WriteBlock(struct LZWriter *writer, int blockSize, int blockDistance)
+{
+	NextFlag(writer);
+	writer->dest[writer->flagsPos] |= 0x80 >> ((writer->count - 1) % 8);
+
+	blockSize -= 3;
+	blockDistance--;
+	writer->dest[writer->destPos++] = (blockSize << 4) | ((unsigned int)blockDistance >> 8);
+	writer->dest[writer->destPos++] = (unsigned char)blockDistance;
+}
+
+static unsigned char *FinishWriter(struct LZWriter *writer, int *compressedSize)
+{
+	// Pad to multiple of 4 bytes.
+	while (writer->destPos % 4 != 0)
+		writer->dest[writer->destPos++] = 0;
+
+	*compressedSize = writer->destPos;
+	return writer->dest;
+}
+
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
+
+	struct LZWriter writer;
+	struct LZMatchFinder finder;
+
+	StartWriter(&writer, srcSize);
+	InitMatchFinder(&finder, srcSize);
 
 	int srcPos = 0;
-	int destPos = 4;
 
-	for (;;) {
-		unsigned char *flags = &dest[destPos++];
-		*flags = 0;
+	while (srcPos < srcSize) {
+		int blockDistance;
+		int blockSize = FindBlock(&finder, src, srcSize, srcPos, minDistance, &blockDistance);
 
-		for (int i = 0; i < 8; i++) {
-			int bestBlockDistance = 0;
-			int bestBlockSize = 0;
-			int blockDistance = minDistance;
+		if (blockSize != 0) {
+			WriteBlock(&writer, blockSize, blockDistance);
+			srcPos += blockSize;
+		} else {
+			WriteLiteral(&writer, src[srcPos++]);
+		}
+	}
 
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
-				int blockStart = srcPos - blockDistance;
-				int blockSize = 0;
+	FreeMatchFinder(&finder);
+	return FinishWriter(&writer, compressedSize);
+}
 
-				while (blockSize < 18
-				    && srcPos + blockSize < srcSize
-				    && src[blockStart + blockSize] == src[srcPos + blockSize])
-					blockSize++;
+// Rather than always taking the longest block, picks the blocks and literals
+// that come to the fewest bits overall (9 for a literal and 17 for a block,
+// counting its flag). A block can be cut short to any length from 3 up, so
+// only the longest one at each position has to be found.
+unsigned char *LZCompressOptimal(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
 
-				if (blockSize > bestBlockSize) {
-					bestBlockDistance = blockDistance;
-					bestBlockSize = blockSize;
+	int *blockSizes = malloc(sizeof(int) * srcSize);
+	int *blockDistances = malloc(sizeof(int) * srcSize);
+	int *costs = malloc(sizeof(int) * (srcSize + 1));
 
-					if (blockSize == 18)
-						break;
-				}
+	if (blockSizes == NULL || blockDistances == NULL || costs == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ optimal parse.\n");
 
-				blockDistance++;
-			}
+	struct LZMatchFinder finder;
 
-			if (bestBlockSize >= 3) {
-				*flags |= (0x80 >> i);
-				srcPos += bestBlockSize;
-				bestBlockSize -= 3;
-				bestBlockDistance--;
-				dest[destPos++] = (bestBlockSize << 4) | ((unsigned int)bestBlockDistance >> 8);
-				dest[destPos++] = (unsigned char)bestBlockDistance;
-			} else {
-				dest[destPos++] = src[srcPos++];
-			}
+	InitMatchFinder(&finder, srcSize);
 
-			if (srcPos == srcSize) {
-				// Pad to multiple of 4 bytes.
-				int remainder = destPos % 4;
+	for (int srcPos = 0; srcPos < srcSize; srcPos++)
+		blockSizes[srcPos] = FindBlock(&finder, src, srcSize, srcPos, minDistance, &blockDistances[srcPos]);
 
-				if (remainder != 0) {
-					for (int i = 0; i < 4 - remainder; i++)
-						dest[destPos++] = 0;
-				}
+	FreeMatchFinder(&finder);
 
-				*compressedSize = destPos;
-				return dest;
+	// costs[i] is the fewest bits src[i..] can be written in, and blockSizes
+	// becomes the length to take there (0 for a literal)
+	costs[srcSize] = 0;
+
+	for (int srcPos = srcSize - 1; srcPos >= 0; srcPos--) {
+		int longest = blockSizes[srcPos];
+
+		costs[srcPos] = 9 + costs[srcPos + 1];
+		blockSizes[srcPos] = 0;
+
+		for (int blockSize = LZ_MIN_BLOCK_SIZE; blockSize <= longest; blockSize++) {
+			if (17 + costs[srcPos + blockSize] < costs[srcPos]) {
+				costs[srcPos] = 17 + costs[srcPos + blockSize];
+				blockSizes[srcPos] = blockSize;
 			}
 		}
 	}
 
-fail:
-	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+	struct LZWriter writer;
+
+	StartWriter(&writer, srcSize);
+
+	int srcPos = 0;
+
+	while (srcPos < srcSize) {
+		if (blockSizes[srcPos] != 0) {
+			WriteBlock(&writer, blockSizes[srcPos], blockDistances[srcPos]);
+			srcPos += blockSizes[srcPos];
+		} else {
+			WriteLiteral(&writer, src[srcPos++]);
+		}
+	}
+
+	free(blockSizes);
+	free(blockDistances);
+	free(costs);
+	return FinishWriter(&writer, compressedSize);
 }
@@ -0,0 +1,221 @@
+// Times LZCompress and LZCompressOptimal against the brute force search
+// LZCompress used to do, over whatever files it's given. `make lzbench`
+// from pokeemerald's root runs it over every .lz the ROM uses.
+//
+// Usage: lzbench [-search N] [-no-reference] FILES... (- reads the paths from stdin)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "global.h"
+#include "lz.h"
+#include "util.h"
+
+struct Encoder {
+    const char *name;
+    unsigned char *(*compress)(unsigned char *src, int srcSize, int *compressedSize, const int minDistance);
+    double seconds;
+    long long compressedSize;
+};
+
+// LZCompress as it was, searching every distance for every byte
+static unsigned char *ReferenceCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+    int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
+
+    worstCaseDestSize = (worstCaseDestSize + 3) & ~3;
+
+    unsigned char *dest = malloc(worstCaseDestSize);
+
+    if (dest == NULL)
+        FATAL_ERROR("Failed to allocate memory for reference compression.\n");
+
+    dest[0] = 0x10;
+    dest[1] = (unsigned char)srcSize;
+    dest[2] = (unsigned char)(srcSize >> 8);
+    dest[3] = (unsigned char)(srcSize >> 16);
+
+    int srcPos = 0;
+    int destPos = 4;
+
+    for (;;)
+    {
+        unsigned char *flags = &dest[destPos++];
+        *flags = 0;
+
+        for (int i = 0; i < 8; i++)
+        {
+            int bestBlockDistance = 0;
+            int bestBlockSize = 0;
+            int blockDistance = minDistance;
+
+            while (blockDistance <= srcPos && blockDistance <= 0x1000)
+            {
+                int blockStart = srcPos - blockDistance;
+                int blockSize = 0;
+
+                while (blockSize < 18
+                    && srcPos + blockSize < srcSize
+                    && src[blockStart + blockSize] == src[srcPos + blockSize])
+                    blockSize++;
+
+                if (blockSize > bestBlockSize)
+                {
+                    bestBlockDistance = blockDistance;
+                    bestBlockSize = blockSize;
+
+                    if (blockSize == 18)
+                        break;
+                }
+
+                blockDistance++;
+            }
+
+            if (bestBlockSize >= 3)
+            {
+                *flags |= (0x80 >> i);
+                srcPos += bestBlockSize;
+                bestBlockSize -= 3;
+                bestBlockDistance--;
+                dest[destPos++] = (bestBlockSize << 4) | ((unsigned int)bestBlockDistance >> 8);
+                dest[destPos++] = (unsigned char)bestBlockDistance;
+            }
+            else
+            {
+                dest[destPos++] = src[srcPos++];
+            }
+
+            if (srcPos == srcSize)
+            {
+                while (destPos % 4 != 0)
+                    dest[destPos++] = 0;
+
+                *compressedSize = destPos;
+                return dest;
+            }
+        }
+    }
+}
+
+static struct Encoder sEncoders[] =
+{
+    { "reference", ReferenceCompress, 0, 0 },
+    { "LZCompress", LZCompress, 0, 0 },
+    { "LZCompressOptimal", LZCompressOptimal, 0, 0 },
+};
+static int sMinDistance = 2;
+static bool sSkipReference = false;
+static int sFileCount = 0;
+static int sMismatchCount = 0;
+static long long sTotalSize = 0;
+
+static void BenchFile(char *path)
+{
+    int encoderCount = sizeof(sEncoders) / sizeof(sEncoders[0]);
+    int fileSize;
+    unsigned char *buffer = ReadWholeFile(path, &fileSize);
+
+    if (fileSize == 0)
+    {
+        free(buffer);
+        return;
+    }
+
+    unsigned char *outputs[3] = { NULL, NULL, NULL };
+    int outputSizes[3];
+
+    for (int j = sSkipReference ? 1 : 0; j < encoderCount; j++)
+    {
+        clock_t start = clock();
+
+        outputs[j] = sEncoders[j].compress(buffer, fileSize, &outputSizes[j], sMinDistance);
+        sEncoders[j].seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+        sEncoders[j].compressedSize += outputSizes[j];
+
+        int uncompressedSize;
+        unsigned char *uncompressed = LZDecompress(outputs[j], outputSizes[j], &uncompressedSize);
+
+        if (uncompressedSize != fileSize || memcmp(uncompressed, buffer, fileSize) != 0)
+            FATAL_ERROR("%s: %s doesn't decompress to the input.\n", path, sEncoders[j].name);
+
+        free(uncompressed);
+    }
+
+    if (!sSkipReference && (outputSizes[0] != outputSizes[1] || memcmp(outputs[0], outputs[1], outputSizes[0]) != 0))
+    {
+        fprintf(stderr, "%s: LZCompress doesn't match the reference.\n", path);
+        sMismatchCount++;
+    }
+
+    for (int j = 0; j < encoderCount; j++)
+        free(outputs[j]);
+
+    free(buffer);
+    sFileCount++;
+    sTotalSize += fileSize;
+}
+
+int main(int argc, char **argv)
+{
+    int encoderCount = sizeof(sEncoders) / sizeof(sEncoders[0]);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-search") == 0)
+        {
+            if (i + 1 >= argc || !ParseNumber(argv[++i], NULL, 10, &sMinDistance) || sMinDistance < 1)
+                FATAL_ERROR("\"-search\" needs a positive distance.\n");
+        }
+        else if (strcmp(argv[i], "-no-reference") == 0)
+        {
+            sSkipReference = true;
+        }
+        else if (strcmp(argv[i], "-") == 0)
+        {
+            // One path per line
+            char path[4096];
+
+            while (fgets(path, sizeof(path), stdin) != NULL)
+            {
+                path[strcspn(path, "\r\n")] = 0;
+
+                if (path[0] != 0)
+                    BenchFile(path);
+            }
+        }
+        else
+        {
+            BenchFile(argv[i]);
+        }
+    }
+
+    if (sFileCount == 0)
+        FATAL_ERROR("Usage: lzbench [-search N] [-no-reference] FILES... (- reads the paths from stdin)\n");
+
+    printf("%d files, %lld bytes\n\n", sFileCount, sTotalSize);
+    printf("%-18s %10s %12s %8s\n", "ENCODER", "SECONDS", "COMPRESSED", "RATIO");
+
+    for (int j = sSkipReference ? 1 : 0; j < encoderCount; j++)
+    {
+        printf("%-18s %10.3f %12lld %7.2f%%\n", sEncoders[j].name, sEncoders[j].seconds,
+               sEncoders[j].compressedSize, 100.0 * sEncoders[j].compressedSize / sTotalSize);
+    }
+
+    if (!sSkipReference)
+    {
+        printf("\nLZCompress took %.1f%% of the reference's time, ", 100.0 * sEncoders[1].seconds / sEncoders[0].seconds);
+
+        if (sMismatchCount == 0)
+            printf("every file matched.\n");
+        else
+            printf("%d files didn't match.\n", sMismatchCount);
+    }
+
+    printf("LZCompressOptimal is %lld bytes (%.2f%%) smaller than LZCompress.\n",
+           sEncoders[1].compressedSize - sEncoders[2].compressedSize,
+           100.0 * (sEncoders[1].compressedSize - sEncoders[2].compressedSize) / sEncoders[1].compressedSize);
+
+    return sMismatchCount == 0 ? 0 : 1;
+}
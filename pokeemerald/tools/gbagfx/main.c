@@ -13,6 +13,8 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "assetcache.h"
 
 struct CommandHandler
 {
@@ -81,12 +83,20 @@ void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *
     image.bitDepth = options->bitDepth;
     image.tilemap.data.affine = NULL; // initialize to NULL to avoid issues in FreeImage
 
-    ReadPng(inputPath, &image);
-
     if (options->isTiled)
-        WriteTileImage(outputPath, options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+    {
+        // Tiles are converted a band at a time as the rows are decoded, so the whole png never has to be in memory
+        struct PngReader *reader = OpenPng(inputPath, &image);
+
+        image.pixels = NULL;
+        WriteTileImageFromRows(outputPath, options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, ReadPngRows, reader, !image.hasPalette);
+        ClosePng(reader);
+    }
     else
+    {
+        ReadPng(inputPath, &image);
         WritePlainImage(outputPath, options->dataWidth, &image, !image.hasPalette);
+    }
 
     FreeImage(&image);
 }
@@ -426,6 +436,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
 {
     int overflowSize = 0;
     int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    bool optimal = false;
 
     for (int i = 3; i < argc; i++)
     {
@@ -457,6 +468,11 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
             if (minDistance < 1)
                 FATAL_ERROR("LZ min search distance must be positive.\n");
         }
+        else if (strcmp(option, "-optimal") == 0)
+        {
+            // Smaller, but not the same bytes as the original tools made
+            optimal = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
@@ -473,7 +489,12 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
 
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    unsigned char *compressedData;
+
+    if (optimal)
+        compressedData = LZCompressOptimal(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    else
+        compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
@@ -586,12 +607,36 @@ void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNU
     free(uncompressedData);
 }
 
-int main(int argc, char **argv)
+// Shows what's in the asset cache gbagfx, aif2pcm and mid2agb share, or empties it
+void HandleCacheCommand(int argc, char **argv)
+{
+    bool clear = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-clear") == 0)
+            clear = true;
+        else
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+    }
+
+    if (!AssetCacheEnabled())
+        FATAL_ERROR("There's no asset cache, ASSET_CACHE_DIR isn't set.\n");
+
+    if (clear)
+        AssetCacheClear();
+
+    AssetCachePrintStats();
+}
+
+void RunConversion(int argc, char **argv)
 {
     char converted = 0;
 
     if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n"
+                    "       gbagfx batch MANIFEST [-j THREADS] [-skip-missing] [-unchanged FILE]\n"
+                    "       gbagfx cache [-clear]\n");
 
     struct CommandHandler handlers[] =
     {
@@ -656,12 +701,23 @@ int main(int argc, char **argv)
         }
     }
 
+    struct AssetCacheEntry cacheEntry;
+
     for (int i = 0; handlers[i].function != NULL; i++)
     {
         if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
             && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
         {
-            handlers[i].function(inputPath, outputPath, argc, argv);
+            if (!AssetCacheFetch(&cacheEntry, argc, argv, outputPath))
+            {
+                handlers[i].function(inputPath, outputPath, argc, argv);
+                AssetCacheStore(&cacheEntry);
+            }
+            else if (cacheEntry.outputUnchanged)
+            {
+                NoteUnchangedFile(outputPath);
+            }
+
             converted = 1;
             break;
         }
@@ -672,6 +728,18 @@ int main(int argc, char **argv)
 
     if (!converted)
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
+}
+
+int main(int argc, char **argv)
+{
+    AssetCacheInit("gbagfx", argv[0]);
+
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0)
+        HandleBatchCommand(argc, argv, RunConversion);
+    else if (argc >= 2 && strcmp(argv[1], "cache") == 0)
+        HandleCacheCommand(argc, argv);
+    else
+        RunConversion(argc, argv);
 
     return 0;
 }
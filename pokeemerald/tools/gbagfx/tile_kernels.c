@@ -0,0 +1,502 @@
+#include <stdbool.h>
+#include <string.h>
+#include "tile_kernels.h"
+
+// The SSE2 and AVX2 versions are built whatever -march says and only used if
+// the CPU has them. Each does whole 16 or 32 byte blocks and returns how many
+// bytes that came to, the scalar version does the rest.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+static enum TileKernelLevel sMaxLevel = TILE_KERNELS_AVX2;
+
+enum TileKernelLevel GetTileKernelLevel(void)
+{
+	enum TileKernelLevel level = TILE_KERNELS_SCALAR;
+
+#ifdef HAVE_X86_KERNELS
+	if (__builtin_cpu_supports("avx2"))
+		level = TILE_KERNELS_AVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		level = TILE_KERNELS_SSE2;
+#endif
+
+	return level < sMaxLevel ? level : sMaxLevel;
+}
+
+void SetTileKernelLevel(enum TileKernelLevel level)
+{
+	sMaxLevel = level;
+}
+
+const char *GetTileKernelLevelName(enum TileKernelLevel level)
+{
+	switch (level) {
+	case TILE_KERNELS_SCALAR:
+		return "scalar";
+	case TILE_KERNELS_SSE2:
+		return "SSE2";
+	case TILE_KERNELS_AVX2:
+		return "AVX2";
+	}
+
+	return "?";
+}
+
+// ---------------------------------------------------------------------------
+// Scalar
+
+#define NSWAP(x) ({ (((x) >> 4) & 0xF) | (((x) << 4) & 0xF0); })
+
+static void SwapNybblesScalar(unsigned char *data, int size, bool invert)
+{
+	unsigned char flip = invert ? 0xFF : 0;
+
+	for (int i = 0; i < size; i++)
+		data[i] = NSWAP(data[i]) ^ flip;
+}
+
+static void ReverseBitsScalar(unsigned char *data, int size, bool invert)
+{
+	unsigned char flip = invert ? 0xFF : 0;
+
+	for (int i = 0; i < size; i++) {
+		unsigned char x = data[i];
+
+		x = ((x >> 1) & 0x55) | ((x & 0x55) << 1);
+		x = ((x >> 2) & 0x33) | ((x & 0x33) << 2);
+		data[i] = NSWAP(x) ^ flip;
+	}
+}
+
+#define SWAP_BYTES(a, b) ({   \
+    unsigned char tmp = *(a); \
+    *(a) = *(b);              \
+    *(b) = tmp;               \
+})
+
+#define SWAP_NYBBLES(a, b) ({        \
+    unsigned char tmp = NSWAP(*(a)); \
+    *(a) = NSWAP(*(b));              \
+    *(b) = tmp;                      \
+})
+
+static void VflipTileScalar(unsigned char * tile, int bitDepth)
+{
+    int i;
+    switch (bitDepth)
+    {
+    case 1:
+        SWAP_BYTES(&tile[0], &tile[7]);
+        SWAP_BYTES(&tile[1], &tile[6]);
+        SWAP_BYTES(&tile[2], &tile[5]);
+        SWAP_BYTES(&tile[3], &tile[4]);
+        break;
+    case 4:
+        for (i = 0; i < 4; i++)
+        {
+            SWAP_BYTES(&tile[i + 0], &tile[i + 28]);
+            SWAP_BYTES(&tile[i + 4], &tile[i + 24]);
+            SWAP_BYTES(&tile[i + 8], &tile[i + 20]);
+            SWAP_BYTES(&tile[i + 12], &tile[i + 16]);
+        }
+        break;
+    case 8:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_BYTES(&tile[i + 0], &tile[i + 56]);
+            SWAP_BYTES(&tile[i + 8], &tile[i + 48]);
+            SWAP_BYTES(&tile[i + 16], &tile[i + 40]);
+            SWAP_BYTES(&tile[i + 24], &tile[i + 32]);
+        }
+        break;
+    }
+}
+
+static void HflipTileScalar(unsigned char * tile, int bitDepth)
+{
+    int i;
+    switch (bitDepth)
+    {
+    case 1:
+        ReverseBitsScalar(tile, 8, false);
+        break;
+    case 4:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_NYBBLES(&tile[4 * i + 0], &tile[4 * i + 3]);
+            SWAP_NYBBLES(&tile[4 * i + 1], &tile[4 * i + 2]);
+        }
+        break;
+    case 8:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_BYTES(&tile[8 * i + 0], &tile[8 * i + 7]);
+            SWAP_BYTES(&tile[8 * i + 1], &tile[8 * i + 6]);
+            SWAP_BYTES(&tile[8 * i + 2], &tile[8 * i + 5]);
+            SWAP_BYTES(&tile[8 * i + 3], &tile[8 * i + 4]);
+        }
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SSE2
+
+#ifdef HAVE_X86_KERNELS
+
+SSE2 static __m128i SwapNybbles128(__m128i x)
+{
+	__m128i low = _mm_set1_epi8(0x0F);
+
+	return _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), low), _mm_andnot_si128(low, _mm_slli_epi16(x, 4)));
+}
+
+// Reverses the bytes in each 16 bit word
+SSE2 static __m128i SwapBytes128(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+SSE2 static int SwapNybblesSse2(unsigned char *data, int size, bool invert)
+{
+	__m128i flip = _mm_set1_epi8(invert ? -1 : 0);
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i *)&data[i]);
+
+		_mm_storeu_si128((__m128i *)&data[i], _mm_xor_si128(SwapNybbles128(x), flip));
+	}
+
+	return i;
+}
+
+SSE2 static int InvertBytesSse2(unsigned char *data, int size)
+{
+	__m128i flip = _mm_set1_epi8(-1);
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i *)&data[i]);
+
+		_mm_storeu_si128((__m128i *)&data[i], _mm_xor_si128(x, flip));
+	}
+
+	return i;
+}
+
+SSE2 static int ReverseBitsSse2(unsigned char *data, int size, bool invert)
+{
+	__m128i flip = _mm_set1_epi8(invert ? -1 : 0);
+	__m128i pairs = _mm_set1_epi8(0x55);
+	__m128i quads = _mm_set1_epi8(0x33);
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i *)&data[i]);
+
+		// The masks throw away any bits a 16 bit shift brings in from the next byte
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), pairs), _mm_slli_epi16(_mm_and_si128(x, pairs), 1));
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), quads), _mm_slli_epi16(_mm_and_si128(x, quads), 2));
+		_mm_storeu_si128((__m128i *)&data[i], _mm_xor_si128(SwapNybbles128(x), flip));
+	}
+
+	return i;
+}
+
+SSE2 static int UnpackNybblesSse2(unsigned char *src, unsigned char *dest, int size, unsigned char highBits)
+{
+	__m128i low = _mm_set1_epi8(0x0F);
+	__m128i high = _mm_set1_epi8(highBits);
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i *)&src[i]);
+		__m128i left = _mm_and_si128(x, low);
+		__m128i right = _mm_and_si128(_mm_srli_epi16(x, 4), low);
+
+		_mm_storeu_si128((__m128i *)&dest[i * 2], _mm_or_si128(_mm_unpacklo_epi8(left, right), high));
+		_mm_storeu_si128((__m128i *)&dest[i * 2 + 16], _mm_or_si128(_mm_unpackhi_epi8(left, right), high));
+	}
+
+	return i;
+}
+
+// A 4bpp row is 32 bits and an 8bpp one 64
+SSE2 static void HflipTileSse2(unsigned char *tile, int bitDepth)
+{
+	for (int i = 0; i < bitDepth * 8; i += 16) {
+		__m128i x = SwapBytes128(_mm_loadu_si128((__m128i *)&tile[i]));
+
+		if (bitDepth == 4)
+			x = SwapNybbles128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1));
+		else
+			x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1B), 0x1B);
+
+		_mm_storeu_si128((__m128i *)&tile[i], x);
+	}
+}
+
+SSE2 static void VflipTileSse2(unsigned char *tile, int bitDepth)
+{
+	__m128i rows[4];
+	int count = bitDepth / 2;
+
+	for (int i = 0; i < count; i++)
+		rows[i] = _mm_loadu_si128((__m128i *)&tile[i * 16]);
+
+	for (int i = 0; i < count; i++) {
+		__m128i x = rows[count - 1 - i];
+
+		x = bitDepth == 4 ? _mm_shuffle_epi32(x, 0x1B) : _mm_shuffle_epi32(x, 0x4E);
+		_mm_storeu_si128((__m128i *)&tile[i * 16], x);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// AVX2
+
+AVX2 static __m256i SwapNybbles256(__m256i x)
+{
+	__m256i low = _mm256_set1_epi8(0x0F);
+
+	return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 4), low), _mm256_andnot_si256(low, _mm256_slli_epi16(x, 4)));
+}
+
+AVX2 static int SwapNybblesAvx2(unsigned char *data, int size, bool invert)
+{
+	__m256i flip = _mm256_set1_epi8(invert ? -1 : 0);
+	int i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i *)&data[i]);
+
+		_mm256_storeu_si256((__m256i *)&data[i], _mm256_xor_si256(SwapNybbles256(x), flip));
+	}
+
+	return i;
+}
+
+AVX2 static int InvertBytesAvx2(unsigned char *data, int size)
+{
+	__m256i flip = _mm256_set1_epi8(-1);
+	int i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i *)&data[i]);
+
+		_mm256_storeu_si256((__m256i *)&data[i], _mm256_xor_si256(x, flip));
+	}
+
+	return i;
+}
+
+// Looks up each nybble reversed, and puts them back the other way round
+AVX2 static int ReverseBitsAvx2(unsigned char *data, int size, bool invert)
+{
+	__m256i flip = _mm256_set1_epi8(invert ? -1 : 0);
+	__m256i low = _mm256_set1_epi8(0x0F);
+	__m256i reversed = _mm256_setr_epi8(
+	    0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF,
+	    0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF);
+	__m256i reversedHigh = _mm256_slli_epi16(reversed, 4);
+	int i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i *)&data[i]);
+		__m256i left = _mm256_shuffle_epi8(reversedHigh, _mm256_and_si256(x, low));
+		__m256i right = _mm256_shuffle_epi8(reversed, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+
+		_mm256_storeu_si256((__m256i *)&data[i], _mm256_xor_si256(_mm256_or_si256(left, right), flip));
+	}
+
+	return i;
+}
+
+// Widening each byte to 16 bits leaves room to split it in place
+AVX2 static int UnpackNybblesAvx2(unsigned char *src, unsigned char *dest, int size, unsigned char highBits)
+{
+	__m256i left = _mm256_set1_epi16(0x000F);
+	__m256i right = _mm256_set1_epi16(0x0F00);
+	__m256i high = _mm256_set1_epi8(highBits);
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)&src[i]));
+
+		x = _mm256_or_si256(_mm256_and_si256(x, left), _mm256_and_si256(_mm256_slli_epi16(x, 4), right));
+		_mm256_storeu_si256((__m256i *)&dest[i * 2], _mm256_or_si256(x, high));
+	}
+
+	return i;
+}
+
+AVX2 static void HflipTileAvx2(unsigned char *tile, int bitDepth)
+{
+	__m256i rows4 = _mm256_setr_epi8(
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i rows8 = _mm256_setr_epi8(
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+	for (int i = 0; i < bitDepth * 8; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i *)&tile[i]);
+
+		if (bitDepth == 4)
+			x = SwapNybbles256(_mm256_shuffle_epi8(x, rows4));
+		else
+			x = _mm256_shuffle_epi8(x, rows8);
+
+		_mm256_storeu_si256((__m256i *)&tile[i], x);
+	}
+}
+
+AVX2 static void VflipTileAvx2(unsigned char *tile, int bitDepth)
+{
+	if (bitDepth == 4) {
+		__m256i x = _mm256_loadu_si256((__m256i *)tile);
+
+		_mm256_storeu_si256((__m256i *)tile, _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+	} else {
+		__m256i top = _mm256_loadu_si256((__m256i *)tile);
+		__m256i bottom = _mm256_loadu_si256((__m256i *)&tile[32]);
+
+		_mm256_storeu_si256((__m256i *)tile, _mm256_permute4x64_epi64(bottom, 0x1B));
+		_mm256_storeu_si256((__m256i *)&tile[32], _mm256_permute4x64_epi64(top, 0x1B));
+	}
+}
+
+#endif // HAVE_X86_KERNELS
+
+// ---------------------------------------------------------------------------
+
+void SwapNybbles(unsigned char *data, int size, bool invert)
+{
+	int done = 0;
+
+#ifdef HAVE_X86_KERNELS
+	switch (GetTileKernelLevel()) {
+	case TILE_KERNELS_AVX2:
+		done = SwapNybblesAvx2(data, size, invert);
+		break;
+	case TILE_KERNELS_SSE2:
+		done = SwapNybblesSse2(data, size, invert);
+		break;
+	case TILE_KERNELS_SCALAR:
+		break;
+	}
+#endif
+
+	SwapNybblesScalar(&data[done], size - done, invert);
+}
+
+void InvertBytes(unsigned char *data, int size)
+{
+	int done = 0;
+
+#ifdef HAVE_X86_KERNELS
+	switch (GetTileKernelLevel()) {
+	case TILE_KERNELS_AVX2:
+		done = InvertBytesAvx2(data, size);
+		break;
+	case TILE_KERNELS_SSE2:
+		done = InvertBytesSse2(data, size);
+		break;
+	case TILE_KERNELS_SCALAR:
+		break;
+	}
+#endif
+
+	for (int i = done; i < size; i++)
+		data[i] = 255 - data[i];
+}
+
+void ReverseBits(unsigned char *data, int size, bool invert)
+{
+	int done = 0;
+
+#ifdef HAVE_X86_KERNELS
+	switch (GetTileKernelLevel()) {
+	case TILE_KERNELS_AVX2:
+		done = ReverseBitsAvx2(data, size, invert);
+		break;
+	case TILE_KERNELS_SSE2:
+		done = ReverseBitsSse2(data, size, invert);
+		break;
+	case TILE_KERNELS_SCALAR:
+		break;
+	}
+#endif
+
+	ReverseBitsScalar(&data[done], size - done, invert);
+}
+
+void UnpackNybbles(unsigned char *src, unsigned char *dest, int size, unsigned char highBits)
+{
+	int done = 0;
+
+#ifdef HAVE_X86_KERNELS
+	switch (GetTileKernelLevel()) {
+	case TILE_KERNELS_AVX2:
+		done = UnpackNybblesAvx2(src, dest, size, highBits);
+		break;
+	case TILE_KERNELS_SSE2:
+		done = UnpackNybblesSse2(src, dest, size, highBits);
+		break;
+	case TILE_KERNELS_SCALAR:
+		break;
+	}
+#endif
+
+	for (int i = done; i < size; i++) {
+		dest[i * 2] = (src[i] & 0xF) | highBits;
+		dest[i * 2 + 1] = (src[i] >> 4) | highBits;
+	}
+}
+
+// A 1bpp tile is only 8 bytes, so it's always done a byte at a time
+void HflipTile(unsigned char *tile, int bitDepth)
+{
+#ifdef HAVE_X86_KERNELS
+	if (bitDepth == 4 || bitDepth == 8) {
+		switch (GetTileKernelLevel()) {
+		case TILE_KERNELS_AVX2:
+			HflipTileAvx2(tile, bitDepth);
+			return;
+		case TILE_KERNELS_SSE2:
+			HflipTileSse2(tile, bitDepth);
+			return;
+		case TILE_KERNELS_SCALAR:
+			break;
+		}
+	}
+#endif
+
+	HflipTileScalar(tile, bitDepth);
+}
+
+void VflipTile(unsigned char *tile, int bitDepth)
+{
+#ifdef HAVE_X86_KERNELS
+	if (bitDepth == 4 || bitDepth == 8) {
+		switch (GetTileKernelLevel()) {
+		case TILE_KERNELS_AVX2:
+			VflipTileAvx2(tile, bitDepth);
+			return;
+		case TILE_KERNELS_SSE2:
+			VflipTileSse2(tile, bitDepth);
+			return;
+		case TILE_KERNELS_SCALAR:
+			break;
+		}
+	}
+#endif
+
+	VflipTileScalar(tile, bitDepth);
+}
@@ -0,0 +1,31 @@
+#ifndef TILE_KERNELS_H
+#define TILE_KERNELS_H
+
+#include <stdbool.h>
+
+// The byte level work of converting tiles, done 16 or 32 bytes at a time when
+// the CPU can. Every level gives exactly the same bytes.
+enum TileKernelLevel {
+    TILE_KERNELS_SCALAR,
+    TILE_KERNELS_SSE2,
+    TILE_KERNELS_AVX2,
+};
+
+// The best level this CPU has, capped by SetTileKernelLevel
+enum TileKernelLevel GetTileKernelLevel(void);
+void SetTileKernelLevel(enum TileKernelLevel level);
+const char *GetTileKernelLevelName(enum TileKernelLevel level);
+
+// Swaps the two pixels in each byte of 4bpp data, and inverts them if asked
+void SwapNybbles(unsigned char *data, int size, bool invert);
+// Inverts 8bpp pixels
+void InvertBytes(unsigned char *data, int size);
+// Reverses the order of the pixels in each byte of 1bpp data, and inverts them if asked
+void ReverseBits(unsigned char *data, int size, bool invert);
+// Unpacks size bytes of 4bpp pixels (low nybble first) into twice as many 8bpp ones, with highBits set in each
+void UnpackNybbles(unsigned char *src, unsigned char *dest, int size, unsigned char highBits);
+
+void HflipTile(unsigned char *tile, int bitDepth);
+void VflipTile(unsigned char *tile, int bitDepth);
+
+#endif // TILE_KERNELS_H
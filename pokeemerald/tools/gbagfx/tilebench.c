@@ -0,0 +1,644 @@
+// Times the tile conversions at each level tile_kernels.c has, over large
+// made up tilesheets, and checks every level gives exactly what the original
+// pixel at a time code (kept below) did. Only the default 1x1 metatiles are
+// timed, but each metatile shape is checked, with the whole sheet and with a
+// tile count that stops partway through a row, like -num_tiles does.
+//
+// Usage: tilebench [-tiles N] [-runs N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "global.h"
+#include "gfx.h"
+#include "tile_kernels.h"
+#include "util.h"
+
+// ---------------------------------------------------------------------------
+// gfx.c as it was
+
+static void ReferenceAdvanceMetatilePosition(int *subTileX, int *subTileY, int *metatileX, int *metatileY, int metatilesWide, int metatileWidth, int metatileHeight)
+{
+	(*subTileX)++;
+	if (*subTileX == metatileWidth) {
+		*subTileX = 0;
+		(*subTileY)++;
+		if (*subTileY == metatileHeight) {
+			*subTileY = 0;
+			(*metatileX)++;
+			if (*metatileX == metatilesWide) {
+				*metatileX = 0;
+				(*metatileY)++;
+			}
+		}
+	}
+}
+
+static void ReferenceConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = metatilesWide * metatileWidth;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
+			int destX = metatileX * metatileWidth + subTileX;
+			unsigned char srcPixelOctet = *src++;
+			unsigned char *destPixelOctet = &dest[destY * pitch + destX];
+
+			for (int k = 0; k < 8; k++) {
+				*destPixelOctet <<= 1;
+				*destPixelOctet |= (srcPixelOctet & 1) ^ invertColors;
+				srcPixelOctet >>= 1;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ReferenceConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 4;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
+
+			for (int k = 0; k < 4; k++) {
+				int destX = (metatileX * metatileWidth + subTileX) * 4 + k;
+				unsigned char srcPixelPair = *src++;
+				unsigned char leftPixel = srcPixelPair & 0xF;
+				unsigned char rightPixel = srcPixelPair >> 4;
+
+				if (invertColors) {
+					leftPixel = 15 - leftPixel;
+					rightPixel = 15 - rightPixel;
+				}
+
+				dest[destY * pitch + destX] = (leftPixel << 4) | rightPixel;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ReferenceConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 8;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
+
+			for (int k = 0; k < 8; k++) {
+				int destX = (metatileX * metatileWidth + subTileX) * 8 + k;
+				unsigned char srcPixel = *src++;
+
+				if (invertColors)
+					srcPixel = 255 - srcPixel;
+
+				dest[destY * pitch + destX] = srcPixel;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ReferenceConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = metatilesWide * metatileWidth;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
+			int srcX = metatileX * metatileWidth + subTileX;
+			unsigned char srcPixelOctet = src[srcY * pitch + srcX];
+			unsigned char *destPixelOctet = dest++;
+
+			for (int k = 0; k < 8; k++) {
+				*destPixelOctet <<= 1;
+				*destPixelOctet |= (srcPixelOctet & 1) ^ invertColors;
+				srcPixelOctet >>= 1;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ReferenceConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 4;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
+
+			for (int k = 0; k < 4; k++) {
+				int srcX = (metatileX * metatileWidth + subTileX) * 4 + k;
+				unsigned char srcPixelPair = src[srcY * pitch + srcX];
+				unsigned char leftPixel = srcPixelPair >> 4;
+				unsigned char rightPixel = srcPixelPair & 0xF;
+
+				if (invertColors) {
+					leftPixel = 15 - leftPixel;
+					rightPixel = 15 - rightPixel;
+				}
+
+				*dest++ = (rightPixel << 4) | leftPixel;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ReferenceConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 8;
+
+	for (int i = 0; i < numTiles; i++) {
+		for (int j = 0; j < 8; j++) {
+			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
+
+			for (int k = 0; k < 8; k++) {
+				int srcX = (metatileX * metatileWidth + subTileX) * 8 + k;
+				unsigned char srcPixel = src[srcY * pitch + srcX];
+
+				if (invertColors)
+					srcPixel = 255 - srcPixel;
+
+				*dest++ = srcPixel;
+			}
+		}
+
+		ReferenceAdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+#define REVERSE_BIT_ORDER(x) ({ \
+      ((((x) >> 7) & 1) << 0)   \
+    | ((((x) >> 6) & 1) << 1)   \
+    | ((((x) >> 5) & 1) << 2)   \
+    | ((((x) >> 4) & 1) << 3)   \
+    | ((((x) >> 3) & 1) << 4)   \
+    | ((((x) >> 2) & 1) << 5)   \
+    | ((((x) >> 1) & 1) << 6)   \
+    | ((((x) >> 0) & 1) << 7);  \
+})
+
+#define SWAP_BYTES(a, b) ({   \
+    unsigned char tmp = *(a); \
+    *(a) = *(b);              \
+    *(b) = tmp;               \
+})
+
+#define NSWAP(x) ({ (((x) >> 4) & 0xF) | (((x) << 4) & 0xF0); })
+
+#define SWAP_NYBBLES(a, b) ({        \
+    unsigned char tmp = NSWAP(*(a)); \
+    *(a) = NSWAP(*(b));              \
+    *(b) = tmp;                      \
+})
+
+static void ReferenceVflipTile(unsigned char * tile, int bitDepth)
+{
+    int i;
+    switch (bitDepth)
+    {
+    case 1:
+        SWAP_BYTES(&tile[0], &tile[7]);
+        SWAP_BYTES(&tile[1], &tile[6]);
+        SWAP_BYTES(&tile[2], &tile[5]);
+        SWAP_BYTES(&tile[3], &tile[4]);
+        break;
+    case 4:
+        for (i = 0; i < 4; i++)
+        {
+            SWAP_BYTES(&tile[i + 0], &tile[i + 28]);
+            SWAP_BYTES(&tile[i + 4], &tile[i + 24]);
+            SWAP_BYTES(&tile[i + 8], &tile[i + 20]);
+            SWAP_BYTES(&tile[i + 12], &tile[i + 16]);
+        }
+        break;
+    case 8:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_BYTES(&tile[i + 0], &tile[i + 56]);
+            SWAP_BYTES(&tile[i + 8], &tile[i + 48]);
+            SWAP_BYTES(&tile[i + 16], &tile[i + 40]);
+            SWAP_BYTES(&tile[i + 24], &tile[i + 32]);
+        }
+        break;
+    }
+}
+
+static void ReferenceHflipTile(unsigned char * tile, int bitDepth)
+{
+    int i;
+    switch (bitDepth)
+    {
+    case 1:
+        for (i = 0; i < 8; i++)
+            tile[i] = REVERSE_BIT_ORDER(tile[i]);
+        break;
+    case 4:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_NYBBLES(&tile[4 * i + 0], &tile[4 * i + 3]);
+            SWAP_NYBBLES(&tile[4 * i + 1], &tile[4 * i + 2]);
+        }
+        break;
+    case 8:
+        for (i = 0; i < 8; i++)
+        {
+            SWAP_BYTES(&tile[8 * i + 0], &tile[8 * i + 7]);
+            SWAP_BYTES(&tile[8 * i + 1], &tile[8 * i + 6]);
+            SWAP_BYTES(&tile[8 * i + 2], &tile[8 * i + 5]);
+            SWAP_BYTES(&tile[8 * i + 3], &tile[8 * i + 4]);
+        }
+        break;
+    }
+}
+
+static void ReferenceDecodeNonAffineTilemap(unsigned char *input, unsigned char *output, struct NonAffineTile *tilemap, int tileSize, int outTileSize, int bitDepth, int numTiles)
+{
+    unsigned char * in_tile;
+    unsigned char * out_tile = output;
+    int effectiveBitDepth = tileSize == outTileSize ? bitDepth : 8;
+    for (int i = 0; i < numTiles; i++)
+    {
+        in_tile = &input[tilemap[i].index * tileSize];
+        if (tileSize == outTileSize)
+            memcpy(out_tile, in_tile, tileSize);
+        else
+        {
+            for (int j = 0; j < 64; j++)
+            {
+                int shift = (j & 1) * 4;
+                out_tile[j] = (in_tile[j / 2] & (0xF << shift)) >> shift;
+            }
+        }
+        if (tilemap[i].hflip)
+            ReferenceHflipTile(out_tile, effectiveBitDepth);
+        if (tilemap[i].vflip)
+            ReferenceVflipTile(out_tile, effectiveBitDepth);
+        if (bitDepth == 4 && effectiveBitDepth == 8)
+        {
+            for (int j = 0; j < 64; j++)
+            {
+                out_tile[j] &= 0xF;
+                out_tile[j] |= (15 - tilemap[i].palno) << 4;
+            }
+        }
+        out_tile += outTileSize;
+    }
+}
+
+
+static void ReferenceConvertFromTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+    switch (bitDepth)
+    {
+    case 1:
+        ReferenceConvertFromTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    case 4:
+        ReferenceConvertFromTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    case 8:
+        ReferenceConvertFromTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    }
+}
+
+static void ReferenceConvertToTiles(unsigned char *src, unsigned char *dest, int bitDepth, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+    switch (bitDepth)
+    {
+    case 1:
+        ReferenceConvertToTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    case 4:
+        ReferenceConvertToTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    case 8:
+        ReferenceConvertToTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+#define TILES_WIDE 128
+
+// -mwidth and -mheight, the default first. The timings are for that one, the others are only checked
+struct MetatileShape {
+    int width;
+    int height;
+};
+
+static const struct MetatileShape sShapes[] =
+{
+    { 1, 1 },
+    { 2, 2 },
+    { 2, 1 },
+    { 1, 2 },
+};
+
+enum BenchKind {
+    BENCH_TO_TILES,
+    BENCH_FROM_TILES,
+    BENCH_TILEMAP,
+};
+
+struct Bench {
+    enum BenchKind kind;
+    int bitDepth; // of the tiles, for BENCH_TILEMAP 4 and decoded to 8bpp if outBitDepth says so
+    int outBitDepth;
+    bool invert;
+};
+
+static const struct Bench sBenches[] =
+{
+    { BENCH_TO_TILES, 1, 1, false },
+    { BENCH_TO_TILES, 1, 1, true },
+    { BENCH_TO_TILES, 4, 4, false },
+    { BENCH_TO_TILES, 4, 4, true },
+    { BENCH_TO_TILES, 8, 8, false },
+    { BENCH_TO_TILES, 8, 8, true },
+    { BENCH_FROM_TILES, 1, 1, false },
+    { BENCH_FROM_TILES, 1, 1, true },
+    { BENCH_FROM_TILES, 4, 4, false },
+    { BENCH_FROM_TILES, 4, 4, true },
+    { BENCH_FROM_TILES, 8, 8, false },
+    { BENCH_FROM_TILES, 8, 8, true },
+    { BENCH_TILEMAP, 4, 4, false },
+    { BENCH_TILEMAP, 4, 8, false },
+    { BENCH_TILEMAP, 8, 8, false },
+};
+
+static unsigned int sRandom = 1;
+
+static unsigned char NextRandom(void)
+{
+    sRandom = sRandom * 1103515245 + 12345;
+    return sRandom >> 16;
+}
+
+static void *AllocOrDie(size_t size)
+{
+    void *buffer = calloc(size, 1);
+
+    if (buffer == NULL)
+        FATAL_ERROR("Failed to allocate memory for the benchmark.\n");
+
+    return buffer;
+}
+
+// The tiles in the sheet numTiles is read into or written from, whole rows of whole metatiles like gbagfx makes it
+static int GetSheetTiles(const struct MetatileShape *shape, int numTiles)
+{
+    int tilesTall = (numTiles + TILES_WIDE - 1) / TILES_WIDE;
+
+    tilesTall = (tilesTall + shape->height - 1) / shape->height * shape->height;
+    return tilesTall * TILES_WIDE;
+}
+
+static size_t GetOutSize(const struct Bench *bench, const struct MetatileShape *shape, int numTiles)
+{
+    // Converting from tiles fills in a whole sheet, the rest of it left clear
+    if (bench->kind == BENCH_FROM_TILES)
+        numTiles = GetSheetTiles(shape, numTiles);
+
+    return (size_t)numTiles * bench->outBitDepth * 8;
+}
+
+// Runs one bench at level (or the original code for -1), returning the seconds per run and leaving the output in out
+static double RunBench(const struct Bench *bench, const struct MetatileShape *shape, int level, int numTiles, int runs, unsigned char *in, unsigned char *scratch, struct NonAffineTile *tilemap, unsigned char *out)
+{
+    int tileSize = bench->bitDepth * 8;
+    int metatilesWide = TILES_WIDE / shape->width;
+    double seconds = 0;
+
+    // gbagfx only stops short of the sheet when converting from tiles, going to tiles it converts the whole image
+    if (bench->kind == BENCH_TO_TILES)
+        numTiles = GetSheetTiles(shape, numTiles);
+
+    if (level >= 0)
+        SetTileKernelLevel(level);
+
+    for (int run = 0; run < runs; run++)
+    {
+        // Converting from tiles changes its input now, so each run gets a fresh copy
+        memcpy(scratch, in, (size_t)numTiles * tileSize);
+        memset(out, 0, GetOutSize(bench, shape, numTiles));
+
+        clock_t start = clock();
+
+        switch (bench->kind)
+        {
+        case BENCH_TO_TILES:
+            if (level < 0)
+                ReferenceConvertToTiles(scratch, out, bench->bitDepth, numTiles, metatilesWide, shape->width, shape->height, bench->invert);
+            else
+                ConvertToTiles(scratch, out, bench->bitDepth, numTiles, metatilesWide, shape->width, shape->height, bench->invert);
+            break;
+        case BENCH_FROM_TILES:
+            if (level < 0)
+                ReferenceConvertFromTiles(scratch, out, bench->bitDepth, numTiles, metatilesWide, shape->width, shape->height, bench->invert);
+            else
+                ConvertFromTiles(scratch, out, bench->bitDepth, numTiles, metatilesWide, shape->width, shape->height, bench->invert);
+            break;
+        case BENCH_TILEMAP:
+            if (level < 0)
+                ReferenceDecodeNonAffineTilemap(scratch, out, tilemap, tileSize, bench->outBitDepth * 8, bench->bitDepth, numTiles);
+            else
+                DecodeNonAffineTilemap(scratch, out, tilemap, tileSize, bench->outBitDepth * 8, bench->bitDepth, numTiles);
+            break;
+        }
+
+        seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+
+    return seconds / runs;
+}
+
+static void GetBenchName(const struct Bench *bench, char *name, size_t size)
+{
+    const char *kinds[] = { "to tiles", "from tiles", "tilemap" };
+
+    snprintf(name, size, "%s %dbpp%s%s", kinds[bench->kind], bench->bitDepth,
+             bench->outBitDepth != bench->bitDepth ? " to 8bpp" : "", bench->invert ? " inverted" : "");
+}
+
+int main(int argc, char **argv)
+{
+    int numTiles = 128 * 128;
+    int runs = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-tiles") == 0 && i + 1 < argc)
+        {
+            if (!ParseNumber(argv[++i], NULL, 10, &numTiles) || numTiles < 1)
+                FATAL_ERROR("Number of tiles must be positive.\n");
+        }
+        else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+        {
+            if (!ParseNumber(argv[++i], NULL, 10, &runs) || runs < 1)
+                FATAL_ERROR("Number of runs must be positive.\n");
+        }
+        else
+        {
+            FATAL_ERROR("Usage: tilebench [-tiles N] [-runs N]\n");
+        }
+    }
+
+    // Whole rows of every metatile shape, 128 tiles wide
+    numTiles = (numTiles + TILES_WIDE * 2 - 1) / (TILES_WIDE * 2) * (TILES_WIDE * 2);
+
+    // As well as the whole sheet, a -num_tiles that stops partway through a row and through a metatile
+    int tileCounts[] = { numTiles, numTiles - TILES_WIDE - 61 };
+    int bestLevel = GetTileKernelLevel();
+    size_t maxSize = (size_t)numTiles * 64;
+    unsigned char *in = AllocOrDie(maxSize);
+    unsigned char *scratch = AllocOrDie(maxSize);
+    unsigned char *expected = AllocOrDie(maxSize);
+    unsigned char *out = AllocOrDie(maxSize);
+    struct NonAffineTile *tilemap = AllocOrDie(sizeof(struct NonAffineTile) * numTiles);
+    int mismatchCount = 0;
+    int checkCount = 0;
+
+    for (size_t i = 0; i < maxSize; i++)
+        in[i] = NextRandom();
+
+    for (int i = 0; i < numTiles; i++)
+    {
+        tilemap[i].index = NextRandom() | (NextRandom() << 8);
+        tilemap[i].index %= numTiles < 1024 ? numTiles : 1024;
+        tilemap[i].hflip = NextRandom() & 1;
+        tilemap[i].vflip = NextRandom() & 1;
+        tilemap[i].palno = NextRandom() & 0xF;
+    }
+
+    printf("%d tiles, %d runs, ms per run\n\n", numTiles, runs);
+    printf("%-26s %10s", "CONVERSION", "ORIGINAL");
+
+    for (int level = 0; level <= bestLevel; level++)
+        printf(" %10s", GetTileKernelLevelName(level));
+
+    printf(" %8s\n", "SPEEDUP");
+
+    for (int i = 0; i < (int)(sizeof(sBenches) / sizeof(sBenches[0])); i++)
+    {
+        const struct Bench *bench = &sBenches[i];
+        size_t outSize = GetOutSize(bench, &sShapes[0], numTiles);
+        char name[32];
+
+        GetBenchName(bench, name, sizeof(name));
+
+        double original = RunBench(bench, &sShapes[0], -1, numTiles, runs, in, scratch, tilemap, expected);
+        double best = original;
+
+        printf("%-26s %10.3f", name, original * 1000);
+
+        for (int level = 0; level <= bestLevel; level++)
+        {
+            double seconds = RunBench(bench, &sShapes[0], level, numTiles, runs, in, scratch, tilemap, out);
+
+            printf(" %10.3f", seconds * 1000);
+            best = seconds;
+            checkCount++;
+
+            if (memcmp(out, expected, outSize) != 0)
+            {
+                fprintf(stderr, "%s at %s doesn't match the original.\n", name, GetTileKernelLevelName(level));
+                mismatchCount++;
+            }
+        }
+
+        printf(" %7.1fx\n", best > 0 ? original / best : 0);
+    }
+
+    // Every other shape and tile count is run once at each level, only to check it
+    for (int j = 0; j < (int)(sizeof(sShapes) / sizeof(sShapes[0])); j++)
+    {
+        const struct MetatileShape *shape = &sShapes[j];
+
+        for (int k = 0; k < (int)(sizeof(tileCounts) / sizeof(tileCounts[0])); k++)
+        {
+            if (j == 0 && k == 0)
+                continue;
+
+            for (int i = 0; i < (int)(sizeof(sBenches) / sizeof(sBenches[0])); i++)
+            {
+                const struct Bench *bench = &sBenches[i];
+                size_t outSize = GetOutSize(bench, shape, tileCounts[k]);
+                char name[32];
+
+                // The tilemap has no metatiles, so it's only worth checking once for each count
+                if (bench->kind == BENCH_TILEMAP && j != 0)
+                    continue;
+
+                GetBenchName(bench, name, sizeof(name));
+                RunBench(bench, shape, -1, tileCounts[k], 1, in, scratch, tilemap, expected);
+
+                for (int level = 0; level <= bestLevel; level++)
+                {
+                    RunBench(bench, shape, level, tileCounts[k], 1, in, scratch, tilemap, out);
+                    checkCount++;
+
+                    if (memcmp(out, expected, outSize) != 0)
+                    {
+                        fprintf(stderr, "%s with %dx%d metatiles and %d tiles at %s doesn't match the original.\n",
+                                name, shape->width, shape->height, tileCounts[k], GetTileKernelLevelName(level));
+                        mismatchCount++;
+                    }
+                }
+            }
+        }
+    }
+
+    if (mismatchCount == 0)
+        printf("\nEvery level gave exactly what the original code did, over %d conversions with each metatile shape and %d or %d tiles.\n",
+               checkCount, tileCounts[0], tileCounts[1]);
+    else
+        printf("\n%d of %d conversions didn't match the original code.\n", mismatchCount, checkCount);
+
+    free(in);
+    free(scratch);
+    free(expected);
+    free(out);
+    free(tilemap);
+
+    return mismatchCount == 0 ? 0 : 1;
+}
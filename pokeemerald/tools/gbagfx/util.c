@@ -6,8 +6,10 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include "global.h"
 #include "util.h"
+#include "assetcache.h"
 
 bool ParseNumber(char *s, char **end, int radix, int *intValue)
 {
@@ -65,8 +67,186 @@ char *GetFileExtensionAfterDot(char *path)
 	return extension;
 }
 
+// Once batch mode has called KeepWrittenFiles, every file written is also
+// kept in memory, so a later conversion reading it (e.g. a .4bpp that's
+// then LZ compressed) gets it from there rather than the disk.
+#define KEPT_FILE_BUCKETS 4096
+
+struct KeptFile {
+	char *path;
+	unsigned char *data;
+	int size;
+	struct KeptFile *next;
+};
+
+static bool sKeepingFiles;
+static struct KeptFile *sKeptFiles[KEPT_FILE_BUCKETS];
+static pthread_mutex_t sKeptFilesLock = PTHREAD_MUTEX_INITIALIZER;
+static int sFilesWritten;
+static int sFilesUnchanged;
+static char **sUnchangedPaths;
+static int sUnchangedCount;
+static int sUnchangedCapacity;
+
+static unsigned int HashPath(const char *path)
+{
+	unsigned int hash = 5381;
+
+	while (*path != 0)
+		hash = hash * 33 + (unsigned char)*path++;
+
+	return hash % KEPT_FILE_BUCKETS;
+}
+
+void KeepWrittenFiles(void)
+{
+	sKeepingFiles = true;
+}
+
+void GetWrittenFileCounts(int *written, int *unchanged)
+{
+	*written = sFilesWritten;
+	*unchanged = sFilesUnchanged;
+}
+
+void NoteUnchangedFile(char *path)
+{
+	if (!sKeepingFiles)
+		return;
+
+	pthread_mutex_lock(&sKeptFilesLock);
+
+	if (sUnchangedCount == sUnchangedCapacity) {
+		sUnchangedCapacity = sUnchangedCapacity == 0 ? 256 : sUnchangedCapacity * 2;
+		sUnchangedPaths = realloc(sUnchangedPaths, sUnchangedCapacity * sizeof(char *));
+
+		if (sUnchangedPaths == NULL)
+			FATAL_ERROR("Failed to allocate memory for the unchanged files.\n");
+	}
+
+	sUnchangedPaths[sUnchangedCount] = malloc(strlen(path) + 1);
+
+	if (sUnchangedPaths[sUnchangedCount] == NULL)
+		FATAL_ERROR("Failed to allocate memory for the unchanged files.\n");
+
+	strcpy(sUnchangedPaths[sUnchangedCount++], path);
+
+	pthread_mutex_unlock(&sKeptFilesLock);
+}
+
+void WriteUnchangedFileList(char *path)
+{
+	FILE *fp = fopen(path, "w");
+
+	if (fp == NULL)
+		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+
+	for (int i = 0; i < sUnchangedCount; i++)
+		fprintf(fp, "%s\n", sUnchangedPaths[i]);
+
+	fclose(fp);
+}
+
+// Returns a copy of the kept file with padAmount zeros after it, or NULL if
+// it hasn't been written
+static unsigned char *ReadKeptFile(char *path, int *size, int padAmount)
+{
+	unsigned char *buffer = NULL;
+
+	pthread_mutex_lock(&sKeptFilesLock);
+
+	for (struct KeptFile *file = sKeptFiles[HashPath(path)]; file != NULL; file = file->next) {
+		if (strcmp(file->path, path) == 0) {
+			buffer = calloc(file->size + padAmount, 1);
+
+			if (buffer == NULL)
+				FATAL_ERROR("Failed to allocate memory for reading \"%s\".\n", path);
+
+			memcpy(buffer, file->data, file->size);
+			*size = file->size;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&sKeptFilesLock);
+
+	return buffer;
+}
+
+static void KeepFile(char *path, void *buffer, int bufferSize)
+{
+	unsigned char *data = malloc(bufferSize);
+
+	if (data == NULL)
+		FATAL_ERROR("Failed to allocate memory for keeping \"%s\".\n", path);
+
+	memcpy(data, buffer, bufferSize);
+
+	pthread_mutex_lock(&sKeptFilesLock);
+
+	struct KeptFile **bucket = &sKeptFiles[HashPath(path)];
+	struct KeptFile *file = *bucket;
+
+	while (file != NULL && strcmp(file->path, path) != 0)
+		file = file->next;
+
+	if (file == NULL) {
+		file = malloc(sizeof(struct KeptFile));
+
+		if (file == NULL || (file->path = malloc(strlen(path) + 1)) == NULL)
+			FATAL_ERROR("Failed to allocate memory for keeping \"%s\".\n", path);
+
+		strcpy(file->path, path);
+
+		file->next = *bucket;
+		*bucket = file;
+	} else {
+		free(file->data);
+	}
+
+	file->data = data;
+	file->size = bufferSize;
+
+	pthread_mutex_unlock(&sKeptFilesLock);
+}
+
+// Whether the file on the disk is already exactly buffer, in which case it
+// isn't written again
+static bool IsFileUnchanged(char *path, void *buffer, int bufferSize)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+
+	bool unchanged = ftell(fp) == bufferSize;
+
+	if (unchanged && bufferSize != 0) {
+		unsigned char *existing = malloc(bufferSize);
+
+		rewind(fp);
+		unchanged = existing != NULL
+		         && fread(existing, bufferSize, 1, fp) == 1
+		         && memcmp(existing, buffer, bufferSize) == 0;
+		free(existing);
+	}
+
+	fclose(fp);
+
+	return unchanged;
+}
+
 unsigned char *ReadWholeFile(char *path, int *size)
 {
+	if (sKeepingFiles) {
+		unsigned char *kept = ReadKeptFile(path, size, 0);
+
+		if (kept != NULL)
+			return kept;
+	}
+
 	FILE *fp = fopen(path, "rb");
 
 	if (fp == NULL)
@@ -93,6 +273,13 @@ unsigned char *ReadWholeFile(char *path, int *size)
 
 unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 {
+	if (sKeepingFiles) {
+		unsigned char *kept = ReadKeptFile(path, size, padAmount);
+
+		if (kept != NULL)
+			return kept;
+	}
+
 	FILE *fp = fopen(path, "rb");
 
 	if (fp == NULL)
@@ -119,12 +306,27 @@ unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 
 void WriteWholeFile(char *path, void *buffer, int bufferSize)
 {
+	if (sKeepingFiles)
+		KeepFile(path, buffer, bufferSize);
+
+	// Leaving it alone keeps its timestamp, so nothing made from it looks out of date
+	if (IsFileUnchanged(path, buffer, bufferSize)) {
+		__atomic_add_fetch(&sFilesUnchanged, 1, __ATOMIC_RELAXED);
+		NoteUnchangedFile(path);
+		return;
+	}
+
+	__atomic_add_fetch(&sFilesWritten, 1, __ATOMIC_RELAXED);
+
+	// Writing through a link into the asset cache would change the entry too
+	AssetCacheReleaseOutput(path);
+
 	FILE *fp = fopen(path, "wb");
 
 	if (fp == NULL)
 		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
 
-	if (fwrite(buffer, bufferSize, 1, fp) != 1)
+	if (bufferSize != 0 && fwrite(buffer, bufferSize, 1, fp) != 1)
 		FATAL_ERROR("Failed to write to \"%s\".\n", path);
 
 	fclose(fp);
@@ -11,5 +11,10 @@ char *GetFileExtensionAfterDot(char *path);
 unsigned char *ReadWholeFile(char *path, int *size);
 unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount);
 void WriteWholeFile(char *path, void *buffer, int bufferSize);
+void KeepWrittenFiles(void);
+void GetWrittenFileCounts(int *written, int *unchanged);
+// Batch mode only, the files that were left alone because they already had the right contents
+void NoteUnchangedFile(char *path);
+void WriteUnchangedFileList(char *path);
 
 #endif // UTIL_H
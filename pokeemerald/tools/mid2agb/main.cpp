@@ -29,6 +29,7 @@
 #include "error.h"
 #include "midi.h"
 #include "agb.h"
+#include "assetcache.h"
 
 FILE* g_inputFile = nullptr;
 FILE* g_outputFile = nullptr;
@@ -211,11 +212,19 @@ int main(int argc, char** argv)
     if (g_asmLabel.empty())
         g_asmLabel = BaseName(outputFilename);
 
+    AssetCacheEntry cacheEntry;
+
+    AssetCacheInit("mid2agb", argv[0]);
+
+    if (AssetCacheFetch(&cacheEntry, argc, argv, outputFilename.c_str()))
+        return 0;
+
     g_inputFile = std::fopen(inputFilename.c_str(), "rb");
 
     if (g_inputFile == nullptr)
         RaiseError("failed to open \"%s\" for reading", inputFilename.c_str());
 
+    AssetCacheReleaseOutput(outputFilename.c_str());
     g_outputFile = std::fopen(outputFilename.c_str(), "w");
 
     if (g_outputFile == nullptr)
@@ -229,5 +238,7 @@ int main(int argc, char** argv)
     std::fclose(g_inputFile);
     std::fclose(g_outputFile);
 
+    AssetCacheStore(&cacheEntry);
+
     return 0;
 }